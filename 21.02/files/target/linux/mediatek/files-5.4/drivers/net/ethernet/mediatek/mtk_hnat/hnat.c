@@ -14,6 +14,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/delay.h>
 #include <linux/if.h>
+#include <linux/if_vlan.h>
 #include <linux/io.h>
 #include <linux/module.h>
 #include <linux/of_device.h>
@@ -24,6 +25,8 @@
 
 #include "nf_hnat_mtk.h"
 #include "hnat.h"
+#include "hnat_hash.h"
+#include "hnat_nl.h"
 
 struct mtk_hnat *hnat_priv;
 static struct socket *_hnat_roam_sock;
@@ -95,28 +98,149 @@ void hnat_cache_ebl(int enable)
 }
 EXPORT_SYMBOL(hnat_cache_ebl);
 
-static void hnat_reset_timestamp(struct timer_list *t)
+/* The PPE cache can only be flushed as a whole. A single entry that was
+ * cleared in DRAM from a hot path only asks for a flush here, and the FOE
+ * scan tick flushes once for all of them, so a burst of invalidations
+ * costs one flush per FOE_SCAN_INTERVAL instead of one each.
+ */
+void hnat_cache_flush_defer(void)
+{
+	struct hnat_foe_scan *scan = &hnat_priv->foe_scan;
+
+	set_bit(0, &scan->flush_pending);
+}
+EXPORT_SYMBOL(hnat_cache_flush_defer);
+
+static void hnat_foe_scan_age(int enable)
 {
+	int i;
+
+	for (i = 0; i < CFG_PPE_NUM; i++) {
+		cr_set_field(hnat_priv->ppe_base[i] + PPE_TB_CFG, TCP_AGE, enable);
+		cr_set_field(hnat_priv->ppe_base[i] + PPE_TB_CFG, UDP_AGE, enable);
+	}
+}
+
+/* Walk one slice of one PPE per tick instead of the whole table at once.
+ * The same pass re-stamps bound entries after the global timestamp is
+ * reset (mt7629), pushes the per-flow counters to conntrack when they
+ * can be read from the DMA table and counts bound entries by type for
+ * the offload statistics. Multicast entries are aged from the group
+ * table, which tracks them, on every tick.
+ */
+static void hnat_foe_scan(struct timer_list *t)
+{
+	struct hnat_foe_scan *scan = &hnat_priv->foe_scan;
+	struct hnat_offload_stats *stats;
+	bool acct_update, flush = false;
 	struct foe_entry *entry;
-	int hash_index;
+	u64 start, lock_start, ns;
+	u32 i, end, expired;
+	u16 now;
+
+	start = ktime_get_ns();
+
+	if (hnat_priv->data->version == MTK_HNAT_V1_3 && !scan->ts_reset &&
+	    time_after_eq(jiffies, scan->ts_reset_next)) {
+		/* the timestamp is global, so stop ageing on every PPE
+		 * until all bound entries have been re-stamped
+		 */
+		hnat_foe_scan_age(0);
+		writel(0, hnat_priv->fe_base + 0x0010);
+		scan->ts_reset = true;
+		scan->ppe_id = 0;
+		scan->index = 0;
+		for (i = 0; i < CFG_PPE_NUM; i++)
+			memset(hnat_priv->offload_stats[i].scan_bound, 0,
+			       sizeof(hnat_priv->offload_stats[i].scan_bound));
+	}
 
-	hnat_cache_ebl(0);
-	cr_set_field(hnat_priv->ppe_base[0] + PPE_TB_CFG, TCP_AGE, 0);
-	cr_set_field(hnat_priv->ppe_base[0] + PPE_TB_CFG, UDP_AGE, 0);
-	writel(0, hnat_priv->fe_base + 0x0010);
-
-	for (hash_index = 0; hash_index < hnat_priv->foe_etry_num; hash_index++) {
-		entry = hnat_priv->foe_table_cpu[0] + hash_index;
-		if (entry->bfib1.state == BIND)
-			entry->bfib1.time_stamp =
-				readl(hnat_priv->fe_base + 0x0010) & (0xFFFF);
+	now = foe_timestamp(hnat_priv);
+
+	if (test_and_clear_bit(0, &scan->flush_pending))
+		flush = true;
+
+	expired = hnat_mcast_age(now);
+	if (expired) {
+		scan->mcast_expired += expired;
+		flush = true;
 	}
 
-	cr_set_field(hnat_priv->ppe_base[0] + PPE_TB_CFG, TCP_AGE, 1);
-	cr_set_field(hnat_priv->ppe_base[0] + PPE_TB_CFG, UDP_AGE, 1);
-	hnat_cache_ebl(1);
+	acct_update = hnat_priv->data->per_flow_accounting &&
+		      hnat_priv->nf_stat_en && hnat_priv->mib_dma_en;
+
+	if (scan->ppe_id >= CFG_PPE_NUM || scan->index >= hnat_priv->foe_etry_num) {
+		scan->ppe_id = 0;
+		scan->index = 0;
+	}
+
+	end = min(scan->index + scan->slice, hnat_priv->foe_etry_num);
+
+	if (scan->ts_reset) {
+		hnat_cache_ebl(0);
+
+		lock_start = ktime_get_ns();
+		spin_lock(&hnat_priv->entry_lock);
+		for (i = scan->index; i < end; i++) {
+			entry = hnat_priv->foe_table_cpu[scan->ppe_id] + i;
+
+			if (entry->bfib1.state == BIND) {
+				entry->bfib1.time_stamp = now;
+				scan->restamped++;
+			}
+		}
+		spin_unlock(&hnat_priv->entry_lock);
+
+		ns = ktime_get_ns() - lock_start;
+		if (ns > scan->max_lock_ns)
+			scan->max_lock_ns = ns;
+	}
+
+	/* re-enabling also clears the HWNAT cache */
+	if (scan->ts_reset || flush) {
+		hnat_cache_ebl(1);
+		scan->flushes++;
+	}
+
+	stats = &hnat_priv->offload_stats[scan->ppe_id];
+	for (i = scan->index; i < end; i++) {
+		entry = hnat_priv->foe_table_cpu[scan->ppe_id] + i;
+		if (entry->bfib1.state != BIND) {
+			/* aged out by the PPE, let the conntrack go */
+			if (hnat_priv->data->per_flow_accounting)
+				hnat_acct_ct_put(hnat_priv, scan->ppe_id, i);
+			continue;
+		}
+
+		if (entry->bfib1.pkt_type < HNAT_PKT_TYPE_NUM)
+			stats->scan_bound[entry->bfib1.pkt_type]++;
+
+		if (acct_update)
+			hnat_get_count(hnat_priv, scan->ppe_id, i, NULL);
+	}
+
+	scan->index = end;
+	if (scan->index >= hnat_priv->foe_etry_num) {
+		memcpy(stats->bound, stats->scan_bound, sizeof(stats->bound));
+		memset(stats->scan_bound, 0, sizeof(stats->scan_bound));
+		stats->scan_done = jiffies;
+
+		scan->index = 0;
+		if (++scan->ppe_id >= CFG_PPE_NUM) {
+			scan->ppe_id = 0;
+			if (scan->ts_reset) {
+				hnat_foe_scan_age(1);
+				scan->ts_reset = false;
+				scan->ts_reset_next = jiffies + FOE_TS_RESET_INTERVAL;
+			}
+		}
+	}
+
+	ns = ktime_get_ns() - start;
+	if (ns > scan->max_tick_ns)
+		scan->max_tick_ns = ns;
 
-	mod_timer(&hnat_priv->hnat_reset_timestamp_timer, jiffies + 14400 * HZ);
+	mod_timer(&hnat_priv->hnat_foe_scan_timer, jiffies + FOE_SCAN_INTERVAL);
 }
 
 static void cr_set_bits(void __iomem *reg, u32 bs)
@@ -535,6 +659,43 @@ static void hnat_roaming_disable(void)
 	pr_info("hnat roaming work disable\n");
 }
 
+static u32 hnat_ppe_mtu(void)
+{
+	u32 mtu = 0;
+
+	if (hnat_priv->g_ppdev)
+		mtu = hnat_priv->g_ppdev->mtu;
+	if (hnat_priv->g_wandev)
+		mtu = max(mtu, hnat_priv->g_wandev->mtu);
+
+	return mtu ? mtu : ETH_DATA_LEN;
+}
+
+static void hnat_ppe_mtu_set(u32 ppe_id, u32 mtu)
+{
+	void __iomem *base = hnat_priv->ppe_base[ppe_id];
+	u32 len = ETH_HLEN + mtu;
+
+	cr_set_field(base + PPE_MTU_VLYR_0, MTU_VLYR_LO, len);
+	cr_set_field(base + PPE_MTU_VLYR_0, MTU_VLYR_HI, len + VLAN_HLEN);
+	cr_set_field(base + PPE_MTU_VLYR_1, MTU_VLYR_LO, len + 2 * VLAN_HLEN);
+	cr_set_field(base + PPE_MTU_VLYR_1, MTU_VLYR_HI, len + 3 * VLAN_HLEN);
+}
+
+/* Bound frames longer than the LAN/WAN MTU come back to the CPU as
+ * HIT_BIND_EXCEED_MTU instead of leaving the PPE, and the pre-routing
+ * hooks unbind their entry. This is what keeps a bound inline IPsec flow
+ * from sending EIP197 output that no longer fits once ESP is added.
+ */
+void hnat_ppe_mtu_update(void)
+{
+	u32 mtu = hnat_ppe_mtu();
+	int i;
+
+	for (i = 0; i < CFG_PPE_NUM; i++)
+		hnat_ppe_mtu_set(i, mtu);
+}
+
 static int hnat_hw_init(u32 ppe_id)
 {
 	if (ppe_id >= CFG_PPE_NUM)
@@ -587,6 +748,8 @@ static int hnat_hw_init(u32 ppe_id)
 	cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_BND_AGE_1, FIN_DLTA, 1);
 	cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_BND_AGE_1, TCP_DLTA, 7);
 
+	hnat_ppe_mtu_set(ppe_id, hnat_ppe_mtu());
+
 	/* setup FOE ka */
 	cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_TB_CFG, KA_CFG, 0);
 	cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_BIND_LMT_1, NTU_KA, 0);
@@ -635,7 +798,8 @@ static int hnat_hw_init(u32 ppe_id)
 	if (hnat_priv->data->per_flow_accounting) {
 		cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_MIB_CFG, MIB_EN, 1);
 		cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_MIB_CFG, MIB_READ_CLEAR, 1);
-		cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_MIB_CAH_CTRL, MIB_CAH_EN, 1);
+		cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_MIB_CAH_CTRL, MIB_CAH_EN,
+			     !hnat_priv->mib_dma_en);
 	}
 
 	hnat_priv->g_ppdev = dev_get_by_name(&init_net, hnat_priv->ppd);
@@ -644,6 +808,8 @@ static int hnat_hw_init(u32 ppe_id)
 	dev_info(hnat_priv->dev, "PPE%d hwnat start\n", ppe_id);
 
 	spin_lock_init(&hnat_priv->entry_lock);
+	spin_lock_init(&hnat_priv->acct_lock);
+	spin_lock_init(&hnat_priv->mib_lock);
 	return 0;
 }
 
@@ -697,6 +863,18 @@ static int hnat_start(u32 ppe_id)
 			return -1;
 	}
 
+	hnat_priv->evict_cand[ppe_id] =
+		kcalloc(hnat_priv->foe_etry_num / HNAT_HASH_WAYS,
+			sizeof(struct hnat_evict_cand), GFP_KERNEL);
+	if (!hnat_priv->evict_cand[ppe_id])
+		return -1;
+
+	hnat_priv->rate_est[ppe_id] =
+		kcalloc(hnat_priv->foe_etry_num, sizeof(struct hnat_rate_est),
+			GFP_KERNEL);
+	if (!hnat_priv->rate_est[ppe_id])
+		return -1;
+
 	hnat_priv->etry_num_cfg = etry_num_cfg;
 	hnat_hw_init(ppe_id);
 
@@ -801,20 +979,25 @@ static void hnat_stop(u32 ppe_id)
 					  hnat_priv->foe_mib_cpu[ppe_id],
 					  hnat_priv->foe_mib_dev[ppe_id]);
 		writel(0, hnat_priv->ppe_base[ppe_id] + PPE_MIB_TB_BASE);
+		hnat_acct_ct_put_all(hnat_priv, ppe_id);
 		kfree(hnat_priv->acct[ppe_id]);
 	}
+
+	kfree(hnat_priv->evict_cand[ppe_id]);
+	hnat_priv->evict_cand[ppe_id] = NULL;
+	kfree(hnat_priv->rate_est[ppe_id]);
+	hnat_priv->rate_est[ppe_id] = NULL;
 }
 
 static void hnat_release_netdev(void)
 {
-	int i;
 	struct extdev_entry *ext_entry;
 
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
+	/* ext_if_del() shifts the array down, so always take the head */
+	while ((ext_entry = hnat_priv->ext_if[0])) {
+		ext_if_del(ext_entry);
 		if (ext_entry->dev)
 			dev_put(ext_entry->dev);
-		ext_if_del(ext_entry);
 		kfree(ext_entry);
 	}
 
@@ -925,8 +1108,18 @@ int hnat_warm_init(void)
 			       hnat_priv->ppe_base[ppe_id] + PPE_MIB_TB_BASE);
 			memset(hnat_priv->foe_mib_cpu[ppe_id], 0,
 			       foe_mib_tb_sz);
+			hnat_acct_ct_put_all(hnat_priv, ppe_id);
+			memset(hnat_priv->acct[ppe_id], 0,
+			       hnat_priv->foe_etry_num *
+			       sizeof(struct hnat_accounting));
 		}
 
+		memset(hnat_priv->evict_cand[ppe_id], 0,
+		       hnat_priv->foe_etry_num / HNAT_HASH_WAYS *
+		       sizeof(struct hnat_evict_cand));
+		memset(hnat_priv->rate_est[ppe_id], 0,
+		       hnat_priv->foe_etry_num * sizeof(struct hnat_rate_est));
+
 		hnat_hw_init(ppe_id);
 	}
 
@@ -1068,10 +1261,20 @@ static int hnat_probe(struct platform_device *pdev)
 	hnat_priv->ppe_base[0] = hnat_priv->fe_base + 0xe00;
 #endif
 
+	hnat_priv->sw_stats = devm_alloc_percpu(&pdev->dev, struct hnat_sw_stats);
+	if (!hnat_priv->sw_stats) {
+		err = -ENOMEM;
+		goto err_out2;
+	}
+
 	err = hnat_init_debugfs(hnat_priv);
 	if (err)
 		goto err_out2;
 
+	hash_init(hnat_priv->ext_dev_hash);
+	hash_init(hnat_priv->ext_name_hash);
+	spin_lock_init(&hnat_priv->ext_if_lock);
+
 	prop = of_find_property(np, "ext-devices", NULL);
 	for (name = of_prop_next_string(prop, NULL); name;
 	     name = of_prop_next_string(prop, name), index++) {
@@ -1118,6 +1321,8 @@ static int hnat_probe(struct platform_device *pdev)
 	if (err)
 		goto err_out;
 
+	hnat_qos_shadow_sync();
+
 	register_netdevice_notifier(&nf_hnat_netdevice_nb);
 	register_netevent_notifier(&nf_hnat_netevent_nb);
 
@@ -1127,11 +1332,14 @@ static int hnat_probe(struct platform_device *pdev)
 	}
 
 	timer_setup(&hnat_priv->hnat_sma_build_entry_timer, hnat_sma_build_entry, 0);
-	if (hnat_priv->data->version == MTK_HNAT_V1_3) {
-		timer_setup(&hnat_priv->hnat_reset_timestamp_timer, hnat_reset_timestamp, 0);
-		hnat_priv->hnat_reset_timestamp_timer.expires = jiffies;
-		add_timer(&hnat_priv->hnat_reset_timestamp_timer);
-	}
+
+	hnat_priv->foe_scan.slice = FOE_SCAN_SLICE;
+	hnat_priv->evict_idle = HNAT_EVICT_IDLE;
+	hnat_priv->rate_stats_start = jiffies;
+	hnat_priv->foe_scan.ts_reset_next = jiffies;
+	timer_setup(&hnat_priv->hnat_foe_scan_timer, hnat_foe_scan, 0);
+	hnat_priv->hnat_foe_scan_timer.expires = jiffies;
+	add_timer(&hnat_priv->hnat_foe_scan_timer);
 
 	if (IS_HQOS_MODE && IS_GMAC1_MODE)
 		dev_add_pack(&mtk_pack_type);
@@ -1141,6 +1349,13 @@ static int hnat_probe(struct platform_device *pdev)
 		pr_info("hnat roaming work fail\n");
 
 	INIT_LIST_HEAD(&hnat_priv->xlat.map_list);
+	hash_init(hnat_priv->xlat.map4_hash);
+	hash_init(hnat_priv->xlat.map6_hash);
+	mutex_init(&hnat_priv->xlat.lock);
+
+	err = hnat_nl_init();
+	if (err)
+		pr_info("hnat netlink init fail\n");
 
 	return 0;
 
@@ -1149,8 +1364,7 @@ err_out:
 		hnat_stop(i);
 err_out1:
 	hnat_deinit_debugfs(hnat_priv);
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
+	while ((ext_entry = hnat_priv->ext_if[0])) {
 		ext_if_del(ext_entry);
 		kfree(ext_entry);
 	}
@@ -1164,10 +1378,12 @@ static int hnat_remove(struct platform_device *pdev)
 {
 	int i;
 
+	hnat_nl_exit();
 	hnat_roaming_disable();
 	unregister_netdevice_notifier(&nf_hnat_netdevice_nb);
 	unregister_netevent_notifier(&nf_hnat_netevent_nb);
 	hnat_disable_hook();
+	del_timer_sync(&hnat_priv->hnat_foe_scan_timer);
 
 	if (hnat_priv->data->mcast)
 		hnat_mcast_disable();
@@ -1179,10 +1395,11 @@ static int hnat_remove(struct platform_device *pdev)
 		mtk_set_ppe_pse_port_state(i, false);
 
 	hnat_deinit_debugfs(hnat_priv);
+	mutex_lock(&hnat_priv->xlat.lock);
+	hnat_xlat_map_flush();
+	mutex_unlock(&hnat_priv->xlat.lock);
 	hnat_release_netdev();
 	del_timer_sync(&hnat_priv->hnat_sma_build_entry_timer);
-	if (hnat_priv->data->version == MTK_HNAT_V1_3)
-		del_timer_sync(&hnat_priv->hnat_reset_timestamp_timer);
 
 	if (IS_HQOS_MODE && IS_GMAC1_MODE)
 		dev_remove_pack(&mtk_pack_type);
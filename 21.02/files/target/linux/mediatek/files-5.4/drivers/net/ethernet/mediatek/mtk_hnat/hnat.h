@@ -14,6 +14,7 @@
 #define NF_HNAT_H
 
 #include <linux/debugfs.h>
+#include <linux/hashtable.h>
 #include <linux/string.h>
 #include <linux/if.h>
 #include <linux/if_ether.h>
@@ -154,6 +155,10 @@
 #define DSCP_TRFC_ECN_EN (0x1 << 25) /* RW */
 
 
+/*PPE_MTU_VLYR_x mask, frame length with n and n + 1 VLAN tags*/
+#define MTU_VLYR_LO (0x3fff << 0) /* RW */
+#define MTU_VLYR_HI (0x3fff << 16) /* RW */
+
 /*PPE_CAH_CTRL mask*/
 #define CAH_EN (0x1 << 0) /* RW */
 #define CAH_X_MODE (0x1 << 9) /* RW */
@@ -863,6 +868,7 @@ struct foe_entry {
  * TABLE_1K
  */
 #define MAX_EXT_DEVS		(0x3fU)
+#define EXT_DEV_HASH_BITS	6
 #define MAX_IF_NUM		64
 
 #if defined(CONFIG_MEDIATEK_NETSYS_V3)
@@ -893,6 +899,19 @@ struct hnat_accounting {
 	u64 packets;
 	struct nf_conntrack_zone zone;
 	u8 dir;
+	/* conntrack of the bound flow, referenced until the entry unbinds */
+	struct nf_conn *ct;
+	/* raw counters last seen in the DMA MIB table */
+	u64 mib_bytes;
+	u64 mib_packets;
+};
+
+struct hnat_acct_stats {
+	u64 cycle_ns;
+	u64 max_cycle_ns;
+	u32 flows;
+	u32 ct_hit;
+	u32 ct_miss;
 };
 
 enum mtk_hnat_version {
@@ -911,18 +930,133 @@ struct mtk_hnat_data {
 	enum mtk_hnat_version version;
 };
 
+#define XLAT_MAP_HASH_BITS	10
+
+/* 464XLAT mapping, hashed by both addresses for the per-packet lookups
+ * and listed in insertion order for configuration dumps.
+ */
 struct map46 {
 	u32 ipv4;
 	struct in6_addr ipv6;
 	struct list_head list;
+	struct hlist_node v4_node;
+	struct hlist_node v6_node;
+	struct rcu_head rcu;
 };
 
 struct xlat_conf {
 	struct list_head map_list;
+	DECLARE_HASHTABLE(map4_hash, XLAT_MAP_HASH_BITS);
+	DECLARE_HASHTABLE(map6_hash, XLAT_MAP_HASH_BITS);
+	struct mutex lock;	/* serializes map and prefix updates */
+	u32 map_num;
 	struct in6_addr prefix;
 	int prefix_len;
 };
 
+/* FOE table housekeeping walks a bounded slice of one PPE per tick */
+#define FOE_SCAN_SLICE		1024
+#define FOE_SCAN_INTERVAL	(HZ / 10)
+#define FOE_TS_RESET_INTERVAL	(14400 * HZ)
+
+struct hnat_foe_scan {
+	u32 ppe_id;
+	u32 index;
+	u32 slice;
+	bool ts_reset;
+	unsigned long ts_reset_next;
+	u64 max_tick_ns;
+	u64 max_lock_ns;
+	u64 restamped;
+	u64 mcast_expired;
+	unsigned long flush_pending;	/* bit 0: a cleared entry needs a flush */
+	u64 flushes;
+};
+
+/* A flow that misses the FOE table while all ways of its bucket are in use
+ * may take over the way that has been idle the longest.
+ */
+#define HNAT_EVICT_WINDOW	HZ
+#define HNAT_EVICT_IDLE		2	/* seconds, 0 disables eviction */
+
+struct hnat_evict_cand {
+	u32 sig;
+	u32 pkts;
+	unsigned long start;
+};
+
+struct hnat_evict_stats {
+	u64 bucket_full;
+	u64 evicted;
+	u64 evicted_unbind;
+	u64 no_victim;
+	u64 busy;
+};
+
+/* Software packet rate of unbound flows, one slot per FOE entry. Rates are
+ * packets per second with HNAT_RATE_FRAC fraction bits, averaged over
+ * HNAT_RATE_TICK with a 1/2^HNAT_RATE_EWMA_SHIFT weight.
+ */
+#define HNAT_RATE_TICK		(HZ / 10)
+#define HNAT_RATE_FRAC		4
+#define HNAT_RATE_EWMA_SHIFT	2
+#define HNAT_REBIND_WINDOW	(10 * HZ)
+
+/* Updated without a lock: the CPU whose cmpxchg on sig wins takes the slot
+ * over for a new flow, the one whose cmpxchg on last wins closes the tick.
+ */
+#define HNAT_RATE_HOT		BIT(0)
+#define HNAT_RATE_BOUND		BIT(1)
+
+struct hnat_rate_est {
+	u32 sig;
+	u32 rate;
+	u32 last;
+	u32 bound_at;
+	atomic_t pkts;
+	atomic_t flags;		/* HNAT_RATE_* */
+};
+
+struct hnat_rate_stats {
+	u64 flows;
+	u64 binds;
+	u64 rebinds;		/* bound again within HNAT_REBIND_WINDOW */
+	u64 unbind_active;	/* unbound while the flow kept sending */
+	u64 deferred;		/* RATE_REACH held back, flow not hot */
+	u64 promoted;		/* hot flow bound below the PPE threshold */
+};
+
+/* Offload telemetry that is always on. Bound entries are counted by the
+ * FOE scan and published once per pass, the rest as it happens, so a read
+ * costs the same however full the table is.
+ */
+#define MAX_CRSN_NUM		32
+#define HNAT_PKT_TYPE_NUM	12
+
+enum hnat_bind_fail {
+	HNAT_BIND_FAIL_ACCEL,	/* device or path cannot be offloaded */
+	HNAT_BIND_FAIL_TNL,	/* tunnel left to the tunnel offload */
+	HNAT_BIND_FAIL_BUSY,	/* entry_lock or the entry is locked */
+	HNAT_BIND_FAIL_STATE,	/* entry is no longer UNBIND */
+	HNAT_BIND_FAIL_MAX,
+};
+
+struct hnat_sw_stats {
+	u64 packets[MAX_CRSN_NUM];
+	u64 bytes[MAX_CRSN_NUM];
+	struct hnat_rate_stats rate[MAX_PPE_NUM];
+	u64 bind_attempts[MAX_PPE_NUM];
+	u64 bind_fail[MAX_PPE_NUM][HNAT_BIND_FAIL_MAX];
+};
+
+struct hnat_offload_stats {
+	u32 bound[HNAT_PKT_TYPE_NUM];		/* last complete scan pass */
+	u32 scan_bound[HNAT_PKT_TYPE_NUM];	/* pass in progress */
+	unsigned long scan_done;
+	u64 hw_bytes;		/* from the per-flow MIB as it is read */
+	u64 hw_packets;
+};
+
 struct mtk_hnat {
 	struct device *dev;
 	void __iomem *fe_base;
@@ -937,6 +1071,8 @@ struct mtk_hnat {
 	struct mib_entry *foe_mib_cpu[MAX_PPE_NUM];
 	dma_addr_t foe_mib_dev[MAX_PPE_NUM];
 	struct hnat_accounting *acct[MAX_PPE_NUM];
+	struct hnat_acct_stats acct_stats[MAX_PPE_NUM];
+	bool mib_dma_en;
 	const struct mtk_hnat_data *data;
 
 	/*devices we plays for*/
@@ -960,17 +1096,34 @@ struct mtk_hnat {
 	struct net_device *g_wandev;
 	struct net_device *wifi_hook_if[MAX_IF_NUM];
 	struct extdev_entry *ext_if[MAX_EXT_DEVS];
+	/* ext_if[] keeps the registration order, the hashes serve the hooks */
+	DECLARE_HASHTABLE(ext_dev_hash, EXT_DEV_HASH_BITS);
+	DECLARE_HASHTABLE(ext_name_hash, EXT_DEV_HASH_BITS);
+	spinlock_t ext_if_lock;
 	struct timer_list hnat_sma_build_entry_timer;
-	struct timer_list hnat_reset_timestamp_timer;
-	struct timer_list hnat_mcast_check_timer;
+	struct timer_list hnat_foe_scan_timer;
+	struct hnat_foe_scan foe_scan;
+	struct hnat_evict_cand *evict_cand[MAX_PPE_NUM];
+	struct hnat_evict_stats evict_stats[MAX_PPE_NUM];
+	u32 evict_idle;
+	struct hnat_rate_est *rate_est[MAX_PPE_NUM];
+	unsigned long rate_stats_start;
+	u32 bind_pps;		/* 0: leave binding to the PPE threshold */
+	u32 unbind_pps;		/* 0: half of bind_pps */
+	struct hnat_offload_stats offload_stats[MAX_PPE_NUM];
+	struct hnat_sw_stats __percpu *sw_stats;
 	bool nf_stat_en;
 	struct xlat_conf xlat;
 	spinlock_t		entry_lock;
+	spinlock_t		acct_lock;	/* counters, snapshots and ct refs */
+	spinlock_t		mib_lock;	/* MIB search registers */
 };
 
 struct extdev_entry {
 	char name[IFNAMSIZ];
 	struct net_device *dev;
+	struct hlist_node dev_node;	/* keyed by dev->ifindex while dev is set */
+	struct hlist_node name_node;	/* keyed by name */
 };
 
 struct tcpudphdr {
@@ -1233,7 +1386,6 @@ enum FoeIpAct {
 #define IS_DSA_TAG_PROTO_MXL862_8021Q(dp)				       \
 	(dp->cpu_dp->tag_ops->proto == DSA_TAG_PROTO_MXL862_8021Q)
 #define NONE_DSA_PORT 0xff
-#define MAX_CRSN_NUM 32
 #define IPV6_HDR_LEN 40
 #define IPV6_SNAT	0
 #define IPV6_DNAT	1
@@ -1339,6 +1491,7 @@ extern bool (*mtk_crypto_offloadable)(struct sk_buff *skb);
 extern int hnat_bind_crypto_entry(struct sk_buff *skb,
 				  const struct net_device *dev,
 				  int fill_inner_info);
+extern int hnat_unbind_crypto_entry(struct sk_buff *skb);
 int ext_if_add(struct extdev_entry *ext_entry);
 int ext_if_del(struct extdev_entry *ext_entry);
 void cr_set_field(void __iomem *reg, u32 field, u32 val);
@@ -1356,7 +1509,16 @@ uint32_t hnat_cpu_reason_cnt(struct sk_buff *skb);
 int hnat_enable_hook(void);
 int hnat_disable_hook(void);
 void hnat_cache_ebl(int enable);
+void hnat_cache_flush_defer(void);
+void hnat_ppe_mtu_update(void);
 void hnat_qos_shaper_ebl(u32 id, u32 enable);
+struct hnat_nl_qos_sch;
+struct hnat_nl_qos_queue;
+void hnat_qos_shadow_sync(void);
+void hnat_qtx_sch_write(u32 id, u32 val);
+int hnat_qos_apply(const struct hnat_nl_qos_sch *sch, int nsch,
+		   const struct hnat_nl_qos_queue *queue, int nqueue);
+void hnat_qos_get(struct hnat_nl_qos_sch *sch, struct hnat_nl_qos_queue *queue);
 void exclude_boundary_entry(struct foe_entry *foe_table_cpu);
 void set_gmac_ppe_fwd(int gmac_no, int enable);
 int entry_detail(u32 ppe_id, int index);
@@ -1365,12 +1527,33 @@ int entry_delete_by_ip(bool is_ipv4, void *addr);
 int entry_delete(u32 ppe_id, int index);
 int hnat_warm_init(void);
 u32 hnat_get_ppe_hash(struct foe_entry *entry);
+bool hnat_mcast_entry_expired(struct foe_entry *entry, u16 foe_ts);
+int hnat_static_entry_bind(struct foe_entry *entry, int hash, u32 *ppe);
 int mtk_ppe_get_xlat_v4_by_v6(struct in6_addr *ipv6, u32 *ipv4);
 int mtk_ppe_get_xlat_v6_by_v4(u32 *ipv4, struct in6_addr *ipv6,
 			      struct in6_addr *prefix);
+int hnat_xlat_map_add(u32 ipv4, const struct in6_addr *ipv6);
+int hnat_xlat_map_del(u32 ipv4, const struct in6_addr *ipv6);
+void hnat_xlat_map_flush(void);
 
 struct hnat_accounting *hnat_get_count(struct mtk_hnat *h, u32 ppe_id,
 				       u32 index, struct hnat_accounting *diff);
+int hnat_get_count_bulk(struct mtk_hnat *h, u32 ppe_id);
+int read_mib(struct mtk_hnat *h, u32 ppe_id,
+	     u32 index, u64 *bytes, u64 *packets);
+void hnat_acct_reset(struct mtk_hnat *h, u32 ppe_id, u32 index,
+		     struct nf_conn *ct, u8 dir);
+void hnat_acct_ct_put(struct mtk_hnat *h, u32 ppe_id, u32 index);
+void hnat_acct_ct_put_all(struct mtk_hnat *h, u32 ppe_id);
+void hnat_entry_state_reset(u32 ppe_id, u32 index);
+
+/* A flow that never cools down is never demoted, so default to some
+ * hysteresis below the bind rate.
+ */
+static inline u32 hnat_unbind_pps(void)
+{
+	return hnat_priv->unbind_pps ?: DIV_ROUND_UP(hnat_priv->bind_pps, 2);
+}
 
 static inline u16 foe_timestamp(struct mtk_hnat *h)
 {
@@ -24,6 +24,8 @@
 #include <net/netfilter/nf_conntrack_tuple.h>
 
 #include "hnat.h"
+#include "hnat_hash.h"
+#include "hnat_nl.h"
 #include "nf_hnat_mtk.h"
 #include "../mtk_eth_soc.h"
 
@@ -824,6 +826,14 @@ int cr_set_usage(int level)
 	pr_info("              6     0~255      Set UDP keep alive interval\n");
 	pr_info("              7     0~1        Set hnat counter update to nf_conntrack\n");
 	pr_info("              8     0~6        Set PPE hash debug mode\n");
+	pr_info("              9     0~1        Read per-flow MIB from DMA table in bulk\n");
+	pr_info("              10    1~%u    Set FOE scan slice (entries per tick)\n",
+		hnat_priv->foe_etry_num);
+	pr_info("              11    0~%u      Evict FOE entries idle for N seconds on bucket full (0: off)\n",
+		(hnat_priv->data->version == MTK_HNAT_V2 ||
+		 hnat_priv->data->version == MTK_HNAT_V3) ? 0xff : 0x7fff);
+	pr_info("              12    0~65535    Bind flows whose software rate reaches N pps (0: PPE threshold only)\n");
+	pr_info("              13    0~65535    Stop binding flows whose software rate falls below N pps\n");
 
 	return 0;
 }
@@ -969,8 +979,10 @@ int set_hash_dbg_mode(int dbg_mode)
 		if (hnat_priv->data->version == MTK_HNAT_V1_1)
 			exclude_boundary_entry(hnat_priv->foe_table_cpu[ppe_id]);
 
-		if (hnat_priv->data->per_flow_accounting)
+		if (hnat_priv->data->per_flow_accounting) {
+			hnat_acct_ct_put_all(hnat_priv, ppe_id);
 			memset(hnat_priv->acct[ppe_id], 0, foe_acct_tb_sz);
+		}
 	}
 
 	/* clear HWNAT cache */
@@ -1001,12 +1013,140 @@ static const debugfs_write_func entry_set_func[] = {
 	[7] = wrapped_ppe2_entry_delete,
 };
 
+int set_foe_scan_slice(int slice)
+{
+	if (slice <= 0 || slice > hnat_priv->foe_etry_num) {
+		pr_info("input error\n");
+		return -EINVAL;
+	}
+
+	hnat_priv->foe_scan.slice = slice;
+	hnat_priv->foe_scan.max_tick_ns = 0;
+	hnat_priv->foe_scan.max_lock_ns = 0;
+	pr_info("FOE scan slice = %d entries\n", slice);
+
+	return 0;
+}
+
+int set_foe_evict_idle(int idle)
+{
+	u32 max = (hnat_priv->data->version == MTK_HNAT_V2 ||
+		   hnat_priv->data->version == MTK_HNAT_V3) ? 0xff : 0x7fff;
+
+	if (idle < 0 || idle > max) {
+		pr_info("input error\n");
+		return -EINVAL;
+	}
+
+	hnat_priv->evict_idle = idle;
+	if (idle)
+		pr_info("Evict FOE entries idle for %d seconds on bucket full\n",
+			idle);
+	else
+		pr_info("FOE eviction is disabled\n");
+
+	return 0;
+}
+
+int set_bind_rate_pps(int pps)
+{
+	if (pps < 0 || pps > 0xffff) {
+		pr_info("input error\n");
+		return -EINVAL;
+	}
+
+	hnat_priv->bind_pps = pps;
+	if (hnat_priv->unbind_pps > pps)
+		hnat_priv->unbind_pps = pps;
+
+	if (pps)
+		pr_info("Bind at %d pps, unbind below %u pps\n", pps,
+			hnat_unbind_pps());
+	else
+		pr_info("Software bind rate is disabled\n");
+
+	return 0;
+}
+
+int set_unbind_rate_pps(int pps)
+{
+	if (pps < 0 || pps > hnat_priv->bind_pps) {
+		pr_info("input error, must not exceed the bind rate %u pps\n",
+			hnat_priv->bind_pps);
+		return -EINVAL;
+	}
+
+	hnat_priv->unbind_pps = pps;
+	pr_info("Unbind below %u pps%s\n", hnat_unbind_pps(),
+		pps ? "" : " (half of the bind rate)");
+
+	return 0;
+}
+
+static void read_mib_dma_raw(struct mtk_hnat *h, u32 ppe_id, u32 index,
+			     u64 *bytes, u64 *packets);
+
+int set_mib_dma_mode(int enable)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct hnat_accounting *acct;
+	u64 bytes, packets;
+	u32 ppe_id, index;
+
+	if (!h->data->per_flow_accounting) {
+		pr_info("per-flow accounting is not supported\n");
+		return -EINVAL;
+	}
+
+	if (enable != 0 && enable != 1) {
+		pr_info("input error\n");
+		return -EINVAL;
+	}
+
+	if (h->mib_dma_en == enable)
+		return 0;
+
+	for (ppe_id = 0; ppe_id < CFG_PPE_NUM; ppe_id++) {
+		/* charge whatever the current source still holds */
+		hnat_get_count_bulk(h, ppe_id);
+
+		/* the DMA table is only up to date with the MIB cache off */
+		cr_set_field(h->ppe_base[ppe_id] + PPE_MIB_CAH_CTRL,
+			     MIB_CAH_EN, !enable);
+
+		for (index = 0; index < h->foe_etry_num; index++) {
+			acct = &h->acct[ppe_id][index];
+			if (enable) {
+				read_mib_dma_raw(h, ppe_id, index, &bytes,
+						 &packets);
+				spin_lock_bh(&h->acct_lock);
+				acct->mib_bytes = bytes;
+				acct->mib_packets = packets;
+				spin_unlock_bh(&h->acct_lock);
+			} else {
+				/* drop counts already charged from the table */
+				spin_lock_bh(&h->mib_lock);
+				read_mib(h, ppe_id, index, &bytes, &packets);
+				spin_unlock_bh(&h->mib_lock);
+			}
+		}
+	}
+
+	h->mib_dma_en = enable;
+	pr_info("Read per-flow MIB from %s\n",
+		enable ? "DMA table" : "MIB search registers");
+
+	return 0;
+}
+
 static const debugfs_write_func cr_set_func[] = {
 	[0] = cr_set_usage,      [1] = binding_threshold,
 	[2] = tcp_bind_lifetime, [3] = fin_bind_lifetime,
 	[4] = udp_bind_lifetime, [5] = tcp_keep_alive,
 	[6] = udp_keep_alive,    [7] = set_nf_update_toggle,
-	[8] = set_hash_dbg_mode,
+	[8] = set_hash_dbg_mode, [9] = set_mib_dma_mode,
+	[10] = set_foe_scan_slice, [11] = set_foe_evict_idle,
+	[12] = set_bind_rate_pps, [13] = set_unbind_rate_pps,
 };
 
 int read_mib(struct mtk_hnat *h, u32 ppe_id,
@@ -1044,23 +1184,66 @@ int read_mib(struct mtk_hnat *h, u32 ppe_id,
 
 }
 
-static int hnat_nf_acct_update(struct mtk_hnat *h, u32 ppe_id,
-			       u32 index, u64 bytes, u64 packets)
+/* Copy the raw counters of one entry out of the DMA MIB table. The table
+ * is never cleared by hardware, so the values only grow until they wrap.
+ */
+static void read_mib_dma_raw(struct mtk_hnat *h, u32 ppe_id, u32 index,
+			     u64 *bytes, u64 *packets)
 {
-	struct nf_conntrack_tuple tuple = {0};
-	struct nf_conntrack_tuple_hash *hash;
-	struct nf_conntrack_zone *zone;
-	struct nf_conn_counter *counter;
-	struct nf_conn_acct *acct;
-	struct foe_entry *entry;
-	struct nf_conn *ct;
-	u8 dir;
+	struct mib_entry *hw = &h->foe_mib_cpu[ppe_id][index];
+	struct mib_entry mib, chk;
+	int retry = 3;
+	u32 *w;
+
+	/* hardware may update the entry while it is being copied */
+	do {
+		memcpy(&mib, hw, sizeof(mib));
+		memcpy(&chk, hw, sizeof(chk));
+	} while (memcmp(&mib, &chk, sizeof(mib)) && --retry);
 
-	entry = &h->foe_table_cpu[ppe_id][index];
-	zone = &h->acct[ppe_id][index].zone;
-	dir = h->acct[ppe_id][index].dir;
+	if (hnat_priv->data->version == MTK_HNAT_V3) {
+		w = (u32 *)&mib;
+		*bytes = w[0] + ((u64)w[1] << 32);
+		*packets = w[2] + ((u64)w[3] << 32);
+	} else {
+		*bytes = mib.byt_cnt_l + ((u64)mib.byt_cnt_h << 32);
+		*packets = mib.pkt_cnt_l + ((u64)mib.pkt_cnt_h << 32);
+	}
+}
 
-	tuple.dst.protonum = (entry->bfib1.udp) ? IPPROTO_UDP : IPPROTO_TCP;
+/* Turn the raw DMA counters into the counts since the last read and move
+ * the snapshot. Caller holds acct_lock. A read that was overtaken by a
+ * newer one would look like a wrap of almost the whole counter, so it is
+ * dropped; the newer read already charged those counts.
+ */
+static void read_mib_dma_delta(struct mtk_hnat *h, u32 ppe_id, u32 index,
+			       u64 cur_bytes, u64 cur_packets,
+			       u64 *bytes, u64 *packets)
+{
+	struct hnat_accounting *acct = &h->acct[ppe_id][index];
+	u64 byt_mask = GENMASK_ULL(47, 0), pkt_mask = GENMASK_ULL(39, 0);
+
+	if (hnat_priv->data->version == MTK_HNAT_V3) {
+		byt_mask = U64_MAX;
+		pkt_mask = U64_MAX;
+	}
+
+	*bytes = (cur_bytes - acct->mib_bytes) & byt_mask;
+	*packets = (cur_packets - acct->mib_packets) & pkt_mask;
+	if (*bytes > byt_mask >> 1 || *packets > pkt_mask >> 1) {
+		*bytes = 0;
+		*packets = 0;
+		return;
+	}
+
+	acct->mib_bytes = cur_bytes;
+	acct->mib_packets = cur_packets;
+}
+
+static int hnat_nf_acct_tuple(struct foe_entry *entry,
+			      struct nf_conntrack_tuple *tuple)
+{
+	tuple->dst.protonum = (entry->bfib1.udp) ? IPPROTO_UDP : IPPROTO_TCP;
 
 	switch (entry->bfib1.pkt_type) {
 	case IPV4_HNAT:
@@ -1068,52 +1251,191 @@ static int hnat_nf_acct_update(struct mtk_hnat *h, u32 ppe_id,
 	case IPV4_DSLITE:
 	case IPV4_MAP_T:
 	case IPV4_MAP_E:
-		tuple.src.l3num = AF_INET;
-		tuple.src.u3.ip = htonl(entry->ipv4_hnapt.sip);
-		tuple.dst.u3.ip = htonl(entry->ipv4_hnapt.dip);
-		tuple.src.u.tcp.port = htons(entry->ipv4_hnapt.sport);
-		tuple.dst.u.tcp.port = htons(entry->ipv4_hnapt.dport);
+		tuple->src.l3num = AF_INET;
+		tuple->src.u3.ip = htonl(entry->ipv4_hnapt.sip);
+		tuple->dst.u3.ip = htonl(entry->ipv4_hnapt.dip);
+		tuple->src.u.tcp.port = htons(entry->ipv4_hnapt.sport);
+		tuple->dst.u.tcp.port = htons(entry->ipv4_hnapt.dport);
 		break;
 	case IPV6_6RD:
 	case IPV6_HNAT:
 	case IPV6_HNAPT:
 	case IPV6_3T_ROUTE:
 	case IPV6_5T_ROUTE:
-		tuple.src.l3num = AF_INET6;
+		tuple->src.l3num = AF_INET6;
 
-		tuple.src.u3.in6.s6_addr32[0] = htonl(entry->ipv6_5t_route.ipv6_sip0);
-		tuple.src.u3.in6.s6_addr32[1] = htonl(entry->ipv6_5t_route.ipv6_sip1);
-		tuple.src.u3.in6.s6_addr32[2] = htonl(entry->ipv6_5t_route.ipv6_sip2);
-		tuple.src.u3.in6.s6_addr32[3] = htonl(entry->ipv6_5t_route.ipv6_sip3);
+		tuple->src.u3.in6.s6_addr32[0] = htonl(entry->ipv6_5t_route.ipv6_sip0);
+		tuple->src.u3.in6.s6_addr32[1] = htonl(entry->ipv6_5t_route.ipv6_sip1);
+		tuple->src.u3.in6.s6_addr32[2] = htonl(entry->ipv6_5t_route.ipv6_sip2);
+		tuple->src.u3.in6.s6_addr32[3] = htonl(entry->ipv6_5t_route.ipv6_sip3);
 
-		tuple.dst.u3.in6.s6_addr32[0] = htonl(entry->ipv6_5t_route.ipv6_dip0);
-		tuple.dst.u3.in6.s6_addr32[1] = htonl(entry->ipv6_5t_route.ipv6_dip1);
-		tuple.dst.u3.in6.s6_addr32[2] = htonl(entry->ipv6_5t_route.ipv6_dip2);
-		tuple.dst.u3.in6.s6_addr32[3] = htonl(entry->ipv6_5t_route.ipv6_dip3);
+		tuple->dst.u3.in6.s6_addr32[0] = htonl(entry->ipv6_5t_route.ipv6_dip0);
+		tuple->dst.u3.in6.s6_addr32[1] = htonl(entry->ipv6_5t_route.ipv6_dip1);
+		tuple->dst.u3.in6.s6_addr32[2] = htonl(entry->ipv6_5t_route.ipv6_dip2);
+		tuple->dst.u3.in6.s6_addr32[3] = htonl(entry->ipv6_5t_route.ipv6_dip3);
 
-		tuple.src.u.tcp.port = htons(entry->ipv6_5t_route.sport);
-		tuple.dst.u.tcp.port = htons(entry->ipv6_5t_route.dport);
+		tuple->src.u.tcp.port = htons(entry->ipv6_5t_route.sport);
+		tuple->dst.u.tcp.port = htons(entry->ipv6_5t_route.dport);
 		break;
 	default:
 		return -EINVAL;
 	}
 
-	hash = nf_conntrack_find_get(&init_net, zone, &tuple);
-	if (hash) {
+	return 0;
+}
+
+static int hnat_nf_acct_update(struct mtk_hnat *h, u32 ppe_id,
+			       u32 index, u64 bytes, u64 packets)
+{
+	struct hnat_acct_stats *stats = &h->acct_stats[ppe_id];
+	struct hnat_accounting *hnat_acct = &h->acct[ppe_id][index];
+	struct nf_conntrack_tuple tuple = {0};
+	struct nf_conntrack_tuple_hash *hash;
+	struct nf_conn_counter *counter;
+	struct nf_conn_acct *acct;
+	struct nf_conn *ct;
+	u8 dir = hnat_acct->dir;
+
+	ct = hnat_acct->ct;
+	if (ct) {
+		stats->ct_hit++;
+	} else {
+		stats->ct_miss++;
+
+		if (hnat_nf_acct_tuple(&h->foe_table_cpu[ppe_id][index], &tuple))
+			return -EINVAL;
+
+		hash = nf_conntrack_find_get(&init_net, &hnat_acct->zone, &tuple);
+		if (!hash)
+			return 0;
+
+		/* keep the reference for the next reads */
 		ct = nf_ct_tuplehash_to_ctrack(hash);
-		if (ct) {
-			acct = nf_conn_acct_find(ct);
-			if (acct) {
-				counter = acct->counter;
-				atomic64_add(bytes, &counter[dir].bytes);
-				atomic64_add(packets, &counter[dir].packets);
-			}
-		}
+		hnat_acct->ct = ct;
+	}
+
+	acct = nf_conn_acct_find(ct);
+	if (acct) {
+		counter = acct->counter;
+		atomic64_add(bytes, &counter[dir].bytes);
+		atomic64_add(packets, &counter[dir].packets);
 	}
 
 	return 0;
 }
 
+void hnat_acct_reset(struct mtk_hnat *h, u32 ppe_id, u32 index,
+		     struct nf_conn *ct, u8 dir)
+{
+	struct hnat_accounting *acct;
+	u64 bytes = 0, packets = 0;
+	struct nf_conn *old;
+
+	if (!h->data->per_flow_accounting ||
+	    ppe_id >= CFG_PPE_NUM || index >= h->foe_etry_num)
+		return;
+
+	acct = &h->acct[ppe_id][index];
+
+	/* counts left over from the previous flow must not be charged */
+	if (h->mib_dma_en)
+		read_mib_dma_raw(h, ppe_id, index, &bytes, &packets);
+
+	if (ct)
+		nf_conntrack_get(&ct->ct_general);
+
+	spin_lock_bh(&h->acct_lock);
+	old = acct->ct;
+	memset(acct, 0, sizeof(*acct));
+	acct->mib_bytes = bytes;
+	acct->mib_packets = packets;
+
+	if (ct) {
+		acct->zone = ct->zone;
+		acct->dir = dir;
+		acct->ct = ct;
+	}
+	spin_unlock_bh(&h->acct_lock);
+
+	if (old)
+		nf_ct_put(old);
+}
+
+/* Drop the conntrack reference of an entry that is no longer bound. The
+ * counters are kept, the next bind resets them.
+ */
+void hnat_acct_ct_put(struct mtk_hnat *h, u32 ppe_id, u32 index)
+{
+	struct hnat_accounting *acct = &h->acct[ppe_id][index];
+	struct nf_conn *ct;
+
+	if (!READ_ONCE(acct->ct))
+		return;
+
+	spin_lock_bh(&h->acct_lock);
+	ct = acct->ct;
+	acct->ct = NULL;
+	spin_unlock_bh(&h->acct_lock);
+
+	if (ct)
+		nf_ct_put(ct);
+}
+
+/* called before the accounting table of a PPE is cleared or freed */
+void hnat_acct_ct_put_all(struct mtk_hnat *h, u32 ppe_id)
+{
+	u32 index;
+
+	if (!h->data->per_flow_accounting || !h->acct[ppe_id])
+		return;
+
+	for (index = 0; index < h->foe_etry_num; index++)
+		hnat_acct_ct_put(h, ppe_id, index);
+}
+
+/* Read the counts of one entry since the last read and charge them.
+ * The timer, debugfs, netlink and eviction all get here. The MIB itself
+ * is read outside acct_lock, which is only taken to apply the delta, so
+ * the bind path never waits for a busy poll; the search registers are
+ * shared and have mib_lock of their own.
+ */
+static int hnat_acct_collect(struct mtk_hnat *h, u32 ppe_id, u32 index,
+			     u64 *bytes, u64 *packets)
+{
+	struct hnat_accounting *acct = &h->acct[ppe_id][index];
+	bool dma = READ_ONCE(h->mib_dma_en);
+	u64 cur_bytes, cur_packets;
+	int ret = 0;
+
+	if (dma) {
+		read_mib_dma_raw(h, ppe_id, index, &cur_bytes, &cur_packets);
+	} else {
+		spin_lock_bh(&h->mib_lock);
+		ret = read_mib(h, ppe_id, index, bytes, packets);
+		spin_unlock_bh(&h->mib_lock);
+		if (ret)
+			return ret;
+	}
+
+	spin_lock_bh(&h->acct_lock);
+
+	if (dma)
+		read_mib_dma_delta(h, ppe_id, index, cur_bytes, cur_packets,
+				   bytes, packets);
+
+	if (*bytes || *packets) {
+		acct->bytes += *bytes;
+		acct->packets += *packets;
+		h->offload_stats[ppe_id].hw_bytes += *bytes;
+		h->offload_stats[ppe_id].hw_packets += *packets;
+		hnat_nf_acct_update(h, ppe_id, index, *bytes, *packets);
+	}
+
+	spin_unlock_bh(&h->acct_lock);
+
+	return ret;
+}
+
 struct hnat_accounting *hnat_get_count(struct mtk_hnat *h, u32 ppe_id,
 				       u32 index, struct hnat_accounting *diff)
 
@@ -1129,23 +1451,62 @@ struct hnat_accounting *hnat_get_count(struct mtk_hnat *h, u32 ppe_id,
 	if (!hnat_priv->data->per_flow_accounting)
 		return NULL;
 
-	if (read_mib(h, ppe_id, index, &bytes, &packets))
+	if (hnat_acct_collect(h, ppe_id, index, &bytes, &packets))
 		return NULL;
 
-	h->acct[ppe_id][index].bytes += bytes;
-	h->acct[ppe_id][index].packets += packets;
-
 	if (diff) {
 		diff->bytes = bytes;
 		diff->packets = packets;
 	}
 
-	hnat_nf_acct_update(h, ppe_id, index, bytes, packets);
-
 	return &h->acct[ppe_id][index];
 }
 EXPORT_SYMBOL(hnat_get_count);
 
+/* Collect the counters of every bound entry of one PPE in a single pass.
+ * Returns the number of entries visited. Only the DMA mode makes this a
+ * memory sweep; with the search registers every bound entry still costs
+ * one MMIO request and busy poll, the pass merely saves the per-call
+ * overhead of hnat_get_count().
+ */
+int hnat_get_count_bulk(struct mtk_hnat *h, u32 ppe_id)
+{
+	struct hnat_acct_stats *stats;
+	struct foe_entry *entry;
+	u64 bytes, packets, start;
+	u32 index, flows = 0;
+
+	if (ppe_id >= CFG_PPE_NUM)
+		return -EINVAL;
+
+	if (!h->data->per_flow_accounting)
+		return -EINVAL;
+
+	stats = &h->acct_stats[ppe_id];
+	stats->ct_hit = 0;
+	stats->ct_miss = 0;
+	start = ktime_get_ns();
+
+	for (index = 0; index < h->foe_etry_num; index++) {
+		entry = &h->foe_table_cpu[ppe_id][index];
+		if (entry->bfib1.state != BIND)
+			continue;
+
+		if (hnat_acct_collect(h, ppe_id, index, &bytes, &packets))
+			break;
+
+		flows++;
+	}
+
+	stats->flows = flows;
+	stats->cycle_ns = ktime_get_ns() - start;
+	if (stats->cycle_ns > stats->max_cycle_ns)
+		stats->max_cycle_ns = stats->cycle_ns;
+
+	return flows;
+}
+EXPORT_SYMBOL(hnat_get_count_bulk);
+
 #define PRINT_COUNT(m, acct) {if (acct) \
 		seq_printf(m, "bytes=%llu|packets=%llu|", \
 			   acct->bytes, acct->packets); }
@@ -1161,6 +1522,9 @@ static int __hnat_debug_show(struct seq_file *m, void *private, u32 ppe_id)
 	if (ppe_id >= CFG_PPE_NUM)
 		return -EINVAL;
 
+	if (h->data->per_flow_accounting)
+		hnat_get_count_bulk(h, ppe_id);
+
 	entry = h->foe_table_cpu[ppe_id];
 	end = h->foe_table_cpu[ppe_id] + hnat_priv->foe_etry_num;
 	while (entry < end) {
@@ -1169,7 +1533,8 @@ static int __hnat_debug_show(struct seq_file *m, void *private, u32 ppe_id)
 			entry_index++;
 			continue;
 		}
-		acct = hnat_get_count(h, ppe_id, entry_index, NULL);
+		acct = (h->data->per_flow_accounting) ?
+		       &h->acct[ppe_id][entry_index] : NULL;
 		if (IS_IPV4_HNAPT(entry)) {
 			__be32 saddr = htonl(entry->ipv4_hnapt.sip);
 			__be32 daddr = htonl(entry->ipv4_hnapt.dip);
@@ -1536,6 +1901,325 @@ static const struct file_operations hnat_debug_fops = {
 	.release = single_release,
 };
 
+static int hnat_foe_scan_show(struct seq_file *m, void *private)
+{
+	struct hnat_foe_scan *scan = &hnat_priv->foe_scan;
+
+	seq_printf(m, "slice=%u interval=%ums cursor=PPE%u/%u\n",
+		   scan->slice, jiffies_to_msecs(FOE_SCAN_INTERVAL),
+		   scan->ppe_id, scan->index);
+	seq_printf(m, "max_tick=%lluus max_lock=%lluus\n",
+		   div_u64(scan->max_tick_ns, NSEC_PER_USEC),
+		   div_u64(scan->max_lock_ns, NSEC_PER_USEC));
+	seq_printf(m, "ts_reset=%s restamped=%llu mcast_expired=%llu\n",
+		   scan->ts_reset ? "running" : "idle",
+		   scan->restamped, scan->mcast_expired);
+	seq_printf(m, "cache flushes=%llu\n", scan->flushes);
+
+	return 0;
+}
+
+static int hnat_foe_scan_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hnat_foe_scan_show, file->private_data);
+}
+
+static const struct file_operations hnat_foe_scan_fops = {
+	.open = hnat_foe_scan_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int hnat_foe_evict_show(struct seq_file *m, void *private)
+{
+	struct hnat_evict_stats *stats;
+	int i;
+
+	if (hnat_priv->evict_idle)
+		seq_printf(m, "evict idle=%us window=%ums\n", hnat_priv->evict_idle,
+			   jiffies_to_msecs(HNAT_EVICT_WINDOW));
+	else
+		seq_puts(m, "evict disabled\n");
+
+	for (i = 0; i < CFG_PPE_NUM; i++) {
+		stats = &hnat_priv->evict_stats[i];
+		seq_printf(m, "PPE%d: bucket_full=%llu evicted=%llu (unbind=%llu) no_victim=%llu busy=%llu\n",
+			   i, stats->bucket_full, stats->evicted,
+			   stats->evicted_unbind, stats->no_victim, stats->busy);
+	}
+
+	return 0;
+}
+
+static int hnat_foe_evict_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hnat_foe_evict_show, file->private_data);
+}
+
+static const struct file_operations hnat_foe_evict_fops = {
+	.open = hnat_foe_evict_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void hnat_rate_stats_sum(int ppe_id, struct hnat_rate_stats *sum)
+{
+	struct hnat_rate_stats *stats;
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		stats = &per_cpu_ptr(hnat_priv->sw_stats, cpu)->rate[ppe_id];
+		sum->flows += stats->flows;
+		sum->binds += stats->binds;
+		sum->rebinds += stats->rebinds;
+		sum->unbind_active += stats->unbind_active;
+		sum->deferred += stats->deferred;
+		sum->promoted += stats->promoted;
+	}
+}
+
+static int hnat_bind_rate_show(struct seq_file *m, void *private)
+{
+	u32 secs = jiffies_to_msecs(jiffies - hnat_priv->rate_stats_start) / 1000;
+	struct hnat_rate_stats sum, *stats = &sum;
+	int i;
+
+	if (hnat_priv->bind_pps)
+		seq_printf(m, "bind=%upps unbind=%upps tick=%ums\n",
+			   hnat_priv->bind_pps, hnat_unbind_pps(),
+			   jiffies_to_msecs(HNAT_RATE_TICK));
+	else
+		seq_puts(m, "software bind rate disabled, counting binds only\n");
+
+	seq_printf(m, "interval=%us rebind window=%us\n", secs,
+		   HNAT_REBIND_WINDOW / HZ);
+	if (!secs)
+		secs = 1;
+
+	for (i = 0; i < CFG_PPE_NUM; i++) {
+		hnat_rate_stats_sum(i, stats);
+		seq_printf(m, "PPE%d: flows=%llu binds=%llu rebinds=%llu unbind_active=%llu deferred=%llu promoted=%llu\n",
+			   i, stats->flows, stats->binds, stats->rebinds,
+			   stats->unbind_active, stats->deferred,
+			   stats->promoted);
+		seq_printf(m, "      binds/s=%llu rebinds/s=%llu unbinds/s=%llu\n",
+			   div_u64(stats->binds, secs),
+			   div_u64(stats->rebinds, secs),
+			   div_u64(stats->unbind_active, secs));
+	}
+
+	return 0;
+}
+
+static int hnat_bind_rate_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hnat_bind_rate_show, file->private_data);
+}
+
+static ssize_t hnat_bind_rate_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	char line[16] = {0};
+	int cpu;
+
+	if (count >= sizeof(line))
+		return -EINVAL;
+
+	if (copy_from_user(line, buf, count))
+		return -EFAULT;
+
+	if (strncmp(line, "reset", 5)) {
+		pr_info("Usage: echo reset > /sys/kernel/debug/hnat/bind_rate\n");
+		return -EINVAL;
+	}
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(hnat_priv->sw_stats, cpu)->rate, 0,
+		       sizeof(struct hnat_rate_stats) * MAX_PPE_NUM);
+	hnat_priv->rate_stats_start = jiffies;
+
+	return count;
+}
+
+static const struct file_operations hnat_bind_rate_fops = {
+	.open = hnat_bind_rate_open,
+	.read = seq_read,
+	.write = hnat_bind_rate_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const char * const crsn_name[MAX_CRSN_NUM] = {
+	[TTL_0] = "ttl_0",
+	[HAS_OPTION_HEADER] = "option_header",
+	[NO_FLOW_IS_ASSIGNED] = "no_flow",
+	[IPV4_WITH_FRAGMENT] = "ipv4_frag",
+	[IPV4_HNAPT_DSLITE_WITH_FRAGMENT] = "hnapt_dslite_frag",
+	[IPV4_HNAPT_DSLITE_WITHOUT_TCP_UDP] = "hnapt_dslite_no_l4",
+	[IPV6_5T_6RD_WITHOUT_TCP_UDP] = "ipv6_5t_6rd_no_l4",
+	[TCP_FIN_SYN_RST] = "tcp_fin_syn_rst",
+	[UN_HIT] = "un_hit",
+	[HIT_UNBIND] = "hit_unbind",
+	[HIT_UNBIND_RATE_REACH] = "hit_unbind_rate_reach",
+	[HIT_BIND_TCP_FIN] = "hit_bind_tcp_fin",
+	[HIT_BIND_TTL_1] = "hit_bind_ttl_1",
+	[HIT_BIND_WITH_VLAN_VIOLATION] = "hit_bind_vlan_violation",
+	[HIT_BIND_KEEPALIVE_UC_OLD_HDR] = "keepalive_uc_old_hdr",
+	[HIT_BIND_KEEPALIVE_MC_NEW_HDR] = "keepalive_mc_new_hdr",
+	[HIT_BIND_KEEPALIVE_DUP_OLD_HDR] = "keepalive_dup_old_hdr",
+	[HIT_BIND_FORCE_TO_CPU] = "hit_bind_force_to_cpu",
+	[HIT_BIND_WITH_OPTION_HEADER] = "hit_bind_option_header",
+	[HIT_BIND_MULTICAST_TO_CPU] = "hit_bind_mcast_to_cpu",
+	[HIT_BIND_MULTICAST_TO_GMAC_CPU] = "hit_bind_mcast_to_gmac_cpu",
+	[HIT_PRE_BIND] = "hit_pre_bind",
+	[HIT_BIND_PACKET_SAMPLING] = "hit_bind_sampling",
+	[HIT_BIND_EXCEED_MTU] = "hit_bind_exceed_mtu",
+};
+
+static const char * const bind_fail_name[HNAT_BIND_FAIL_MAX] = {
+	[HNAT_BIND_FAIL_ACCEL] = "accel",
+	[HNAT_BIND_FAIL_TNL] = "tnl",
+	[HNAT_BIND_FAIL_BUSY] = "busy",
+	[HNAT_BIND_FAIL_STATE] = "state",
+};
+
+/* Reads only counters, never the FOE table or the MIB, so the cost does
+ * not depend on the number of flows. Bound entries are as of the last
+ * FOE scan pass; hardware bytes are what the per-flow MIB has reported.
+ */
+static int hnat_offload_stats_show(struct seq_file *m, void *private)
+{
+	struct hnat_offload_stats *stats;
+	struct hnat_rate_stats rate;
+	struct hnat_sw_stats *sw;
+	u64 sw_packets[MAX_CRSN_NUM] = { 0 }, sw_bytes[MAX_CRSN_NUM] = { 0 };
+	u64 bind_fail[HNAT_BIND_FAIL_MAX], attempts;
+	u64 hw_total = 0, sw_total = 0, fail, ok;
+	u32 bound;
+	int i, j, cpu;
+
+	for_each_possible_cpu(cpu) {
+		sw = per_cpu_ptr(hnat_priv->sw_stats, cpu);
+		for (j = 0; j < MAX_CRSN_NUM; j++) {
+			sw_packets[j] += sw->packets[j];
+			sw_bytes[j] += sw->bytes[j];
+		}
+	}
+
+	for (i = 0; i < CFG_PPE_NUM; i++) {
+		stats = &hnat_priv->offload_stats[i];
+
+		bound = 0;
+		for (j = 0; j < HNAT_PKT_TYPE_NUM; j++)
+			bound += stats->bound[j];
+
+		seq_printf(m, "PPE%d: bound=%u/%u (scanned %ums ago)\n", i,
+			   bound, hnat_priv->foe_etry_num,
+			   jiffies_to_msecs(jiffies - stats->scan_done));
+		for (j = 0; j < HNAT_PKT_TYPE_NUM; j++) {
+			if (stats->bound[j])
+				seq_printf(m, "  %-14s %u\n", packet_type[j],
+					   stats->bound[j]);
+		}
+
+		attempts = 0;
+		memset(bind_fail, 0, sizeof(bind_fail));
+		for_each_possible_cpu(cpu) {
+			sw = per_cpu_ptr(hnat_priv->sw_stats, cpu);
+			attempts += sw->bind_attempts[i];
+			for (j = 0; j < HNAT_BIND_FAIL_MAX; j++)
+				bind_fail[j] += sw->bind_fail[i][j];
+		}
+
+		hnat_rate_stats_sum(i, &rate);
+		ok = rate.binds;
+		fail = 0;
+		seq_printf(m, "  bind attempts=%llu ok=%llu", attempts, ok);
+		for (j = 0; j < HNAT_BIND_FAIL_MAX; j++) {
+			seq_printf(m, " %s=%llu", bind_fail_name[j],
+				   bind_fail[j]);
+			fail += bind_fail[j];
+		}
+		/* early exits of skb_to_hnat_info, e.g. unsupported headers */
+		seq_printf(m, " other=%llu\n",
+			   attempts > ok + fail ? attempts - ok - fail : 0);
+
+		seq_printf(m, "  hw bytes=%llu packets=%llu\n", stats->hw_bytes,
+			   stats->hw_packets);
+		hw_total += stats->hw_bytes;
+	}
+
+	seq_puts(m, "sw path by reason:\n");
+	for (j = 0; j < MAX_CRSN_NUM; j++) {
+		sw_total += sw_bytes[j];
+		if (sw_packets[j])
+			seq_printf(m, "  %-26s packets=%llu bytes=%llu\n",
+				   crsn_name[j] ? crsn_name[j] : "unknown",
+				   sw_packets[j], sw_bytes[j]);
+	}
+
+	seq_printf(m, "hw bytes=%llu sw bytes=%llu offload=%llu%%\n", hw_total,
+		   sw_total, hw_total + sw_total ?
+		   div64_u64(hw_total * 100, hw_total + sw_total) : 0);
+	if (!hnat_priv->data->per_flow_accounting)
+		seq_puts(m, "(no per-flow MIB on this SoC, hw bytes stay 0)\n");
+
+	return 0;
+}
+
+static int hnat_offload_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hnat_offload_stats_show, file->private_data);
+}
+
+static const struct file_operations hnat_offload_stats_fops = {
+	.open = hnat_offload_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int hnat_mib_acct_show(struct seq_file *m, void *private)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct hnat_acct_stats *stats;
+	int i;
+
+	if (!h->data->per_flow_accounting) {
+		seq_puts(m, "per-flow accounting is not supported\n");
+		return 0;
+	}
+
+	seq_printf(m, "MIB source: %s\n",
+		   h->mib_dma_en ? "DMA table" : "MIB search registers");
+
+	for (i = 0; i < CFG_PPE_NUM; i++) {
+		hnat_get_count_bulk(h, i);
+		stats = &h->acct_stats[i];
+		seq_printf(m, "PPE%d: flows=%u cycle=%lluus max=%lluus ct_hit=%u ct_miss=%u\n",
+			   i, stats->flows, div_u64(stats->cycle_ns, NSEC_PER_USEC),
+			   div_u64(stats->max_cycle_ns, NSEC_PER_USEC),
+			   stats->ct_hit, stats->ct_miss);
+	}
+
+	return 0;
+}
+
+static int hnat_mib_acct_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hnat_mib_acct_show, file->private_data);
+}
+
+static const struct file_operations hnat_mib_acct_fops = {
+	.open = hnat_mib_acct_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int hnat_whnat_show(struct seq_file *m, void *private)
 {
 	int i;
@@ -2107,6 +2791,11 @@ ssize_t hnat_setting_write(struct file *file, const char __user *buffer,
 	case 6:
 	case 7:
 	case 8:
+	case 9:
+	case 10:
+	case 11:
+	case 12:
+	case 13:
 		p_token = strsep(&p_buf, p_delimiter);
 		if (!p_token)
 			arg1 = 0;
@@ -2189,98 +2878,352 @@ int mcast_table_dump(struct seq_file *m, void *private)
 	for (i = 0; i < CFG_PPE_NUM; i++)
 		__mcast_table_dump(m, private, i);
 
+	hnat_mcast_group_dump(m);
+
+	return 0;
+}
+
+static int mcast_table_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mcast_table_dump, file->private_data);
+}
+
+static ssize_t mcast_table_write(struct file *file, const char __user *buffer,
+				 size_t count, loff_t *data)
+{
+	char buf[32] = {0};
+	int len = count;
+	int groups, loops;
+
+	if ((len > sizeof(buf) - 1) || copy_from_user(buf, buffer, len))
+		return -EFAULT;
+
+	if (sscanf(buf, "bench %d %d", &groups, &loops) != 2) {
+		pr_info("echo bench <groups> <loops> > /sys/kernel/debug/hnat/mcast_table\n");
+		return -EINVAL;
+	}
+
+	hnat_mcast_bench(groups, loops);
+
+	return len;
+}
+
+static const struct file_operations hnat_mcast_fops = {
+	.open = mcast_table_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.write = mcast_table_write,
+	.release = single_release,
+};
+
+static int hnat_ext_show(struct seq_file *m, void *private)
+{
+	int i;
+	struct extdev_entry *ext_entry;
+
+	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
+		ext_entry = hnat_priv->ext_if[i];
+		if (ext_entry->dev)
+			seq_printf(m, "ext devices [%d] = %s  (dev=%p, ifindex=%d)\n",
+				   i, ext_entry->name, ext_entry->dev,
+				   ext_entry->dev->ifindex);
+	}
+
+	return 0;
+}
+
+static int hnat_ext_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hnat_ext_show, file->private_data);
+}
+
+static const struct file_operations hnat_ext_fops = {
+	.open = hnat_ext_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+#if defined(CONFIG_MEDIATEK_NETSYS_V3)
+#define HNAT_QOS_RATE_MAX	10000000
+#else
+#define HNAT_QOS_RATE_MAX	1000000
+#endif
+
+/* Software copy of the QDMA scheduler and queue registers. Readers use it
+ * instead of paging through MMIO. It is re-read when a link changes, since
+ * the ethernet driver programs the per-port queue speed on its own.
+ */
+static struct {
+	u32 qtx_sch[MTK_QDMA_TX_NUM];
+	u32 qtx_cfg[MTK_QDMA_TX_NUM];
+	u32 tx_sch[2];	/* two 16-bit schedulers per word */
+} qos_shadow;
+
+static DEFINE_SPINLOCK(qos_lock);
+
+static void __iomem *hnat_qdma_sch_reg(u32 id)
+{
+	if (hnat_priv->data->num_of_sch == 4)
+		return hnat_priv->fe_base + QDMA_TX_4SCH_BASE(id);
+
+	return hnat_priv->fe_base + QDMA_TX_2SCH_BASE;
+}
+
+static void hnat_qtx_page(u32 id)
+{
+	cr_set_field(hnat_priv->fe_base + QDMA_PAGE, QTX_CFG_PAGE,
+		     (id / NUM_OF_Q_PER_PAGE));
+}
+
+void hnat_qos_shadow_sync(void)
+{
+	u32 id;
+
+	spin_lock_bh(&qos_lock);
+	for (id = 0; id < MTK_QDMA_TX_NUM; id++) {
+		if (!(id % NUM_OF_Q_PER_PAGE))
+			hnat_qtx_page(id);
+		qos_shadow.qtx_cfg[id] = readl(hnat_priv->fe_base +
+					       QTX_CFG(id % NUM_OF_Q_PER_PAGE));
+		qos_shadow.qtx_sch[id] = readl(hnat_priv->fe_base +
+					       QTX_SCH(id % NUM_OF_Q_PER_PAGE));
+	}
+
+	for (id = 0; id < hnat_priv->data->num_of_sch; id += 2)
+		qos_shadow.tx_sch[id >> 1] = readl(hnat_qdma_sch_reg(id));
+	spin_unlock_bh(&qos_lock);
+}
+
+/* The __ writers expect qos_lock and leave the page register at id */
+static void __hnat_qtx_sch_write(u32 id, u32 val)
+{
+	hnat_qtx_page(id);
+	writel(val, hnat_priv->fe_base + QTX_SCH(id % NUM_OF_Q_PER_PAGE));
+	qos_shadow.qtx_sch[id] = val;
+}
+
+static void __hnat_qtx_resv_write(u32 id, u32 resv)
+{
+	u32 val;
+
+	val = qos_shadow.qtx_cfg[id] & 0xffff0000;
+	val |= (resv << QTX_CFG_HW_RESV_CNT_OFFSET) |
+	       (resv << QTX_CFG_SW_RESV_CNT_OFFSET);
+
+	hnat_qtx_page(id);
+	writel(val, hnat_priv->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
+	qos_shadow.qtx_cfg[id] = val;
+}
+
+static void __hnat_qdma_sch_write(u32 id, u32 val)
+{
+	u32 shift = (id & 0x1) ? 16 : 0;
+	u32 *word = &qos_shadow.tx_sch[id >> 1];
+
+	*word &= ~(MTK_QDMA_TX_SCH_MASK << shift);
+	*word |= val << shift;
+	writel(*word, hnat_qdma_sch_reg(id));
+}
+
+void hnat_qtx_sch_write(u32 id, u32 val)
+{
+	spin_lock_bh(&qos_lock);
+	__hnat_qtx_sch_write(id, val);
+	spin_unlock_bh(&qos_lock);
+}
+
+/* rate in Kbps to the 7-bit mantissa at [10:4] and exponent at [3:0] */
+static u32 hnat_qos_rate_encode(u32 rate)
+{
+	u32 exp = 0;
+
+	while (rate > 127) {
+		rate /= 10;
+		exp++;
+	}
+
+	return ((rate & 0x7f) << 4) | (exp & 0xf);
+}
+
+static u32 hnat_qos_rate_decode(u32 val)
+{
+	u32 rate = (val >> 4) & 0x7f;
+	u32 exp = val & 0xf;
+
+	while (exp--)
+		rate *= 10;
+
+	return rate;
+}
+
+static u32 hnat_qos_sch_encode(const struct hnat_nl_qos_sch *sch)
+{
+	u32 val = hnat_qos_rate_encode(sch->max_rate);
+
+	if (sch->enable)
+		val |= BIT(11);
+	if (sch->wrr)
+		val |= BIT(15);
+
+	return val;
+}
+
+static void hnat_qos_sch_decode(u32 id, struct hnat_nl_qos_sch *sch)
+{
+	u32 val = qos_shadow.tx_sch[id >> 1];
+
+	if (id & 0x1)
+		val >>= 16;
+	val &= MTK_QDMA_TX_SCH_MASK;
+
+	memset(sch, 0, sizeof(*sch));
+	sch->id = id;
+	sch->enable = !!(val & BIT(11));
+	sch->wrr = !!(val & BIT(15));
+	sch->max_rate = hnat_qos_rate_decode(val);
+}
+
+static u32 hnat_qos_queue_encode(const struct hnat_nl_qos_queue *q)
+{
+	u32 val = 0;
+
+	if (hnat_priv->data->num_of_sch == 4)
+		val |= (q->scheduler & 0x3) << 30;
+	else
+		val |= (q->scheduler & 0x1) << 31;
+	if (q->min_en)
+		val |= QTX_SCH_MIN_RATE_EN;
+	val |= hnat_qos_rate_encode(q->min_rate) << QTX_SCH_MIN_RATE_EXP_OFFSET;
+	if (q->max_en)
+		val |= QTX_SCH_MAX_RATE_EN;
+	val |= (q->weight & 0xf) << QTX_SCH_MAX_RATE_WGHT_OFFSET;
+	val |= hnat_qos_rate_encode(q->max_rate);
+
+	return val;
+}
+
+static void hnat_qos_queue_decode(u32 id, struct hnat_nl_qos_queue *q)
+{
+	u32 sch = qos_shadow.qtx_sch[id];
+
+	memset(q, 0, sizeof(*q));
+	q->id = id;
+	if (hnat_priv->data->num_of_sch == 4)
+		q->scheduler = (sch >> 30) & 0x3;
+	else
+		q->scheduler = !!(sch & BIT(31));
+	q->min_en = !!(sch & QTX_SCH_MIN_RATE_EN);
+	q->min_rate = hnat_qos_rate_decode(sch >> QTX_SCH_MIN_RATE_EXP_OFFSET);
+	q->max_en = !!(sch & QTX_SCH_MAX_RATE_EN);
+	q->weight = (sch >> QTX_SCH_MAX_RATE_WGHT_OFFSET) & 0xf;
+	q->max_rate = hnat_qos_rate_decode(sch);
+	q->resv = qos_shadow.qtx_cfg[id] & 0xff;
+}
+
+static int hnat_qos_sch_check(const struct hnat_nl_qos_sch *sch)
+{
+	if (sch->id >= hnat_priv->data->num_of_sch ||
+	    sch->max_rate > HNAT_QOS_RATE_MAX)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int hnat_qos_queue_check(const struct hnat_nl_qos_queue *q)
+{
+	if (q->id >= MTK_QDMA_TX_NUM ||
+	    q->scheduler >= hnat_priv->data->num_of_sch ||
+	    q->min_rate > HNAT_QOS_RATE_MAX ||
+	    q->max_rate > HNAT_QOS_RATE_MAX || q->weight > 0xf)
+		return -EINVAL;
+
 	return 0;
 }
 
-static int mcast_table_open(struct inode *inode, struct file *file)
+/* Program a whole plan. Everything is checked before the first register
+ * is written, and qos_lock keeps the other writers out until the last
+ * one. Returns the number of registers written.
+ */
+int hnat_qos_apply(const struct hnat_nl_qos_sch *sch, int nsch,
+		   const struct hnat_nl_qos_queue *queue, int nqueue)
 {
-	return single_open(file, mcast_table_dump, file->private_data);
-}
+	int i, writes = 0;
+	u32 val;
 
-static const struct file_operations hnat_mcast_fops = {
-	.open = mcast_table_open,
-	.read = seq_read,
-	.llseek = seq_lseek,
-	.release = single_release,
-};
+	for (i = 0; i < nsch; i++) {
+		if (hnat_qos_sch_check(&sch[i]))
+			return -EINVAL;
+	}
 
-static int hnat_ext_show(struct seq_file *m, void *private)
-{
-	int i;
-	struct extdev_entry *ext_entry;
+	for (i = 0; i < nqueue; i++) {
+		if (hnat_qos_queue_check(&queue[i]))
+			return -EINVAL;
+	}
 
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
-		if (ext_entry->dev)
-			seq_printf(m, "ext devices [%d] = %s  (dev=%p, ifindex=%d)\n",
-				   i, ext_entry->name, ext_entry->dev,
-				   ext_entry->dev->ifindex);
+	spin_lock_bh(&qos_lock);
+	for (i = 0; i < nsch; i++) {
+		__hnat_qdma_sch_write(sch[i].id, hnat_qos_sch_encode(&sch[i]));
+		writes++;
 	}
 
-	return 0;
+	for (i = 0; i < nqueue; i++) {
+		val = hnat_qos_queue_encode(&queue[i]);
+		if (val != qos_shadow.qtx_sch[queue[i].id]) {
+			__hnat_qtx_sch_write(queue[i].id, val);
+			writes++;
+		}
+		if (queue[i].resv != (qos_shadow.qtx_cfg[queue[i].id] & 0xff)) {
+			__hnat_qtx_resv_write(queue[i].id, queue[i].resv);
+			writes++;
+		}
+	}
+	spin_unlock_bh(&qos_lock);
+
+	return writes;
 }
 
-static int hnat_ext_open(struct inode *inode, struct file *file)
+/* Fill num_of_sch schedulers and MTK_QDMA_TX_NUM queues from the shadow */
+void hnat_qos_get(struct hnat_nl_qos_sch *sch, struct hnat_nl_qos_queue *queue)
 {
-	return single_open(file, hnat_ext_show, file->private_data);
-}
+	u32 id;
 
-static const struct file_operations hnat_ext_fops = {
-	.open = hnat_ext_open,
-	.read = seq_read,
-	.llseek = seq_lseek,
-	.release = single_release,
-};
+	spin_lock_bh(&qos_lock);
+	for (id = 0; id < hnat_priv->data->num_of_sch; id++)
+		hnat_qos_sch_decode(id, &sch[id]);
+	for (id = 0; id < MTK_QDMA_TX_NUM; id++)
+		hnat_qos_queue_decode(id, &queue[id]);
+	spin_unlock_bh(&qos_lock);
+}
 
 static ssize_t hnat_sched_show(struct file *file, char __user *user_buf,
 			       size_t count, loff_t *ppos)
 {
 	long id = (long)file->private_data;
-	struct mtk_hnat *h = hnat_priv;
-	u32 qdma_tx_sch;
-	int enable;
-	int scheduling;
-	int max_rate;
+	struct hnat_nl_qos_queue queue;
+	struct hnat_nl_qos_sch sch;
 	char *buf;
 	unsigned int len = 0, buf_len = 1500;
 	ssize_t ret_cnt;
-	int scheduler, i;
-	u32 sch_reg;
+	int i;
 
 	buf = kzalloc(buf_len, GFP_KERNEL);
 	if (!buf)
 		return -ENOMEM;
 
-	if (hnat_priv->data->num_of_sch == 4)
-		qdma_tx_sch = readl(h->fe_base + QDMA_TX_4SCH_BASE(id));
-	else
-		qdma_tx_sch = readl(h->fe_base + QDMA_TX_2SCH_BASE);
-
-	if (id & 0x1)
-		qdma_tx_sch >>= 16;
-	qdma_tx_sch &= MTK_QDMA_TX_SCH_MASK;
-	enable = !!(qdma_tx_sch & BIT(11));
-	scheduling = !!(qdma_tx_sch & BIT(15));
-	max_rate = ((qdma_tx_sch >> 4) & 0x7f);
-	qdma_tx_sch &= 0xf;
-	while (qdma_tx_sch--)
-		max_rate *= 10;
+	spin_lock_bh(&qos_lock);
+	hnat_qos_sch_decode(id, &sch);
 
 	len += scnprintf(buf + len, buf_len - len,
-			 "EN\tScheduling\tMAX\tQueue#\n%d\t%s%16d\t", enable,
-			 (scheduling == 1) ? "WRR" : "SP", max_rate);
+			 "EN\tScheduling\tMAX\tQueue#\n%d\t%s%16d\t", sch.enable,
+			 (sch.wrr) ? "WRR" : "SP", sch.max_rate);
 
 	for (i = 0; i < MTK_QDMA_TX_NUM; i++) {
-		cr_set_field(h->fe_base + QDMA_PAGE, QTX_CFG_PAGE,
-			     (i / NUM_OF_Q_PER_PAGE));
-		sch_reg = readl(h->fe_base + QTX_SCH(i % NUM_OF_Q_PER_PAGE));
-		if (hnat_priv->data->num_of_sch == 4)
-			scheduler = (sch_reg >> 30) & 0x3;
-		else
-			scheduler = !!(sch_reg & BIT(31));
-		if (id == scheduler)
+		hnat_qos_queue_decode(i, &queue);
+		if (id == queue.scheduler)
 			len += scnprintf(buf + len, buf_len - len, "%d  ", i);
 	}
+	spin_unlock_bh(&qos_lock);
 
 	len += scnprintf(buf + len, buf_len - len, "\n");
 	if (len > buf_len)
@@ -2296,13 +3239,11 @@ static ssize_t hnat_sched_write(struct file *file, const char __user *buf,
 				size_t length, loff_t *offset)
 {
 	long id = (long)file->private_data;
-	struct mtk_hnat *h = hnat_priv;
+	struct hnat_nl_qos_sch sch = { 0 };
 	char line[64] = {0};
-	int enable, rate, exp = 0, shift = 0;
+	int enable, rate;
 	char scheduling[32];
 	size_t size;
-	u32 qdma_tx_sch;
-	u32 val = 0;
 
 	if (length >= sizeof(line))
 		return -EINVAL;
@@ -2313,40 +3254,16 @@ static ssize_t hnat_sched_write(struct file *file, const char __user *buf,
 	if (sscanf(line, "%1d %3s %9d", &enable, scheduling, &rate) != 3)
 		return -EFAULT;
 
-#if defined(CONFIG_MEDIATEK_NETSYS_V3)
-	if (rate > 10000000 || rate < 0)
-#else
-	if (rate > 1000000 || rate < 0)
-#endif
+	if (rate > HNAT_QOS_RATE_MAX || rate < 0)
 		return -EINVAL;
 
-	while (rate > 127) {
-		rate /= 10;
-		exp++;
-	}
-
 	line[length] = '\0';
 
-	if (enable)
-		val |= BIT(11);
-	if (strcmp(scheduling, "sp") != 0)
-		val |= BIT(15);
-	val |= (rate & 0x7f) << 4;
-	val |= exp & 0xf;
-	if (id & 0x1)
-		shift = 16;
-
-	if (hnat_priv->data->num_of_sch == 4)
-		qdma_tx_sch = readl(h->fe_base + QDMA_TX_4SCH_BASE(id));
-	else
-		qdma_tx_sch = readl(h->fe_base + QDMA_TX_2SCH_BASE);
-
-	qdma_tx_sch &= ~(MTK_QDMA_TX_SCH_MASK << shift);
-	qdma_tx_sch |= val << shift;
-	if (hnat_priv->data->num_of_sch == 4)
-		writel(qdma_tx_sch, h->fe_base + QDMA_TX_4SCH_BASE(id));
-	else
-		writel(qdma_tx_sch, h->fe_base + QDMA_TX_2SCH_BASE);
+	sch.id = id;
+	sch.enable = !!enable;
+	sch.wrr = strcmp(scheduling, "sp") != 0;
+	sch.max_rate = rate;
+	hnat_qos_apply(&sch, 1, NULL, 0);
 
 	size = strlen(line);
 	*offset += size;
@@ -2366,16 +3283,9 @@ static ssize_t hnat_queue_show(struct file *file, char __user *user_buf,
 {
 	struct mtk_hnat *h = hnat_priv;
 	long id = (long)file->private_data;
+	struct hnat_nl_qos_queue q;
 	u32 qtx_sch;
 	u32 qtx_cfg;
-	int scheduler;
-	int min_rate_en;
-	int min_rate;
-	int min_rate_exp;
-	int max_rate_en;
-	int max_weight;
-	int max_rate;
-	int max_rate_exp;
 	char *buf;
 	unsigned int len = 0, buf_len = 1500;
 	ssize_t ret_cnt;
@@ -2384,32 +3294,17 @@ static ssize_t hnat_queue_show(struct file *file, char __user *user_buf,
 	if (!buf)
 		return -ENOMEM;
 
-	cr_set_field(h->fe_base + QDMA_PAGE, QTX_CFG_PAGE, (id / NUM_OF_Q_PER_PAGE));
-	qtx_cfg = readl(h->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
-	qtx_sch = readl(h->fe_base + QTX_SCH(id % NUM_OF_Q_PER_PAGE));
-	if (hnat_priv->data->num_of_sch == 4)
-		scheduler = (qtx_sch >> 30) & 0x3;
-	else
-		scheduler = !!(qtx_sch & BIT(31));
-	min_rate_en = !!(qtx_sch & BIT(27));
-	min_rate = (qtx_sch >> 20) & 0x7f;
-	min_rate_exp = (qtx_sch >> 16) & 0xf;
-	max_rate_en = !!(qtx_sch & BIT(11));
-	max_weight = (qtx_sch >> 12) & 0xf;
-	max_rate = (qtx_sch >> 4) & 0x7f;
-	max_rate_exp = qtx_sch & 0xf;
-	while (min_rate_exp--)
-		min_rate *= 10;
-
-	while (max_rate_exp--)
-		max_rate *= 10;
+	spin_lock_bh(&qos_lock);
+	hnat_qos_queue_decode(id, &q);
 
 	len += scnprintf(buf + len, buf_len - len,
-			 "scheduler: %d\nhw resv: %d\nsw resv: %d\n", scheduler,
-			 (qtx_cfg >> 8) & 0xff, qtx_cfg & 0xff);
+			 "scheduler: %d\nhw resv: %d\nsw resv: %d\n", q.scheduler,
+			 (qos_shadow.qtx_cfg[id] >> 8) & 0xff,
+			 qos_shadow.qtx_cfg[id] & 0xff);
 
 	if (hnat_priv->data->version != MTK_HNAT_V1_1) {
 		/* Switch to debug mode */
+		hnat_qtx_page(id);
 		cr_set_field(h->fe_base + QTX_MIB_IF, MIB_ON_QTX_CFG, 1);
 		cr_set_field(h->fe_base + QTX_MIB_IF, VQTX_MIB_EN, 1);
 		qtx_cfg = readl(h->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
@@ -2424,15 +3319,16 @@ static ssize_t hnat_queue_show(struct file *file, char __user *user_buf,
 			     MIB_ON_QTX_CFG, 0);
 		cr_set_field(hnat_priv->fe_base + QTX_MIB_IF, VQTX_MIB_EN, 0);
 	}
+	spin_unlock_bh(&qos_lock);
 
 	len += scnprintf(buf + len, buf_len - len,
 			 "      EN     RATE     WEIGHT\n");
 	len += scnprintf(buf + len, buf_len - len,
 			 "----------------------------\n");
 	len += scnprintf(buf + len, buf_len - len,
-			 "max%5d%9d%9d\n", max_rate_en, max_rate, max_weight);
+			 "max%5d%9d%9d\n", q.max_en, q.max_rate, q.weight);
 	len += scnprintf(buf + len, buf_len - len,
-			 "min%5d%9d        -\n", min_rate_en, min_rate);
+			 "min%5d%9d        -\n", q.min_en, q.min_rate);
 
 	if (len > buf_len)
 		len = buf_len;
@@ -2447,17 +3343,15 @@ static ssize_t hnat_queue_write(struct file *file, const char __user *buf,
 				size_t length, loff_t *offset)
 {
 	long id = (long)file->private_data;
-	struct mtk_hnat *h = hnat_priv;
+	struct hnat_nl_qos_queue q = { 0 };
 	char line[64] = {0};
-	int max_enable, max_rate, max_exp = 0;
-	int min_enable, min_rate, min_exp = 0;
+	int max_enable, max_rate;
+	int min_enable, min_rate;
 	int weight;
 	int resv;
 	int scheduler;
 	size_t size;
-	u32 qtx_sch = 0;
 
-	cr_set_field(h->fe_base + QDMA_PAGE, QTX_CFG_PAGE, (id / NUM_OF_Q_PER_PAGE));
 	if (length >= sizeof(line))
 		return -EINVAL;
 
@@ -2470,45 +3364,20 @@ static ssize_t hnat_queue_write(struct file *file, const char __user *buf,
 
 	line[length] = '\0';
 
-#if defined(CONFIG_MEDIATEK_NETSYS_V3)
-	if (max_rate > 10000000 || max_rate < 0 ||
-	    min_rate > 10000000 || min_rate < 0)
-#else
-	if (max_rate > 1000000 || max_rate < 0 ||
-	    min_rate > 1000000 || min_rate < 0)
-#endif
+	if (max_rate > HNAT_QOS_RATE_MAX || max_rate < 0 ||
+	    min_rate > HNAT_QOS_RATE_MAX || min_rate < 0)
 		return -EINVAL;
 
-	while (max_rate > 127) {
-		max_rate /= 10;
-		max_exp++;
-	}
-
-	while (min_rate > 127) {
-		min_rate /= 10;
-		min_exp++;
-	}
-
-	if (hnat_priv->data->num_of_sch == 4)
-		qtx_sch |= (scheduler & 0x3) << 30;
-	else
-		qtx_sch |= (scheduler & 0x1) << 31;
-	if (min_enable)
-		qtx_sch |= BIT(27);
-	qtx_sch |= (min_rate & 0x7f) << 20;
-	qtx_sch |= (min_exp & 0xf) << 16;
-	if (max_enable)
-		qtx_sch |= BIT(11);
-	qtx_sch |= (weight & 0xf) << 12;
-	qtx_sch |= (max_rate & 0x7f) << 4;
-	qtx_sch |= max_exp & 0xf;
-	writel(qtx_sch, h->fe_base + QTX_SCH(id % NUM_OF_Q_PER_PAGE));
-
-	resv &= 0xff;
-	qtx_sch = readl(h->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
-	qtx_sch &= 0xffff0000;
-	qtx_sch |= (resv << 8) | resv;
-	writel(qtx_sch, h->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
+	/* out of range scheduler and weight values are masked as before */
+	q.id = id;
+	q.scheduler = scheduler & (hnat_priv->data->num_of_sch - 1);
+	q.min_en = !!min_enable;
+	q.min_rate = min_rate;
+	q.max_en = !!max_enable;
+	q.max_rate = max_rate;
+	q.weight = weight & 0xf;
+	q.resv = resv & 0xff;
+	hnat_qos_apply(NULL, 0, &q, 1);
 
 	size = strlen(line);
 	*offset += size;
@@ -2789,24 +3658,144 @@ int mtk_ppe_get_xlat_v6_by_v4(u32 *ipv4, struct in6_addr *ipv6,
 {
 	struct mtk_hnat *h = hnat_priv;
 	struct map46 *m = NULL;
+	int ret = -1;
 
-	list_for_each_entry(m, &h->xlat.map_list, list) {
+	rcu_read_lock();
+	hash_for_each_possible_rcu(h->xlat.map4_hash, m, v4_node, *ipv4) {
 		if (m->ipv4 == *ipv4) {
 			memcpy(ipv6, &m->ipv6, sizeof(*ipv6));
 			memcpy(prefix, &h->xlat.prefix, sizeof(*ipv6));
-			return 0;
+			ret = 0;
+			break;
 		}
 	}
+	rcu_read_unlock();
 
-	return -1;
+	return ret;
 }
 
 int mtk_ppe_get_xlat_v4_by_v6(struct in6_addr *ipv6, u32 *ipv4)
 {
 	struct mtk_hnat *h = hnat_priv;
 	struct map46 *m = NULL;
+	int ret = -1;
 
-	list_for_each_entry(m, &h->xlat.map_list, list) {
+	rcu_read_lock();
+	hash_for_each_possible_rcu(h->xlat.map6_hash, m, v6_node,
+				   ipv6_addr_hash(ipv6)) {
+		if (ipv6_addr_equal(ipv6, &m->ipv6)) {
+			*ipv4 = m->ipv4;
+			ret = 0;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* The map updaters below run under xlat.lock, lookups only take RCU */
+static bool hnat_xlat_map_used(u32 ipv4, const struct in6_addr *ipv6)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct map46 *m = NULL;
+
+	hash_for_each_possible(h->xlat.map4_hash, m, v4_node, ipv4) {
+		if (m->ipv4 == ipv4)
+			return true;
+	}
+
+	hash_for_each_possible(h->xlat.map6_hash, m, v6_node,
+			       ipv6_addr_hash(ipv6)) {
+		if (ipv6_addr_equal(ipv6, &m->ipv6))
+			return true;
+	}
+
+	return false;
+}
+
+static void hnat_xlat_map_free(struct map46 *m)
+{
+	hash_del_rcu(&m->v4_node);
+	hash_del_rcu(&m->v6_node);
+	list_del(&m->list);
+	hnat_priv->xlat.map_num--;
+	kfree_rcu(m, rcu);
+}
+
+/* A CLAT mapping is 1:1, so neither address may be mapped already */
+int hnat_xlat_map_add(u32 ipv4, const struct in6_addr *ipv6)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct map46 *map;
+
+	lockdep_assert_held(&h->xlat.lock);
+
+	if (hnat_xlat_map_used(ipv4, ipv6))
+		return -EEXIST;
+
+	map = kmalloc(sizeof(struct map46), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	map->ipv4 = ipv4;
+	map->ipv6 = *ipv6;
+	list_add_tail(&map->list, &h->xlat.map_list);
+	hash_add_rcu(h->xlat.map4_hash, &map->v4_node, ipv4);
+	hash_add_rcu(h->xlat.map6_hash, &map->v6_node, ipv6_addr_hash(ipv6));
+	h->xlat.map_num++;
+
+	return 0;
+}
+
+int hnat_xlat_map_del(u32 ipv4, const struct in6_addr *ipv6)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct map46 *m = NULL;
+
+	lockdep_assert_held(&h->xlat.lock);
+
+	hash_for_each_possible(h->xlat.map4_hash, m, v4_node, ipv4) {
+		if (m->ipv4 == ipv4 && ipv6_addr_equal(ipv6, &m->ipv6)) {
+			hnat_xlat_map_free(m);
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+void hnat_xlat_map_flush(void)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct map46 *m = NULL, *next = NULL;
+
+	lockdep_assert_held(&h->xlat.lock);
+
+	list_for_each_entry_safe(m, next, &h->xlat.map_list, list)
+		hnat_xlat_map_free(m);
+}
+
+/* The list walk the lookups used before the hash tables, kept to compare */
+static int hnat_xlat_list_v6_by_v4(u32 ipv4, struct in6_addr *ipv6)
+{
+	struct map46 *m = NULL;
+
+	list_for_each_entry(m, &hnat_priv->xlat.map_list, list) {
+		if (m->ipv4 == ipv4) {
+			*ipv6 = m->ipv6;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int hnat_xlat_list_v4_by_v6(struct in6_addr *ipv6, u32 *ipv4)
+{
+	struct map46 *m = NULL;
+
+	list_for_each_entry(m, &hnat_priv->xlat.map_list, list) {
 		if (ipv6_addr_equal(ipv6, &m->ipv6)) {
 			*ipv4 = m->ipv4;
 			return 0;
@@ -2816,6 +3805,80 @@ int mtk_ppe_get_xlat_v4_by_v6(struct in6_addr *ipv6, u32 *ipv4)
 	return -1;
 }
 
+#define XLAT_BENCH_KEYS		256
+
+/* Time both lookup directions against keys spread over the whole map, with
+ * the hash tables and with a list walk, at the current map size.
+ */
+static void hnat_xlat_bench(int loops)
+{
+	struct mtk_hnat *h = hnat_priv;
+	struct in6_addr *keys6, ipv6, prefix;
+	u64 t0, hash4, hash6, list4, list6;
+	struct map46 *m = NULL;
+	u32 *keys4, ipv4;
+	int i, n = 0, step, pos = 0;
+
+	if (loops <= 0 || loops > 1000000) {
+		pr_info("input error\n");
+		return;
+	}
+
+	keys4 = kmalloc_array(XLAT_BENCH_KEYS, sizeof(*keys4), GFP_KERNEL);
+	keys6 = kmalloc_array(XLAT_BENCH_KEYS, sizeof(*keys6), GFP_KERNEL);
+	if (!keys4 || !keys6)
+		goto out;
+
+	mutex_lock(&h->xlat.lock);
+
+	step = max_t(u32, h->xlat.map_num / XLAT_BENCH_KEYS, 1);
+	list_for_each_entry(m, &h->xlat.map_list, list) {
+		if (pos++ % step || n == XLAT_BENCH_KEYS)
+			continue;
+		keys4[n] = m->ipv4;
+		keys6[n] = m->ipv6;
+		n++;
+	}
+
+	if (!n) {
+		mutex_unlock(&h->xlat.lock);
+		pr_info("no map to look up\n");
+		goto out;
+	}
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < loops; i++)
+		mtk_ppe_get_xlat_v6_by_v4(&keys4[i % n], &ipv6, &prefix);
+	hash4 = ktime_get_ns() - t0;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < loops; i++)
+		mtk_ppe_get_xlat_v4_by_v6(&keys6[i % n], &ipv4);
+	hash6 = ktime_get_ns() - t0;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < loops; i++)
+		hnat_xlat_list_v6_by_v4(keys4[i % n], &ipv6);
+	list4 = ktime_get_ns() - t0;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < loops; i++)
+		hnat_xlat_list_v4_by_v6(&keys6[i % n], &ipv4);
+	list6 = ktime_get_ns() - t0;
+
+	pr_info("464XLAT lookup: maps=%u loops=%d (ns per lookup)\n",
+		h->xlat.map_num, loops);
+	pr_info("  v4->v6: hash=%llu list=%llu\n",
+		div_u64(hash4, loops), div_u64(list4, loops));
+	pr_info("  v6->v4: hash=%llu list=%llu\n",
+		div_u64(hash6, loops), div_u64(list6, loops));
+
+	mutex_unlock(&h->xlat.lock);
+out:
+	kfree(keys4);
+	kfree(keys6);
+}
+
 static int hnat_xlat_cfg_read(struct seq_file *m, void *private)
 {
 	pr_info("\n464XLAT Config Command Usage:\n");
@@ -2829,8 +3892,13 @@ static int hnat_xlat_cfg_read(struct seq_file *m, void *private)
 	pr_info("echo map add <ipv4> <ipv6> > /sys/kernel/debug/hnat/xlat_cfg\n");
 	pr_info("Delete map :\n");
 	pr_info("echo map del <ipv4> <ipv6> > /sys/kernel/debug/hnat/xlat_cfg\n");
+	pr_info("Delete all maps :\n");
+	pr_info("echo map flush > /sys/kernel/debug/hnat/xlat_cfg\n");
 	pr_info("Show config:\n");
 	pr_info("echo show > /sys/kernel/debug/hnat/xlat_cfg\n");
+	pr_info("Measure lookup cost at the current map size:\n");
+	pr_info("echo bench <loops> > /sys/kernel/debug/hnat/xlat_cfg\n");
+	pr_info("Batch updates: hnatnl xlat add|del|show\n");
 
 	return 0;
 }
@@ -2846,9 +3914,10 @@ static ssize_t hnat_xlat_cfg_write(struct file *file, const char __user *buffer,
 	struct mtk_hnat *h = hnat_priv;
 	int len = count;
 	char buf[256] = {0}, v4_str[64] = {0}, v6_str[64] = {0};
-	struct map46 *map = NULL, *m = NULL, *next = NULL;
+	struct map46 *m = NULL;
 	struct in6_addr ipv6;
 	u32 ipv4;
+	int loops, ret;
 
 	if ((len > 256) || copy_from_user(buf, buffer, len))
 		return -EFAULT;
@@ -2859,7 +3928,9 @@ static ssize_t hnat_xlat_cfg_write(struct file *file, const char __user *buffer,
 			return -1;
 		}
 
+		mutex_lock(&h->xlat.lock);
 		in6_pton(v6_str, -1, (u8 *)&h->xlat.prefix, -1, NULL);
+		mutex_unlock(&h->xlat.lock);
 		pr_info("set prefix = %pI6\n", &h->xlat.prefix);
 	} else if (!strncmp(buf, "pfx_len", 7)) {
 		if (sscanf(buf, "pfx_len %3d", &h->xlat.prefix_len) != 1) {
@@ -2874,23 +3945,21 @@ static ssize_t hnat_xlat_cfg_write(struct file *file, const char __user *buffer,
 			return -1;
 		}
 
-		map = kmalloc(sizeof(struct map46), GFP_KERNEL);
-		if (!map)
-			return -1;
+		in4_pton(v4_str, -1, (u8 *)&ipv4, -1, NULL);
+		in6_pton(v6_str, -1, (u8 *)&ipv6, -1, NULL);
 
-		in4_pton(v4_str, -1, (u8 *)&map->ipv4, -1, NULL);
-		in6_pton(v6_str, -1, (u8 *)&map->ipv6, -1, NULL);
-		list_for_each_entry(m, &h->xlat.map_list, list) {
-			if (ipv6_addr_equal(&map->ipv6, &m->ipv6) &&
-			    map->ipv4 == m->ipv4) {
-				pr_info("this map already added.\n");
-				kfree(map);
-				return -1;
-			}
+		mutex_lock(&h->xlat.lock);
+		ret = hnat_xlat_map_add(ipv4, &ipv6);
+		mutex_unlock(&h->xlat.lock);
+
+		if (ret == -EEXIST) {
+			pr_info("this map already added.\n");
+			return -1;
+		} else if (ret) {
+			return -1;
 		}
 
-		list_add(&map->list, &h->xlat.map_list);
-		pr_info("add map: %pI4<=>%pI6\n", &map->ipv4, &map->ipv6);
+		pr_info("add map: %pI4<=>%pI6\n", &ipv4, &ipv6);
 	} else if (!strncmp(buf, "map del", 7)) {
 		if (sscanf(buf, "map del %64s %64s\n", v4_str, v6_str) != 2) {
 			pr_info("input error\n");
@@ -2900,24 +3969,36 @@ static ssize_t hnat_xlat_cfg_write(struct file *file, const char __user *buffer,
 		in4_pton(v4_str, -1, (u8 *)&ipv4, -1, NULL);
 		in6_pton(v6_str, -1, (u8 *)&ipv6, -1, NULL);
 
-		list_for_each_entry_safe(m, next, &h->xlat.map_list, list) {
-			if (ipv6_addr_equal(&ipv6, &m->ipv6) &&
-			    ipv4 == m->ipv4) {
-				list_del(&m->list);
-				kfree(m);
-				pr_info("del map: %s<=>%s\n", v4_str, v6_str);
-				return len;
-			}
+		mutex_lock(&h->xlat.lock);
+		ret = hnat_xlat_map_del(ipv4, &ipv6);
+		mutex_unlock(&h->xlat.lock);
+
+		if (!ret) {
+			pr_info("del map: %s<=>%s\n", v4_str, v6_str);
+			return len;
 		}
 
 		pr_info("not found map: %s<=>%s\n", v4_str, v6_str);
+	} else if (!strncmp(buf, "map flush", 9)) {
+		mutex_lock(&h->xlat.lock);
+		hnat_xlat_map_flush();
+		mutex_unlock(&h->xlat.lock);
+		pr_info("del all maps\n");
 	} else if (!strncmp(buf, "show", 4)) {
+		mutex_lock(&h->xlat.lock);
 		pr_info("prefix=%pI6\n", &h->xlat.prefix);
 		pr_info("prefix_len=%d\n", h->xlat.prefix_len);
+		pr_info("maps=%u\n", h->xlat.map_num);
 
 		list_for_each_entry(m, &h->xlat.map_list, list) {
 			pr_info("map: %pI4<=>%pI6\n", &m->ipv4, &m->ipv6);
 		}
+		mutex_unlock(&h->xlat.lock);
+	} else if (!strncmp(buf, "bench", 5)) {
+		if (sscanf(buf, "bench %d", &loops) != 1)
+			loops = 100000;
+
+		hnat_xlat_bench(loops);
 	} else {
 		pr_info("input error\n");
 		return -1;
@@ -2977,10 +4058,8 @@ static int hnat_qos_toggle_open(struct inode *inode, struct file *file)
 
 void hnat_qos_shaper_ebl(u32 id, u32 enable)
 {
-	struct mtk_hnat *h = hnat_priv;
 	u32 cfg;
 
-	cr_set_field(h->fe_base + QDMA_PAGE, QTX_CFG_PAGE, (id / NUM_OF_Q_PER_PAGE));
 	if (enable) {
 		cfg = QTX_SCH_MIN_RATE_EN | QTX_SCH_MAX_RATE_EN;
 		cfg |= (1 << QTX_SCH_MIN_RATE_MAN_OFFSET) |
@@ -2989,37 +4068,34 @@ void hnat_qos_shaper_ebl(u32 id, u32 enable)
 		       (5 << QTX_SCH_MAX_RATE_EXP_OFFSET) |
 		       (4 << QTX_SCH_MAX_RATE_WGHT_OFFSET);
 
-		writel(cfg, h->fe_base + QTX_SCH(id % NUM_OF_Q_PER_PAGE));
+		hnat_qtx_sch_write(id, cfg);
 	} else {
-		writel(0, h->fe_base + QTX_SCH(id % NUM_OF_Q_PER_PAGE));
+		hnat_qtx_sch_write(id, 0);
 	}
 }
 
 static void hnat_qos_disable(void)
 {
 	struct mtk_hnat *h = hnat_priv;
-	u32 id, cfg;
+	u32 id;
 
 	for (id = 0; id < MAX_PPPQ_PORT_NUM; id++) {
 		hnat_qos_shaper_ebl(id, 0);
-		writel((4 << QTX_CFG_HW_RESV_CNT_OFFSET) |
-		       (4 << QTX_CFG_SW_RESV_CNT_OFFSET),
-		       h->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
+		spin_lock_bh(&qos_lock);
+		__hnat_qtx_resv_write(id, 4);
+		spin_unlock_bh(&qos_lock);
 	}
 
-	cfg = (QDMA_TX_SCH_WFQ_EN) | (QDMA_TX_SCH_WFQ_EN << 16);
-	for (id = 0; id < h->data->num_of_sch; id += 2) {
-		if (h->data->num_of_sch == 4)
-			writel(cfg, h->fe_base + QDMA_TX_4SCH_BASE(id));
-		else
-			writel(cfg, h->fe_base + QDMA_TX_2SCH_BASE);
-	}
+	spin_lock_bh(&qos_lock);
+	for (id = 0; id < h->data->num_of_sch; id++)
+		__hnat_qdma_sch_write(id, QDMA_TX_SCH_WFQ_EN);
+	spin_unlock_bh(&qos_lock);
 }
 
 static void hnat_qos_pppq_enable(void)
 {
 	struct mtk_hnat *h = hnat_priv;
-	u32 id, cfg;
+	u32 id;
 
 	for (id = 0; id < MAX_PPPQ_PORT_NUM; id++) {
 		if (hook_toggle)
@@ -3027,18 +4103,15 @@ static void hnat_qos_pppq_enable(void)
 		else
 			hnat_qos_shaper_ebl(id, 0);
 
-		writel((4 << QTX_CFG_HW_RESV_CNT_OFFSET) |
-		       (4 << QTX_CFG_SW_RESV_CNT_OFFSET),
-		       h->fe_base + QTX_CFG(id % NUM_OF_Q_PER_PAGE));
+		spin_lock_bh(&qos_lock);
+		__hnat_qtx_resv_write(id, 4);
+		spin_unlock_bh(&qos_lock);
 	}
 
-	cfg = (QDMA_TX_SCH_WFQ_EN) | (QDMA_TX_SCH_WFQ_EN << 16);
-	for (id = 0; id < h->data->num_of_sch; id+= 2) {
-		if (h->data->num_of_sch == 4)
-                        writel(cfg, h->fe_base + QDMA_TX_4SCH_BASE(id));
-                else
-                        writel(cfg, h->fe_base + QDMA_TX_2SCH_BASE);
-	}
+	spin_lock_bh(&qos_lock);
+	for (id = 0; id < h->data->num_of_sch; id++)
+		__hnat_qdma_sch_write(id, QDMA_TX_SCH_WFQ_EN);
+	spin_unlock_bh(&qos_lock);
 }
 
 static ssize_t hnat_qos_toggle_write(struct file *file, const char __user *buffer,
@@ -3135,38 +4208,86 @@ static const struct file_operations hnat_version_fops = {
 
 u32 hnat_get_ppe_hash(struct foe_entry *entry)
 {
-	u32 hv1 = 0, hv2 = 0, hv3 = 0, hash = 0;
+	u32 sip[4], dip[4];
 
 	switch (entry->bfib1.pkt_type) {
 	case IPV4_HNAPT:
 	case IPV4_HNAT:
 	case IPV4_DSLITE:
-		hv1 = entry->ipv4_hnapt.sport << 16 | entry->ipv4_hnapt.dport;
-		hv2 = entry->ipv4_hnapt.dip;
-		hv3 = entry->ipv4_hnapt.sip;
-		break;
+		return hnat_ppe_hash_ipv4(entry->ipv4_hnapt.sip,
+					  entry->ipv4_hnapt.dip,
+					  entry->ipv4_hnapt.sport,
+					  entry->ipv4_hnapt.dport,
+					  hnat_priv->foe_etry_num);
 	case IPV6_3T_ROUTE:
 	case IPV6_5T_ROUTE:
 	case IPV6_6RD:
-		hv1 = entry->ipv6_5t_route.ipv6_sip3 ^
-			  entry->ipv6_5t_route.ipv6_dip3;
-		hv1 ^= entry->ipv6_5t_route.sport << 16 |
-			   entry->ipv6_5t_route.dport;
-		hv2 = entry->ipv6_5t_route.ipv6_sip2 ^
-			  entry->ipv6_5t_route.ipv6_dip2;
-		hv2 ^= entry->ipv6_5t_route.ipv6_dip0;
-		hv3 = entry->ipv6_5t_route.ipv6_sip1 ^
-			  entry->ipv6_5t_route.ipv6_dip1;
-		hv3 ^= entry->ipv6_5t_route.ipv6_sip0;
-		break;
+		sip[0] = entry->ipv6_5t_route.ipv6_sip0;
+		sip[1] = entry->ipv6_5t_route.ipv6_sip1;
+		sip[2] = entry->ipv6_5t_route.ipv6_sip2;
+		sip[3] = entry->ipv6_5t_route.ipv6_sip3;
+		dip[0] = entry->ipv6_5t_route.ipv6_dip0;
+		dip[1] = entry->ipv6_5t_route.ipv6_dip1;
+		dip[2] = entry->ipv6_5t_route.ipv6_dip2;
+		dip[3] = entry->ipv6_5t_route.ipv6_dip3;
+		return hnat_ppe_hash_ipv6(sip, dip,
+					  entry->ipv6_5t_route.sport,
+					  entry->ipv6_5t_route.dport,
+					  hnat_priv->foe_etry_num);
+	}
+
+	return 0;
+}
+
+/* Write a static entry into the FOE table. A hash of -1 is computed from
+ * the tuple. Returns the index used or a negative errno. Caller holds
+ * entry_lock.
+ */
+int hnat_static_entry_bind(struct foe_entry *entry, int hash, u32 *ppe)
+{
+	struct foe_entry *foe;
+	u32 ppe_id = 0;
+	int coll = 0;
+
+	if (hash == -1)
+		hash = hnat_get_ppe_hash(entry);
+
+	if (hash < 0 || hash >= (int)hnat_priv->foe_etry_num)
+		return -EINVAL;
+
+#if defined(CONFIG_MEDIATEK_NETSYS_V3)
+	if (CFG_PPE_NUM == 3) {
+		switch (entry->ipv4_hnapt.bfib1.sp) {
+		case NR_GMAC1_PORT:
+			ppe_id = 0;
+			break;
+		case NR_GMAC2_PORT:
+			ppe_id = 1;
+			break;
+		case NR_GMAC3_PORT:
+			ppe_id = 2;
+			break;
+		default:
+			break;
+		}
 	}
+#endif
+
+	foe = &hnat_priv->foe_table_cpu[ppe_id][hash];
+	while ((foe->ipv4_hnapt.bfib1.state == BIND) && (coll < 4) &&
+	       (hash + 1 < (int)hnat_priv->foe_etry_num)) {
+		hash++;
+		coll++;
+		foe = &hnat_priv->foe_table_cpu[ppe_id][hash];
+	};
+
+	hnat_entry_state_reset(ppe_id, hash);
+
+	/* We must ensure all info has been updated before set to hw */
+	wmb();
+	memcpy(foe, entry, sizeof(*entry));
 
-	hash = (hv1 & hv2) | ((~hv1) & hv3);
-	hash = (hash >> 24) | ((hash & 0xffffff) << 8);
-	hash ^= hv1 ^ hv2 ^ hv3;
-	hash ^= hash >> 16;
-	hash <<= 2;
-	hash &= hnat_priv->foe_etry_num - 1;
+	*ppe = ppe_id;
 
 	return hash;
 }
@@ -3217,9 +4338,9 @@ static ssize_t hnat_static_entry_write(struct file *file,
 				       const char __user *buffer,
 				       size_t count, loff_t *data)
 {
-	struct foe_entry *foe, entry = { 0 };
+	struct foe_entry entry = { 0 };
 	char buf[256], dmac_str[18], smac_str[18], dmac[6], smac[6];
-	int len = count, hash, coll = 0;
+	int len = count, hash;
 	u32 ppe_id = 0;
 #if defined(CONFIG_MEDIATEK_NETSYS_V3)
 	u32 tport_id, tops_entry, cdrt_id;
@@ -3364,37 +4485,11 @@ static ssize_t hnat_static_entry_write(struct file *file,
 		entry.ipv6_5t_route.smac_lo = swab16(*((u16 *)&smac[4]));
 	}
 
-	if (hash == -1)
-		hash = hnat_get_ppe_hash(&entry);
-
-#if defined(CONFIG_MEDIATEK_NETSYS_V3)
-	if (CFG_PPE_NUM == 3) {
-		switch (entry.ipv4_hnapt.bfib1.sp) {
-		case NR_GMAC1_PORT:
-			ppe_id = 0;
-			break;
-		case NR_GMAC2_PORT:
-			ppe_id = 1;
-			break;
-		case NR_GMAC3_PORT:
-			ppe_id = 2;
-			break;
-		default:
-			break;
-		}
-	}
-#endif
-
-	foe = &hnat_priv->foe_table_cpu[ppe_id][hash];
-	while ((foe->ipv4_hnapt.bfib1.state == BIND) && (coll < 4)) {
-		hash++;
-		coll++;
-		foe = &hnat_priv->foe_table_cpu[ppe_id][hash];
-	};
-
-	/* We must ensure all info has been updated before set to hw */
-	wmb();
-	memcpy(foe, &entry, sizeof(entry));
+	spin_lock_bh(&hnat_priv->entry_lock);
+	hash = hnat_static_entry_bind(&entry, hash, &ppe_id);
+	spin_unlock_bh(&hnat_priv->entry_lock);
+	if (hash < 0)
+		return hash;
 
 	debug_level = 7;
 	entry_detail(ppe_id, hash);
@@ -3571,6 +4666,16 @@ int hnat_init_debugfs(struct mtk_hnat *h)
 			    &hnat_xlat_toggle_fops);
 	debugfs_create_file("xlat_cfg", 0444, root, h,
 			    &hnat_xlat_cfg_fops);
+	debugfs_create_file("mib_acct", 0444, root, h,
+			    &hnat_mib_acct_fops);
+	debugfs_create_file("foe_scan", 0444, root, h,
+			    &hnat_foe_scan_fops);
+	debugfs_create_file("foe_evict", 0444, root, h,
+			    &hnat_foe_evict_fops);
+	debugfs_create_file("bind_rate", 0444, root, h,
+			    &hnat_bind_rate_fops);
+	debugfs_create_file("offload_stats", 0444, root, h,
+			    &hnat_offload_stats_fops);
 
 	for (i = 0; i < hnat_priv->data->num_of_sch; i++) {
 		ret = snprintf(name, sizeof(name), "qdma_sch%ld", i);
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (c) 2023 MediaTek Inc.
+ */
+
+#ifndef NF_HNAT_HASH_H
+#define NF_HNAT_HASH_H
+
+#include <linux/types.h>
+
+/* Software copy of the PPE FOE hash (HASH_MODE_1) shared by the driver and
+ * the host-side hash simulator, so keep it free of kernel-only helpers.
+ * All tuple words are in host byte order, as stored in struct foe_entry.
+ *
+ * The result is the first index of a 4-way bucket; the hardware and the
+ * static bind path try the following three entries on collision.
+ */
+#define HNAT_HASH_WAYS		4
+
+static inline __u32 hnat_ppe_hash_calc(__u32 hv1, __u32 hv2, __u32 hv3,
+				       __u32 foe_etry_num)
+{
+	__u32 hash;
+
+	hash = (hv1 & hv2) | ((~hv1) & hv3);
+	hash = (hash >> 24) | ((hash & 0xffffff) << 8);
+	hash ^= hv1 ^ hv2 ^ hv3;
+	hash ^= hash >> 16;
+	hash <<= 2;
+	hash &= foe_etry_num - 1;
+
+	return hash;
+}
+
+/* IPV4_HNAPT, IPV4_HNAT and IPV4_DSLITE */
+static inline __u32 hnat_ppe_hash_ipv4(__u32 sip, __u32 dip, __u16 sport,
+				       __u16 dport, __u32 foe_etry_num)
+{
+	return hnat_ppe_hash_calc((__u32)sport << 16 | dport, dip, sip,
+				  foe_etry_num);
+}
+
+/* IPV6_3T_ROUTE, IPV6_5T_ROUTE and IPV6_6RD; sip[0]/dip[0] are the most
+ * significant words.
+ */
+static inline __u32 hnat_ppe_hash_ipv6(const __u32 *sip, const __u32 *dip,
+				       __u16 sport, __u16 dport,
+				       __u32 foe_etry_num)
+{
+	__u32 hv1, hv2, hv3;
+
+	hv1 = sip[3] ^ dip[3];
+	hv1 ^= (__u32)sport << 16 | dport;
+	hv2 = sip[2] ^ dip[2];
+	hv2 ^= dip[0];
+	hv3 = sip[1] ^ dip[1];
+	hv3 ^= sip[0];
+
+	return hnat_ppe_hash_calc(hv1, hv2, hv3, foe_etry_num);
+}
+
+#endif /* NF_HNAT_HASH_H */
@@ -13,43 +13,16 @@
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/if_bridge.h>
+#include <asm/unaligned.h>
 #include "hnat.h"
 
-/* *
- * mcast_entry_get - Returns the index of an unused entry
- * or an already existed entry in mtbl
- */
-static int mcast_entry_get(u16 vlan_id, u32 dst_mac)
-{
-	int index = -1;
-	u8 i;
-	struct ppe_mcast_group *p = hnat_priv->pmcast->mtbl;
-	u8 max = hnat_priv->pmcast->max_entry;
-
-	for (i = 0; i < max; i++) {
-		if ((index == -1) && (!p->valid)) {
-			index = i; /*get the first unused entry index*/
-			continue;
-		}
-		if ((p->vid == vlan_id) && (p->mac_hi == dst_mac)) {
-			index = i;
-			break;
-		}
-		p++;
-	}
-	if (index == -1)
-		pr_info("%s:group table is full\n", __func__);
-
-	return index;
-}
-
 static void get_mac_from_mdb_entry(struct br_mdb_entry *entry,
 				   u32 *mac_hi, u16 *mac_lo)
 {
 	switch (ntohs(entry->addr.proto)) {
 	case ETH_P_IP:
 		*mac_lo = 0x0100;
-		*mac_hi = swab32((entry->addr.u.ip4 & 0xfffffe00) + 0x5e);
+		*mac_hi = (ntohl(entry->addr.u.ip4) & 0x7fffff) | 0x5e000000;
 		break;
 	case ETH_P_IPV6:
 		*mac_lo = 0x3333;
@@ -97,87 +70,268 @@ static int set_hnat_mtbl(struct ppe_mcast_group *group, u32 ppe_id, int index)
 		reg = hnat_priv->fe_base + PPE_MCAST_H_10 + ((index) * 8);
 		writel(mcast_h.u.value, reg);
 		reg = hnat_priv->fe_base + PPE_MCAST_L_10 + ((index) * 8);
-		writel(mcast_h.u.value, reg);
+		writel(mcast_l.addr, reg);
 	}
 
 	return 0;
 }
 
+static inline u32 mcast_group_key(u32 mac_hi, u16 mac_lo)
+{
+	return mac_hi ^ mac_lo;
+}
+
+static struct ppe_mcast_group *mcast_group_find(struct ppe_mcast_table *pmcast,
+						u16 vlan_id, u32 mac_hi,
+						u16 mac_lo)
+{
+	struct ppe_mcast_group *p;
+
+	hash_for_each_possible(pmcast->group_hash, p, node,
+			       mcast_group_key(mac_hi, mac_lo)) {
+		if (p->vid == vlan_id && p->mac_hi == mac_hi &&
+		    p->mac_lo == mac_lo)
+			return p;
+	}
+	return NULL;
+}
+
+/* *
+ * mcast_entry_get - Returns the index of an already existed entry
+ * or of a newly claimed unused entry in mtbl
+ */
+static int mcast_entry_get(struct ppe_mcast_table *pmcast, u16 vlan_id,
+			   u32 mac_hi, u16 mac_lo)
+{
+	struct ppe_mcast_group *p;
+	int index;
+
+	p = mcast_group_find(pmcast, vlan_id, mac_hi, mac_lo);
+	if (p)
+		return p - pmcast->mtbl;
+
+	index = find_first_zero_bit(pmcast->used, pmcast->max_entry);
+	if (index >= pmcast->max_entry) {
+		pmcast->stats.table_full++;
+		pr_info_ratelimited("%s:group table is full\n", __func__);
+		return -1;
+	}
+
+	p = &pmcast->mtbl[index];
+	p->mac_hi = mac_hi;
+	p->mac_lo = mac_lo;
+	p->vid = vlan_id;
+	p->join_ns = ktime_get_ns();
+	set_bit(index, pmcast->used);
+	hash_add(pmcast->group_hash, &p->node, mcast_group_key(mac_hi, mac_lo));
+
+	return index;
+}
+
+static struct hnat_mcast_port *mcast_port_find(struct ppe_mcast_group *group,
+					       int ifindex)
+{
+	struct hnat_mcast_port *port;
+
+	list_for_each_entry(port, &group->ports, list) {
+		if (port->ifindex == ifindex)
+			return port;
+	}
+	return NULL;
+}
+
+static bool mcast_foe_bound(struct foe_entry *entry)
+{
+	if (entry->bfib1.state != BIND)
+		return false;
+
+	if (IS_IPV4_GRP(entry))
+		return entry->ipv4_hnapt.iblk2.mcast;
+
+	return entry->ipv6_5t_route.iblk2.mcast;
+}
+
+/* Unbind the FOE entry of a flow; returns true if the cache needs a flush */
+static bool mcast_flow_clear(struct hnat_mcast_flow *flow)
+{
+	struct foe_entry *entry;
+	bool cleared = false;
+
+	entry = hnat_priv->foe_table_cpu[flow->ppe_id] + flow->index;
+
+	spin_lock(&hnat_priv->entry_lock);
+	if (mcast_foe_bound(entry)) {
+		memset(entry, 0, sizeof(*entry));
+		cleared = true;
+	}
+	spin_unlock(&hnat_priv->entry_lock);
+
+	return cleared;
+}
+
+static void mcast_flow_free(struct hnat_mcast_flow *flow, u32 *flow_num)
+{
+	list_del(&flow->list);
+	(*flow_num)--;
+	kfree(flow);
+}
+
+/* Drop a group nobody listens to any more, together with its bound flows
+ * so that the PPE stops replicating to the ports right away
+ */
+static bool mcast_group_release(struct ppe_mcast_table *pmcast,
+				struct ppe_mcast_group *group)
+{
+	struct hnat_mcast_port *port, *port_n;
+	struct hnat_mcast_flow *flow, *flow_n;
+	bool flush = false;
+
+	list_for_each_entry_safe(port, port_n, &group->ports, list) {
+		list_del(&port->list);
+		kfree(port);
+	}
+
+	list_for_each_entry_safe(flow, flow_n, &group->flows, list) {
+		flush |= mcast_flow_clear(flow);
+		mcast_flow_free(flow, &group->flow_num);
+	}
+
+	hash_del(&group->node);
+	clear_bit(group - pmcast->mtbl, pmcast->used);
+
+	group->mac_hi = 0;
+	group->mac_lo = 0;
+	group->vid = 0;
+	group->mc_port = 0;
+	group->eif = 0;
+	group->oif = 0;
+	group->valid = false;
+	group->hits = 0;
+	group->last_hit = 0;
+	group->join_ns = 0;
+
+	return flush;
+}
+
+/* Write every group touched since the last batch to the PPEs, once */
+static void hnat_mcast_write_dirty(struct ppe_mcast_table *pmcast)
+{
+	int i, index;
+
+	for_each_set_bit(index, pmcast->dirty, pmcast->max_entry) {
+		for (i = 0; i < CFG_PPE_NUM; i++)
+			set_hnat_mtbl(&pmcast->mtbl[index], i, index);
+		pmcast->stats.reg_writes++;
+	}
+	bitmap_zero(pmcast->dirty, MAX_MCAST_ENTRY);
+}
+
 /**
  * hnat_mcast_table_update -
  *	1.get a valid group entry
  *	2.update group info
- *		a.update eif&oif count
+ *		a.take or drop a reference on the port, update eif&oif
+ *		  count when the port joins or leaves for good
  *		b.eif ==0 & oif == 0,delete it from group table
  *		c.oif != 0,set mc forward port to cpu,else do not forward to cpu
- *	3.set the group info to ppe register
+ *	3.mark the group so the batch writes it to ppe register
+ *
+ * Called with pmcast->lock and rcu_read_lock held.
  */
-static int hnat_mcast_table_update(int type, struct br_mdb_entry *entry)
+static int hnat_mcast_table_update(struct ppe_mcast_table *pmcast, int type,
+				   struct br_mdb_entry *entry, bool *flush)
 {
+	struct hnat_mcast_port *port;
+	struct ppe_mcast_group *group;
 	struct net_device *dev;
 	u32 mac_hi = 0;
 	u16 mac_lo = 0;
-	int i, index;
-	struct ppe_mcast_group *group;
+	int index;
 
-	rcu_read_lock();
 	dev = dev_get_by_index_rcu(&init_net, entry->ifindex);
-	if (!dev) {
-		rcu_read_unlock();
+	if (!dev)
 		return -ENODEV;
-	}
-	rcu_read_unlock();
 
 	get_mac_from_mdb_entry(entry, &mac_hi, &mac_lo);
-	index = mcast_entry_get(entry->vid, mac_hi);
-	if (index == -1)
-		return -1;
 
-	group = &hnat_priv->pmcast->mtbl[index];
-	group->mac_hi = mac_hi;
-	group->mac_lo = mac_lo;
 	switch (type) {
 	case RTM_NEWMDB:
-		if (IS_LAN(dev) || IS_WAN(dev))
+		index = mcast_entry_get(pmcast, entry->vid, mac_hi, mac_lo);
+		if (index == -1)
+			return -1;
+
+		group = &pmcast->mtbl[index];
+		port = mcast_port_find(group, entry->ifindex);
+		if (port) {
+			/* e.g. two IPv4 groups sharing one MAC */
+			port->ref++;
+			return 0;
+		}
+
+		port = kzalloc(sizeof(*port), GFP_ATOMIC);
+		if (!port) {
+			if (list_empty(&group->ports))
+				*flush |= mcast_group_release(pmcast, group);
+			return -ENOMEM;
+		}
+
+		port->ifindex = entry->ifindex;
+		port->ref = 1;
+		port->eth = IS_LAN(dev) || IS_WAN(dev);
+		list_add_tail(&port->list, &group->ports);
+		if (port->eth)
 			group->eif++;
 		else
 			group->oif++;
-		group->vid = entry->vid;
 		group->valid = true;
 		break;
 	case RTM_DELMDB:
-		if (group->valid) {
-			if (IS_LAN(dev) || IS_WAN(dev))
-				group->eif--;
-			else
-				group->oif--;
-			}
+		group = mcast_group_find(pmcast, entry->vid, mac_hi, mac_lo);
+		if (!group)
+			return 0;
+
+		index = group - pmcast->mtbl;
+		port = mcast_port_find(group, entry->ifindex);
+		if (!port || --port->ref)
+			return 0;
+
+		if (port->eth)
+			group->eif--;
+		else
+			group->oif--;
+		list_del(&port->list);
+		kfree(port);
 		break;
+	default:
+		return 0;
 	}
 	if (debug_level >= 7)
 		trace_printk("%s:devname=%s,eif=%d,oif=%d\n", __func__,
 			     dev->name, group->eif, group->oif);
-	if (group->valid) {
-		if (group->oif && group->eif)
-			/*eth&wifi both in group,forward to cpu&GDMA1*/
-			group->mc_port = (MCAST_TO_PDMA || MCAST_TO_GDMA1);
-		else if (group->oif)
-			/*only wifi in group,forward to cpu only*/
-			group->mc_port = MCAST_TO_PDMA;
-		else
-			/*only eth in group,forward to GDMA1 only*/
-			group->mc_port = MCAST_TO_GDMA1;
-		if (!group->oif && !group->eif)
-			/*nobody in this group,clear the entry*/
-			memset(group, 0, sizeof(struct ppe_mcast_group));
 
-		for (i = 0; i < CFG_PPE_NUM; i++)
-			set_hnat_mtbl(group, i, index);
-	}
+	if (!group->oif && !group->eif)
+		/*nobody in this group,clear the entry*/
+		*flush |= mcast_group_release(pmcast, group);
+	else if (group->oif && group->eif)
+		/*eth&wifi both in group,forward to cpu&GDMA1*/
+		group->mc_port = (MCAST_TO_PDMA | MCAST_TO_GDMA1);
+	else if (group->oif)
+		/*only wifi in group,forward to cpu only*/
+		group->mc_port = MCAST_TO_PDMA;
+	else
+		/*only eth in group,forward to GDMA1 only*/
+		group->mc_port = MCAST_TO_GDMA1;
+
+	set_bit(index, pmcast->dirty);
 
 	return 0;
 }
 
+/* Apply every MDB entry queued on the socket, then write the touched
+ * groups once, so a burst of joins and leaves costs one register update
+ * per group instead of one per message. The table lock is only held per
+ * entry, the FOE scanner and the bind path must not wait for the drain.
+ */
 static void hnat_mcast_nlmsg_handler(struct work_struct *work)
 {
 	struct sk_buff *skb = NULL;
@@ -187,6 +341,9 @@ static void hnat_mcast_nlmsg_handler(struct work_struct *work)
 	struct br_mdb_entry *entry;
 	struct ppe_mcast_table *pmcast;
 	struct sock *sk;
+	bool flush = false;
+	u64 msgs = 0, mdb_entries = 0;
+	int rem, rem2;
 
 	pmcast = container_of(work, struct ppe_mcast_table, work);
 	sk = pmcast->msock->sk;
@@ -197,33 +354,375 @@ static void hnat_mcast_nlmsg_handler(struct work_struct *work)
 			kfree_skb(skb);
 			continue;
 		}
+		msgs++;
 		bpm = nlmsg_data(nlh);
-		nest = nlmsg_find_attr(nlh, sizeof(bpm), MDBA_MDB);
+		nest = nlmsg_find_attr(nlh, sizeof(*bpm), MDBA_MDB);
 		if (!nest) {
 			kfree_skb(skb);
 			continue;
 		}
-		nest2 = nla_find_nested(nest, MDBA_MDB_ENTRY);
-		if (nest2) {
-			info = nla_find_nested(nest2, MDBA_MDB_ENTRY_INFO);
-			if (!info) {
-				kfree_skb(skb);
+		nla_for_each_nested(nest2, nest, rem) {
+			if (nla_type(nest2) != MDBA_MDB_ENTRY)
 				continue;
-			}
 
-			entry = (struct br_mdb_entry *)nla_data(info);
-			if (debug_level >= 7) {
-				trace_printk("%s:cmd=0x%2x,ifindex=0x%x,state=0x%x",
-					     __func__, nlh->nlmsg_type,
-					     entry->ifindex, entry->state);
-				trace_printk("vid=0x%x,ip=0x%x,proto=0x%x\n",
-					     entry->vid, entry->addr.u.ip4,
-					     entry->addr.proto);
+			nla_for_each_nested(info, nest2, rem2) {
+				if (nla_type(info) != MDBA_MDB_ENTRY_INFO ||
+				    nla_len(info) < sizeof(*entry))
+					continue;
+
+				entry = (struct br_mdb_entry *)nla_data(info);
+				if (debug_level >= 7) {
+					trace_printk("%s:cmd=0x%2x,ifindex=0x%x,state=0x%x",
+						     __func__, nlh->nlmsg_type,
+						     entry->ifindex, entry->state);
+					trace_printk("vid=0x%x,ip=0x%x,proto=0x%x\n",
+						     entry->vid, entry->addr.u.ip4,
+						     entry->addr.proto);
+				}
+				mdb_entries++;
+
+				spin_lock_bh(&pmcast->lock);
+				rcu_read_lock();
+				hnat_mcast_table_update(pmcast, nlh->nlmsg_type,
+							entry, &flush);
+				rcu_read_unlock();
+				spin_unlock_bh(&pmcast->lock);
 			}
-			hnat_mcast_table_update(nlh->nlmsg_type, entry);
 		}
 		kfree_skb(skb);
 	}
+
+	spin_lock_bh(&pmcast->lock);
+	pmcast->stats.msgs += msgs;
+	pmcast->stats.mdb_entries += mdb_entries;
+	pmcast->stats.batches++;
+	hnat_mcast_write_dirty(pmcast);
+	spin_unlock_bh(&pmcast->lock);
+
+	if (flush)
+		hnat_cache_ebl(1);
+}
+
+static void hnat_mcast_fwd_sample(struct ppe_mcast_table *pmcast,
+				  struct ppe_mcast_group *group)
+{
+	struct hnat_mcast_stats *stats = &pmcast->stats;
+	u64 ns;
+
+	if (!group->join_ns)
+		return;
+
+	ns = ktime_get_ns() - group->join_ns;
+	group->join_ns = 0;
+
+	if (!stats->fwd_num || ns < stats->fwd_ns_min)
+		stats->fwd_ns_min = ns;
+	if (ns > stats->fwd_ns_max)
+		stats->fwd_ns_max = ns;
+	stats->fwd_ns_sum += ns;
+	stats->fwd_num++;
+}
+
+/* Track a FOE entry just bound for multicast, keyed by its destination
+ * MAC. The PPE replicates by MAC only, so the first group with that MAC
+ * owns the flow whatever its VLAN.
+ */
+void hnat_mcast_flow_add(u32 ppe_id, u32 index, const u8 *dmac)
+{
+	struct ppe_mcast_table *pmcast = hnat_priv->pmcast;
+	struct ppe_mcast_group *p, *group = NULL;
+	struct hnat_mcast_flow *flow;
+	struct list_head *flows;
+	bool flush = false;
+	u32 *flow_num;
+	u32 mac_hi;
+	u16 mac_lo;
+
+	if (!pmcast)
+		return;
+
+	mac_lo = (dmac[0] << 8) | dmac[1];
+	mac_hi = get_unaligned_be32(&dmac[2]);
+
+	spin_lock_bh(&pmcast->lock);
+	hash_for_each_possible(pmcast->group_hash, p, node,
+			       mcast_group_key(mac_hi, mac_lo)) {
+		if (p->mac_hi == mac_hi && p->mac_lo == mac_lo) {
+			group = p;
+			break;
+		}
+	}
+
+	flows = group ? &group->flows : &pmcast->flows;
+	flow_num = group ? &group->flow_num : &pmcast->flow_num;
+
+	list_for_each_entry(flow, flows, list) {
+		if (flow->ppe_id == ppe_id && flow->index == index)
+			goto out;
+	}
+
+	flow = NULL;
+	if (*flow_num < MCAST_FLOW_MAX)
+		flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow) {
+		/* an untracked flow is never aged nor released with its
+		 * group, so send it back to the CPU instead
+		 */
+		struct hnat_mcast_flow drop = {
+			.ppe_id = ppe_id,
+			.index = index,
+		};
+
+		pmcast->stats.flow_drops++;
+		flush = mcast_flow_clear(&drop);
+		goto out;
+	}
+
+	flow->ppe_id = ppe_id;
+	flow->index = index;
+	flow->m_ts = hnat_priv->foe_table_cpu[ppe_id][index].ipv4_hnapt.m_timestamp;
+	if (hnat_priv->acct[ppe_id])
+		flow->packets = hnat_priv->acct[ppe_id][index].packets;
+	list_add_tail(&flow->list, flows);
+	(*flow_num)++;
+	pmcast->stats.flows++;
+
+	if (group)
+		hnat_mcast_fwd_sample(pmcast, group);
+out:
+	spin_unlock_bh(&pmcast->lock);
+
+	if (flush)
+		hnat_cache_ebl(1);
+}
+
+/* Age up to *budget flows from the head of the list. Each flow visited is
+ * freed or moved to the tail, so the next call carries on where this one
+ * stopped.
+ */
+static u32 hnat_mcast_flows_age(struct ppe_mcast_group *group,
+				struct list_head *flows, u32 *flow_num,
+				u16 foe_ts, u32 *budget)
+{
+	bool manual = hnat_priv->data->version == MTK_HNAT_V1_3;
+	struct hnat_mcast_flow *flow;
+	struct foe_entry *entry;
+	u32 expired = 0, left = *flow_num;
+	u64 packets;
+	u16 m_ts;
+
+	for (; left && *budget; left--, (*budget)--) {
+		flow = list_first_entry(flows, struct hnat_mcast_flow, list);
+		entry = hnat_priv->foe_table_cpu[flow->ppe_id] + flow->index;
+
+		/* unbound or reused by the hardware or another path */
+		if (!mcast_foe_bound(entry)) {
+			mcast_flow_free(flow, flow_num);
+			continue;
+		}
+
+		/* mt7629 should checkout mcast entry life time manualy */
+		if (manual && entry->bfib1.sta == 1 &&
+		    hnat_mcast_entry_expired(entry, foe_ts)) {
+			if (mcast_flow_clear(flow))
+				expired++;
+			mcast_flow_free(flow, flow_num);
+			continue;
+		}
+
+		list_move_tail(&flow->list, flows);
+		if (!group)
+			continue;
+
+		/* count hits from the MIB when it is read, else from the
+		 * keepalive timestamp the hardware hits refresh
+		 */
+		if (hnat_priv->acct[flow->ppe_id]) {
+			packets = hnat_priv->acct[flow->ppe_id][flow->index].packets;
+			if (packets > flow->packets) {
+				group->hits += packets - flow->packets;
+				group->last_hit = jiffies;
+			}
+			flow->packets = packets;
+		} else {
+			m_ts = entry->ipv4_hnapt.m_timestamp;
+			if (m_ts != flow->m_ts) {
+				group->hits++;
+				group->last_hit = jiffies;
+			}
+			flow->m_ts = m_ts;
+		}
+	}
+
+	return expired;
+}
+
+/* Visit only the FOE entries bound for multicast, called from the FOE
+ * scanner. At most MCAST_AGE_BUDGET flows are aged per call, resuming from
+ * the group where the last call ran out. Returns the number of expired
+ * entries, which need a cache flush.
+ */
+u32 hnat_mcast_age(u16 foe_ts)
+{
+	struct ppe_mcast_table *pmcast = hnat_priv->pmcast;
+	u32 expired = 0, budget = MCAST_AGE_BUDGET;
+	struct ppe_mcast_group *group;
+	u32 index, n;
+
+	if (!pmcast)
+		return 0;
+
+	spin_lock(&pmcast->lock);
+	index = pmcast->age_next;
+	if (index > pmcast->max_entry)
+		index = 0;
+
+	/* index max_entry stands for the flows without a known group */
+	for (n = 0; n <= pmcast->max_entry; n++) {
+		if (index == pmcast->max_entry) {
+			expired += hnat_mcast_flows_age(NULL, &pmcast->flows,
+							&pmcast->flow_num,
+							foe_ts, &budget);
+		} else if (test_bit(index, pmcast->used)) {
+			group = &pmcast->mtbl[index];
+			expired += hnat_mcast_flows_age(group, &group->flows,
+							&group->flow_num,
+							foe_ts, &budget);
+		}
+
+		if (!budget)
+			break;
+		index = index < pmcast->max_entry ? index + 1 : 0;
+	}
+	pmcast->age_next = index;
+	pmcast->stats.expired += expired;
+	spin_unlock(&pmcast->lock);
+
+	return expired;
+}
+
+void hnat_mcast_group_dump(struct seq_file *m)
+{
+	struct ppe_mcast_table *pmcast = hnat_priv->pmcast;
+	struct hnat_mcast_stats *stats;
+	struct ppe_mcast_group *group;
+	struct hnat_mcast_port *port;
+	int index;
+
+	if (!pmcast)
+		return;
+
+	spin_lock_bh(&pmcast->lock);
+	stats = &pmcast->stats;
+	seq_printf(m, "groups=%d/%u orphan_flows=%u\n",
+		   bitmap_weight(pmcast->used, pmcast->max_entry),
+		   pmcast->max_entry, pmcast->flow_num);
+	seq_printf(m, "msgs=%llu mdb_entries=%llu batches=%llu reg_writes=%llu table_full=%llu\n",
+		   stats->msgs, stats->mdb_entries, stats->batches,
+		   stats->reg_writes, stats->table_full);
+	seq_printf(m, "flows=%llu flow_drops=%llu expired=%llu\n",
+		   stats->flows, stats->flow_drops, stats->expired);
+	if (stats->fwd_num)
+		seq_printf(m, "join_to_bind: samples=%llu min=%lluus avg=%lluus max=%lluus\n",
+			   stats->fwd_num, div_u64(stats->fwd_ns_min, 1000),
+			   div_u64(div64_u64(stats->fwd_ns_sum, stats->fwd_num),
+				   1000),
+			   div_u64(stats->fwd_ns_max, 1000));
+
+	for_each_set_bit(index, pmcast->used, pmcast->max_entry) {
+		group = &pmcast->mtbl[index];
+		seq_printf(m, "[%d] %04x%08x vid=%u port=%x eif=%u oif=%u flows=%u hits=%llu idle=%ums ifindex:",
+			   index, group->mac_lo, group->mac_hi, group->vid,
+			   group->mc_port, group->eif, group->oif,
+			   group->flow_num, group->hits,
+			   group->last_hit ?
+			   jiffies_to_msecs(jiffies - group->last_hit) : 0);
+		list_for_each_entry(port, &group->ports, list)
+			seq_printf(m, " %d(%u)", port->ifindex, port->ref);
+		seq_puts(m, "\n");
+	}
+	spin_unlock_bh(&pmcast->lock);
+}
+
+/* Channel zapping: one eth listener leaves a group and joins the next.
+ * Times the MDB update plus the PPE table write per zap, written after
+ * every zap and then batched per round of groups. Uses 239.255.255.x
+ * groups on the LAN device and removes them afterwards.
+ */
+void hnat_mcast_bench(int groups, int loops)
+{
+	struct ppe_mcast_table *pmcast = hnat_priv->pmcast;
+	struct br_mdb_entry entry = { 0 };
+	struct net_device *dev;
+	u64 t0, single = 0, batch = 0, writes;
+	bool flush = false;
+	int i, pass, free;
+
+	if (!pmcast) {
+		pr_info("multicast offload is not enabled\n");
+		return;
+	}
+
+	if (loops <= 0 || loops > 100000) {
+		pr_info("input error\n");
+		return;
+	}
+
+	dev = dev_get_by_name(&init_net, hnat_priv->lan);
+	if (!dev) {
+		pr_info("no lan device %s\n", hnat_priv->lan);
+		return;
+	}
+
+	spin_lock_bh(&pmcast->lock);
+	free = pmcast->max_entry - bitmap_weight(pmcast->used,
+						 pmcast->max_entry);
+	spin_unlock_bh(&pmcast->lock);
+	if (groups < 2 || groups > free || groups > 255) {
+		pr_info("groups must be 2..%d\n", min(free, 255));
+		goto out;
+	}
+
+	entry.ifindex = dev->ifindex;
+	entry.addr.proto = htons(ETH_P_IP);
+
+	for (pass = 0; pass < 2; pass++) {
+		writes = pmcast->stats.reg_writes;
+		t0 = ktime_get_ns();
+		for (i = 0; i <= loops; i++) {
+			spin_lock_bh(&pmcast->lock);
+			rcu_read_lock();
+			if (i) {
+				entry.addr.u.ip4 = htonl(0xefffff00 |
+							 ((i - 1) % groups + 1));
+				hnat_mcast_table_update(pmcast, RTM_DELMDB,
+							&entry, &flush);
+			}
+			if (i < loops) {
+				entry.addr.u.ip4 = htonl(0xefffff00 |
+							 (i % groups + 1));
+				hnat_mcast_table_update(pmcast, RTM_NEWMDB,
+							&entry, &flush);
+			}
+			rcu_read_unlock();
+			if (!pass || !(i % groups) || i == loops)
+				hnat_mcast_write_dirty(pmcast);
+			spin_unlock_bh(&pmcast->lock);
+		}
+		if (!pass)
+			single = ktime_get_ns() - t0;
+		else
+			batch = ktime_get_ns() - t0;
+		pr_info("%s: reg_writes=%llu\n", pass ? "batched" : "single",
+			pmcast->stats.reg_writes - writes);
+	}
+
+	pr_info("mcast zapping: groups=%d loops=%d (ns per zap)\n",
+		groups, loops);
+	pr_info("  single=%llu batched=%llu\n",
+		div_u64(single, loops), div_u64(batch, loops));
+out:
+	dev_put(dev);
 }
 
 static void hnat_mcast_nlmsg_rcv(struct sock *sk)
@@ -261,31 +760,21 @@ out:
 	return NULL;
 }
 
-static void hnat_mcast_check_timestamp(struct timer_list *t)
+bool hnat_mcast_entry_expired(struct foe_entry *entry, u16 foe_ts)
 {
-	struct foe_entry *entry;
-	int i, hash_index;
-	u16 e_ts, foe_ts;
-
-	for (i = 0; i < CFG_PPE_NUM; i++) {
-		for (hash_index = 0; hash_index < hnat_priv->foe_etry_num; hash_index++) {
-			entry = hnat_priv->foe_table_cpu[i] + hash_index;
-			if (entry->bfib1.sta == 1) {
-				e_ts = (entry->ipv4_hnapt.m_timestamp) & 0xffff;
-				foe_ts = foe_timestamp(hnat_priv);
-				if ((foe_ts - e_ts) > 0x3000)
-					foe_ts = (~(foe_ts)) & 0xffff;
-				if (abs(foe_ts - e_ts) > 20)
-					entry_delete(i, hash_index);
-			}
-		}
-	}
-	mod_timer(&hnat_priv->hnat_mcast_check_timer, jiffies + 10 * HZ);
+	u16 e_ts;
+
+	e_ts = (entry->ipv4_hnapt.m_timestamp) & 0xffff;
+	if ((foe_ts - e_ts) > 0x3000)
+		foe_ts = (~(foe_ts)) & 0xffff;
+
+	return abs(foe_ts - e_ts) > 20;
 }
 
 int hnat_mcast_enable(u32 ppe_id)
 {
 	struct ppe_mcast_table *pmcast;
+	int i;
 
 	if (ppe_id >= CFG_PPE_NUM)
 		return -EINVAL;
@@ -299,6 +788,14 @@ int hnat_mcast_enable(u32 ppe_id)
 	else
 		pmcast->max_entry = MAX_MCAST_ENTRY;
 
+	for (i = 0; i < MAX_MCAST_ENTRY; i++) {
+		INIT_LIST_HEAD(&pmcast->mtbl[i].ports);
+		INIT_LIST_HEAD(&pmcast->mtbl[i].flows);
+	}
+	INIT_LIST_HEAD(&pmcast->flows);
+	hash_init(pmcast->group_hash);
+	spin_lock_init(&pmcast->lock);
+
 	INIT_WORK(&pmcast->work, hnat_mcast_nlmsg_handler);
 	pmcast->queue = create_singlethread_workqueue("ppe_mcast");
 	if (!pmcast->queue)
@@ -310,13 +807,9 @@ int hnat_mcast_enable(u32 ppe_id)
 
 	hnat_priv->pmcast = pmcast;
 
-	/* mt7629 should checkout mcast entry life time manualy */
-	if (hnat_priv->data->version == MTK_HNAT_V1_3) {
-		timer_setup(&hnat_priv->hnat_mcast_check_timer,
-			    hnat_mcast_check_timestamp, 0);
-		hnat_priv->hnat_mcast_check_timer.expires = jiffies;
-		add_timer(&hnat_priv->hnat_mcast_check_timer);
-	}
+	/* mt7629 should checkout mcast entry life time manualy,
+	 * which is done by the FOE scanner in hnat.c
+	 */
 
 	/* Enable multicast table lookup */
 	cr_set_field(hnat_priv->ppe_base[ppe_id] + PPE_GLO_CFG, MCAST_TB_EN, 1);
@@ -342,16 +835,29 @@ err1:
 int hnat_mcast_disable(void)
 {
 	struct ppe_mcast_table *pmcast = hnat_priv->pmcast;
+	struct hnat_mcast_port *port, *port_n;
+	struct hnat_mcast_flow *flow, *flow_n;
+	struct ppe_mcast_group *group;
+	int index;
 
 	if (!pmcast)
 		return -EINVAL;
 
-	if (hnat_priv->data->version == MTK_HNAT_V1_3)
-		del_timer_sync(&hnat_priv->hnat_mcast_check_timer);
-
 	flush_work(&pmcast->work);
 	destroy_workqueue(pmcast->queue);
 	sock_release(pmcast->msock);
+	hnat_priv->pmcast = NULL;
+
+	/* the FOE tables may be gone already, only free the bookkeeping */
+	for (index = 0; index < MAX_MCAST_ENTRY; index++) {
+		group = &pmcast->mtbl[index];
+		list_for_each_entry_safe(port, port_n, &group->ports, list)
+			kfree(port);
+		list_for_each_entry_safe(flow, flow_n, &group->flows, list)
+			kfree(flow);
+	}
+	list_for_each_entry_safe(flow, flow_n, &pmcast->flows, list)
+		kfree(flow);
 	kfree(pmcast);
 
 	return 0;
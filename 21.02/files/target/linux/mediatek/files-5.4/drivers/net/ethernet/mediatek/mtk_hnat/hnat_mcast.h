@@ -22,6 +22,29 @@
 #define MCAST_TO_GDMA1 (0x1 << 1)
 #define MCAST_TO_GDMA2 (0x1 << 2)
 
+#define MCAST_GROUP_HASH_BITS 6
+#define MCAST_FLOW_MAX 256
+#define MCAST_AGE_BUDGET 512	/* flows aged per FOE scan tick */
+
+struct seq_file;
+
+/* A bridge port joined to a group, counted once per MDB add */
+struct hnat_mcast_port {
+	struct list_head list;
+	int ifindex;
+	u16 ref;
+	bool eth;
+};
+
+/* A FOE entry bound for a group, aged from here instead of a table walk */
+struct hnat_mcast_flow {
+	struct list_head list;
+	u16 ppe_id;
+	u16 m_ts;	/* last seen keepalive timestamp */
+	u32 index;
+	u64 packets;	/* last seen MIB packet count */
+};
+
 struct ppe_mcast_group {
 	u32 mac_hi; /*multicast mac addr*/
 	u16 mac_lo; /*multicast mac addr*/
@@ -30,6 +53,28 @@ struct ppe_mcast_group {
 	u8 eif; /*num of eth if added to multi group. */
 	u8 oif; /* num of other if added to multi group ,ex wifi.*/
 	bool valid;
+	struct hlist_node node;
+	struct list_head ports;
+	struct list_head flows;
+	u32 flow_num;
+	u64 hits;
+	unsigned long last_hit;
+	u64 join_ns; /* first join, cleared once the group is bound */
+};
+
+struct hnat_mcast_stats {
+	u64 msgs;
+	u64 mdb_entries;
+	u64 batches;
+	u64 reg_writes;
+	u64 table_full;
+	u64 flows;
+	u64 flow_drops;
+	u64 expired;
+	u64 fwd_num;	/* join-to-forward samples */
+	u64 fwd_ns_sum;
+	u64 fwd_ns_min;
+	u64 fwd_ns_max;
 };
 
 struct ppe_mcast_table {
@@ -37,6 +82,14 @@ struct ppe_mcast_table {
 	struct work_struct work;
 	struct socket *msock;
 	struct ppe_mcast_group mtbl[MAX_MCAST_ENTRY];
+	DECLARE_HASHTABLE(group_hash, MCAST_GROUP_HASH_BITS);
+	DECLARE_BITMAP(used, MAX_MCAST_ENTRY);
+	DECLARE_BITMAP(dirty, MAX_MCAST_ENTRY);
+	struct list_head flows;	/* bound without a known group */
+	u32 flow_num;
+	u32 age_next;	/* group to age next, max_entry for flows */
+	struct hnat_mcast_stats stats;
+	spinlock_t lock; /* groups, bitmaps, flow lists and stats */
 	u8 max_entry;
 };
 
@@ -65,5 +118,9 @@ struct ppe_mcast_l {
 
 int hnat_mcast_enable(u32 ppe_id);
 int hnat_mcast_disable(void);
+void hnat_mcast_flow_add(u32 ppe_id, u32 index, const u8 *dmac);
+u32 hnat_mcast_age(u16 foe_ts);
+void hnat_mcast_group_dump(struct seq_file *m);
+void hnat_mcast_bench(int groups, int loops);
 
 #endif
@@ -13,6 +13,8 @@
 
 #include <linux/netfilter_bridge.h>
 #include <linux/netfilter_ipv6.h>
+#include <linux/jhash.h>
+#include <linux/stringhash.h>
 
 #include <net/arp.h>
 #include <net/neighbour.h>
@@ -28,6 +30,7 @@
 
 #include "nf_hnat_mtk.h"
 #include "hnat.h"
+#include "hnat_hash.h"
 
 #include "../mtk_eth_soc.h"
 #include "../mtk_eth_reset.h"
@@ -40,7 +43,7 @@
 	(IS_PPD(dev) &&                                                        \
 	 (skb_hnat_sport(skb) == NR_PDMA_PORT ||                           \
 	  skb_hnat_sport(skb) == NR_QDMA_PORT) &&                       \
-	  ((get_dev_from_index(skb->vlan_tci & VLAN_VID_MASK)) ||   \
+	  (extif_has_index(skb->vlan_tci & VLAN_VID_MASK) ||        \
 		 get_wandev_from_index(skb->vlan_tci & VLAN_VID_MASK)))
 #define do_mape_w2l_fast(dev, skb)                                          \
 		(mape_toggle && IS_WAN(dev) && (!is_from_mape(skb)))
@@ -68,45 +71,90 @@ static inline int get_ext_device_number(void)
 	return number;
 }
 
-static inline int find_extif_from_devname(const char *name)
+static inline u32 extif_name_hash(const char *name)
+{
+	return full_name_hash(NULL, name, strnlen(name, IFNAMSIZ));
+}
+
+/* Called under rcu_read_lock() or with ext_if_lock held */
+static struct extdev_entry *extif_lookup_name(const char *name)
 {
-	int i;
 	struct extdev_entry *ext_entry;
 
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
+	hash_for_each_possible_rcu(hnat_priv->ext_name_hash, ext_entry,
+				   name_node, extif_name_hash(name)) {
 		if (!strcmp(name, ext_entry->name))
-			return 1;
+			return ext_entry;
 	}
-	return 0;
+	return NULL;
+}
+
+static inline int find_extif_from_devname(const char *name)
+{
+	int found;
+
+	rcu_read_lock();
+	found = extif_lookup_name(name) ? 1 : 0;
+	rcu_read_unlock();
+	return found;
 }
 
 static inline int get_index_from_dev(const struct net_device *dev)
 {
-	int i;
 	struct extdev_entry *ext_entry;
+	int index = 0;
 
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
-		if (dev == ext_entry->dev)
-			return ext_entry->dev->ifindex;
+	if (!dev)
+		return 0;
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(hnat_priv->ext_dev_hash, ext_entry,
+				   dev_node, dev->ifindex) {
+		if (READ_ONCE(ext_entry->dev) == dev) {
+			index = dev->ifindex;
+			break;
+		}
 	}
-	return 0;
+	rcu_read_unlock();
+	return index;
 }
 
-static inline struct net_device *get_dev_from_index(int index)
+static inline bool extif_has_index(int index)
 {
-	int i;
 	struct extdev_entry *ext_entry;
-	struct net_device *dev = 0;
+	struct net_device *ext_dev;
+	bool found = false;
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(hnat_priv->ext_dev_hash, ext_entry,
+				   dev_node, index) {
+		ext_dev = READ_ONCE(ext_entry->dev);
+		if (ext_dev && index == ext_dev->ifindex) {
+			found = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return found;
+}
 
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
-		if (ext_entry->dev && index == ext_entry->dev->ifindex) {
-			dev = ext_entry->dev;
+/* Returns the device with a reference held, the caller must dev_put() it */
+static inline struct net_device *get_dev_from_index(int index)
+{
+	struct extdev_entry *ext_entry;
+	struct net_device *dev = NULL, *ext_dev;
+
+	rcu_read_lock();
+	hash_for_each_possible_rcu(hnat_priv->ext_dev_hash, ext_entry,
+				   dev_node, index) {
+		ext_dev = READ_ONCE(ext_entry->dev);
+		if (ext_dev && index == ext_dev->ifindex) {
+			dev = ext_dev;
+			dev_hold(dev);
 			break;
 		}
 	}
+	rcu_read_unlock();
 	return dev;
 }
 
@@ -122,64 +170,94 @@ static inline struct net_device *get_wandev_from_index(int index)
 
 static inline int extif_set_dev(struct net_device *dev)
 {
-	int i;
 	struct extdev_entry *ext_entry;
-
-	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
-		ext_entry = hnat_priv->ext_if[i];
-		if (!strcmp(dev->name, ext_entry->name) && !ext_entry->dev) {
-			dev_hold(dev);
-			ext_entry->dev = dev;
-			pr_info("%s(%s)\n", __func__, dev->name);
-
-			return ext_entry->dev->ifindex;
-		}
+	int index = -1;
+
+	spin_lock(&hnat_priv->ext_if_lock);
+	ext_entry = extif_lookup_name(dev->name);
+	if (ext_entry && !ext_entry->dev) {
+		dev_hold(dev);
+		WRITE_ONCE(ext_entry->dev, dev);
+		hash_add_rcu(hnat_priv->ext_dev_hash, &ext_entry->dev_node,
+			     dev->ifindex);
+		index = dev->ifindex;
 	}
+	spin_unlock(&hnat_priv->ext_if_lock);
 
-	return -1;
+	if (index >= 0)
+		pr_info("%s(%s)\n", __func__, dev->name);
+
+	return index;
 }
 
 static inline int extif_put_dev(struct net_device *dev)
 {
-	int i;
+	int i, ret = -1;
 	struct extdev_entry *ext_entry;
 
+	/* Walk the array rather than the hash, the ifindex may have changed */
+	spin_lock(&hnat_priv->ext_if_lock);
 	for (i = 0; i < MAX_EXT_DEVS && hnat_priv->ext_if[i]; i++) {
 		ext_entry = hnat_priv->ext_if[i];
 		if (ext_entry->dev == dev) {
-			ext_entry->dev = NULL;
-			dev_put(dev);
-			pr_info("%s(%s)\n", __func__, dev->name);
-
-			return 0;
+			hash_del_rcu(&ext_entry->dev_node);
+			WRITE_ONCE(ext_entry->dev, NULL);
+			ret = 0;
+			break;
 		}
 	}
+	spin_unlock(&hnat_priv->ext_if_lock);
 
-	return -1;
+	if (!ret) {
+		/* Let hash walkers that still see the entry take their ref */
+		synchronize_rcu();
+		dev_put(dev);
+		pr_info("%s(%s)\n", __func__, dev->name);
+	}
+
+	return ret;
 }
 
 int ext_if_add(struct extdev_entry *ext_entry)
 {
-	int len = get_ext_device_number();
+	int len;
 
-	if (len < MAX_EXT_DEVS)
+	spin_lock(&hnat_priv->ext_if_lock);
+	len = get_ext_device_number();
+	if (len < MAX_EXT_DEVS) {
 		hnat_priv->ext_if[len++] = ext_entry;
+		hash_add_rcu(hnat_priv->ext_name_hash, &ext_entry->name_node,
+			     extif_name_hash(ext_entry->name));
+		if (ext_entry->dev)
+			hash_add_rcu(hnat_priv->ext_dev_hash,
+				     &ext_entry->dev_node,
+				     ext_entry->dev->ifindex);
+	}
+	spin_unlock(&hnat_priv->ext_if_lock);
 
 	return len;
 }
 
+/* May sleep; the entry can be freed once this returns */
 int ext_if_del(struct extdev_entry *ext_entry)
 {
 	int i, j;
 
+	spin_lock(&hnat_priv->ext_if_lock);
 	for (i = 0; i < MAX_EXT_DEVS; i++) {
 		if (hnat_priv->ext_if[i] == ext_entry) {
 			for (j = i; hnat_priv->ext_if[j] && j < MAX_EXT_DEVS - 1; j++)
 				hnat_priv->ext_if[j] = hnat_priv->ext_if[j + 1];
 			hnat_priv->ext_if[j] = NULL;
+			hash_del_rcu(&ext_entry->name_node);
+			if (ext_entry->dev)
+				hash_del_rcu(&ext_entry->dev_node);
 			break;
 		}
 	}
+	spin_unlock(&hnat_priv->ext_if_lock);
+
+	synchronize_rcu();
 
 	return i;
 }
@@ -287,6 +365,13 @@ static void gmac_ppe_fwd_enable(struct net_device *dev)
 		set_gmac_ppe_fwd(NR_GMAC3_PORT, 1);
 }
 
+/* The ethernet driver sets a QDMA queue speed on the link of these */
+static inline bool hnat_qos_speed_dev(const struct net_device *dev)
+{
+	return IS_LAN_GRP(dev) || IS_WAN(dev) || IS_DSA_LAN(dev) ||
+	       IS_DSA_WAN(dev);
+}
+
 int nf_hnat_netdevice_event(struct notifier_block *unused, unsigned long event,
 			    void *ptr)
 {
@@ -298,10 +383,23 @@ int nf_hnat_netdevice_event(struct notifier_block *unused, unsigned long event,
 	case NETDEV_UP:
 		gmac_ppe_fwd_enable(dev);
 
+		if (IS_LAN_GRP(dev) || IS_WAN(dev))
+			hnat_ppe_mtu_update();
+
 		extif_set_dev(dev);
 
+		if (hnat_qos_speed_dev(dev))
+			hnat_qos_shadow_sync();
+		break;
+	case NETDEV_CHANGEMTU:
+		if (IS_LAN_GRP(dev) || IS_WAN(dev))
+			hnat_ppe_mtu_update();
 		break;
 	case NETDEV_CHANGE:
+		/* The ethernet driver notifier ran first and set the queue speed */
+		if (hnat_qos_speed_dev(dev))
+			hnat_qos_shadow_sync();
+
 		/* Clear PPE entries if the slave of bond device physical link down */
 		if (!netif_is_bond_slave(dev) ||
 		    (!IS_LAN_GRP(dev) && !IS_WAN(dev)))
@@ -520,8 +618,10 @@ unsigned int do_hnat_ext_to_ge2(struct sk_buff *skb, const char *func)
 
 		if (ntohs(eth->h_proto) == ETH_P_8021Q) {
 			skb = skb_vlan_untag(skb);
-			if (unlikely(!skb))
+			if (unlikely(!skb)) {
+				dev_put(dev);
 				return -1;
+			}
 		}
 
 		if (IS_BOND(dev) &&
@@ -536,6 +636,7 @@ unsigned int do_hnat_ext_to_ge2(struct sk_buff *skb, const char *func)
 		set_from_extge(skb);
 		fix_skb_packet_type(skb, skb->dev, eth);
 		netif_rx(skb);
+		dev_put(dev);
 		if (debug_level >= 7)
 			trace_printk("%s: called from %s successfully\n", __func__,
 				     func);
@@ -593,11 +694,15 @@ unsigned int do_hnat_ge_to_ext(struct sk_buff *skb, const char *func)
 
 	if (IS_HQOS_MODE && eth_hdr(skb)->h_proto == HQOS_MAGIC_TAG) {
 		skb = skb_unshare(skb, GFP_ATOMIC);
-		if (!skb)
+		if (!skb) {
+			dev_put(dev);
 			return NF_ACCEPT;
+		}
 
-		if (unlikely(!pskb_may_pull(skb, VLAN_HLEN)))
+		if (unlikely(!pskb_may_pull(skb, VLAN_HLEN))) {
+			dev_put(dev);
 			return NF_ACCEPT;
+		}
 
 		skb_pull_rcsum(skb, VLAN_HLEN);
 
@@ -609,6 +714,7 @@ unsigned int do_hnat_ge_to_ext(struct sk_buff *skb, const char *func)
 		skb_set_network_header(skb, 0);
 		skb_push(skb, ETH_HLEN);
 		dev_queue_xmit(skb);
+		dev_put(dev);
 		if (debug_level >= 7)
 			trace_printk("%s: called from %s successfully\n", __func__,
 				     func);
@@ -866,6 +972,367 @@ static unsigned int is_ppe_support_type(struct sk_buff *skb)
 	return 0;
 }
 
+/* Hash the flow of a packet the PPE found no FOE entry for, the way the
+ * hardware would for an IPv4 HNAPT or IPv6 5T entry, and give it a
+ * signature to tell flows sharing a bucket apart.
+ */
+static int hnat_foe_flow_hash(struct sk_buff *skb, u32 *hash, u32 *sig)
+{
+	struct foe_entry tmp = { 0 };
+	const struct tcpudphdr *pptr;
+	struct tcpudphdr _ports;
+	const struct ipv6hdr *ip6h;
+	const struct iphdr *iph;
+	int protoff;
+
+	switch (ntohs(skb->protocol)) {
+	case ETH_P_IP:
+		iph = ip_hdr(skb);
+		if (ip_is_fragment(iph) ||
+		    (iph->protocol != IPPROTO_TCP &&
+		     iph->protocol != IPPROTO_UDP))
+			return -1;
+
+		protoff = iph->ihl * 4;
+		tmp.bfib1.pkt_type = IPV4_HNAPT;
+		tmp.ipv4_hnapt.sip = ntohl(iph->saddr);
+		tmp.ipv4_hnapt.dip = ntohl(iph->daddr);
+		*sig = jhash_3words(iph->saddr, iph->daddr, iph->protocol, 0);
+		break;
+	case ETH_P_IPV6:
+		ip6h = ipv6_hdr(skb);
+		if (ip6h->nexthdr != NEXTHDR_TCP && ip6h->nexthdr != NEXTHDR_UDP)
+			return -1;
+
+		protoff = sizeof(*ip6h);
+		tmp.bfib1.pkt_type = IPV6_5T_ROUTE;
+		tmp.ipv6_5t_route.ipv6_sip0 = ntohl(ip6h->saddr.s6_addr32[0]);
+		tmp.ipv6_5t_route.ipv6_sip1 = ntohl(ip6h->saddr.s6_addr32[1]);
+		tmp.ipv6_5t_route.ipv6_sip2 = ntohl(ip6h->saddr.s6_addr32[2]);
+		tmp.ipv6_5t_route.ipv6_sip3 = ntohl(ip6h->saddr.s6_addr32[3]);
+		tmp.ipv6_5t_route.ipv6_dip0 = ntohl(ip6h->daddr.s6_addr32[0]);
+		tmp.ipv6_5t_route.ipv6_dip1 = ntohl(ip6h->daddr.s6_addr32[1]);
+		tmp.ipv6_5t_route.ipv6_dip2 = ntohl(ip6h->daddr.s6_addr32[2]);
+		tmp.ipv6_5t_route.ipv6_dip3 = ntohl(ip6h->daddr.s6_addr32[3]);
+		*sig = jhash2(ip6h->saddr.s6_addr32, 4,
+			      jhash2(ip6h->daddr.s6_addr32, 4, ip6h->nexthdr));
+		break;
+	default:
+		return -1;
+	}
+
+	pptr = skb_header_pointer(skb, protoff, sizeof(_ports), &_ports);
+	if (unlikely(!pptr))
+		return -1;
+
+	if (tmp.bfib1.pkt_type == IPV4_HNAPT) {
+		tmp.ipv4_hnapt.sport = ntohs(pptr->src);
+		tmp.ipv4_hnapt.dport = ntohs(pptr->dst);
+	} else {
+		tmp.ipv6_5t_route.sport = ntohs(pptr->src);
+		tmp.ipv6_5t_route.dport = ntohs(pptr->dst);
+	}
+
+	*hash = hnat_get_ppe_hash(&tmp);
+	*sig = jhash_2words(*sig, (u32)ntohs(pptr->src) << 16 | ntohs(pptr->dst), 0);
+
+	return 0;
+}
+
+/* Pick the way of a full bucket that has been idle the longest. Bound ways
+ * must have been idle for idle_min seconds; unbound and FIN ways are below
+ * the bind rate already, so one idle second is enough. Static, multicast
+ * and half-written (locked) ways are never chosen.
+ */
+static int hnat_foe_evict_victim(u32 ppe_id, u32 hash, u32 idle_min)
+{
+	u16 now = foe_timestamp(hnat_priv);
+	u32 idle, min, ts_mask, score, best = 0;
+	struct foe_entry *entry;
+	int i, victim = -1;
+
+	ts_mask = (hnat_priv->data->version == MTK_HNAT_V2 ||
+		   hnat_priv->data->version == MTK_HNAT_V3) ? 0xff : 0x7fff;
+
+	for (i = 0; i < HNAT_HASH_WAYS; i++) {
+		entry = &hnat_priv->foe_table_cpu[ppe_id][hash + i];
+
+		/* a free way is used by hardware on the next miss */
+		if (entry->bfib1.state == INVALID)
+			return -1;
+
+		if (entry->bfib1.sta || is_hnat_entry_locked(entry))
+			continue;
+
+		if (entry->bfib1.state == UNBIND) {
+			idle = (now - entry->udib1.time_stamp) & 0xff;
+			min = 1;
+		} else {
+			idle = (now - entry->bfib1.time_stamp) & ts_mask;
+			min = (entry->bfib1.state == BIND) ? idle_min : 1;
+		}
+
+		if (idle < min)
+			continue;
+
+		score = idle - min + 1;
+		if (score > best) {
+			best = score;
+			victim = hash + i;
+		}
+	}
+
+	return victim;
+}
+
+/* The PPE missed and could not build an entry because every way of the
+ * flow's bucket is in use, so the flow would stay in software for as long
+ * as the bucket stays full. Once the flow reaches the bind rate within one
+ * window, free the most idle way; hardware builds the new entry on a
+ * packet after the next cache flush and the normal bind path takes over
+ * from there.
+ */
+static void hnat_foe_bucket_full(struct sk_buff *skb)
+{
+	struct mtk_hnat *h = hnat_priv;
+	u32 ppe_id = skb_hnat_ppe(skb), hash, sig, rate;
+	struct hnat_evict_stats *stats;
+	struct hnat_evict_cand *cand;
+	struct foe_entry *entry;
+	int victim;
+
+	if (ppe_id >= CFG_PPE_NUM || !h->evict_cand[ppe_id])
+		return;
+
+	stats = &h->evict_stats[ppe_id];
+	stats->bucket_full++;
+
+	if (!h->evict_idle || hnat_foe_flow_hash(skb, &hash, &sig))
+		return;
+
+	if (!spin_trylock(&h->entry_lock)) {
+		stats->busy++;
+		return;
+	}
+
+	cand = &h->evict_cand[ppe_id][hash / HNAT_HASH_WAYS];
+	if (cand->sig != sig ||
+	    time_after(jiffies, cand->start + HNAT_EVICT_WINDOW)) {
+		cand->sig = sig;
+		cand->start = jiffies;
+		cand->pkts = 0;
+	}
+
+	rate = readl(h->ppe_base[ppe_id] + PPE_BNDR) & BIND_RATE;
+	if (++cand->pkts < rate)
+		goto out;
+
+	victim = hnat_foe_evict_victim(ppe_id, hash, h->evict_idle);
+	if (victim < 0) {
+		stats->no_victim++;
+		cand->pkts = 0;
+		goto out;
+	}
+
+	entry = &h->foe_table_cpu[ppe_id][victim];
+	if (entry->bfib1.state == UNBIND)
+		stats->evicted_unbind++;
+	else if (h->data->per_flow_accounting && h->nf_stat_en)
+		/* charge what the victim forwarded before it goes away */
+		hnat_get_count(h, ppe_id, victim, NULL);
+
+	memset(entry, 0, sizeof(*entry));
+	wmb();
+	hnat_cache_flush_defer();
+
+	stats->evicted++;
+	memset(cand, 0, sizeof(*cand));
+
+	if (debug_level >= 7)
+		trace_printk("%s: PPE%u evict entry %d for bucket 0x%x\n",
+			     __func__, ppe_id, victim, hash);
+out:
+	spin_unlock(&h->entry_lock);
+}
+
+static int hnat_unbind_skb_entry(struct sk_buff *skb);
+
+/* A bound flow outgrew the PPE MTU, e.g. after ESP was added on the way
+ * through EIP197. Leave it to the stack, which fragments or updates the
+ * PMTU, until it binds again.
+ */
+static inline void hnat_exceed_mtu_check(struct sk_buff *skb)
+{
+	if (unlikely(skb_hnat_reason(skb) == HIT_BIND_EXCEED_MTU))
+		hnat_unbind_skb_entry(skb);
+}
+
+static inline void hnat_foe_miss_check(struct sk_buff *skb)
+{
+	/* a miss with no entry index means the bucket had no room */
+	if (unlikely(skb_hnat_reason(skb) == UN_HIT &&
+		     skb_hnat_entry(skb) >= hnat_priv->foe_etry_num))
+		hnat_foe_bucket_full(skb);
+}
+
+/* per reason count of the packets the PPE leaves to the CPU */
+static inline void hnat_sw_path_count(struct sk_buff *skb)
+{
+	u32 reason = skb_hnat_reason(skb);
+
+	this_cpu_inc(hnat_priv->sw_stats->packets[reason]);
+	this_cpu_add(hnat_priv->sw_stats->bytes[reason], skb->len);
+}
+
+/* The words after info1 hold the start of the tuple for every packet type,
+ * which is enough to tell that another flow took over the entry.
+ */
+static u32 hnat_rate_sig(struct foe_entry *entry)
+{
+	u32 *w = (u32 *)entry;
+
+	return jhash_3words(w[1], w[2], w[3], entry->bfib1.pkt_type);
+}
+
+/* Average the rate of unbound flows from the HIT_UNBIND and
+ * HIT_UNBIND_RATE_REACH packets the PPE sends to the CPU. A flow turns hot
+ * at bind_pps and cools down below hnat_unbind_pps(). A hot flow is bound
+ * even if the PPE threshold never fires, and RATE_REACH from a flow that is
+ * not hot, i.e. a short burst, goes up the stack unbound. Off with bind_pps
+ * 0. The slot is also written by the bind path, which only holds the entry
+ * lock of the PPE, so it is updated with atomics rather than entry_lock.
+ */
+static void hnat_rate_est_update(struct sk_buff *skb)
+{
+	u32 ppe_id = skb_hnat_ppe(skb), index = skb_hnat_entry(skb);
+	u32 reason = skb_hnat_reason(skb), now = jiffies, elapsed, sample;
+	u32 bind_pps = READ_ONCE(hnat_priv->bind_pps);
+	struct hnat_rate_stats __percpu *stats;
+	struct hnat_rate_est *est;
+	u32 sig, old, last, pkts, rate;
+
+	if (!bind_pps)
+		return;
+
+	if (reason != HIT_UNBIND && reason != HIT_UNBIND_RATE_REACH)
+		return;
+
+	if (ppe_id >= CFG_PPE_NUM || index >= hnat_priv->foe_etry_num ||
+	    !hnat_priv->rate_est[ppe_id])
+		return;
+
+	est = &hnat_priv->rate_est[ppe_id][index];
+	stats = &hnat_priv->sw_stats->rate[ppe_id];
+
+	sig = hnat_rate_sig(&hnat_priv->foe_table_cpu[ppe_id][index]);
+	old = READ_ONCE(est->sig);
+	if (old != sig) {
+		/* lost to another CPU taking over the slot, skip the sample */
+		if (cmpxchg(&est->sig, old, sig) != old)
+			return;
+		WRITE_ONCE(est->rate, 0);
+		WRITE_ONCE(est->bound_at, 0);
+		atomic_set(&est->pkts, 0);
+		atomic_set(&est->flags, 0);
+		WRITE_ONCE(est->last, now);
+		this_cpu_inc(stats->flows);
+	} else if (atomic_fetch_andnot(HNAT_RATE_BOUND, &est->flags) &
+		   HNAT_RATE_BOUND) {
+		/* aged out or evicted while the flow is still running */
+		this_cpu_inc(stats->unbind_active);
+	}
+
+	atomic_inc(&est->pkts);
+
+	last = READ_ONCE(est->last);
+	elapsed = now - last;
+	if (elapsed >= HNAT_RATE_TICK && cmpxchg(&est->last, last, now) == last) {
+		pkts = min_t(u32, atomic_xchg(&est->pkts, 0), U16_MAX);
+		sample = (pkts << HNAT_RATE_FRAC) * HZ / elapsed;
+		rate = READ_ONCE(est->rate);
+		if (!rate)
+			rate = sample;
+		else
+			rate += (sample >> HNAT_RATE_EWMA_SHIFT) -
+				(rate >> HNAT_RATE_EWMA_SHIFT);
+		WRITE_ONCE(est->rate, rate);
+
+		if (rate >= bind_pps << HNAT_RATE_FRAC)
+			atomic_or(HNAT_RATE_HOT, &est->flags);
+		else if (rate < hnat_unbind_pps() << HNAT_RATE_FRAC)
+			atomic_andnot(HNAT_RATE_HOT, &est->flags);
+	}
+
+	if (atomic_read(&est->flags) & HNAT_RATE_HOT) {
+		if (reason == HIT_UNBIND) {
+			skb_hnat_reason(skb) = HIT_UNBIND_RATE_REACH;
+			this_cpu_inc(stats->promoted);
+		}
+	} else if (reason == HIT_UNBIND_RATE_REACH) {
+		skb_hnat_reason(skb) = HIT_UNBIND;
+		this_cpu_inc(stats->deferred);
+	}
+}
+
+static inline void hnat_bind_fail_count(struct sk_buff *skb,
+					enum hnat_bind_fail why)
+{
+	this_cpu_inc(hnat_priv->sw_stats->bind_fail[skb_hnat_ppe(skb)][why]);
+}
+
+/* called right after the entry was written as BIND, with either entry_lock
+ * or the entry lock of the PPE held, so it uses the atomics of the estimator
+ */
+static void hnat_rate_est_bound(struct sk_buff *skb)
+{
+	u32 ppe_id = skb_hnat_ppe(skb), now = jiffies, bound_at;
+	struct hnat_rate_stats __percpu *stats;
+	struct hnat_rate_est *est;
+
+	if (!hnat_priv->rate_est[ppe_id])
+		return;
+
+	est = &hnat_priv->rate_est[ppe_id][skb_hnat_entry(skb)];
+	stats = &hnat_priv->sw_stats->rate[ppe_id];
+
+	this_cpu_inc(stats->binds);
+	bound_at = READ_ONCE(est->bound_at);
+	if (bound_at && now - bound_at < HNAT_REBIND_WINDOW)
+		this_cpu_inc(stats->rebinds);
+
+	if (READ_ONCE(hnat_priv->bind_pps))
+		atomic_or(HNAT_RATE_BOUND, &est->flags);
+	WRITE_ONCE(est->bound_at, now ? now : 1);
+}
+
+/* Forget the accounting, eviction and rate state of an entry that is
+ * rewritten or cleared outside the PPE, so the next flow in the slot does
+ * not inherit it. Counts still in the MIB are charged first. Caller holds
+ * entry_lock.
+ */
+void hnat_entry_state_reset(u32 ppe_id, u32 index)
+{
+	struct mtk_hnat *h = hnat_priv;
+
+	if (ppe_id >= CFG_PPE_NUM || index >= h->foe_etry_num)
+		return;
+
+	if (h->data->per_flow_accounting) {
+		if (h->nf_stat_en &&
+		    h->foe_table_cpu[ppe_id][index].bfib1.state == BIND)
+			hnat_get_count(h, ppe_id, index, NULL);
+		hnat_acct_reset(h, ppe_id, index, NULL, 0);
+	}
+
+	if (h->rate_est[ppe_id])
+		memset(&h->rate_est[ppe_id][index], 0,
+		       sizeof(struct hnat_rate_est));
+
+	if (h->evict_cand[ppe_id])
+		memset(&h->evict_cand[ppe_id][index / HNAT_HASH_WAYS], 0,
+		       sizeof(struct hnat_evict_cand));
+}
+
 static unsigned int
 mtk_hnat_ipv6_nf_pre_routing(void *priv, struct sk_buff *skb,
 			     const struct nf_hook_state *state)
@@ -885,6 +1352,11 @@ mtk_hnat_ipv6_nf_pre_routing(void *priv, struct sk_buff *skb,
 
 	pre_routing_print(skb, state->in, state->out, __func__);
 
+	hnat_sw_path_count(skb);
+	hnat_foe_miss_check(skb);
+	hnat_exceed_mtu_check(skb);
+	hnat_rate_est_update(skb);
+
 	/* packets from external devices -> xxx ,step 1 , learning stage & bound stage*/
 	if (do_ext2ge_fast_try(state->in, skb)) {
 		if (!do_hnat_ext_to_ge(skb, state->in, __func__))
@@ -938,7 +1410,7 @@ static inline void qos_rate_limit_set(u32 id, const struct net_device *dev)
 	u32 max_exp = 5;
 	u32 cfg;
 
-	if (id > MTK_QDMA_TX_NUM)
+	if (id >= MTK_QDMA_TX_NUM)
 		return;
 
 	if (!dev)
@@ -965,7 +1437,9 @@ setup_rate_limit:
 	       (max_man << QTX_SCH_MAX_RATE_MAN_OFFSET) |
 	       (max_exp << QTX_SCH_MAX_RATE_EXP_OFFSET) |
 	       (4 << QTX_SCH_MAX_RATE_WGHT_OFFSET);
-	writel(cfg, hnat_priv->fe_base + QTX_SCH(id % NUM_OF_Q_PER_PAGE));
+
+	/* Always write: the ethernet driver programs QTX_SCH behind the shadow */
+	hnat_qtx_sch_write(id, cfg);
 }
 
 static unsigned int
@@ -1020,6 +1494,11 @@ mtk_hnat_ipv4_nf_pre_routing(void *priv, struct sk_buff *skb,
 
 	pre_routing_print(skb, state->in, state->out, __func__);
 
+	hnat_sw_path_count(skb);
+	hnat_foe_miss_check(skb);
+	hnat_exceed_mtu_check(skb);
+	hnat_rate_est_update(skb);
+
 	/* packets from external devices -> xxx ,step 1 , learning stage & bound stage*/
 	if (do_ext2ge_fast_try(state->in, skb)) {
 		if (!do_hnat_ext_to_ge(skb, state->in, __func__))
@@ -1479,8 +1958,13 @@ static inline void hnat_fill_offload_engine_entry(struct sk_buff *skb,
 		entry->ipv4_hnapt.tops_entry = skb_hnat_tops(skb);
 
 	} else if (skb_hnat_cdrt(skb) && skb_hnat_is_encrypt(skb)) {
-		entry->ipv4_hnapt.tport_id = NR_EIP197_QDMA_TPORT;
-		entry->ipv4_hnapt.cdrt_id = skb_hnat_cdrt(skb);
+		if (IS_IPV6_3T_ROUTE(entry) || IS_IPV6_5T_ROUTE(entry)) {
+			entry->ipv6_5t_route.tport_id = NR_EIP197_QDMA_TPORT;
+			entry->ipv6_5t_route.cdrt_id = skb_hnat_cdrt(skb);
+		} else {
+			entry->ipv4_hnapt.tport_id = NR_EIP197_QDMA_TPORT;
+			entry->ipv4_hnapt.cdrt_id = skb_hnat_cdrt(skb);
+		}
 	} else {
 		return;
 	}
@@ -1489,7 +1973,10 @@ static inline void hnat_fill_offload_engine_entry(struct sk_buff *skb,
 	 * outbound flow of offload engines use QID 12
 	 * set its rate limit to line rate
 	 */
-	entry->ipv4_hnapt.iblk2.qid = 12;
+	if (IS_IPV6_3T_ROUTE(entry) || IS_IPV6_5T_ROUTE(entry))
+		entry->ipv6_5t_route.iblk2.qid = 12;
+	else
+		entry->ipv4_hnapt.iblk2.qid = 12;
 	qos_rate_limit_set(12, dev);
 #endif /* defined(CONFIG_MEDIATEK_NETSYS_V3) */
 }
@@ -1500,10 +1987,12 @@ int hnat_bind_crypto_entry(struct sk_buff *skb, const struct net_device *dev, in
 	struct foe_entry entry = { 0 };
 	struct ethhdr *eth = eth_hdr(skb);
 	struct iphdr *iph;
+	struct ipv6hdr *ip6h;
 	struct tcpudphdr _ports;
 	const struct tcpudphdr *pptr;
 	u32 gmac = NR_DISCARD;
 	int udp = 0;
+	int ipv6 = 0;
 	struct mtk_mac *mac = netdev_priv(dev);
 	struct flow_offload_hw_path hw_path = { .dev = (struct net_device *) dev,
 						.virt_dev = (struct net_device *) dev };
@@ -1521,8 +2010,14 @@ int hnat_bind_crypto_entry(struct sk_buff *skb, const struct net_device *dev, in
 	if (entry_hnat_is_bound(foe))
 		return 0;
 
-	if (eth->h_proto != htons(ETH_P_IP))
+	/* IPv6 flows are only routed, so only 3T/5T route entries are bound */
+	if (eth->h_proto == htons(ETH_P_IPV6)) {
+		if (!IS_IPV6_3T_ROUTE(foe) && !IS_IPV6_5T_ROUTE(foe))
+			return 0;
+		ipv6 = 1;
+	} else if (eth->h_proto != htons(ETH_P_IP)) {
 		return 0;
+	}
 
 	if (skb_hnat_tops(skb) && mtk_tnl_encap_offload)
 		mtk_tnl_encap_offload(skb);
@@ -1537,7 +2032,44 @@ int hnat_bind_crypto_entry(struct sk_buff *skb, const struct net_device *dev, in
 	 * Since the skb->mac_header is not pointed to correct position
 	 * in skb_to_hnat_info().
 	 */
-	if (fill_inner_info) {
+	if (fill_inner_info && ipv6) {
+		ip6h = ipv6_hdr(skb);
+		switch (ip6h->nexthdr) {
+		case NEXTHDR_UDP:
+			udp = 1;
+			/* fallthrough */
+		case NEXTHDR_TCP:
+			entry.ipv6_5t_route.etype = htons(ETH_P_IPV6);
+			entry.ipv6_5t_route.iblk2.dscp =
+				(ip6h->priority << 4 | (ip6h->flow_lbl[0] >> 4));
+			if (hnat_priv->data->per_flow_accounting)
+				entry.ipv6_5t_route.iblk2.mibf = 1;
+
+			entry.ipv6_5t_route.vlan1 = hw_path.vlan_id;
+
+			if (skb_vlan_tagged(skb)) {
+				entry.bfib1.vlan_layer += 1;
+
+				if (entry.ipv6_5t_route.vlan1)
+					entry.ipv6_5t_route.vlan2 =
+						skb->vlan_tci;
+				else
+					entry.ipv6_5t_route.vlan1 =
+						skb->vlan_tci;
+			}
+
+			entry.ipv6_5t_route.bfib1.udp = udp;
+
+#if defined(CONFIG_MEDIATEK_NETSYS_V3)
+			entry.ipv6_5t_route.eg_keep_ecn = 1;
+			entry.ipv6_5t_route.eg_keep_cls = 1;
+#endif
+			break;
+
+		default:
+			return -1;
+		}
+	} else if (fill_inner_info) {
 		iph = ip_hdr(skb);
 		switch (iph->protocol) {
 		case IPPROTO_UDP:
@@ -1617,16 +2149,28 @@ int hnat_bind_crypto_entry(struct sk_buff *skb, const struct net_device *dev, in
 		return -1;
 	}
 
-	entry.ipv4_hnapt.iblk2.mibf = 1;
-	entry.ipv4_hnapt.iblk2.dp = gmac;
-	entry.ipv4_hnapt.iblk2.port_mg =
-		(hnat_priv->data->version == MTK_HNAT_V1_1) ? 0x3f : 0;
+	if (ipv6) {
+		entry.ipv6_5t_route.iblk2.mibf = 1;
+		entry.ipv6_5t_route.iblk2.dp = gmac;
+		entry.ipv6_5t_route.iblk2.port_mg =
+			(hnat_priv->data->version == MTK_HNAT_V1_1) ? 0x3f : 0;
+	} else {
+		entry.ipv4_hnapt.iblk2.mibf = 1;
+		entry.ipv4_hnapt.iblk2.dp = gmac;
+		entry.ipv4_hnapt.iblk2.port_mg =
+			(hnat_priv->data->version == MTK_HNAT_V1_1) ? 0x3f : 0;
+	}
 	entry.bfib1.ttl = 1;
 	entry.bfib1.state = BIND;
 
 	hnat_fill_offload_engine_entry(skb, &entry, dev);
 
-	if (!skb_hnat_tops(skb)) {
+	if (ipv6) {
+		entry.ipv6_5t_route.dmac_hi = swab32(*((u32 *)eth->h_dest));
+		entry.ipv6_5t_route.dmac_lo = swab16(*((u16 *)&eth->h_dest[4]));
+		entry.ipv6_5t_route.smac_hi = swab32(*((u32 *)eth->h_source));
+		entry.ipv6_5t_route.smac_lo = swab16(*((u16 *)&eth->h_source[4]));
+	} else if (!skb_hnat_tops(skb)) {
 		entry.ipv4_hnapt.dmac_hi = swab32(*((u32 *)eth->h_dest));
 		entry.ipv4_hnapt.dmac_lo = swab16(*((u16 *)&eth->h_dest[4]));
 		entry.ipv4_hnapt.smac_hi = swab32(*((u32 *)eth->h_source));
@@ -1643,16 +2187,52 @@ int hnat_bind_crypto_entry(struct sk_buff *skb, const struct net_device *dev, in
 	memcpy(foe, &entry, sizeof(entry));
 	spin_unlock(&hnat_priv->entry_lock);
 
-	if (hnat_priv->data->per_flow_accounting &&
-	    skb_hnat_entry(skb) < hnat_priv->foe_etry_num &&
-	    skb_hnat_ppe(skb) < CFG_PPE_NUM)
-		memset(&hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)],
-		       0, sizeof(struct mib_entry));
+	hnat_acct_reset(hnat_priv, skb_hnat_ppe(skb), skb_hnat_entry(skb),
+			NULL, 0);
 
 	return 0;
 }
 EXPORT_SYMBOL(hnat_bind_crypto_entry);
 
+/* Send the bound entry a packet came from back to the CPU path. The
+ * cache flush is left to the FOE scan, so a stream of such packets does
+ * not flush the PPE cache once each.
+ */
+static int hnat_unbind_skb_entry(struct sk_buff *skb)
+{
+	struct foe_entry *foe;
+	int unbound = 0;
+
+	if (!skb_hnat_is_hashed(skb) || skb_hnat_ppe(skb) >= CFG_PPE_NUM ||
+	    skb_hnat_entry(skb) >= hnat_priv->foe_etry_num)
+		return 0;
+
+	foe = &hnat_priv->foe_table_cpu[skb_hnat_ppe(skb)][skb_hnat_entry(skb)];
+
+	spin_lock(&hnat_priv->entry_lock);
+	if (entry_hnat_is_bound(foe)) {
+		foe->bfib1.state = INVALID;
+		foe->bfib1.time_stamp =
+			readl((hnat_priv->fe_base + 0x0010)) & 0xFF;
+		unbound = 1;
+	}
+	spin_unlock(&hnat_priv->entry_lock);
+
+	if (unbound)
+		hnat_cache_flush_defer();
+
+	return unbound;
+}
+
+/* Drop a bound crypto entry back to the CPU path, e.g. when the flow has
+ * started to carry packets that no longer fit the post-ESP MTU.
+ */
+int hnat_unbind_crypto_entry(struct sk_buff *skb)
+{
+	return hnat_unbind_skb_entry(skb);
+}
+EXPORT_SYMBOL(hnat_unbind_crypto_entry);
+
 static unsigned int skb_to_hnat_info(struct sk_buff *skb,
 				     const struct net_device *dev,
 				     struct foe_entry *foe,
@@ -2363,6 +2943,7 @@ hnat_entry_bind:
 			if (is_hnat_entry_locked(foe)) {
 				skb_hnat_filled(skb) = HNAT_INFO_FILLED;
 				spin_unlock(&hnat_priv->entry_lock);
+				hnat_bind_fail_count(skb, HNAT_BIND_FAIL_BUSY);
 				return 0;
 			}
 
@@ -2371,6 +2952,7 @@ hnat_entry_bind:
 			 */
 			if (foe->udib1.state != UNBIND) {
 				spin_unlock(&hnat_priv->entry_lock);
+				hnat_bind_fail_count(skb, HNAT_BIND_FAIL_STATE);
 				return 0;
 			}
 
@@ -2383,6 +2965,8 @@ hnat_entry_bind:
 
 			skb_hnat_filled(skb) = HNAT_INFO_FILLED;
 			spin_unlock(&hnat_priv->entry_lock);
+		} else {
+			hnat_bind_fail_count(skb, HNAT_BIND_FAIL_BUSY);
 		}
 		return 0;
 	}
@@ -2394,6 +2978,7 @@ hnat_entry_skip_bind:
 		 */
 		if (foe->udib1.state != UNBIND) {
 			spin_unlock(&hnat_priv->entry_lock);
+			hnat_bind_fail_count(skb, HNAT_BIND_FAIL_STATE);
 			return 0;
 		}
 
@@ -2409,22 +2994,25 @@ hnat_entry_skip_bind:
 		/* After other fields have been written, write info1 to BIND the entry */
 		memcpy(&foe->bfib1, &entry.bfib1, sizeof(entry.bfib1));
 
+		if (entry.bfib1.state == BIND)
+			hnat_rate_est_bound(skb);
+
 		/* reset statistic for this entry */
-		if (hnat_priv->data->per_flow_accounting &&
-		    skb_hnat_entry(skb) < hnat_priv->foe_etry_num &&
-		    skb_hnat_ppe(skb) < CFG_PPE_NUM) {
-			memset(&hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)],
-			       0, sizeof(struct hnat_accounting));
+		if (hnat_priv->data->per_flow_accounting) {
 			ct = nf_ct_get(skb, &ctinfo);
-			if (ct) {
-				hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)].zone =
-					ct->zone;
-				hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)].dir =
-					CTINFO2DIR(ctinfo);
-			}
+			hnat_acct_reset(hnat_priv, skb_hnat_ppe(skb),
+					skb_hnat_entry(skb), ct,
+					CTINFO2DIR(ctinfo));
 		}
 
 		spin_unlock(&hnat_priv->entry_lock);
+
+		if (hnat_priv->pmcast && entry.bfib1.state == BIND &&
+		    is_multicast_ether_addr(eth->h_dest))
+			hnat_mcast_flow_add(skb_hnat_ppe(skb),
+					    skb_hnat_entry(skb), eth->h_dest);
+	} else {
+		hnat_bind_fail_count(skb, HNAT_BIND_FAIL_BUSY);
 	}
 
 	return 0;
@@ -2730,17 +3318,13 @@ int mtk_sw_nat_hook_tx(struct sk_buff *skb, int gmac_no)
 	memcpy(&hw_entry->bfib1, &entry.bfib1, sizeof(entry.bfib1));
 
 	hnat_set_entry_lock(hw_entry, false);
+	hnat_rate_est_bound(skb);
 
 	/* reset statistic for this entry */
 	if (hnat_priv->data->per_flow_accounting) {
-		memset(&hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)],
-			0, sizeof(struct hnat_accounting));
 		ct = nf_ct_get(skb, &ctinfo);
-		if (ct) {
-			hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)].zone = ct->zone;
-			hnat_priv->acct[skb_hnat_ppe(skb)][skb_hnat_entry(skb)].dir =
-										CTINFO2DIR(ctinfo);
-		}
+		hnat_acct_reset(hnat_priv, skb_hnat_ppe(skb),
+				skb_hnat_entry(skb), ct, CTINFO2DIR(ctinfo));
 	}
 
 #if defined(CONFIG_MEDIATEK_NETSYS_V3)
@@ -3284,10 +3868,12 @@ static unsigned int mtk_hnat_nf_post_routing(
 		}
 	}
 
-	/* we are not support protocols other than IPv4 TCP for crypto offload yet */
+	/* we are not support protocols other than IPv4/IPv6 TCP for crypto offload yet */
 	if (skb_hnat_is_decrypt(skb) &&
-	    (ntohs(skb->protocol) != ETH_P_IP ||
-	    ip_hdr(skb)->protocol != IPPROTO_TCP)) {
+	    !(ntohs(skb->protocol) == ETH_P_IP &&
+	      ip_hdr(skb)->protocol == IPPROTO_TCP) &&
+	    !(ntohs(skb->protocol) == ETH_P_IPV6 &&
+	      ipv6_hdr(skb)->nexthdr == NEXTHDR_TCP)) {
 		skb_hnat_alg(skb) = 1;
 		return 0;
 	}
@@ -3315,19 +3901,22 @@ static unsigned int mtk_hnat_nf_post_routing(
 		if (entry_hnat_is_bound(entry))
 			break;
 
-		if (fn && !mtk_hnat_accel_type(skb))
-			break;
+		this_cpu_inc(hnat_priv->sw_stats->bind_attempts[skb_hnat_ppe(skb)]);
 
-		if (!is_virt_dev && fn && fn(skb, arp_dev, &hw_path))
+		if ((fn && !mtk_hnat_accel_type(skb)) ||
+		    (!is_virt_dev && fn && fn(skb, arp_dev, &hw_path))) {
+			hnat_bind_fail_count(skb, HNAT_BIND_FAIL_ACCEL);
 			break;
+		}
 
 		/* skb_hnat_tops(skb) is updated in mtk_tnl_offload() */
 		if (skb_hnat_tops(skb)) {
-			if (skb_hnat_is_encap(skb) && !is_virt_dev &&
-			    mtk_tnl_encap_offload && mtk_tnl_encap_offload(skb))
-				break;
-			if (skb_hnat_is_decap(skb))
+			if ((skb_hnat_is_encap(skb) && !is_virt_dev &&
+			     mtk_tnl_encap_offload && mtk_tnl_encap_offload(skb)) ||
+			    skb_hnat_is_decap(skb)) {
+				hnat_bind_fail_count(skb, HNAT_BIND_FAIL_TNL);
 				break;
+			}
 		}
 
 		skb_to_hnat_info(skb, out, entry, &hw_path);
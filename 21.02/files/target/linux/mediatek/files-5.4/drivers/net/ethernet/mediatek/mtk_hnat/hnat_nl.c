@@ -0,0 +1,767 @@
+/* SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (c) 2023 MediaTek Inc.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <net/genetlink.h>
+
+#include "hnat.h"
+#include "hnat_nl.h"
+#include "../mtk_eth_soc.h"
+
+struct hnat_nl_filter {
+	int state;
+	int ppe_id;
+	bool has_ipv4;
+	__be32 ipv4;
+	bool has_ipv6;
+	struct in6_addr ipv6;
+	int port;
+};
+
+static struct genl_family hnat_nl_family;
+
+/* Entries written per entry_lock hold. The batch size is up to userspace
+ * and resetting an entry may wait for a MIB read, so the lock is dropped
+ * in between to let the packet path and the FOE scan in.
+ */
+#define HNAT_NL_LOCK_BATCH	16
+
+static void hnat_nl_lock_break(int *n)
+{
+	if (++(*n) % HNAT_NL_LOCK_BATCH)
+		return;
+
+	spin_unlock_bh(&hnat_priv->entry_lock);
+	cond_resched();
+	spin_lock_bh(&hnat_priv->entry_lock);
+}
+
+static const struct nla_policy hnat_nl_policy[HNAT_NL_ATTR_MAX + 1] = {
+	[HNAT_NL_ATTR_STATE] = { .type = NLA_U8 },
+	[HNAT_NL_ATTR_PPE] = { .type = NLA_U32 },
+	[HNAT_NL_ATTR_IPV4] = { .type = NLA_U32 },
+	[HNAT_NL_ATTR_IPV6] = { .len = sizeof(struct in6_addr) },
+	[HNAT_NL_ATTR_PORT] = { .type = NLA_U16 },
+	[HNAT_NL_ATTR_MIB] = { .type = NLA_FLAG },
+	[HNAT_NL_ATTR_STATIC] = { .len = sizeof(struct hnat_nl_static) },
+	[HNAT_NL_ATTR_ID] = { .len = sizeof(struct hnat_nl_id) },
+	[HNAT_NL_ATTR_XLAT_MAP] = { .len = sizeof(struct hnat_nl_xlat_map) },
+	[HNAT_NL_ATTR_XLAT_PREFIX] = { .len = sizeof(struct in6_addr) },
+	[HNAT_NL_ATTR_XLAT_PREFIX_LEN] = { .type = NLA_U8 },
+	[HNAT_NL_ATTR_FLUSH] = { .type = NLA_FLAG },
+	[HNAT_NL_ATTR_QOS_SCH] = { .len = sizeof(struct hnat_nl_qos_sch) },
+	[HNAT_NL_ATTR_QOS_QUEUE] = { .len = sizeof(struct hnat_nl_qos_queue) },
+};
+
+static void hnat_nl_fill_foe(struct hnat_nl_foe *rec, struct foe_entry *entry,
+			     u32 ppe_id, u32 index)
+{
+	struct hnat_accounting *acct;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->ppe_id = ppe_id;
+	rec->index = index;
+	rec->state = entry->bfib1.state;
+	rec->pkt_type = entry->bfib1.pkt_type;
+	rec->udp = entry->bfib1.udp;
+	rec->info1 = entry->ipv4_hnapt.info_blk1;
+
+	switch (entry->bfib1.pkt_type) {
+	case IPV4_HNAPT:
+	case IPV4_HNAT:
+		rec->new_sip = htonl(entry->ipv4_hnapt.new_sip);
+		rec->new_dip = htonl(entry->ipv4_hnapt.new_dip);
+		rec->new_sport = entry->ipv4_hnapt.new_sport;
+		rec->new_dport = entry->ipv4_hnapt.new_dport;
+		rec->info2 = entry->ipv4_hnapt.info_blk2;
+		/* fall through */
+	case IPV4_DSLITE:
+	case IPV4_MAP_T:
+	case IPV4_MAP_E:
+		rec->family = AF_INET;
+		rec->sip[0] = htonl(entry->ipv4_hnapt.sip);
+		rec->dip[0] = htonl(entry->ipv4_hnapt.dip);
+		rec->sport = entry->ipv4_hnapt.sport;
+		rec->dport = entry->ipv4_hnapt.dport;
+		if (IS_IPV4_DSLITE(entry))
+			rec->info2 = entry->ipv4_dslite.info_blk2;
+		else if (IS_IPV4_MAPE(entry) || IS_IPV4_MAPT(entry))
+			rec->info2 = entry->ipv4_mape.info_blk2;
+		break;
+	case IPV6_3T_ROUTE:
+		rec->family = AF_INET6;
+		rec->sip[0] = htonl(entry->ipv6_3t_route.ipv6_sip0);
+		rec->sip[1] = htonl(entry->ipv6_3t_route.ipv6_sip1);
+		rec->sip[2] = htonl(entry->ipv6_3t_route.ipv6_sip2);
+		rec->sip[3] = htonl(entry->ipv6_3t_route.ipv6_sip3);
+		rec->dip[0] = htonl(entry->ipv6_3t_route.ipv6_dip0);
+		rec->dip[1] = htonl(entry->ipv6_3t_route.ipv6_dip1);
+		rec->dip[2] = htonl(entry->ipv6_3t_route.ipv6_dip2);
+		rec->dip[3] = htonl(entry->ipv6_3t_route.ipv6_dip3);
+		rec->info2 = entry->ipv6_3t_route.info_blk2;
+		break;
+	case IPV6_5T_ROUTE:
+	case IPV6_6RD:
+	case IPV6_HNAPT:
+	case IPV6_HNAT:
+		rec->family = AF_INET6;
+		rec->sip[0] = htonl(entry->ipv6_5t_route.ipv6_sip0);
+		rec->sip[1] = htonl(entry->ipv6_5t_route.ipv6_sip1);
+		rec->sip[2] = htonl(entry->ipv6_5t_route.ipv6_sip2);
+		rec->sip[3] = htonl(entry->ipv6_5t_route.ipv6_sip3);
+		rec->dip[0] = htonl(entry->ipv6_5t_route.ipv6_dip0);
+		rec->dip[1] = htonl(entry->ipv6_5t_route.ipv6_dip1);
+		rec->dip[2] = htonl(entry->ipv6_5t_route.ipv6_dip2);
+		rec->dip[3] = htonl(entry->ipv6_5t_route.ipv6_dip3);
+		rec->sport = entry->ipv6_5t_route.sport;
+		rec->dport = entry->ipv6_5t_route.dport;
+		if (IS_IPV6_6RD(entry))
+			rec->info2 = entry->ipv6_6rd.info_blk2;
+		else if (IS_IPV6_HNAPT(entry) || IS_IPV6_HNAT(entry))
+			rec->info2 = entry->ipv6_hnapt.info_blk2;
+		else
+			rec->info2 = entry->ipv6_5t_route.info_blk2;
+		break;
+	default:
+		break;
+	}
+
+	if (hnat_priv->data->per_flow_accounting) {
+		acct = &hnat_priv->acct[ppe_id][index];
+		rec->bytes = acct->bytes;
+		rec->packets = acct->packets;
+	}
+}
+
+static bool hnat_nl_match(struct hnat_nl_filter *filter, struct hnat_nl_foe *rec)
+{
+	if (filter->has_ipv4) {
+		if (rec->family != AF_INET)
+			return false;
+		if (rec->sip[0] != filter->ipv4 && rec->dip[0] != filter->ipv4 &&
+		    rec->new_sip != filter->ipv4 && rec->new_dip != filter->ipv4)
+			return false;
+	}
+
+	if (filter->has_ipv6) {
+		if (rec->family != AF_INET6)
+			return false;
+		if (memcmp(rec->sip, &filter->ipv6, sizeof(rec->sip)) &&
+		    memcmp(rec->dip, &filter->ipv6, sizeof(rec->dip)))
+			return false;
+	}
+
+	if (filter->port >= 0 &&
+	    rec->sport != filter->port && rec->dport != filter->port &&
+	    rec->new_sport != filter->port && rec->new_dport != filter->port)
+		return false;
+
+	return true;
+}
+
+static int hnat_nl_foe_dump_start(struct netlink_callback *cb)
+{
+	struct nlattr *attrs[HNAT_NL_ATTR_MAX + 1];
+	struct hnat_nl_filter *filter;
+	int err, i;
+
+	err = nlmsg_parse_deprecated(cb->nlh, GENL_HDRLEN, attrs,
+				     HNAT_NL_ATTR_MAX, hnat_nl_policy, NULL);
+	if (err)
+		return err;
+
+	filter = kzalloc(sizeof(*filter), GFP_KERNEL);
+	if (!filter)
+		return -ENOMEM;
+
+	filter->state = -1;
+	filter->ppe_id = -1;
+	filter->port = -1;
+
+	if (attrs[HNAT_NL_ATTR_STATE])
+		filter->state = nla_get_u8(attrs[HNAT_NL_ATTR_STATE]);
+	if (attrs[HNAT_NL_ATTR_PPE])
+		filter->ppe_id = nla_get_u32(attrs[HNAT_NL_ATTR_PPE]);
+	if (attrs[HNAT_NL_ATTR_IPV4]) {
+		filter->has_ipv4 = true;
+		filter->ipv4 = nla_get_in_addr(attrs[HNAT_NL_ATTR_IPV4]);
+	}
+	if (attrs[HNAT_NL_ATTR_IPV6]) {
+		filter->has_ipv6 = true;
+		filter->ipv6 = nla_get_in6_addr(attrs[HNAT_NL_ATTR_IPV6]);
+	}
+	if (attrs[HNAT_NL_ATTR_PORT])
+		filter->port = nla_get_u16(attrs[HNAT_NL_ATTR_PORT]);
+
+	if (attrs[HNAT_NL_ATTR_MIB] && hnat_priv->data->per_flow_accounting) {
+		for (i = 0; i < CFG_PPE_NUM; i++) {
+			if (filter->ppe_id < 0 || filter->ppe_id == i)
+				hnat_get_count_bulk(hnat_priv, i);
+		}
+	}
+
+	cb->args[0] = 0;
+	cb->args[1] = 0;
+	cb->args[2] = (long)filter;
+
+	return 0;
+}
+
+static int hnat_nl_foe_dump_done(struct netlink_callback *cb)
+{
+	kfree((void *)cb->args[2]);
+
+	return 0;
+}
+
+static int hnat_nl_foe_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct hnat_nl_filter *filter = (struct hnat_nl_filter *)cb->args[2];
+	u32 ppe_id = cb->args[0], index = cb->args[1];
+	struct foe_entry *entry;
+	struct hnat_nl_foe rec;
+	void *hdr = NULL;
+
+	for (; ppe_id < CFG_PPE_NUM; ppe_id++, index = 0) {
+		if (filter->ppe_id >= 0 && filter->ppe_id != ppe_id)
+			continue;
+
+		for (; index < hnat_priv->foe_etry_num; index++) {
+			entry = hnat_priv->foe_table_cpu[ppe_id] + index;
+
+			if (filter->state < 0) {
+				if (entry->bfib1.state == INVALID)
+					continue;
+			} else if (entry->bfib1.state != filter->state) {
+				continue;
+			}
+
+			hnat_nl_fill_foe(&rec, entry, ppe_id, index);
+			if (!hnat_nl_match(filter, &rec))
+				continue;
+
+			if (!hdr) {
+				hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+						  cb->nlh->nlmsg_seq, &hnat_nl_family,
+						  NLM_F_MULTI, HNAT_NL_CMD_FOE_DUMP);
+				if (!hdr)
+					goto out;
+			}
+
+			if (nla_put(skb, HNAT_NL_ATTR_FOE, sizeof(rec), &rec))
+				goto out;
+		}
+	}
+
+out:
+	if (hdr)
+		genlmsg_end(skb, hdr);
+
+	cb->args[0] = ppe_id;
+	cb->args[1] = index;
+
+	return skb->len;
+}
+
+static int hnat_nl_static_to_foe(struct hnat_nl_static *st,
+				 struct foe_entry *entry)
+{
+	memset(entry, 0, sizeof(*entry));
+	entry->ipv4_hnapt.info_blk1 = st->info1;
+
+#if defined(CONFIG_MEDIATEK_NETSYS_V3)
+	if (TPORT_ID(st->tport_id) != st->tport_id ||
+	    TOPS_ENTRY(st->tops_entry) != st->tops_entry ||
+	    CDRT_ID(st->cdrt_id) != st->cdrt_id)
+		return -EINVAL;
+#endif
+
+	if (entry->bfib1.pkt_type == IPV4_HNAPT) {
+		entry->ipv4_hnapt.sip = ntohl(st->sip[0]);
+		entry->ipv4_hnapt.dip = ntohl(st->dip[0]);
+		entry->ipv4_hnapt.sport = st->sport;
+		entry->ipv4_hnapt.dport = st->dport;
+		entry->ipv4_hnapt.info_blk2 = st->info2;
+		entry->ipv4_hnapt.new_sip = ntohl(st->new_sip);
+		entry->ipv4_hnapt.new_dip = ntohl(st->new_dip);
+		entry->ipv4_hnapt.new_sport = st->new_sport;
+		entry->ipv4_hnapt.new_dport = st->new_dport;
+		entry->ipv4_hnapt.dmac_hi = swab32(*((u32 *)st->dmac));
+		entry->ipv4_hnapt.dmac_lo = swab16(*((u16 *)&st->dmac[4]));
+		entry->ipv4_hnapt.smac_hi = swab32(*((u32 *)st->smac));
+		entry->ipv4_hnapt.smac_lo = swab16(*((u16 *)&st->smac[4]));
+#if defined(CONFIG_MEDIATEK_NETSYS_V3)
+		entry->ipv4_hnapt.tport_id = st->tport_id;
+		entry->ipv4_hnapt.tops_entry = st->tops_entry;
+		entry->ipv4_hnapt.cdrt_id = st->cdrt_id;
+#endif
+	} else if (entry->bfib1.pkt_type == IPV6_5T_ROUTE) {
+		entry->ipv6_5t_route.ipv6_sip0 = ntohl(st->sip[0]);
+		entry->ipv6_5t_route.ipv6_sip1 = ntohl(st->sip[1]);
+		entry->ipv6_5t_route.ipv6_sip2 = ntohl(st->sip[2]);
+		entry->ipv6_5t_route.ipv6_sip3 = ntohl(st->sip[3]);
+		entry->ipv6_5t_route.ipv6_dip0 = ntohl(st->dip[0]);
+		entry->ipv6_5t_route.ipv6_dip1 = ntohl(st->dip[1]);
+		entry->ipv6_5t_route.ipv6_dip2 = ntohl(st->dip[2]);
+		entry->ipv6_5t_route.ipv6_dip3 = ntohl(st->dip[3]);
+		entry->ipv6_5t_route.sport = st->sport;
+		entry->ipv6_5t_route.dport = st->dport;
+		entry->ipv6_5t_route.info_blk2 = st->info2;
+		entry->ipv6_5t_route.dmac_hi = swab32(*((u32 *)st->dmac));
+		entry->ipv6_5t_route.dmac_lo = swab16(*((u16 *)&st->dmac[4]));
+		entry->ipv6_5t_route.smac_hi = swab32(*((u32 *)st->smac));
+		entry->ipv6_5t_route.smac_lo = swab16(*((u16 *)&st->smac[4]));
+#if defined(CONFIG_MEDIATEK_NETSYS_V3)
+		entry->ipv6_5t_route.tport_id = st->tport_id;
+		entry->ipv6_5t_route.tops_entry = st->tops_entry;
+		entry->ipv6_5t_route.cdrt_id = st->cdrt_id;
+#endif
+	} else {
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+static int hnat_nl_bind(struct sk_buff *skb, struct genl_info *info)
+{
+	struct hnat_nl_static st;
+	struct foe_entry entry;
+	struct hnat_nl_id id;
+	struct sk_buff *msg;
+	struct nlattr *nla;
+	int rem, cnt = 0, n = 0;
+	void *hdr;
+
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_STATIC)
+			continue;
+		if (nla_len(nla) != sizeof(st))
+			return -EINVAL;
+		cnt++;
+	}
+
+	if (!cnt)
+		return -EINVAL;
+
+	msg = genlmsg_new(cnt * nla_total_size(sizeof(id)), GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq,
+			  &hnat_nl_family, 0, HNAT_NL_CMD_BIND);
+	if (!hdr) {
+		nlmsg_free(msg);
+		return -EMSGSIZE;
+	}
+
+	/* the reply is sized up front, so nla_put() never allocates here */
+	spin_lock_bh(&hnat_priv->entry_lock);
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_STATIC)
+			continue;
+
+		memcpy(&st, nla_data(nla), sizeof(st));
+		id.ppe_id = 0;
+		id.index = hnat_nl_static_to_foe(&st, &entry);
+		if (!id.index)
+			id.index = hnat_static_entry_bind(&entry, st.hash,
+							  &id.ppe_id);
+
+		if (nla_put(msg, HNAT_NL_ATTR_ID, sizeof(id), &id)) {
+			spin_unlock_bh(&hnat_priv->entry_lock);
+			nlmsg_free(msg);
+			return -EMSGSIZE;
+		}
+
+		hnat_nl_lock_break(&n);
+	}
+	spin_unlock_bh(&hnat_priv->entry_lock);
+
+	genlmsg_end(msg, hdr);
+
+	return genlmsg_reply(msg, info);
+}
+
+static int hnat_nl_unbind(struct sk_buff *skb, struct genl_info *info)
+{
+	struct hnat_nl_id *id;
+	struct nlattr *nla;
+	int rem, cnt = 0, n = 0;
+
+	/* reject the whole batch before touching any entry */
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_ID)
+			continue;
+		if (nla_len(nla) != sizeof(*id))
+			return -EINVAL;
+
+		id = nla_data(nla);
+		if (id->ppe_id >= CFG_PPE_NUM || id->index < 0 ||
+		    id->index >= hnat_priv->foe_etry_num)
+			return -EINVAL;
+		cnt++;
+	}
+
+	if (!cnt)
+		return -EINVAL;
+
+	spin_lock_bh(&hnat_priv->entry_lock);
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_ID)
+			continue;
+
+		id = nla_data(nla);
+		hnat_entry_state_reset(id->ppe_id, id->index);
+		memset(hnat_priv->foe_table_cpu[id->ppe_id] + id->index, 0,
+		       sizeof(struct foe_entry));
+
+		hnat_nl_lock_break(&n);
+	}
+	spin_unlock_bh(&hnat_priv->entry_lock);
+
+	/* clear HWNAT cache once for the whole batch */
+	hnat_cache_ebl(1);
+
+	return 0;
+}
+
+static int hnat_nl_xlat_count(struct genl_info *info)
+{
+	struct nlattr *nla;
+	int rem, cnt = 0;
+
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_XLAT_MAP)
+			continue;
+		if (nla_len(nla) != sizeof(struct hnat_nl_xlat_map))
+			return -EINVAL;
+		cnt++;
+	}
+
+	return cnt;
+}
+
+static int hnat_nl_xlat_add(struct sk_buff *skb, struct genl_info *info)
+{
+	struct xlat_conf *xlat = &hnat_priv->xlat;
+	struct hnat_nl_xlat_map *map;
+	struct nlattr *nla;
+	int rem, cnt, err = 0;
+
+	cnt = hnat_nl_xlat_count(info);
+	if (cnt < 0)
+		return cnt;
+
+	if (!cnt && !info->attrs[HNAT_NL_ATTR_FLUSH] &&
+	    !info->attrs[HNAT_NL_ATTR_XLAT_PREFIX] &&
+	    !info->attrs[HNAT_NL_ATTR_XLAT_PREFIX_LEN])
+		return -EINVAL;
+
+	mutex_lock(&xlat->lock);
+
+	if (info->attrs[HNAT_NL_ATTR_FLUSH])
+		hnat_xlat_map_flush();
+	if (info->attrs[HNAT_NL_ATTR_XLAT_PREFIX])
+		xlat->prefix =
+			nla_get_in6_addr(info->attrs[HNAT_NL_ATTR_XLAT_PREFIX]);
+	if (info->attrs[HNAT_NL_ATTR_XLAT_PREFIX_LEN])
+		xlat->prefix_len =
+			nla_get_u8(info->attrs[HNAT_NL_ATTR_XLAT_PREFIX_LEN]);
+
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_XLAT_MAP)
+			continue;
+
+		map = nla_data(nla);
+		err = hnat_xlat_map_add(map->ipv4, (struct in6_addr *)map->ipv6);
+		if (err)
+			break;
+		cnt--;
+	}
+
+	if (err) {
+		if (err == -EEXIST)
+			NL_SET_ERR_MSG(info->extack, "464XLAT address already mapped");
+		else
+			NL_SET_ERR_MSG(info->extack, "cannot add 464XLAT mapping");
+
+		/* take back the part of the batch that went in */
+		cnt = hnat_nl_xlat_count(info) - cnt;
+		nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+				  genlmsg_len(info->genlhdr), rem) {
+			if (nla_type(nla) != HNAT_NL_ATTR_XLAT_MAP)
+				continue;
+			if (!cnt--)
+				break;
+
+			map = nla_data(nla);
+			hnat_xlat_map_del(map->ipv4, (struct in6_addr *)map->ipv6);
+		}
+	}
+
+	mutex_unlock(&xlat->lock);
+
+	return err;
+}
+
+static int hnat_nl_xlat_del(struct sk_buff *skb, struct genl_info *info)
+{
+	struct xlat_conf *xlat = &hnat_priv->xlat;
+	struct hnat_nl_xlat_map *map;
+	struct in6_addr ipv6, prefix;
+	struct nlattr *nla;
+	int rem, cnt;
+
+	cnt = hnat_nl_xlat_count(info);
+	if (cnt <= 0)
+		return cnt ? cnt : -EINVAL;
+
+	mutex_lock(&xlat->lock);
+
+	/* reject the whole batch before deleting any mapping */
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_XLAT_MAP)
+			continue;
+
+		map = nla_data(nla);
+		if (mtk_ppe_get_xlat_v6_by_v4(&map->ipv4, &ipv6, &prefix) ||
+		    memcmp(&ipv6, map->ipv6, sizeof(ipv6))) {
+			mutex_unlock(&xlat->lock);
+			NL_SET_ERR_MSG(info->extack, "464XLAT mapping not found");
+			return -ENOENT;
+		}
+	}
+
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_XLAT_MAP)
+			continue;
+
+		map = nla_data(nla);
+		hnat_xlat_map_del(map->ipv4, (struct in6_addr *)map->ipv6);
+	}
+
+	mutex_unlock(&xlat->lock);
+
+	return 0;
+}
+
+/* args[0] is the next mapping to send, args[1] is set once the prefix
+ * went out with the first message.
+ */
+static int hnat_nl_xlat_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct xlat_conf *xlat = &hnat_priv->xlat;
+	struct hnat_nl_xlat_map rec;
+	long pos = 0, start = cb->args[0];
+	struct map46 *m = NULL;
+	bool filled = false;
+	void *hdr;
+
+	hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+			  &hnat_nl_family, NLM_F_MULTI, HNAT_NL_CMD_XLAT_DUMP);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	mutex_lock(&xlat->lock);
+
+	if (!cb->args[1]) {
+		if (nla_put_in6_addr(skb, HNAT_NL_ATTR_XLAT_PREFIX,
+				     &xlat->prefix) ||
+		    nla_put_u8(skb, HNAT_NL_ATTR_XLAT_PREFIX_LEN,
+			       xlat->prefix_len))
+			goto out;
+		cb->args[1] = 1;
+		filled = true;
+	}
+
+	list_for_each_entry(m, &xlat->map_list, list) {
+		if (pos < start) {
+			pos++;
+			continue;
+		}
+
+		rec.ipv4 = m->ipv4;
+		memcpy(rec.ipv6, &m->ipv6, sizeof(rec.ipv6));
+		if (nla_put(skb, HNAT_NL_ATTR_XLAT_MAP, sizeof(rec), &rec))
+			break;
+
+		pos++;
+		filled = true;
+	}
+
+out:
+	mutex_unlock(&xlat->lock);
+
+	if (!filled) {
+		genlmsg_cancel(skb, hdr);
+		return 0;
+	}
+
+	genlmsg_end(skb, hdr);
+	cb->args[0] = pos;
+
+	return skb->len;
+}
+
+#define HNAT_NL_QOS_SCH_MAX	4
+
+static int hnat_nl_qos_set(struct sk_buff *skb, struct genl_info *info)
+{
+	struct hnat_nl_qos_queue queue[MTK_QDMA_TX_NUM];
+	struct hnat_nl_qos_sch sch[HNAT_NL_QOS_SCH_MAX];
+	int rem, nsch = 0, nqueue = 0;
+	struct nlattr *nla;
+	int ret;
+
+	/* attributes are not aligned for the structs, so copy them out */
+	nla_for_each_attr(nla, genlmsg_data(info->genlhdr),
+			  genlmsg_len(info->genlhdr), rem) {
+		if (nla_type(nla) == HNAT_NL_ATTR_QOS_SCH) {
+			if (nla_len(nla) != sizeof(sch[0]) ||
+			    nsch == HNAT_NL_QOS_SCH_MAX)
+				return -EINVAL;
+			memcpy(&sch[nsch++], nla_data(nla), sizeof(sch[0]));
+		} else if (nla_type(nla) == HNAT_NL_ATTR_QOS_QUEUE) {
+			if (nla_len(nla) != sizeof(queue[0]) ||
+			    nqueue == MTK_QDMA_TX_NUM)
+				return -EINVAL;
+			memcpy(&queue[nqueue++], nla_data(nla), sizeof(queue[0]));
+		}
+	}
+
+	if (!nsch && !nqueue)
+		return -EINVAL;
+
+	ret = hnat_qos_apply(sch, nsch, queue, nqueue);
+	if (ret < 0) {
+		NL_SET_ERR_MSG(info->extack, "QoS scheduler or queue out of range");
+		return ret;
+	}
+
+	return 0;
+}
+
+static int hnat_nl_qos_get(struct sk_buff *skb, struct genl_info *info)
+{
+	struct hnat_nl_qos_queue queue[MTK_QDMA_TX_NUM];
+	struct hnat_nl_qos_sch sch[HNAT_NL_QOS_SCH_MAX];
+	int i, nsch = hnat_priv->data->num_of_sch;
+	struct sk_buff *msg;
+	void *hdr;
+
+	hnat_qos_get(sch, queue);
+
+	msg = genlmsg_new(nsch * nla_total_size(sizeof(sch[0])) +
+			  MTK_QDMA_TX_NUM * nla_total_size(sizeof(queue[0])),
+			  GFP_KERNEL);
+	if (!msg)
+		return -ENOMEM;
+
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq,
+			  &hnat_nl_family, 0, HNAT_NL_CMD_QOS_GET);
+	if (!hdr)
+		goto err;
+
+	for (i = 0; i < nsch; i++) {
+		if (nla_put(msg, HNAT_NL_ATTR_QOS_SCH, sizeof(sch[i]), &sch[i]))
+			goto err;
+	}
+
+	for (i = 0; i < MTK_QDMA_TX_NUM; i++) {
+		if (nla_put(msg, HNAT_NL_ATTR_QOS_QUEUE, sizeof(queue[i]),
+			    &queue[i]))
+			goto err;
+	}
+
+	genlmsg_end(msg, hdr);
+
+	return genlmsg_reply(msg, info);
+
+err:
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+static const struct genl_ops hnat_nl_ops[] = {
+	{
+		.cmd = HNAT_NL_CMD_FOE_DUMP,
+		.start = hnat_nl_foe_dump_start,
+		.dumpit = hnat_nl_foe_dump,
+		.done = hnat_nl_foe_dump_done,
+		.validate = GENL_DONT_VALIDATE_DUMP,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_BIND,
+		.doit = hnat_nl_bind,
+		.validate = GENL_DONT_VALIDATE_STRICT,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_UNBIND,
+		.doit = hnat_nl_unbind,
+		.validate = GENL_DONT_VALIDATE_STRICT,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_XLAT_ADD,
+		.doit = hnat_nl_xlat_add,
+		.validate = GENL_DONT_VALIDATE_STRICT,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_XLAT_DEL,
+		.doit = hnat_nl_xlat_del,
+		.validate = GENL_DONT_VALIDATE_STRICT,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_XLAT_DUMP,
+		.dumpit = hnat_nl_xlat_dump,
+		.validate = GENL_DONT_VALIDATE_DUMP,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_QOS_SET,
+		.doit = hnat_nl_qos_set,
+		.validate = GENL_DONT_VALIDATE_STRICT,
+		.flags = GENL_ADMIN_PERM,
+	}, {
+		.cmd = HNAT_NL_CMD_QOS_GET,
+		.doit = hnat_nl_qos_get,
+		.validate = GENL_DONT_VALIDATE_STRICT,
+		.flags = GENL_ADMIN_PERM,
+	},
+};
+
+static struct genl_family hnat_nl_family = {
+	.name =		HNAT_GENL_NAME,
+	.version =	HNAT_GENL_VERSION,
+	.maxattr =	HNAT_NL_ATTR_MAX,
+	.ops =		hnat_nl_ops,
+	.n_ops =	ARRAY_SIZE(hnat_nl_ops),
+	.policy =	hnat_nl_policy,
+	.module =	THIS_MODULE,
+};
+
+int hnat_nl_init(void)
+{
+	int ret;
+
+	ret = genl_register_family(&hnat_nl_family);
+	if (ret)
+		pr_info("hnat-nl: genl_register_family failed\n");
+
+	return ret;
+}
+
+void hnat_nl_exit(void)
+{
+	genl_unregister_family(&hnat_nl_family);
+}
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0
+ *
+ * Copyright (c) 2023 MediaTek Inc.
+ */
+
+#ifndef NF_HNAT_NL_H
+#define NF_HNAT_NL_H
+
+#include <uapi/linux/mtk_hnat_nl.h>
+
+int hnat_nl_init(void);
+void hnat_nl_exit(void);
+
+#endif /* NF_HNAT_NL_H */
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note
+ *
+ * Copyright (c) 2023 MediaTek Inc.
+ *
+ * mtkhnat generic netlink family, shared by the HNAT driver and hnatnl.
+ */
+
+#ifndef _UAPI_LINUX_MTK_HNAT_NL_H
+#define _UAPI_LINUX_MTK_HNAT_NL_H
+
+#include <linux/types.h>
+
+#define HNAT_GENL_NAME		"mtkhnat"
+#define HNAT_GENL_VERSION	0x1
+
+enum hnat_nl_cmd {
+	HNAT_NL_CMD_UNSPEC = 0,
+	HNAT_NL_CMD_FOE_DUMP,	/* dump entries, optionally filtered */
+	HNAT_NL_CMD_BIND,	/* write a batch of static entries */
+	HNAT_NL_CMD_UNBIND,	/* clear a batch of entries */
+	HNAT_NL_CMD_XLAT_ADD,	/* add a batch of 464XLAT mappings */
+	HNAT_NL_CMD_XLAT_DEL,	/* delete a batch of 464XLAT mappings */
+	HNAT_NL_CMD_XLAT_DUMP,	/* dump the 464XLAT prefix and mappings */
+	HNAT_NL_CMD_QOS_SET,	/* program a batch of schedulers and queues */
+	HNAT_NL_CMD_QOS_GET,	/* read all schedulers and queues */
+
+	__HNAT_NL_CMD_MAX,
+};
+
+#define HNAT_NL_CMD_MAX		(__HNAT_NL_CMD_MAX - 1)
+
+enum hnat_nl_attr {
+	HNAT_NL_ATTR_UNSPEC = 0,
+	HNAT_NL_ATTR_FOE,	/* struct hnat_nl_foe, one per entry */
+	HNAT_NL_ATTR_STATE,	/* u8, dump filter */
+	HNAT_NL_ATTR_PPE,	/* u32, dump filter */
+	HNAT_NL_ATTR_IPV4,	/* be32, dump filter on any address */
+	HNAT_NL_ATTR_IPV6,	/* in6_addr, dump filter on any address */
+	HNAT_NL_ATTR_PORT,	/* u16, dump filter on any port */
+	HNAT_NL_ATTR_MIB,	/* flag, collect counters before the dump */
+	HNAT_NL_ATTR_STATIC,	/* struct hnat_nl_static, one per entry */
+	HNAT_NL_ATTR_ID,	/* struct hnat_nl_id, one per entry */
+	HNAT_NL_ATTR_XLAT_MAP,	/* struct hnat_nl_xlat_map, one per mapping */
+	HNAT_NL_ATTR_XLAT_PREFIX,	/* in6_addr */
+	HNAT_NL_ATTR_XLAT_PREFIX_LEN,	/* u8 */
+	HNAT_NL_ATTR_FLUSH,	/* flag, drop all mappings before adding */
+	HNAT_NL_ATTR_QOS_SCH,	/* struct hnat_nl_qos_sch, one per scheduler */
+	HNAT_NL_ATTR_QOS_QUEUE,	/* struct hnat_nl_qos_queue, one per queue */
+
+	__HNAT_NL_ATTR_MAX,
+};
+
+#define HNAT_NL_ATTR_MAX	(__HNAT_NL_ATTR_MAX - 1)
+
+/* Addresses are in network byte order, ports in host byte order. IPv4
+ * flows only use the first word of sip/dip.
+ */
+struct hnat_nl_foe {
+	__u32 ppe_id;
+	__u32 index;
+	__u8 state;
+	__u8 pkt_type;
+	__u8 udp;
+	__u8 family;
+	__u32 info1;
+	__u32 info2;
+	__be32 sip[4];
+	__be32 dip[4];
+	__u16 sport;
+	__u16 dport;
+	__be32 new_sip;
+	__be32 new_dip;
+	__u16 new_sport;
+	__u16 new_dport;
+	__u32 resv;
+	__u64 bytes;
+	__u64 packets;
+};
+
+/* Same fields as the debugfs static_entry interface. Only IPV4_HNAPT and
+ * IPV6_5T_ROUTE entries are accepted.
+ */
+struct hnat_nl_static {
+	__s32 hash;		/* -1: computed from the tuple */
+	__u32 info1;
+	__u32 info2;
+	__be32 sip[4];
+	__be32 dip[4];
+	__u16 sport;
+	__u16 dport;
+	__be32 new_sip;
+	__be32 new_dip;
+	__u16 new_sport;
+	__u16 new_dport;
+	__u8 dmac[6];
+	__u8 smac[6];
+	__u16 tport_id;
+	__u16 tops_entry;
+	__u16 cdrt_id;
+	__u16 resv;
+};
+
+/* For BIND replies index is the entry written or a negative errno */
+struct hnat_nl_id {
+	__u32 ppe_id;
+	__s32 index;
+};
+
+/* Both addresses in network byte order. A batch is added or deleted as a
+ * whole; a FLUSH that precedes a failed batch is not undone.
+ */
+struct hnat_nl_xlat_map {
+	__be32 ipv4;
+	__be32 ipv6[4];
+};
+
+/* QDMA shapers, rates in Kbps. The hardware keeps a 7-bit mantissa and a
+ * decimal exponent, so a rate reads back rounded down to that precision.
+ * A QOS_SET batch is checked as a whole before any register is written.
+ */
+struct hnat_nl_qos_sch {
+	__u32 id;
+	__u32 max_rate;
+	__u8 enable;
+	__u8 wrr;		/* 0: strict priority */
+	__u16 pad;
+};
+
+struct hnat_nl_qos_queue {
+	__u32 id;
+	__u32 min_rate;
+	__u32 max_rate;
+	__u8 scheduler;
+	__u8 min_en;
+	__u8 max_en;
+	__u8 weight;		/* 0-15 */
+	__u8 resv;		/* hw and sw reserved descriptors */
+	__u8 pad[3];
+};
+
+#endif /* _UAPI_LINUX_MTK_HNAT_NL_H */
@@ -0,0 +1,862 @@
+/*
+ * hnatnl.c: dump, bind and unbind HNAT FOE entries over generic netlink
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <netlink/genl/family.h>
+#include <netlink/genl/ctrl.h>
+
+#include <linux/mtk_hnat_nl.h>
+
+struct hnatnl_filter {
+	int state;
+	int ppe_id;
+	int port;
+	int mib;
+	int has_ipv4;
+	struct in_addr ipv4;
+	int has_ipv6;
+	struct in6_addr ipv6;
+};
+
+struct hnatnl_ctx {
+	int done;
+	int err;
+	int quiet;
+	unsigned long entries;
+};
+
+static const char * const entry_state[] = { "INVALID", "UNBIND", "BIND", "FIN" };
+
+static struct nl_sock *user_sock;
+static int family_id;
+
+static void usage(char *cmd)
+{
+	printf("Usage:\n");
+	printf("  %s dump [filters]                 dump FOE entries\n", cmd);
+	printf("  %s bench [-n loops] [filters]     time repeated dumps\n", cmd);
+	printf("  %s bind < entries                 write static entries\n", cmd);
+	printf("  %s unbind ppe:index [...]         clear entries\n", cmd);
+	printf("  %s xlat add [-F] [-x prefix] [-l len] < maps\n", cmd);
+	printf("                                    add 464XLAT mappings\n");
+	printf("  %s xlat del < maps                delete 464XLAT mappings\n", cmd);
+	printf("  %s xlat show                      dump 464XLAT config\n", cmd);
+	printf("  %s qos set < plan                 program schedulers and queues\n", cmd);
+	printf("  %s qos show                       show schedulers and queues\n", cmd);
+	printf("  %s qos bench [-n loops]           time reprogramming all queues\n", cmd);
+	printf("\nFilters:\n");
+	printf("  -s state   0:INVALID 1:UNBIND 2:BIND 3:FIN\n");
+	printf("  -p ppe     PPE id\n");
+	printf("  -4 addr    IPv4 address on either side of the flow\n");
+	printf("  -6 addr    IPv6 address on either side of the flow\n");
+	printf("  -P port    L4 port on either side of the flow\n");
+	printf("  -m         collect per-flow counters before dumping\n");
+	printf("\nxlat options:\n");
+	printf("  -F         drop all mappings before adding\n");
+	printf("  -x prefix  set the IPv6 prefix\n");
+	printf("  -l len     set the IPv6 prefix length\n");
+	printf("xlat add/del read one 'ipv4 ipv6' mapping per line\n");
+	printf("qos set reads one item per line, rates in Kbps:\n");
+	printf("  sch id enable sp|wrr max_rate\n");
+	printf("  queue id sch min_en min_rate max_en max_rate weight resv\n");
+	printf("\nbind reads one IPv4 HNAPT entry per line:\n");
+	printf("  hash info1 sip dip sport dport info2 new_sip new_dip new_sport new_dport dmac smac\n");
+	printf("  (hash -1 lets the driver compute it, info1/info2 in hex)\n");
+}
+
+static int hnatnl_init(void)
+{
+	struct nl_cache *cache = NULL;
+	struct genl_family *family;
+
+	user_sock = nl_socket_alloc();
+	if (!user_sock) {
+		printf("Failed to create user socket\n");
+		return -ENOMEM;
+	}
+
+	if (genl_connect(user_sock)) {
+		printf("Failed to connect to generic netlink\n");
+		goto err;
+	}
+
+	if (genl_ctrl_alloc_cache(user_sock, &cache) < 0) {
+		printf("Failed to allocate netlink cache\n");
+		goto err;
+	}
+
+	family = genl_ctrl_search_by_name(cache, HNAT_GENL_NAME);
+	if (!family) {
+		printf("%s netlink family not found\n", HNAT_GENL_NAME);
+		nl_cache_free(cache);
+		goto err;
+	}
+
+	family_id = genl_family_get_id(family);
+	nl_object_put((struct nl_object *)family);
+	nl_cache_free(cache);
+
+	/* large dumps arrive faster than they are printed */
+	nl_socket_set_buffer_size(user_sock, 1 << 20, 0);
+
+	return 0;
+err:
+	nl_socket_free(user_sock);
+	user_sock = NULL;
+	return -EINVAL;
+}
+
+static void hnatnl_free(void)
+{
+	if (user_sock)
+		nl_socket_free(user_sock);
+	user_sock = NULL;
+}
+
+static void print_foe(struct hnat_nl_foe *rec)
+{
+	char sip[INET6_ADDRSTRLEN], dip[INET6_ADDRSTRLEN];
+	char nsip[INET_ADDRSTRLEN], ndip[INET_ADDRSTRLEN];
+	int af = (rec->family == AF_INET6) ? AF_INET6 : AF_INET;
+
+	inet_ntop(af, rec->sip, sip, sizeof(sip));
+	inet_ntop(af, rec->dip, dip, sizeof(dip));
+
+	printf("ppe=%u|index=%u|state=%s|type=%u|%s|%s:%u->%s:%u",
+	       rec->ppe_id, rec->index, entry_state[rec->state & 0x3],
+	       rec->pkt_type, rec->udp ? "udp" : "tcp",
+	       sip, rec->sport, dip, rec->dport);
+
+	if (af == AF_INET && (rec->new_sip || rec->new_dip)) {
+		inet_ntop(AF_INET, &rec->new_sip, nsip, sizeof(nsip));
+		inet_ntop(AF_INET, &rec->new_dip, ndip, sizeof(ndip));
+		printf("=>%s:%u->%s:%u", nsip, rec->new_sport,
+		       ndip, rec->new_dport);
+	}
+
+	printf("|info1=0x%x|info2=0x%x|bytes=%llu|packets=%llu\n",
+	       rec->info1, rec->info2,
+	       (unsigned long long)rec->bytes,
+	       (unsigned long long)rec->packets);
+}
+
+static int finish_handler(struct nl_msg *msg, void *arg)
+{
+	struct hnatnl_ctx *ctx = arg;
+
+	ctx->done = 1;
+	return NL_SKIP;
+}
+
+static int ack_handler(struct nl_msg *msg, void *arg)
+{
+	struct hnatnl_ctx *ctx = arg;
+
+	ctx->done = 1;
+	return NL_STOP;
+}
+
+static int error_handler(struct sockaddr_nl *nla, struct nlmsgerr *err,
+			 void *arg)
+{
+	struct hnatnl_ctx *ctx = arg;
+
+	ctx->err = err->error;
+	ctx->done = 1;
+	return NL_STOP;
+}
+
+static int dump_handler(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct hnatnl_ctx *ctx = arg;
+	struct hnat_nl_foe rec;
+	struct nlattr *nla;
+	int rem;
+
+	nla_for_each_attr(nla, genlmsg_attrdata(gnlh, 0),
+			  genlmsg_attrlen(gnlh, 0), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_FOE ||
+		    nla_len(nla) < (int)sizeof(rec))
+			continue;
+
+		/* attribute payloads are only 4-byte aligned */
+		memcpy(&rec, nla_data(nla), sizeof(rec));
+		ctx->entries++;
+		if (!ctx->quiet)
+			print_foe(&rec);
+	}
+
+	return NL_OK;
+}
+
+static int bind_handler(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct hnatnl_ctx *ctx = arg;
+	struct hnat_nl_id id;
+	struct nlattr *nla;
+	int rem;
+
+	nla_for_each_attr(nla, genlmsg_attrdata(gnlh, 0),
+			  genlmsg_attrlen(gnlh, 0), rem) {
+		if (nla_type(nla) != HNAT_NL_ATTR_ID ||
+		    nla_len(nla) < (int)sizeof(id))
+			continue;
+
+		memcpy(&id, nla_data(nla), sizeof(id));
+		ctx->entries++;
+		if (id.index < 0)
+			printf("entry %lu: %s\n", ctx->entries, strerror(-id.index));
+		else
+			printf("entry %lu: ppe=%u index=%d\n", ctx->entries,
+			       id.ppe_id, id.index);
+	}
+
+	return NL_OK;
+}
+
+static int hnatnl_request(struct nl_msg *msg, int (*handler)(struct nl_msg *, void *),
+			  struct hnatnl_ctx *ctx)
+{
+	struct nl_cb *cb;
+	int err;
+
+	cb = nl_cb_alloc(NL_CB_CUSTOM);
+	if (!cb) {
+		printf("Failed to allocate callback handler\n");
+		return -ENOMEM;
+	}
+
+	err = nl_send_auto_complete(user_sock, msg);
+	if (err < 0) {
+		printf("nl_send_auto_complete failed:%d\n", err);
+		goto out;
+	}
+
+	ctx->done = 0;
+	ctx->err = 0;
+	if (handler)
+		nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, handler, ctx);
+	nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, finish_handler, ctx);
+	nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, ack_handler, ctx);
+	nl_cb_err(cb, NL_CB_CUSTOM, error_handler, ctx);
+
+	while (!ctx->done) {
+		err = nl_recvmsgs(user_sock, cb);
+		if (err < 0)
+			break;
+	}
+
+	if (ctx->err)
+		err = ctx->err;
+out:
+	nl_cb_put(cb);
+	return err;
+}
+
+static int hnatnl_dump(struct hnatnl_filter *filter, struct hnatnl_ctx *ctx)
+{
+	struct nl_msg *msg;
+	int err;
+
+	msg = nlmsg_alloc();
+	if (!msg)
+		return -ENOMEM;
+
+	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, family_id, 0, NLM_F_DUMP,
+		    HNAT_NL_CMD_FOE_DUMP, HNAT_GENL_VERSION);
+
+	if (filter->state >= 0)
+		NLA_PUT_U8(msg, HNAT_NL_ATTR_STATE, filter->state);
+	if (filter->ppe_id >= 0)
+		NLA_PUT_U32(msg, HNAT_NL_ATTR_PPE, filter->ppe_id);
+	if (filter->has_ipv4)
+		NLA_PUT_U32(msg, HNAT_NL_ATTR_IPV4, filter->ipv4.s_addr);
+	if (filter->has_ipv6)
+		NLA_PUT(msg, HNAT_NL_ATTR_IPV6, sizeof(filter->ipv6),
+			&filter->ipv6);
+	if (filter->port >= 0)
+		NLA_PUT_U16(msg, HNAT_NL_ATTR_PORT, filter->port);
+	if (filter->mib)
+		NLA_PUT_FLAG(msg, HNAT_NL_ATTR_MIB);
+
+	ctx->entries = 0;
+	err = hnatnl_request(msg, dump_handler, ctx);
+	nlmsg_free(msg);
+	return err;
+
+nla_put_failure:
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int hnatnl_bench(struct hnatnl_filter *filter, int loops)
+{
+	struct hnatnl_ctx ctx = { .quiet = 1 };
+	double start, cost, min = 0, max = 0, total = 0;
+	int i, err;
+
+	for (i = 0; i < loops; i++) {
+		start = now_us();
+		err = hnatnl_dump(filter, &ctx);
+		cost = now_us() - start;
+		if (err < 0) {
+			printf("dump failed: %s\n", strerror(-err));
+			return err;
+		}
+
+		total += cost;
+		if (!i || cost < min)
+			min = cost;
+		if (cost > max)
+			max = cost;
+	}
+
+	printf("loops=%d entries=%lu avg=%.0fus min=%.0fus max=%.0fus (%.0f entries/s)\n",
+	       loops, ctx.entries, total / loops, min, max,
+	       total ? ctx.entries * loops * 1e6 / total : 0);
+
+	return 0;
+}
+
+static int parse_mac(const char *str, __u8 *mac)
+{
+	unsigned int m[6];
+	int i;
+
+	if (sscanf(str, "%x:%x:%x:%x:%x:%x",
+		   &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+		return -1;
+
+	for (i = 0; i < 6; i++)
+		mac[i] = m[i];
+
+	return 0;
+}
+
+static int hnatnl_bind(void)
+{
+	char line[256], sip[16], dip[16], nsip[16], ndip[16], dmac[18], smac[18];
+	struct hnatnl_ctx ctx = { 0 };
+	struct hnat_nl_static st;
+	unsigned int sport, dport, nsport, ndport;
+	struct nl_msg *msg;
+	int err, cnt = 0;
+
+	msg = nlmsg_alloc_size(1 << 16);
+	if (!msg)
+		return -ENOMEM;
+
+	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, family_id, 0, 0,
+		    HNAT_NL_CMD_BIND, HNAT_GENL_VERSION);
+
+	while (fgets(line, sizeof(line), stdin)) {
+		memset(&st, 0, sizeof(st));
+		if (sscanf(line, "%d %x %15s %15s %u %u %x %15s %15s %u %u %17s %17s",
+			   &st.hash, &st.info1, sip, dip, &sport, &dport,
+			   &st.info2, nsip, ndip, &nsport, &ndport,
+			   dmac, smac) != 13)
+			continue;
+
+		if (inet_pton(AF_INET, sip, &st.sip[0]) != 1 ||
+		    inet_pton(AF_INET, dip, &st.dip[0]) != 1 ||
+		    inet_pton(AF_INET, nsip, &st.new_sip) != 1 ||
+		    inet_pton(AF_INET, ndip, &st.new_dip) != 1 ||
+		    parse_mac(dmac, st.dmac) || parse_mac(smac, st.smac)) {
+			printf("skip bad line: %s", line);
+			continue;
+		}
+
+		st.sport = sport;
+		st.dport = dport;
+		st.new_sport = nsport;
+		st.new_dport = ndport;
+		NLA_PUT(msg, HNAT_NL_ATTR_STATIC, sizeof(st), &st);
+		cnt++;
+	}
+
+	if (!cnt) {
+		printf("no entry to bind\n");
+		nlmsg_free(msg);
+		return -EINVAL;
+	}
+
+	err = hnatnl_request(msg, bind_handler, &ctx);
+	nlmsg_free(msg);
+	return err;
+
+nla_put_failure:
+	printf("too many entries in one batch\n");
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+static int hnatnl_unbind(int argc, char *argv[])
+{
+	struct hnatnl_ctx ctx = { 0 };
+	struct hnat_nl_id id;
+	struct nl_msg *msg;
+	int i, err;
+
+	msg = nlmsg_alloc_size(1 << 16);
+	if (!msg)
+		return -ENOMEM;
+
+	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, family_id, 0, 0,
+		    HNAT_NL_CMD_UNBIND, HNAT_GENL_VERSION);
+
+	for (i = 0; i < argc; i++) {
+		if (sscanf(argv[i], "%u:%d", &id.ppe_id, &id.index) != 2) {
+			printf("bad entry id: %s\n", argv[i]);
+			nlmsg_free(msg);
+			return -EINVAL;
+		}
+		NLA_PUT(msg, HNAT_NL_ATTR_ID, sizeof(id), &id);
+	}
+
+	err = hnatnl_request(msg, NULL, &ctx);
+	nlmsg_free(msg);
+	return err;
+
+nla_put_failure:
+	printf("too many entries in one batch\n");
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+struct hnatnl_xlat {
+	int flush;
+	int has_prefix;
+	struct in6_addr prefix;
+	int prefix_len;
+};
+
+static int xlat_dump_handler(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	char v4[INET_ADDRSTRLEN], v6[INET6_ADDRSTRLEN];
+	struct hnatnl_ctx *ctx = arg;
+	struct hnat_nl_xlat_map map;
+	struct nlattr *nla;
+	int rem;
+
+	nla_for_each_attr(nla, genlmsg_attrdata(gnlh, 0),
+			  genlmsg_attrlen(gnlh, 0), rem) {
+		switch (nla_type(nla)) {
+		case HNAT_NL_ATTR_XLAT_PREFIX:
+			if (nla_len(nla) < (int)sizeof(struct in6_addr))
+				break;
+			inet_ntop(AF_INET6, nla_data(nla), v6, sizeof(v6));
+			printf("prefix=%s\n", v6);
+			break;
+		case HNAT_NL_ATTR_XLAT_PREFIX_LEN:
+			printf("prefix_len=%u\n", nla_get_u8(nla));
+			break;
+		case HNAT_NL_ATTR_XLAT_MAP:
+			if (nla_len(nla) < (int)sizeof(map))
+				break;
+			memcpy(&map, nla_data(nla), sizeof(map));
+			inet_ntop(AF_INET, &map.ipv4, v4, sizeof(v4));
+			inet_ntop(AF_INET6, map.ipv6, v6, sizeof(v6));
+			printf("map: %s<=>%s\n", v4, v6);
+			ctx->entries++;
+			break;
+		}
+	}
+
+	return NL_OK;
+}
+
+static int hnatnl_xlat(const char *op, struct hnatnl_xlat *conf)
+{
+	char line[256], v4[64], v6[64];
+	struct hnatnl_ctx ctx = { 0 };
+	struct hnat_nl_xlat_map map;
+	struct nl_msg *msg;
+	int cmd, flags = 0, err, cnt = 0;
+
+	if (!strcmp(op, "add")) {
+		cmd = HNAT_NL_CMD_XLAT_ADD;
+	} else if (!strcmp(op, "del")) {
+		cmd = HNAT_NL_CMD_XLAT_DEL;
+	} else if (!strcmp(op, "show")) {
+		cmd = HNAT_NL_CMD_XLAT_DUMP;
+		flags = NLM_F_DUMP;
+	} else {
+		printf("unknown xlat command: %s\n", op);
+		return -EINVAL;
+	}
+
+	msg = nlmsg_alloc_size(1 << 18);
+	if (!msg)
+		return -ENOMEM;
+
+	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, family_id, 0, flags,
+		    cmd, HNAT_GENL_VERSION);
+
+	if (cmd == HNAT_NL_CMD_XLAT_DUMP) {
+		err = hnatnl_request(msg, xlat_dump_handler, &ctx);
+		if (!err)
+			printf("total %lu maps\n", ctx.entries);
+		nlmsg_free(msg);
+		return err;
+	}
+
+	if (cmd == HNAT_NL_CMD_XLAT_ADD) {
+		if (conf->flush)
+			NLA_PUT_FLAG(msg, HNAT_NL_ATTR_FLUSH);
+		if (conf->has_prefix)
+			NLA_PUT(msg, HNAT_NL_ATTR_XLAT_PREFIX,
+				sizeof(conf->prefix), &conf->prefix);
+		if (conf->prefix_len >= 0)
+			NLA_PUT_U8(msg, HNAT_NL_ATTR_XLAT_PREFIX_LEN,
+				   conf->prefix_len);
+	}
+
+	/* maps come from stdin unless only the prefix is being changed */
+	if (cmd == HNAT_NL_CMD_XLAT_DEL || (!conf->has_prefix &&
+	    conf->prefix_len < 0) || !isatty(fileno(stdin))) {
+		while (fgets(line, sizeof(line), stdin)) {
+			if (sscanf(line, "%63s %63s", v4, v6) != 2)
+				continue;
+
+			memset(&map, 0, sizeof(map));
+			if (inet_pton(AF_INET, v4, &map.ipv4) != 1 ||
+			    inet_pton(AF_INET6, v6, map.ipv6) != 1) {
+				printf("skip bad line: %s", line);
+				continue;
+			}
+
+			NLA_PUT(msg, HNAT_NL_ATTR_XLAT_MAP, sizeof(map), &map);
+			cnt++;
+		}
+	}
+
+	err = hnatnl_request(msg, NULL, &ctx);
+	if (!err)
+		printf("%s %d maps\n", cmd == HNAT_NL_CMD_XLAT_ADD ?
+		       "added" : "deleted", cnt);
+	nlmsg_free(msg);
+	return err;
+
+nla_put_failure:
+	printf("too many maps in one batch\n");
+	nlmsg_free(msg);
+	return -EMSGSIZE;
+}
+
+static int qos_show_handler(struct nl_msg *msg, void *arg)
+{
+	struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
+	struct hnat_nl_qos_queue q;
+	struct hnat_nl_qos_sch sch;
+	struct hnatnl_ctx *ctx = arg;
+	struct nlattr *nla;
+	int rem;
+
+	nla_for_each_attr(nla, genlmsg_attrdata(gnlh, 0),
+			  genlmsg_attrlen(gnlh, 0), rem) {
+		switch (nla_type(nla)) {
+		case HNAT_NL_ATTR_QOS_SCH:
+			if (nla_len(nla) < (int)sizeof(sch))
+				break;
+			memcpy(&sch, nla_data(nla), sizeof(sch));
+			printf("sch %u %u %s %u\n", sch.id, sch.enable,
+			       sch.wrr ? "wrr" : "sp", sch.max_rate);
+			break;
+		case HNAT_NL_ATTR_QOS_QUEUE:
+			if (nla_len(nla) < (int)sizeof(q))
+				break;
+			memcpy(&q, nla_data(nla), sizeof(q));
+			printf("queue %u %u %u %u %u %u %u %u\n", q.id,
+			       q.scheduler, q.min_en, q.min_rate, q.max_en,
+			       q.max_rate, q.weight, q.resv);
+			ctx->entries++;
+			break;
+		}
+	}
+
+	return NL_OK;
+}
+
+static int qos_parse_line(struct nl_msg *msg, const char *line)
+{
+	struct hnat_nl_qos_queue q;
+	struct hnat_nl_qos_sch sch;
+	unsigned int v[8];
+	char mode[8];
+
+	if (sscanf(line, "sch %u %u %7s %u", &v[0], &v[1], mode, &v[2]) == 4) {
+		memset(&sch, 0, sizeof(sch));
+		sch.id = v[0];
+		sch.enable = !!v[1];
+		sch.wrr = strcmp(mode, "sp") != 0;
+		sch.max_rate = v[2];
+		return nla_put(msg, HNAT_NL_ATTR_QOS_SCH, sizeof(sch), &sch);
+	}
+
+	if (sscanf(line, "queue %u %u %u %u %u %u %u %u", &v[0], &v[1], &v[2],
+		   &v[3], &v[4], &v[5], &v[6], &v[7]) == 8) {
+		memset(&q, 0, sizeof(q));
+		q.id = v[0];
+		q.scheduler = v[1];
+		q.min_en = !!v[2];
+		q.min_rate = v[3];
+		q.max_en = !!v[4];
+		q.max_rate = v[5];
+		q.weight = v[6];
+		q.resv = v[7];
+		return nla_put(msg, HNAT_NL_ATTR_QOS_QUEUE, sizeof(q), &q);
+	}
+
+	return 1;
+}
+
+static struct nl_msg *qos_msg_alloc(int cmd)
+{
+	struct nl_msg *msg;
+
+	msg = nlmsg_alloc_size(1 << 12);
+	if (!msg)
+		return NULL;
+
+	genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ, family_id, 0, 0,
+		    cmd, HNAT_GENL_VERSION);
+
+	return msg;
+}
+
+/* Each plan moves every queue to another rate, so both plans cost the
+ * same number of register writes. The netlink path sends one message per
+ * plan, the debugfs path one write per queue as scripts used to do.
+ */
+static int hnatnl_qos_bench(int loops)
+{
+	char line[128], path[64];
+	double start, nl_cost, fs_cost = 0;
+	struct hnatnl_ctx ctx = { 0 };
+	struct nl_msg *msg;
+	int i, q, err = 0;
+	FILE *fp;
+
+	start = now_us();
+	for (i = 0; i < loops; i++) {
+		msg = qos_msg_alloc(HNAT_NL_CMD_QOS_SET);
+		if (!msg)
+			return -ENOMEM;
+
+		for (q = 0; q < 16; q++) {
+			snprintf(line, sizeof(line), "queue %d 0 1 1000 1 %d 4 4",
+				 q, (i & 1) ? 500000 : 1000000);
+			if (qos_parse_line(msg, line) < 0) {
+				nlmsg_free(msg);
+				return -EMSGSIZE;
+			}
+		}
+
+		err = hnatnl_request(msg, NULL, &ctx);
+		nlmsg_free(msg);
+		if (err < 0)
+			return err;
+	}
+	nl_cost = now_us() - start;
+
+	start = now_us();
+	for (i = 0; i < loops; i++) {
+		for (q = 0; q < 16; q++) {
+			snprintf(path, sizeof(path),
+				 "/sys/kernel/debug/hnat/qdma_txq%d", q);
+			fp = fopen(path, "w");
+			if (!fp)
+				goto out;
+			fprintf(fp, "0 1 1000 1 %d 4 4\n",
+				(i & 1) ? 500000 : 1000000);
+			fclose(fp);
+		}
+	}
+	fs_cost = now_us() - start;
+
+out:
+	printf("loops=%d queues=16 netlink=%.1fus/plan", loops, nl_cost / loops);
+	if (fs_cost)
+		printf(" debugfs=%.1fus/plan", fs_cost / loops);
+	printf("\n");
+
+	return 0;
+}
+
+static int hnatnl_qos(const char *op, int loops)
+{
+	struct hnatnl_ctx ctx = { 0 };
+	struct nl_msg *msg;
+	char line[128];
+	int err, cnt = 0;
+
+	if (!strcmp(op, "bench"))
+		return hnatnl_qos_bench(loops > 0 ? loops : 1);
+
+	if (!strcmp(op, "show")) {
+		msg = qos_msg_alloc(HNAT_NL_CMD_QOS_GET);
+		if (!msg)
+			return -ENOMEM;
+		err = hnatnl_request(msg, qos_show_handler, &ctx);
+		nlmsg_free(msg);
+		return err;
+	}
+
+	if (strcmp(op, "set")) {
+		printf("unknown qos command: %s\n", op);
+		return -EINVAL;
+	}
+
+	msg = qos_msg_alloc(HNAT_NL_CMD_QOS_SET);
+	if (!msg)
+		return -ENOMEM;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		err = qos_parse_line(msg, line);
+		if (err > 0) {
+			printf("skip bad line: %s", line);
+			continue;
+		} else if (err < 0) {
+			printf("too many items in one batch\n");
+			nlmsg_free(msg);
+			return -EMSGSIZE;
+		}
+		cnt++;
+	}
+
+	err = hnatnl_request(msg, NULL, &ctx);
+	if (!err)
+		printf("programmed %d items\n", cnt);
+	nlmsg_free(msg);
+	return err;
+}
+
+int main(int argc, char *argv[])
+{
+	struct hnatnl_filter filter = {
+		.state = -1, .ppe_id = -1, .port = -1,
+	};
+	struct hnatnl_xlat xlat = { .prefix_len = -1 };
+	struct hnatnl_ctx ctx = { 0 };
+	char *cmd, *op = NULL;
+	int loops = 100;
+	int c, err;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	cmd = argv[1];
+	optind = 2;
+	if (!strcmp(cmd, "xlat") || !strcmp(cmd, "qos")) {
+		if (argc < 3) {
+			usage(argv[0]);
+			return -EINVAL;
+		}
+		op = argv[2];
+		optind = 3;
+	}
+
+	while ((c = getopt(argc, argv, "s:p:4:6:P:mn:Fx:l:")) != -1) {
+		switch (c) {
+		case 's':
+			filter.state = atoi(optarg);
+			break;
+		case 'p':
+			filter.ppe_id = atoi(optarg);
+			break;
+		case '4':
+			if (inet_pton(AF_INET, optarg, &filter.ipv4) != 1) {
+				printf("bad IPv4 address: %s\n", optarg);
+				return -EINVAL;
+			}
+			filter.has_ipv4 = 1;
+			break;
+		case '6':
+			if (inet_pton(AF_INET6, optarg, &filter.ipv6) != 1) {
+				printf("bad IPv6 address: %s\n", optarg);
+				return -EINVAL;
+			}
+			filter.has_ipv6 = 1;
+			break;
+		case 'P':
+			filter.port = atoi(optarg);
+			break;
+		case 'm':
+			filter.mib = 1;
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		case 'F':
+			xlat.flush = 1;
+			break;
+		case 'x':
+			if (inet_pton(AF_INET6, optarg, &xlat.prefix) != 1) {
+				printf("bad IPv6 prefix: %s\n", optarg);
+				return -EINVAL;
+			}
+			xlat.has_prefix = 1;
+			break;
+		case 'l':
+			xlat.prefix_len = atoi(optarg);
+			if (xlat.prefix_len < 0 || xlat.prefix_len > 128) {
+				printf("bad IPv6 prefix length: %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (hnatnl_init())
+		return -EINVAL;
+
+	if (!strcmp(cmd, "dump")) {
+		err = hnatnl_dump(&filter, &ctx);
+		if (!err)
+			printf("total %lu entries\n", ctx.entries);
+	} else if (!strcmp(cmd, "bench")) {
+		err = hnatnl_bench(&filter, loops > 0 ? loops : 1);
+	} else if (!strcmp(cmd, "bind")) {
+		err = hnatnl_bind();
+	} else if (!strcmp(cmd, "unbind")) {
+		err = hnatnl_unbind(argc - optind, &argv[optind]);
+	} else if (!strcmp(cmd, "xlat")) {
+		err = hnatnl_xlat(op, &xlat);
+	} else if (!strcmp(cmd, "qos")) {
+		err = hnatnl_qos(op, loops);
+	} else {
+		usage(argv[0]);
+		err = -EINVAL;
+	}
+
+	if (err < 0)
+		printf("%s failed: %s\n", cmd, strerror(-err));
+
+	hnatnl_free();
+	return err < 0 ? 1 : 0;
+}
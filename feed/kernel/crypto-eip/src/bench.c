@@ -0,0 +1,526 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 MediaTek Inc.
+ */
+
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/rtnetlink.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include <crypto/aead.h>
+#include <crypto/authenc.h>
+#include <crypto/hash.h>
+#include <crypto/skcipher.h>
+
+#include "crypto-eip/crypto-eip.h"
+#include "crypto-eip/ddk-wrapper.h"
+#include "crypto-eip/debugfs.h"
+#include "crypto-eip/internal.h"
+#include "crypto-eip/lookaside.h"
+
+#define MTK_CRYPTO_BENCH_MAX_JOBS	8
+#define MTK_CRYPTO_BENCH_MAX_DEPTH	64
+#define MTK_CRYPTO_BENCH_MAX_LEN	65536
+#define MTK_CRYPTO_BENCH_MAX_KEY	64
+#define MTK_CRYPTO_BENCH_AUTH_KEY	32
+#define MTK_CRYPTO_BENCH_AAD		16
+#define MTK_CRYPTO_BENCH_TAIL		64	/* room for the tag or digest */
+
+/* Latency histogram: 8 linear buckets per power of two of nanoseconds */
+#define MTK_CRYPTO_BENCH_HIST_SUB	3
+#define MTK_CRYPTO_BENCH_HIST_SIZE	(64 << MTK_CRYPTO_BENCH_HIST_SUB)
+
+enum mtk_crypto_bench_type {
+	MTK_CRYPTO_BENCH_SKCIPHER,
+	MTK_CRYPTO_BENCH_AEAD,
+	MTK_CRYPTO_BENCH_AHASH,
+};
+
+static const char * const mtk_crypto_bench_types[] = {
+	[MTK_CRYPTO_BENCH_SKCIPHER] = "skcipher",
+	[MTK_CRYPTO_BENCH_AEAD] = "aead",
+	[MTK_CRYPTO_BENCH_AHASH] = "ahash",
+};
+
+struct mtk_crypto_bench_job {
+	enum mtk_crypto_bench_type type;
+	char alg[CRYPTO_MAX_ALG_NAME];
+	char driver[CRYPTO_MAX_ALG_NAME];
+	unsigned int keylen;
+	unsigned int len;
+	unsigned int depth;
+	unsigned int count;
+
+	union {
+		struct crypto_skcipher *skcipher;
+		struct crypto_aead *aead;
+		struct crypto_ahash *ahash;
+	};
+
+	/* Results of the last run */
+	int err;
+	u64 ops;
+	u64 ns;
+	u64 max_ns;
+	u32 hist[MTK_CRYPTO_BENCH_HIST_SIZE];
+};
+
+struct mtk_crypto_bench_worker {
+	struct mtk_crypto_bench_job *job;
+	struct completion *start;
+	struct completion done;
+	unsigned int count;
+	int err;
+	u64 ops;
+	u64 end_ns;
+	u64 max_ns;
+	u32 hist[MTK_CRYPTO_BENCH_HIST_SIZE];
+};
+
+static DEFINE_MUTEX(mtk_crypto_bench_lock);
+static struct mtk_crypto_bench_job *mtk_crypto_bench_jobs[MTK_CRYPTO_BENCH_MAX_JOBS];
+static unsigned int mtk_crypto_bench_num;
+
+static unsigned int mtk_crypto_bench_hist_idx(u64 ns)
+{
+	unsigned int shift;
+
+	if (ns < (1 << MTK_CRYPTO_BENCH_HIST_SUB))
+		return ns;
+
+	shift = fls64(ns) - 1 - MTK_CRYPTO_BENCH_HIST_SUB;
+
+	return ((shift + 1) << MTK_CRYPTO_BENCH_HIST_SUB) +
+	       ((ns >> shift) & ((1 << MTK_CRYPTO_BENCH_HIST_SUB) - 1));
+}
+
+/* Lower bound of a bucket, the inverse of mtk_crypto_bench_hist_idx() */
+static u64 mtk_crypto_bench_hist_ns(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < (1 << MTK_CRYPTO_BENCH_HIST_SUB))
+		return idx;
+
+	shift = (idx >> MTK_CRYPTO_BENCH_HIST_SUB) - 1;
+
+	return (u64)((1 << MTK_CRYPTO_BENCH_HIST_SUB) |
+		     (idx & ((1 << MTK_CRYPTO_BENCH_HIST_SUB) - 1))) << shift;
+}
+
+/* @permille of the samples completed within the returned latency */
+static u64 mtk_crypto_bench_percentile(struct mtk_crypto_bench_job *job,
+				       unsigned int permille)
+{
+	u64 want = div_u64(job->ops * permille + 999, 1000);
+	u64 seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < MTK_CRYPTO_BENCH_HIST_SIZE; i++) {
+		seen += job->hist[i];
+		if (seen >= want)
+			return mtk_crypto_bench_hist_ns(i);
+	}
+
+	return job->max_ns;
+}
+
+static int mtk_crypto_bench_setkey(struct mtk_crypto_bench_job *job)
+{
+	u8 key[RTA_SPACE(sizeof(struct crypto_authenc_key_param)) +
+	       MTK_CRYPTO_BENCH_AUTH_KEY + MTK_CRYPTO_BENCH_MAX_KEY];
+	struct crypto_authenc_key_param *param;
+	struct rtattr *rta = (struct rtattr *)key;
+	unsigned int keylen = job->keylen;
+
+	get_random_bytes(key, sizeof(key));
+
+	switch (job->type) {
+	case MTK_CRYPTO_BENCH_SKCIPHER:
+		return crypto_skcipher_setkey(job->skcipher, key, keylen);
+	case MTK_CRYPTO_BENCH_AEAD:
+		/* authenc() takes the HMAC key and keylen bytes of cipher key */
+		if (!strncmp(crypto_aead_alg(job->aead)->base.cra_name, "authenc(", 8)) {
+			rta->rta_type = CRYPTO_AUTHENC_KEYA_PARAM;
+			rta->rta_len = RTA_LENGTH(sizeof(*param));
+			param = RTA_DATA(rta);
+			param->enckeylen = cpu_to_be32(keylen);
+			keylen += RTA_SPACE(sizeof(*param)) + MTK_CRYPTO_BENCH_AUTH_KEY;
+		}
+		return crypto_aead_setkey(job->aead, key, keylen);
+	case MTK_CRYPTO_BENCH_AHASH:
+		if (!(crypto_ahash_get_flags(job->ahash) & CRYPTO_TFM_NEED_KEY))
+			return 0;
+		return crypto_ahash_setkey(job->ahash, key, keylen);
+	}
+
+	return -EINVAL;
+}
+
+static void mtk_crypto_bench_tfm_free(struct mtk_crypto_bench_job *job)
+{
+	switch (job->type) {
+	case MTK_CRYPTO_BENCH_SKCIPHER:
+		crypto_free_skcipher(job->skcipher);
+		break;
+	case MTK_CRYPTO_BENCH_AEAD:
+		crypto_free_aead(job->aead);
+		break;
+	case MTK_CRYPTO_BENCH_AHASH:
+		crypto_free_ahash(job->ahash);
+		break;
+	}
+
+	job->skcipher = NULL;
+}
+
+static int mtk_crypto_bench_tfm_alloc(struct mtk_crypto_bench_job *job)
+{
+	struct crypto_tfm *tfm;
+	int ret;
+
+	switch (job->type) {
+	case MTK_CRYPTO_BENCH_SKCIPHER:
+		job->skcipher = crypto_alloc_skcipher(job->alg, 0, 0);
+		if (IS_ERR(job->skcipher))
+			return PTR_ERR(job->skcipher);
+		tfm = crypto_skcipher_tfm(job->skcipher);
+		break;
+	case MTK_CRYPTO_BENCH_AEAD:
+		job->aead = crypto_alloc_aead(job->alg, 0, 0);
+		if (IS_ERR(job->aead))
+			return PTR_ERR(job->aead);
+		tfm = crypto_aead_tfm(job->aead);
+		break;
+	default:
+		job->ahash = crypto_alloc_ahash(job->alg, 0, 0);
+		if (IS_ERR(job->ahash))
+			return PTR_ERR(job->ahash);
+		tfm = crypto_ahash_tfm(job->ahash);
+		break;
+	}
+
+	strscpy(job->driver, crypto_tfm_alg_driver_name(tfm), sizeof(job->driver));
+
+	ret = mtk_crypto_bench_setkey(job);
+	if (ret)
+		mtk_crypto_bench_tfm_free(job);
+
+	return ret;
+}
+
+static int mtk_crypto_bench_thread(void *data)
+{
+	struct mtk_crypto_bench_worker *w = data;
+	struct mtk_crypto_bench_job *job = w->job;
+	struct skcipher_request *skreq = NULL;
+	struct ahash_request *hreq = NULL;
+	struct aead_request *areq = NULL;
+	struct crypto_wait wait;
+	struct scatterlist sg;
+	u8 iv[32], digest[64];
+	unsigned int i;
+	u64 start, ns;
+	u8 *buf;
+	int ret = -ENOMEM;
+
+	buf = kmalloc(MTK_CRYPTO_BENCH_AAD + job->len + MTK_CRYPTO_BENCH_TAIL, GFP_KERNEL);
+	if (!buf)
+		goto out;
+
+	get_random_bytes(buf, MTK_CRYPTO_BENCH_AAD + job->len);
+	get_random_bytes(iv, sizeof(iv));
+	crypto_init_wait(&wait);
+
+	switch (job->type) {
+	case MTK_CRYPTO_BENCH_SKCIPHER:
+		skreq = skcipher_request_alloc(job->skcipher, GFP_KERNEL);
+		if (!skreq)
+			goto out;
+		sg_init_one(&sg, buf, job->len);
+		skcipher_request_set_callback(skreq, CRYPTO_TFM_REQ_MAY_BACKLOG,
+					      crypto_req_done, &wait);
+		skcipher_request_set_crypt(skreq, &sg, &sg, job->len, iv);
+		break;
+	case MTK_CRYPTO_BENCH_AEAD:
+		areq = aead_request_alloc(job->aead, GFP_KERNEL);
+		if (!areq)
+			goto out;
+		sg_init_one(&sg, buf, MTK_CRYPTO_BENCH_AAD + job->len +
+			    crypto_aead_authsize(job->aead));
+		aead_request_set_callback(areq, CRYPTO_TFM_REQ_MAY_BACKLOG,
+					  crypto_req_done, &wait);
+		aead_request_set_ad(areq, MTK_CRYPTO_BENCH_AAD);
+		aead_request_set_crypt(areq, &sg, &sg, job->len, iv);
+		break;
+	case MTK_CRYPTO_BENCH_AHASH:
+		hreq = ahash_request_alloc(job->ahash, GFP_KERNEL);
+		if (!hreq)
+			goto out;
+		sg_init_one(&sg, buf, job->len);
+		ahash_request_set_callback(hreq, CRYPTO_TFM_REQ_MAY_BACKLOG,
+					   crypto_req_done, &wait);
+		ahash_request_set_crypt(hreq, &sg, digest, job->len);
+		break;
+	}
+
+	ret = 0;
+	wait_for_completion(w->start);
+
+	for (i = 0; i < w->count; i++) {
+		start = ktime_get_ns();
+
+		if (skreq)
+			ret = crypto_wait_req(crypto_skcipher_encrypt(skreq), &wait);
+		else if (areq)
+			ret = crypto_wait_req(crypto_aead_encrypt(areq), &wait);
+		else
+			ret = crypto_wait_req(crypto_ahash_digest(hreq), &wait);
+
+		ns = ktime_get_ns() - start;
+		if (ret)
+			break;
+
+		w->hist[mtk_crypto_bench_hist_idx(ns)]++;
+		if (ns > w->max_ns)
+			w->max_ns = ns;
+		w->ops++;
+
+		cond_resched();
+	}
+
+	w->end_ns = ktime_get_ns();
+
+out:
+	skcipher_request_free(skreq);
+	aead_request_free(areq);
+	ahash_request_free(hreq);
+	kfree(buf);
+
+	w->err = ret;
+	complete(&w->done);
+
+	return 0;
+}
+
+static int mtk_crypto_bench_run(void)
+{
+	struct mtk_crypto_bench_worker *workers[MTK_CRYPTO_BENCH_MAX_JOBS] = { NULL };
+	struct mtk_crypto_bench_job *job;
+	struct task_struct *task;
+	DECLARE_COMPLETION_ONSTACK(start);
+	u64 start_ns;
+	unsigned int i, j, k;
+	int ret = 0;
+
+	for (i = 0; i < mtk_crypto_bench_num; i++) {
+		job = mtk_crypto_bench_jobs[i];
+		job->err = 0;
+		job->ops = 0;
+		job->ns = 0;
+		job->max_ns = 0;
+		memset(job->hist, 0, sizeof(job->hist));
+
+		workers[i] = kvcalloc(job->depth, sizeof(*workers[i]), GFP_KERNEL);
+		if (!workers[i]) {
+			ret = -ENOMEM;
+			goto free;
+		}
+	}
+
+	/* Every worker parks on @start so that the jobs really overlap */
+	for (i = 0; i < mtk_crypto_bench_num; i++) {
+		job = mtk_crypto_bench_jobs[i];
+
+		for (j = 0; j < job->depth; j++) {
+			workers[i][j].job = job;
+			workers[i][j].start = &start;
+			workers[i][j].count = job->count / job->depth +
+					      (j < job->count % job->depth);
+			init_completion(&workers[i][j].done);
+
+			task = kthread_run(mtk_crypto_bench_thread, &workers[i][j],
+					   "mtk_crypto_bench/%u:%u", i, j);
+			if (IS_ERR(task)) {
+				workers[i][j].err = PTR_ERR(task);
+				complete(&workers[i][j].done);
+			}
+		}
+	}
+
+	start_ns = ktime_get_ns();
+	complete_all(&start);
+
+	for (i = 0; i < mtk_crypto_bench_num; i++) {
+		job = mtk_crypto_bench_jobs[i];
+
+		for (j = 0; j < job->depth; j++) {
+			struct mtk_crypto_bench_worker *w = &workers[i][j];
+
+			wait_for_completion(&w->done);
+
+			if (w->err && !job->err)
+				job->err = w->err;
+			if (w->end_ns > start_ns && w->end_ns - start_ns > job->ns)
+				job->ns = w->end_ns - start_ns;
+			if (w->max_ns > job->max_ns)
+				job->max_ns = w->max_ns;
+			job->ops += w->ops;
+			for (k = 0; k < MTK_CRYPTO_BENCH_HIST_SIZE; k++)
+				job->hist[k] += w->hist[k];
+		}
+	}
+
+free:
+	for (i = 0; i < mtk_crypto_bench_num; i++)
+		kvfree(workers[i]);
+
+	return ret;
+}
+
+static void mtk_crypto_bench_job_show(struct seq_file *s, unsigned int id,
+				      struct mtk_crypto_bench_job *job)
+{
+	u64 bytes = job->ops * job->len;
+
+	seq_printf(s, "job %u: %s %s (%s) key %u len %u depth %u count %u\n",
+		   id, mtk_crypto_bench_types[job->type], job->alg, job->driver,
+		   job->keylen, job->len, job->depth, job->count);
+
+	if (!job->ns)
+		return;
+
+	seq_printf(s, "  %llu ops in %llu us, %llu ops/s, %llu MB/s, err %d\n",
+		   job->ops, div_u64(job->ns, NSEC_PER_USEC),
+		   div64_u64(job->ops * NSEC_PER_SEC, job->ns),
+		   div64_u64(bytes * 1000, job->ns), job->err);
+
+	if (!job->ops)
+		return;
+
+	seq_printf(s, "  latency ns p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu\n",
+		   mtk_crypto_bench_percentile(job, 500),
+		   mtk_crypto_bench_percentile(job, 900),
+		   mtk_crypto_bench_percentile(job, 990),
+		   mtk_crypto_bench_percentile(job, 999),
+		   job->max_ns);
+}
+
+void mtk_crypto_bench_show(struct seq_file *s)
+{
+	unsigned int i;
+
+	mutex_lock(&mtk_crypto_bench_lock);
+	for (i = 0; i < mtk_crypto_bench_num; i++)
+		mtk_crypto_bench_job_show(s, i, mtk_crypto_bench_jobs[i]);
+	mutex_unlock(&mtk_crypto_bench_lock);
+}
+
+void mtk_crypto_ring_stats_show(struct seq_file *s)
+{
+	struct crypto_pe_ring_stats stats;
+	unsigned int i;
+
+	for (i = 0; i < MTK_CRYPTO_RING_NUM; i++) {
+		crypto_pe_ring_stats_get(i, &stats);
+		seq_printf(s, "ring %u submitted %llu completed %llu errors %llu inflight %u max inflight %u\n",
+			   stats.interface_id, stats.submitted, stats.completed,
+			   stats.errors, stats.inflight, stats.max_inflight);
+	}
+}
+
+static int mtk_crypto_bench_add(const char *type, const char *alg, unsigned int keylen,
+				unsigned int len, unsigned int depth, unsigned int count)
+{
+	struct mtk_crypto_bench_job *job;
+	int ret;
+
+	if (mtk_crypto_bench_num >= MTK_CRYPTO_BENCH_MAX_JOBS)
+		return -ENOSPC;
+
+	if (keylen > MTK_CRYPTO_BENCH_MAX_KEY || !len || len > MTK_CRYPTO_BENCH_MAX_LEN ||
+	    !depth || depth > MTK_CRYPTO_BENCH_MAX_DEPTH || count < depth)
+		return -EINVAL;
+
+	job = kvzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+
+	ret = match_string(mtk_crypto_bench_types, ARRAY_SIZE(mtk_crypto_bench_types), type);
+	if (ret < 0)
+		goto free;
+
+	job->type = ret;
+	strscpy(job->alg, alg, sizeof(job->alg));
+	job->keylen = keylen;
+	job->len = len;
+	job->depth = depth;
+	job->count = count;
+
+	ret = mtk_crypto_bench_tfm_alloc(job);
+	if (ret)
+		goto free;
+
+	mtk_crypto_bench_jobs[mtk_crypto_bench_num++] = job;
+
+	return 0;
+
+free:
+	kvfree(job);
+
+	return ret;
+}
+
+static void mtk_crypto_bench_clear(void)
+{
+	while (mtk_crypto_bench_num) {
+		struct mtk_crypto_bench_job *job;
+
+		job = mtk_crypto_bench_jobs[--mtk_crypto_bench_num];
+		mtk_crypto_bench_tfm_free(job);
+		kvfree(job);
+	}
+}
+
+int mtk_crypto_bench_cmd(const char *cmd)
+{
+	char type[16], alg[CRYPTO_MAX_ALG_NAME];
+	unsigned int keylen, len, depth, count;
+	int ret = 0;
+
+	mutex_lock(&mtk_crypto_bench_lock);
+
+	if (sscanf(cmd, "add %15s %127s %u %u %u %u", type, alg,
+		   &keylen, &len, &depth, &count) == 6) {
+		ret = mtk_crypto_bench_add(type, alg, keylen, len, depth, count);
+		if (ret)
+			CRYPTO_ERR("bench: cannot add %s %s: %d\n", type, alg, ret);
+	} else if (!strncmp(cmd, "run", 3)) {
+		ret = mtk_crypto_bench_run();
+		if (ret)
+			CRYPTO_ERR("bench: run failed: %d\n", ret);
+	} else if (!strncmp(cmd, "clear", 5)) {
+		mtk_crypto_bench_clear();
+	} else {
+		ret = -EINVAL;
+	}
+
+	mutex_unlock(&mtk_crypto_bench_lock);
+
+	return ret;
+}
+
+void mtk_crypto_bench_exit(void)
+{
+	mutex_lock(&mtk_crypto_bench_lock);
+	mtk_crypto_bench_clear();
+	mutex_unlock(&mtk_crypto_bench_lock);
+}
@@ -10,7 +10,14 @@
 #include <crypto/hash.h>
 #include <crypto/hmac.h>
 #include <crypto/md5.h>
+#include <linux/completion.h>
 #include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/udp.h>
 
 #include <crypto-eip/ddk/slad/api_pcl.h>
 #include <crypto-eip/ddk/slad/api_pcl_dtl.h>
@@ -21,12 +28,13 @@
 #include "crypto-eip/ddk-wrapper.h"
 #include "crypto-eip/internal.h"
 
-LIST_HEAD(result_list);
-
 void crypto_free_sa(void *sa_pointer)
 {
 	DMABuf_Handle_t SAHandle = {0};
 
+	if (!sa_pointer)
+		return;
+
 	SAHandle.p = sa_pointer;
 	PEC_SA_UnRegister(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
 				DMABuf_NULLHandle);
@@ -96,11 +104,29 @@ static bool crypto_iotoken_create(IOToken_Input_Dscr_t * const dscr_p,
 	return true;
 }
 
-unsigned int crypto_pe_busy_get_one(IOToken_Output_Dscr_t *const OutTokenDscr_p,
-			       u32 *OutTokenData_p,
-			       PEC_ResultDescriptor_t *RD_p)
+/*
+ * The synchronous helpers (HMAC precompute, GHASH key derivation, record
+ * invalidation) own PEC_INTERFACE_ID; the lookaside rings never touch it.
+ * Callers are serialised and sleep on the ring's result interrupt instead of
+ * spinning in udelay() until the engine answers.
+ */
+static DEFINE_MUTEX(crypto_pe_sync_lock);
+static DECLARE_COMPLETION(crypto_pe_sync_done);
+/* A command was given up on while still on ring 0, under crypto_pe_sync_lock */
+static bool crypto_pe_sync_stuck;
+struct crypto_pe_sync_stats crypto_pe_sync_stats;
+
+static void crypto_pe_sync_notify(void)
 {
-	int LoopCounter = MTK_EIP197_INLINE_NOF_TRIES;
+	complete(&crypto_pe_sync_done);
+}
+
+/* Returns 1 when a good result was taken, 0 when none is ready yet */
+static int crypto_pe_get_one(IOToken_Output_Dscr_t *const OutTokenDscr_p,
+			     u32 *OutTokenData_p,
+			     PEC_ResultDescriptor_t *RD_p)
+{
+	unsigned int Counter = 0;
 	int IOToken_Rc;
 	PEC_Status_t pecres;
 
@@ -110,85 +136,356 @@ unsigned int crypto_pe_busy_get_one(IOToken_Output_Dscr_t *const OutTokenDscr_p,
 	/* Link data structures */
 	RD_p->OutputToken_p = OutTokenData_p;
 
-	while (LoopCounter > 0) {
-		/* Try to get the processed packet from the driver */
-		unsigned int Counter = 0;
-
-		pecres = PEC_Packet_Get(PEC_INTERFACE_ID, RD_p, 1, &Counter);
-		if (pecres != PEC_STATUS_OK) {
-			/* IO error */
-			CRYPTO_ERR("PEC_Packet_Get error %d\n", pecres);
-			return 0;
+	pecres = PEC_Packet_Get(PEC_INTERFACE_ID, RD_p, 1, &Counter);
+	if (pecres != PEC_STATUS_OK) {
+		/* IO error */
+		CRYPTO_ERR("PEC_Packet_Get error %d\n", pecres);
+		return -EIO;
+	}
+
+	if (!Counter)
+		return 0;
+
+	IOToken_Rc = IOToken_Parse(OutTokenData_p, OutTokenDscr_p);
+	if (IOToken_Rc < 0) {
+		/* IO error */
+		CRYPTO_ERR("IOToken_Parse error %d\n", IOToken_Rc);
+		return -EIO;
+	}
+
+	if (OutTokenDscr_p->ErrorCode != 0) {
+		/* Packet process error */
+		CRYPTO_ERR("Result descriptor error 0x%x\n",
+			OutTokenDscr_p->ErrorCode);
+		return -EIO;
+	}
+
+	return 1;
+}
+
+/*
+ * Returns 0 when a good result was taken. On -ETIMEDOUT the command is still
+ * on ring 0 and the engine may yet write its buffers, so the caller must not
+ * release them. The next request collects the late result before it puts.
+ */
+static int crypto_pe_sync_run(PEC_CommandDescriptor_t *Cmd,
+			      IOToken_Output_Dscr_t *const OutTokenDscr_p,
+			      u32 *OutTokenData_p,
+			      PEC_ResultDescriptor_t *RD_p)
+{
+	unsigned long timeout = msecs_to_jiffies(MTK_EIP197_SYNC_TIMEOUT_MS);
+	unsigned int count = 0;
+	PEC_Status_t pecres;
+	bool slept = false, late = false;
+	u64 start;
+	int ret;
+
+	mutex_lock(&crypto_pe_sync_lock);
+
+	if (crypto_pe_sync_stuck) {
+		/* Drop the result of the abandoned command, it is not ours */
+		ret = crypto_pe_get_one(OutTokenDscr_p, OutTokenData_p, RD_p);
+		if (!ret) {
+			CRYPTO_ERR("Ring 0 still busy with an abandoned request\n");
+			ret = -EBUSY;
+			goto out;
 		}
+		crypto_pe_sync_stuck = false;
+	}
 
-		if (Counter) {
-			IOToken_Rc = IOToken_Parse(OutTokenData_p, OutTokenDscr_p);
-			if (IOToken_Rc < 0) {
-				/* IO error */
-				CRYPTO_ERR("IOToken_Parse error %d\n", IOToken_Rc);
-				return 0;
-			}
+	reinit_completion(&crypto_pe_sync_done);
+	pecres = PEC_Packet_Put(PEC_INTERFACE_ID, Cmd, 1, &count);
+	if (pecres != PEC_STATUS_OK || count != 1) {
+		CRYPTO_ERR("PEC_Packet_Put error %d, count %u\n", pecres, count);
+		ret = -EIO;
+		goto out;
+	}
 
-			if (OutTokenDscr_p->ErrorCode != 0) {
-				/* Packet process error */
-				CRYPTO_ERR("Result descriptor error 0x%x\n",
-					OutTokenDscr_p->ErrorCode);
-				return 0;
-			}
+	start = ktime_get_ns();
+	while (1) {
+		/* Arm before looking so a result landing in between still wakes us */
+		PEC_ResultNotify_Request(PEC_INTERFACE_ID, crypto_pe_sync_notify, 1);
+		ret = crypto_pe_get_one(OutTokenDscr_p, OutTokenData_p, RD_p);
+		if (ret)
+			break;
 
-			/* packet received */
-			return Counter;
+		/* A late notify from an earlier request only costs one more look */
+		timeout = wait_for_completion_timeout(&crypto_pe_sync_done, timeout);
+		slept = true;
+		if (timeout)
+			continue;
+
+		if (late) {
+			ret = crypto_pe_get_one(OutTokenDscr_p, OutTokenData_p, RD_p);
+			if (!ret) {
+				CRYPTO_ERR("Synchronous request abandoned on ring 0\n");
+				crypto_pe_sync_stuck = true;
+				ret = -ETIMEDOUT;
+			}
+			break;
 		}
 
-		/* Wait for MTK_EIP197_PKT_GET_TIMEOUT_MS milliseconds */
-		udelay(MTK_EIP197_PKT_GET_TIMEOUT_MS);
-		LoopCounter--;
+		/*
+		 * Keep the lock: the command still owns ring 0 and the caller's
+		 * buffers, so wait for it rather than let the next one Get it.
+		 */
+		CRYPTO_ERR("Synchronous request timed out, draining\n");
+		crypto_pe_sync_stats.timeouts++;
+		timeout = msecs_to_jiffies(MTK_EIP197_SYNC_DRAIN_MS);
+		late = true;
 	}
 
-	/* IO error (timeout, not result packet received) */
-	return 0;
+	crypto_pe_sync_stats.ops++;
+	if (slept)
+		crypto_pe_sync_stats.sleeps++;
+	crypto_pe_sync_stats.wait_ns += ktime_get_ns() - start;
+
+out:
+	mutex_unlock(&crypto_pe_sync_lock);
+
+	return ret > 0 ? 0 : ret;
 }
 
-unsigned int crypto_pe_get_one(IOToken_Output_Dscr_t *const OutTokenDscr_p,
-			       u32 *OutTokenData_p,
-			       PEC_ResultDescriptor_t *RD_p)
+static int crypto_pe_result_status(PEC_ResultDescriptor_t *RD_p)
 {
+	IOToken_Output_Dscr_t OutTokenDscr;
 	int IOToken_Rc;
-	unsigned int Counter = 0;
-	PEC_Status_t pecres;
-
-	ZEROINIT(*OutTokenDscr_p);
-	ZEROINIT(*RD_p);
 
-	RD_p->OutputToken_p = OutTokenData_p;
+	ZEROINIT(OutTokenDscr);
 
-	/* Try to get the processed packet from the driver */
-	pecres = PEC_Packet_Get(PEC_INTERFACE_ID, RD_p, 1, &Counter);
-	if (pecres != PEC_STATUS_OK) {
+	IOToken_Rc = IOToken_Parse(RD_p->OutputToken_p, &OutTokenDscr);
+	if (IOToken_Rc < 0) {
 		/* IO error */
-		CRYPTO_ERR("PEC_Packet_Get error %d\n", pecres);
-		return 0;
+		CRYPTO_ERR("IOToken_Parse error %d\n", IOToken_Rc);
+		return 1;
 	}
 
-	if (Counter) {
-		IOToken_Rc = IOToken_Parse(OutTokenData_p, OutTokenDscr_p);
-		if (IOToken_Rc < 0) {
-			/* IO error */
-			CRYPTO_ERR("IOToken_Parse error %d\n", IOToken_Rc);
-			return 0;
+	if (OutTokenDscr.ErrorCode == 0)
+		return 0;
+
+	/* Packet process error */
+	CRYPTO_ERR("Result descriptor error 0x%x\n", OutTokenDscr.ErrorCode);
+	if (OutTokenDscr.ErrorCode & BIT(9))
+		return -EBADMSG;
+	else if (OutTokenDscr.ErrorCode == 0x4003)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Per-ring lookaside state. Commands are staged by the ring's dequeue worker
+ * and pushed with one PEC_Packet_Put() per batch, so the doorbell is rung once
+ * for up to MTK_CRYPTO_BATCH_SIZE requests instead of once per request.
+ * Result nodes come from a fixed per-ring pool and travel with the command in
+ * User_p, so a completion is matched without a list walk or an allocation.
+ */
+struct crypto_pe_ring {
+	unsigned int interface_id;
+	PEC_NotifyFunction_t notify;
+
+	spinlock_t lock;
+	struct list_head free;
+	atomic_t inflight;
+	struct mtk_crypto_result pool[MTK_CRYPTO_RING_POOL_SIZE];
+
+	unsigned int count;
+	PEC_CommandDescriptor_t cmd[MTK_CRYPTO_BATCH_SIZE];
+	u32 token[MTK_CRYPTO_BATCH_SIZE][IOTOKEN_IN_WORD_COUNT];
+	struct mtk_crypto_result *result[MTK_CRYPTO_BATCH_SIZE];
+
+	PEC_ResultDescriptor_t res[MTK_CRYPTO_BATCH_SIZE];
+	u32 output_token[MTK_CRYPTO_BATCH_SIZE][IOTOKEN_OUT_WORD_COUNT];
+
+	/* Always-on accounting, every field has a single writer */
+	u64 submitted;			/* batch flush */
+	u64 submit_errors;
+	unsigned int max_inflight;
+	u64 completed;			/* result drain */
+	u64 result_errors;
+};
+
+static struct crypto_pe_ring crypto_rings[MTK_CRYPTO_RING_NUM];
+
+static struct mtk_crypto_result *crypto_pe_result_get(unsigned int ring_id)
+{
+	struct crypto_pe_ring *ring = &crypto_rings[ring_id];
+	struct mtk_crypto_result *result;
+
+	spin_lock_bh(&ring->lock);
+	result = list_first_entry_or_null(&ring->free, struct mtk_crypto_result, list);
+	if (result)
+		list_del(&result->list);
+	spin_unlock_bh(&ring->lock);
+
+	return result;
+}
+
+static void crypto_pe_result_put(struct crypto_pe_ring *ring,
+				 struct mtk_crypto_result *result)
+{
+	spin_lock_bh(&ring->lock);
+	list_add(&result->list, &ring->free);
+	spin_unlock_bh(&ring->lock);
+}
+
+static void crypto_pe_ring_results(struct crypto_pe_ring *ring)
+{
+	struct mtk_crypto_result *rd;
+	struct mtk_crypto_context *ctx;
+	PEC_Status_t pecres;
+	unsigned int count;
+	unsigned int i;
+	int ret;
+
+	while (atomic_read(&ring->inflight)) {
+		for (i = 0; i < MTK_CRYPTO_BATCH_SIZE; i++) {
+			ZEROINIT(ring->res[i]);
+			ring->res[i].OutputToken_p = ring->output_token[i];
 		}
-		if (OutTokenDscr_p->ErrorCode != 0) {
-			/* Packet process error */
-			CRYPTO_ERR("Result descriptor error 0x%x\n",
-				OutTokenDscr_p->ErrorCode);
-			return 0;
+
+		/* Drain everything that is ready with a single ring access */
+		count = 0;
+		pecres = PEC_Packet_Get(ring->interface_id, ring->res,
+					MTK_CRYPTO_BATCH_SIZE, &count);
+		if (pecres != PEC_STATUS_OK)
+			CRYPTO_ERR("PEC_Packet_Get ring %u error %d\n",
+				   ring->interface_id, pecres);
+
+		if (!count) {
+			PEC_ResultNotify_Request(ring->interface_id, ring->notify, 1);
+			return;
+		}
+
+		atomic_sub(count, &ring->inflight);
+		ring->completed += count;
+
+		for (i = 0; i < count; i++) {
+			rd = ring->res[i].User_p;
+			if (!rd) {
+				CRYPTO_ERR("result without pending request\n");
+				continue;
+			}
+
+			ret = crypto_pe_result_status(&ring->res[i]);
+			if (ret)
+				ring->result_errors++;
+			ctx = crypto_tfm_ctx(rd->async->tfm);
+			ctx->handle_result(rd, ret);
+			crypto_pe_result_put(ring, rd);
 		}
-		/* packet received */
-		return Counter;
 	}
+}
 
-	/* IO error (timeout, not result packet received) */
-	return 0;
+/* PEC notify callbacks take no argument, so each ring gets its own */
+#define CRYPTO_PE_RING_NOTIFY(n)				\
+static void crypto_pe_ring##n##_notify(void)			\
+{								\
+	crypto_pe_ring_results(&crypto_rings[n]);		\
+}
+
+CRYPTO_PE_RING_NOTIFY(0)
+CRYPTO_PE_RING_NOTIFY(1)
+CRYPTO_PE_RING_NOTIFY(2)
+CRYPTO_PE_RING_NOTIFY(3)
+
+static const PEC_NotifyFunction_t crypto_pe_ring_notify[] = {
+	crypto_pe_ring0_notify,
+	crypto_pe_ring1_notify,
+	crypto_pe_ring2_notify,
+	crypto_pe_ring3_notify,
+};
+
+void crypto_pe_ring_init(void)
+{
+	struct crypto_pe_ring *ring;
+	unsigned int i, j;
+
+	BUILD_BUG_ON(ARRAY_SIZE(crypto_pe_ring_notify) != MTK_CRYPTO_RING_NUM);
+
+	for (i = 0; i < MTK_CRYPTO_RING_NUM; i++) {
+		ring = &crypto_rings[i];
+		ring->interface_id = MTK_CRYPTO_RING_BASE + i;
+		ring->notify = crypto_pe_ring_notify[i];
+		spin_lock_init(&ring->lock);
+		atomic_set(&ring->inflight, 0);
+		INIT_LIST_HEAD(&ring->free);
+		for (j = 0; j < MTK_CRYPTO_RING_POOL_SIZE; j++)
+			list_add_tail(&ring->pool[j].list, &ring->free);
+	}
+}
+
+void crypto_pe_batch_flush(unsigned int ring_id)
+{
+	struct crypto_pe_ring *ring = &crypto_rings[ring_id];
+	struct mtk_crypto_context *ctx;
+	unsigned int inflight;
+	unsigned int count = 0;
+	unsigned int i;
+	int rc;
+
+	if (!ring->count)
+		return;
+
+	/* Account for the batch before the doorbell, results may be back at once */
+	inflight = atomic_add_return(ring->count, &ring->inflight);
+	if (inflight > ring->max_inflight)
+		ring->max_inflight = inflight;
+
+	rc = PEC_Packet_Put(ring->interface_id, ring->cmd, ring->count, &count);
+	if (rc != PEC_STATUS_OK || count < ring->count) {
+		CRYPTO_ERR("PEC_Packet_Put ring %u error: %d, %u of %u queued\n",
+			   ring->interface_id, rc, count, ring->count);
+		if (rc != PEC_STATUS_OK)
+			count = 0;
+
+		/*
+		 * Nothing can complete the tail, hand it back with an error.
+		 * Not -EBUSY: to a MAY_BACKLOG caller that means "backlogged"
+		 * and it would wait for a completion that never comes.
+		 */
+		atomic_sub(ring->count - count, &ring->inflight);
+		ring->submit_errors += ring->count - count;
+		for (i = count; i < ring->count; i++) {
+			ctx = crypto_tfm_ctx(ring->result[i]->async->tfm);
+			ctx->handle_result(ring->result[i], -ENOSPC);
+			crypto_pe_result_put(ring, ring->result[i]);
+		}
+	}
+
+	ring->submitted += count;
+	ring->count = 0;
+
+	if (count)
+		PEC_ResultNotify_Request(ring->interface_id, ring->notify, 1);
+}
+
+void crypto_pe_ring_stats_get(unsigned int ring_id, struct crypto_pe_ring_stats *stats)
+{
+	struct crypto_pe_ring *ring = &crypto_rings[ring_id];
+
+	stats->interface_id = ring->interface_id;
+	stats->submitted = READ_ONCE(ring->submitted);
+	stats->completed = READ_ONCE(ring->completed);
+	stats->errors = READ_ONCE(ring->submit_errors) + READ_ONCE(ring->result_errors);
+	stats->inflight = atomic_read(&ring->inflight);
+	stats->max_inflight = READ_ONCE(ring->max_inflight);
+}
+
+static void crypto_pe_batch_add(unsigned int ring_id, PEC_CommandDescriptor_t *Cmd,
+				struct mtk_crypto_result *result)
+{
+	struct crypto_pe_ring *ring = &crypto_rings[ring_id];
+	unsigned int i = ring->count;
+
+	ring->cmd[i] = *Cmd;
+	memcpy(ring->token[i], Cmd->InputToken_p, sizeof(ring->token[i]));
+	ring->cmd[i].InputToken_p = ring->token[i];
+	ring->cmd[i].User_p = result;
+	ring->result[i] = result;
+
+	if (++ring->count == MTK_CRYPTO_BATCH_SIZE)
+		crypto_pe_batch_flush(ring_id);
 }
 
 SABuilder_Crypto_Mode_t lookaside_match_alg_mode(enum mtk_crypto_cipher_mode mode)
@@ -255,49 +552,185 @@ SABuilder_Auth_t aead_hash_match(enum mtk_crypto_alg alg)
 	}
 }
 
-void mtk_crypto_interrupt_handler(void)
+static void crypto_cipher_sa_params(struct mtk_crypto_cipher_ctx *ctx,
+				    SABuilder_Params_t *params,
+				    SABuilder_Params_Basic_t *ProtocolParams,
+				    unsigned int digestsize, u8 *iv)
 {
-	struct mtk_crypto_result *rd;
-	struct mtk_crypto_context *ctx;
-	IOToken_Output_Dscr_t OutTokenDscr;
-	PEC_ResultDescriptor_t Res;
-	uint32_t OutputToken[IOTOKEN_OUT_WORD_COUNT];
-	int ret = 0;
+	params->CryptoAlgo = lookaside_match_alg_name(ctx->alg);
+	params->CryptoMode = lookaside_match_alg_mode(ctx->mode);
+	params->KeyByteCount = ctx->key_len;
+	params->Key_p = (uint8_t *) ctx->key;
+
+	/*
+	 * CCM still carries its IV in the SA, so such an SA is only good for
+	 * one request. Every other mode takes the IV from the token.
+	 */
+	if (params->CryptoMode == SAB_CRYPTO_MODE_CCM) {
+		params->IVSrc = SAB_IV_SRC_SA;
+		params->Nonce_p = (uint8_t *) &ctx->nonce + 1;
+		params->IV_p = iv;
+	} else if (params->CryptoMode != SAB_CRYPTO_MODE_ECB) {
+		params->IVSrc = SAB_IV_SRC_TOKEN;
+		params->Nonce_p = (uint8_t *) &ctx->nonce;
+	}
+
+	if (params->CryptoMode == SAB_CRYPTO_MODE_GCM &&
+	    ctx->aead == EIP197_AEAD_TYPE_IPSEC_ESP)
+		params->flags |= SAB_FLAG_COPY_IV;
+
+	if (ctx->aead) {
+		params->AuthAlgo = aead_hash_match(ctx->hash_alg);
+		params->AuthKey1_p = (uint8_t *) ctx->ipad;
+		params->AuthKey2_p = (uint8_t *) ctx->opad;
+		ProtocolParams->ICVByteCount = digestsize;
+	}
+}
 
-	while (true) {
-		spin_lock_bh(&add_lock);
-		if (list_empty(&result_list)) {
-			spin_unlock_bh(&add_lock);
-			return;
-		}
-		rd = list_first_entry(&result_list, struct mtk_crypto_result, list);
-		spin_unlock_bh(&add_lock);
-
-		if (crypto_pe_get_one(&OutTokenDscr, OutputToken, &Res) < 1) {
-			PEC_NotifyFunction_t CBFunc;
-
-			CBFunc = mtk_crypto_interrupt_handler;
-			if (OutTokenDscr.ErrorCode == 0) {
-				PEC_ResultNotify_Request(PEC_INTERFACE_ID, CBFunc, 1);
-				return;
-			} else if (OutTokenDscr.ErrorCode & BIT(9)) {
-				ret = -EBADMSG;
-			} else if (OutTokenDscr.ErrorCode == 0x4003) {
-				ret = 0;
-			} else
-				ret = 1;
-
-			CRYPTO_ERR("error from crypto_pe_get_one: %d\n", ret);
-		}
+static int crypto_cipher_sa_build(struct mtk_crypto_cipher_ctx *ctx,
+				  enum mtk_crypto_cipher_direction dir,
+				  unsigned int digestsize, u8 *iv,
+				  struct mtk_crypto_sa_cache *sa)
+{
+	SABuilder_Params_t params;
+	SABuilder_Params_Basic_t ProtocolParams;
+	unsigned int SAWords = 0;
+	unsigned int TCRWords = 0;
+	void *TCRData = NULL;
+	int rc;
+
+	DMABuf_Status_t DMAStatus;
+	DMABuf_Properties_t DMAProperties = {0, 0, 0, 0};
+	DMABuf_HostAddress_t SAHostAddress;
+	DMABuf_Handle_t SAHandle = {0};
+
+	if (dir == MTK_CRYPTO_ENCRYPT)
+		rc = SABuilder_Init_Basic(&params, &ProtocolParams, SAB_DIRECTION_OUTBOUND);
+	else
+		rc = SABuilder_Init_Basic(&params, &ProtocolParams, SAB_DIRECTION_INBOUND);
+	if (rc) {
+		CRYPTO_ERR("SABuilder_Init_Basic failed: %d\n", rc);
+		return -EINVAL;
+	}
 
-		ctx = crypto_tfm_ctx(rd->async->tfm);
-		ret = ctx->handle_result(rd, ret);
+	crypto_cipher_sa_params(ctx, &params, &ProtocolParams, digestsize, iv);
 
-		spin_lock_bh(&add_lock);
-		list_del(&rd->list);
-		spin_unlock_bh(&add_lock);
-		kfree(rd);
+	rc = SABuilder_GetSizes(&params, &SAWords, NULL, NULL);
+	if (rc) {
+		CRYPTO_ERR("SA not created because of size errors: %d\n", rc);
+		return -EINVAL;
 	}
+
+	DMAProperties.fCached = true;
+	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
+	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_TRANSFORM;
+	DMAProperties.Size = MAX(4*SAWords, 256);
+
+	DMAStatus = DMABuf_Alloc(DMAProperties, &SAHostAddress, &SAHandle);
+	if (DMAStatus != DMABUF_STATUS_OK) {
+		CRYPTO_ERR("Allocation of SA failed: %d\n", DMAStatus);
+		return -ENOMEM;
+	}
+
+	rc = SABuilder_BuildSA(&params, (u32 *)SAHostAddress.p, NULL, NULL);
+	if (rc) {
+		CRYPTO_ERR("SA not created because of errors: %d\n", rc);
+		goto error_exit;
+	}
+
+	rc = TokenBuilder_GetContextSize(&params, &TCRWords);
+	if (rc) {
+		CRYPTO_ERR("TokenBuilder_GetContextSize returned errors: %d\n", rc);
+		goto error_exit;
+	}
+
+	TCRData = kmalloc(4 * TCRWords, GFP_KERNEL);
+	if (!TCRData) {
+		CRYPTO_ERR("Allocation of TCR failed\n");
+		goto error_exit;
+	}
+
+	rc = TokenBuilder_BuildContext(&params, TCRData);
+	if (rc) {
+		CRYPTO_ERR("TokenBuilder_BuildContext failed: %d\n", rc);
+		goto error_exit;
+	}
+
+	rc = TokenBuilder_GetSize(TCRData, &sa->token_words);
+	if (rc) {
+		CRYPTO_ERR("TokenBuilder_GetSize failed: %d\n", rc);
+		goto error_exit;
+	}
+
+	rc = PEC_SA_Register(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
+				DMABuf_NULLHandle);
+	if (rc != PEC_STATUS_OK) {
+		CRYPTO_ERR("PEC_SA_Register failed: %d\n", rc);
+		goto error_exit;
+	}
+
+	sa->sa = SAHandle.p;
+	sa->token_context = TCRData;
+	sa->digestsize = digestsize;
+
+	return 0;
+
+error_exit:
+	DMABuf_Release(SAHandle);
+	kfree(TCRData);
+
+	return -EINVAL;
+}
+
+static void crypto_cipher_sa_release(struct mtk_crypto_sa_cache *sa)
+{
+	crypto_free_sa(sa->sa);
+	kfree(sa->token_context);
+	memset(sa, 0, sizeof(*sa));
+}
+
+static bool crypto_cipher_sa_cacheable(struct mtk_crypto_cipher_ctx *ctx)
+{
+	return ctx->mode != MTK_CRYPTO_MODE_CCM;
+}
+
+/*
+ * Return the cached SA of @ctx for @dir, building it on first use. The
+ * cache is dropped by setkey, and rebuilt when the AEAD ICV size changes.
+ */
+static struct mtk_crypto_sa_cache *
+crypto_cipher_sa_get(struct mtk_crypto_cipher_ctx *ctx,
+		     enum mtk_crypto_cipher_direction dir,
+		     unsigned int digestsize)
+{
+	struct mtk_crypto_sa_cache *sa = &ctx->sa_cache[dir];
+
+	mutex_lock(&ctx->sa_lock);
+	if (sa->sa && sa->digestsize != digestsize)
+		crypto_cipher_sa_release(sa);
+
+	if (!sa->sa && crypto_cipher_sa_build(ctx, dir, digestsize, NULL, sa))
+		sa = NULL;
+	mutex_unlock(&ctx->sa_lock);
+
+	return sa;
+}
+
+void crypto_cipher_sa_init(struct mtk_crypto_cipher_ctx *ctx)
+{
+	mutex_init(&ctx->sa_lock);
+	memset(ctx->sa_cache, 0, sizeof(ctx->sa_cache));
+}
+
+void crypto_cipher_sa_invalidate(struct mtk_crypto_cipher_ctx *ctx)
+{
+	int i;
+
+	mutex_lock(&ctx->sa_lock);
+	for (i = 0; i < ARRAY_SIZE(ctx->sa_cache); i++)
+		if (ctx->sa_cache[i].sa)
+			crypto_cipher_sa_release(&ctx->sa_cache[i]);
+	mutex_unlock(&ctx->sa_lock);
 }
 
 int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cipher_req *mtk_req,
@@ -305,46 +738,41 @@ int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cip
 		       unsigned int assoclen, unsigned int digestsize, u8 *iv, unsigned int ivsize)
 {
 	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(async->tfm);
+	struct mtk_crypto_sa_cache oneshot = {0};
+	struct mtk_crypto_sa_cache *sa;
 	struct mtk_crypto_result *result;
 	struct scatterlist *sg;
 	unsigned int totlen_src;
 	unsigned int totlen_dst;
 	unsigned int src_pkt =  cryptlen + assoclen;
 	unsigned int pass_assoc = 0;
+	unsigned int pass_dst = 0;
 	int pass_id;
 	int rc;
 	int i;
-	SABuilder_Params_t params;
-	SABuilder_Params_Basic_t ProtocolParams;
-	unsigned int SAWords = 0;
 
 	DMABuf_Status_t DMAStatus;
 	DMABuf_Properties_t DMAProperties = {0, 0, 0, 0};
-	DMABuf_HostAddress_t SAHostAddress;
 	DMABuf_HostAddress_t TokenHostAddress;
-	DMABuf_HostAddress_t PktHostAddress;
+	uint8_t pkt_placeholder = 0;
 
 	DMABuf_Handle_t SAHandle = {0};
 	DMABuf_Handle_t TokenHandle = {0};
 	DMABuf_Handle_t SrcSGListHandle = {0};
 	DMABuf_Handle_t DstSGListHandle = {0};
 
-	unsigned int TCRWords = 0;
-	void *TCRData = 0;
 	unsigned int TokenWords = 0;
 	unsigned int TokenHeaderWord;
-	unsigned int TokenMaxWords = 0;
 
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
-	PEC_NotifyFunction_t CBFunc;
-	unsigned int count;
 
 	IOToken_Input_Dscr_t InTokenDscr;
 	IOToken_Output_Dscr_t OutTokenDscr;
 	uint32_t InputToken[IOTOKEN_IN_WORD_COUNT];
 	void *InTokenDscrExt_p = NULL;
 	uint8_t gcm_iv[16] = {0};
+	uint8_t aad_buf[32];
 	uint8_t *aad = NULL;
 
 #ifdef CRYPTO_IOTOKEN_EXT
@@ -356,83 +784,35 @@ int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cip
 	ZEROINIT(InTokenDscr);
 	ZEROINIT(OutTokenDscr);
 
-	/* Init SA */
 	if (mtk_req->direction == MTK_CRYPTO_ENCRYPT) {
 		totlen_src = cryptlen + assoclen;
 		totlen_dst = totlen_src + digestsize;
-		rc = SABuilder_Init_Basic(&params, &ProtocolParams, SAB_DIRECTION_OUTBOUND);
 	} else {
 		totlen_src = cryptlen + assoclen;
 		totlen_dst = totlen_src - digestsize;
-		rc = SABuilder_Init_Basic(&params, &ProtocolParams, SAB_DIRECTION_INBOUND);
 	}
-	if (rc) {
-		CRYPTO_ERR("SABuilder_Init_Basic failed: %d\n", rc);
-		goto error_exit;
+
+	/* Get SA */
+	if (crypto_cipher_sa_cacheable(ctx)) {
+		sa = crypto_cipher_sa_get(ctx, mtk_req->direction, digestsize);
+		if (!sa)
+			return -ENOMEM;
+	} else {
+		rc = crypto_cipher_sa_build(ctx, mtk_req->direction, digestsize, iv, &oneshot);
+		if (rc)
+			return rc;
+		sa = &oneshot;
 	}
+	SAHandle.p = sa->sa;
 
-	/* Build SA */
-	params.CryptoAlgo = lookaside_match_alg_name(ctx->alg);
-	params.CryptoMode = lookaside_match_alg_mode(ctx->mode);
-	params.KeyByteCount = ctx->key_len;
-	params.Key_p = (uint8_t *) ctx->key;
-	if (params.CryptoMode == SAB_CRYPTO_MODE_GCM && ctx->aead == EIP197_AEAD_TYPE_IPSEC_ESP) {
-		params.Nonce_p = (uint8_t *) &ctx->nonce;
-		params.IVSrc = SAB_IV_SRC_TOKEN;
-		params.flags |= SAB_FLAG_COPY_IV;
-		memcpy(gcm_iv, &ctx->nonce, 4);
-		memcpy(gcm_iv + 4, iv, ivsize);
+	if (ctx->mode == MTK_CRYPTO_MODE_GCM && ctx->aead != EIP197_AEAD_TYPE_IPSEC_ESP) {
+		memcpy(gcm_iv, iv, ivsize);
 		gcm_iv[15] = 1;
-	} else if (params.CryptoMode == SAB_CRYPTO_MODE_GMAC) {
-		params.Nonce_p = (uint8_t *) &ctx->nonce;
-		params.IVSrc = SAB_IV_SRC_TOKEN;
+	} else if (ctx->mode == MTK_CRYPTO_MODE_GCM || ctx->mode == MTK_CRYPTO_MODE_GMAC ||
+		   ctx->mode == MTK_CRYPTO_MODE_CTR) {
 		memcpy(gcm_iv, &ctx->nonce, 4);
 		memcpy(gcm_iv + 4, iv, ivsize);
 		gcm_iv[15] = 1;
-	} else if (params.CryptoMode == SAB_CRYPTO_MODE_GCM) {
-		params.IVSrc = SAB_IV_SRC_TOKEN;
-		memcpy(gcm_iv, iv, ivsize);
-		gcm_iv[15] = 1;
-	} else if (params.CryptoMode == SAB_CRYPTO_MODE_CCM) {
-		params.IVSrc = SAB_IV_SRC_SA;
-		params.Nonce_p = (uint8_t *) &ctx->nonce + 1;
-		params.IV_p = iv;
-	} else {
-		params.IVSrc = SAB_IV_SRC_SA;
-		params.IV_p = iv;
-	}
-
-	if (params.CryptoMode == SAB_CRYPTO_MODE_CTR)
-		params.Nonce_p = (uint8_t *) &ctx->nonce;
-
-	params.AuthAlgo = aead_hash_match(ctx->hash_alg);
-	params.AuthKey1_p = (uint8_t *) ctx->ipad;
-	params.AuthKey2_p = (uint8_t *) ctx->opad;
-
-	ProtocolParams.ICVByteCount = digestsize;
-
-	rc = SABuilder_GetSizes(&params, &SAWords, NULL, NULL);
-	if (rc) {
-		CRYPTO_ERR("SA not created because of size errors: %d\n", rc);
-		goto error_remove_sg;
-	}
-
-	DMAProperties.fCached = true;
-	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
-	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_TRANSFORM;
-	DMAProperties.Size = MAX(4*SAWords, 256);
-
-	DMAStatus = DMABuf_Alloc(DMAProperties, &SAHostAddress, &SAHandle);
-	if (DMAStatus != DMABUF_STATUS_OK) {
-		rc = 1;
-		CRYPTO_ERR("Allocation of SA failed: %d\n", DMAStatus);
-		goto error_remove_sg;
-	}
-
-	rc = SABuilder_BuildSA(&params, (u32 *)SAHostAddress.p, NULL, NULL);
-	if (rc) {
-		CRYPTO_ERR("SA not created because of errors: %d\n", rc);
-		goto error_remove_sg;
 	}
 
 	/* Check dst buffer has enough size */
@@ -444,31 +824,40 @@ int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cip
 		mtk_req->nr_dst = mtk_req->nr_src;
 		if (unlikely((totlen_src || totlen_dst) && (mtk_req->nr_src <= 0))) {
 			CRYPTO_ERR("In-place buffer not large enough\n");
-			return -EINVAL;
+			rc = -EINVAL;
+			goto error_exit;
 		}
 		dma_map_sg(crypto_dev, src, mtk_req->nr_src, DMA_BIDIRECTIONAL);
 	} else {
 		if (unlikely(totlen_src && (mtk_req->nr_src <= 0))) {
 			CRYPTO_ERR("Source buffer not large enough\n");
-			return -EINVAL;
+			rc = -EINVAL;
+			goto error_exit;
 		}
 		dma_map_sg(crypto_dev, src, mtk_req->nr_src, DMA_TO_DEVICE);
 
 		if (unlikely(totlen_dst && (mtk_req->nr_dst <= 0))) {
 			CRYPTO_ERR("Dest buffer not large enough\n");
 			dma_unmap_sg(crypto_dev, src, mtk_req->nr_src, DMA_TO_DEVICE);
-			return -EINVAL;
+			rc = -EINVAL;
+			goto error_exit;
 		}
 		dma_map_sg(crypto_dev, dst, mtk_req->nr_dst, DMA_FROM_DEVICE);
 	}
 
-	if (params.CryptoMode == SAB_CRYPTO_MODE_CCM ||
-		(params.CryptoMode == SAB_CRYPTO_MODE_GCM &&
+	if (ctx->mode == MTK_CRYPTO_MODE_CCM ||
+		(ctx->mode == MTK_CRYPTO_MODE_GCM &&
 		 ctx->aead == EIP197_AEAD_TYPE_IPSEC_ESP)) {
 
-		aad = kmalloc(assoclen, GFP_KERNEL);
-		if (!aad)
+		/* ESP AAD is SPI, sequence number and IV, it fits on the stack */
+		if (likely(assoclen <= sizeof(aad_buf)))
+			aad = aad_buf;
+		else
+			aad = kmalloc(assoclen, GFP_KERNEL);
+		if (!aad) {
+			rc = -ENOMEM;
 			goto error_remove_sg;
+		}
 		sg_copy_to_buffer(src, mtk_req->nr_src, aad, assoclen);
 		src_pkt -= assoclen;
 		pass_assoc = assoclen;
@@ -537,59 +926,54 @@ int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cip
 		goto error_remove_sg;
 	}
 
+	/*
+	 * CCM decrypt output comes back without the 8 byte ESP IV in front of
+	 * the payload, so let the engine scatter it past that gap directly.
+	 */
+	if (ctx->mode == MTK_CRYPTO_MODE_CCM && mtk_req->direction == MTK_CRYPTO_DECRYPT) {
+		pass_dst = EIP197_AEAD_IPSEC_IV_SIZE;
+		totlen_dst -= pass_dst;
+	}
+
+	pass_id = 0;
 	for_each_sg(dst, sg, mtk_req->nr_dst, i) {
 		int len = sg_dma_len(sg);
 		DMABuf_Handle_t sg_handle;
 		DMABuf_HostAddress_t host;
 
+		if (pass_dst) {
+			if (pass_dst >= len) {
+				pass_dst -= len;
+				pass_id++;
+				continue;
+			}
+			len -= pass_dst;
+		}
+
 		if (len > totlen_dst)
 			len = totlen_dst;
 
 		DMAProperties.Size = MAX(len, 1);
-		rc = DMABuf_Particle_Alloc(DMAProperties, sg_dma_address(sg), &host, &sg_handle);
+		rc = DMABuf_Particle_Alloc(DMAProperties, sg_dma_address(sg) + pass_dst,
+					   &host, &sg_handle);
 		if (rc != DMABUF_STATUS_OK) {
 			CRYPTO_ERR("DMABuf_Particle_Alloc failed rc = %d\n", rc);
 			goto error_remove_sg;
 		}
-		rc = PEC_SGList_Write(DstSGListHandle, i, sg_handle, len);
+		rc = PEC_SGList_Write(DstSGListHandle, i - pass_id, sg_handle, len);
 		if (rc != PEC_STATUS_OK)
 			pr_notice("PEC_SGList_Write failed rc = %d\n", rc);
+		pass_dst = 0;
 
 		if (unlikely(!len))
 			break;
 		totlen_dst -= len;
 	}
 
-	/* Build Token */
-	rc = TokenBuilder_GetContextSize(&params, &TCRWords);
-	if (rc) {
-		CRYPTO_ERR("TokenBuilder_GetContextSize returned errors: %d\n", rc);
-		goto error_remove_sg;
-	}
-
-	TCRData = kmalloc(4 * TCRWords, GFP_KERNEL);
-	if (!TCRData) {
-		rc = 1;
-		CRYPTO_ERR("Allocation of TCR failed\n");
-		goto error_remove_sg;
-	}
-
-	rc = TokenBuilder_BuildContext(&params, TCRData);
-	if (rc) {
-		CRYPTO_ERR("TokenBuilder_BuildContext failed: %d\n", rc);
-		goto error_remove_sg;
-	}
-
-	rc = TokenBuilder_GetSize(TCRData, &TokenMaxWords);
-	if (rc) {
-		CRYPTO_ERR("TokenBuilder_GetSize failed: %d\n", rc);
-		goto error_remove_sg;
-	}
-
 	DMAProperties.fCached = true;
 	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
 	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_TOKEN;
-	DMAProperties.Size = 4*TokenMaxWords;
+	DMAProperties.Size = 4*sa->token_words;
 
 	DMAStatus = DMABuf_Alloc(DMAProperties, &TokenHostAddress, &TokenHandle);
 	if (DMAStatus != DMABUF_STATUS_OK) {
@@ -598,36 +982,37 @@ int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cip
 		goto error_remove_sg;
 	}
 
-	rc = PEC_SA_Register(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
-				DMABuf_NULLHandle);
-	if (rc != PEC_STATUS_OK) {
-		CRYPTO_ERR("PEC_SA_Register failed: %d\n", rc);
-		goto error_remove_sg;
-	}
-
+	/* Build Token */
 	ZEROINIT(TokenParams);
 
-	if (params.CryptoMode == SAB_CRYPTO_MODE_GCM || params.CryptoMode == SAB_CRYPTO_MODE_GMAC)
+	if (ctx->mode == MTK_CRYPTO_MODE_GCM || ctx->mode == MTK_CRYPTO_MODE_GMAC ||
+	    ctx->mode == MTK_CRYPTO_MODE_CTR)
 		TokenParams.IV_p = gcm_iv;
+	else if (ctx->mode != MTK_CRYPTO_MODE_CCM)
+		TokenParams.IV_p = iv;
 
-	if ((params.CryptoMode == SAB_CRYPTO_MODE_GCM && ctx->aead == EIP197_AEAD_TYPE_IPSEC_ESP) ||
-	     params.CryptoMode == SAB_CRYPTO_MODE_CCM) {
+	if ((ctx->mode == MTK_CRYPTO_MODE_GCM && ctx->aead == EIP197_AEAD_TYPE_IPSEC_ESP) ||
+	     ctx->mode == MTK_CRYPTO_MODE_CCM) {
 		TokenParams.AdditionalValue = assoclen - ivsize;
 		TokenParams.AAD_p = aad;
-	} else if (params.CryptoMode != SAB_CRYPTO_MODE_GMAC)
+	} else if (ctx->mode != MTK_CRYPTO_MODE_GMAC)
 		TokenParams.AdditionalValue = assoclen;
 
 
-	PktHostAddress.p = kmalloc(sizeof(uint8_t), GFP_KERNEL);
-	rc = TokenBuilder_BuildToken(TCRData, (uint8_t *)PktHostAddress.p, src_pkt,
+	/* Basic protocols never look at the packet, a placeholder byte does */
+	rc = TokenBuilder_BuildToken(sa->token_context, &pkt_placeholder, src_pkt,
 					&TokenParams, (uint32_t *)TokenHostAddress.p,
 					&TokenWords, &TokenHeaderWord);
-	kfree(PktHostAddress.p);
 	if (rc != TKB_STATUS_OK) {
 		CRYPTO_ERR("Token builder failed: %d\n", rc);
-		goto error_exit_unregister;
+		goto error_remove_sg;
 	}
 
+	/* The AAD now lives in the token */
+	if (aad != aad_buf)
+		kfree(aad);
+	aad = NULL;
+
 	ZEROINIT(Cmd);
 	Cmd.Token_Handle = TokenHandle;
 	Cmd.Token_WordCount = TokenWords;
@@ -647,42 +1032,27 @@ int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cip
 				   InputToken,
 				   &Cmd)) {
 		rc = 1;
-		goto error_exit_unregister;
+		goto error_remove_sg;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID, &Cmd, 1, &count);
-	if (rc != PEC_STATUS_OK && count != 1)
-		goto error_exit_unregister;
-
-	result = kmalloc(sizeof(struct mtk_crypto_result), GFP_KERNEL);
+	result = crypto_pe_result_get(mtk_req->ring);
 	if (!result) {
 		rc = 1;
-		CRYPTO_ERR("No memory for result\n");
-		goto error_exit_unregister;
+		CRYPTO_ERR("No free result slot on ring %u\n", mtk_req->ring);
+		goto error_remove_sg;
 	}
-	INIT_LIST_HEAD(&result->list);
-	result->eip.sa = SAHandle.p;
+	/* Only a one-shot SA is owned, and freed, by the request */
+	result->eip.sa = oneshot.sa;
 	result->eip.token = TokenHandle.p;
-	result->eip.token_context = TCRData;
+	result->eip.token_context = oneshot.token_context;
 	result->eip.pkt_handle = SrcSGListHandle.p;
 	result->async = async;
 	result->dst = DstSGListHandle.p;
 
-	spin_lock_bh(&add_lock);
-	list_add_tail(&result->list, &result_list);
-	spin_unlock_bh(&add_lock);
-	CBFunc = mtk_crypto_interrupt_handler;
-	rc = PEC_ResultNotify_Request(PEC_INTERFACE_ID, CBFunc, 1);
-	if (rc != PEC_STATUS_OK) {
-		CRYPTO_ERR("PEC_ResultNotify_Request failed with rc = %d\n", rc);
-		goto error_exit_unregister;
-	}
+	crypto_pe_batch_add(mtk_req->ring, &Cmd, result);
 
-	return rc;
+	return 0;
 
-error_exit_unregister:
-	PEC_SA_UnRegister(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
-				DMABuf_NULLHandle);
 error_remove_sg:
 	if (src == dst) {
 		dma_unmap_sg(crypto_dev, src, mtk_req->nr_src, DMA_BIDIRECTIONAL);
@@ -691,19 +1061,16 @@ error_remove_sg:
 		dma_unmap_sg(crypto_dev, dst, mtk_req->nr_dst, DMA_FROM_DEVICE);
 	}
 
-	if (aad != NULL)
+	if (aad != aad_buf)
 		kfree(aad);
 
 	crypto_free_sglist(SrcSGListHandle.p);
 	crypto_free_sglist(DstSGListHandle.p);
 
 error_exit:
-	DMABuf_Release(SAHandle);
+	crypto_cipher_sa_release(&oneshot);
 	DMABuf_Release(TokenHandle);
 
-	if (TCRData != NULL)
-		kfree(TCRData);
-
 	return rc;
 }
 
@@ -714,6 +1081,7 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(async->tfm);
 	struct skcipher_request *areq = skcipher_request_cast(async);
 	struct crypto_skcipher *skcipher = crypto_skcipher_reqtfm(areq);
+	struct mtk_crypto_sa_cache *sa;
 	struct mtk_crypto_result *result;
 	struct scatterlist *sg;
 	unsigned int totlen_src = cryptlen + assoclen;
@@ -721,36 +1089,28 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 	unsigned int blksize = crypto_skcipher_blocksize(skcipher);
 	int rc;
 	int i;
-	SABuilder_Params_t params;
-	SABuilder_Params_Basic_t ProtocolParams;
-	unsigned int SAWords = 0;
 
 	DMABuf_Status_t DMAStatus;
 	DMABuf_Properties_t DMAProperties = {0, 0, 0, 0};
-	DMABuf_HostAddress_t SAHostAddress;
 	DMABuf_HostAddress_t TokenHostAddress;
-	DMABuf_HostAddress_t PktHostAddress;
+	uint8_t pkt_placeholder = 0;
 
 	DMABuf_Handle_t SAHandle = {0};
 	DMABuf_Handle_t TokenHandle = {0};
 	DMABuf_Handle_t SrcSGListHandle = {0};
 	DMABuf_Handle_t DstSGListHandle = {0};
 
-	unsigned int TCRWords = 0;
-	void *TCRData = 0;
 	unsigned int TokenWords = 0;
 	unsigned int TokenHeaderWord;
-	unsigned int TokenMaxWords = 0;
 
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
-	unsigned int count;
 
 	IOToken_Input_Dscr_t InTokenDscr;
 	IOToken_Output_Dscr_t OutTokenDscr;
 	uint32_t InputToken[IOTOKEN_IN_WORD_COUNT];
 	void *InTokenDscrExt_p = NULL;
-	PEC_NotifyFunction_t CBFunc;
+	uint8_t ctr_iv[16] = {0};
 
 #ifdef CRYPTO_IOTOKEN_EXT
 	IOToken_Input_Dscr_Ext_t InTokenDscrExt;
@@ -765,94 +1125,11 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 	if (!IS_ALIGNED(cryptlen, blksize))
 		return -EINVAL;
 
-	/* Init SA */
-	if (mtk_req->direction == MTK_CRYPTO_ENCRYPT)
-		rc = SABuilder_Init_Basic(&params, &ProtocolParams, SAB_DIRECTION_OUTBOUND);
-	else
-		rc = SABuilder_Init_Basic(&params, &ProtocolParams, SAB_DIRECTION_INBOUND);
-	if (rc) {
-		CRYPTO_ERR("SABuilder_Init_Basic failed: %d\n", rc);
-		goto error_exit;
-	}
-
-	/* Build SA */
-	params.CryptoAlgo = lookaside_match_alg_name(ctx->alg);
-	params.CryptoMode = lookaside_match_alg_mode(ctx->mode);
-	params.KeyByteCount = ctx->key_len;
-	params.Key_p = (uint8_t *) ctx->key;
-	params.IVSrc = SAB_IV_SRC_SA;
-	if (params.CryptoMode == SAB_CRYPTO_MODE_CTR)
-		params.Nonce_p = (uint8_t *) &ctx->nonce;
-	params.IV_p = iv;
-
-	rc = SABuilder_GetSizes(&params, &SAWords, NULL, NULL);
-	if (rc) {
-		CRYPTO_ERR("SA not created because of size errors: %d\n", rc);
-		goto error_exit;
-	}
-
-	DMAProperties.fCached = true;
-	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
-	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_TRANSFORM;
-	DMAProperties.Size = MAX(4*SAWords, 256);
-
-	DMAStatus = DMABuf_Alloc(DMAProperties, &SAHostAddress, &SAHandle);
-	if (DMAStatus != DMABUF_STATUS_OK) {
-		rc = 1;
-		CRYPTO_ERR("Allocation of SA failed: %d\n", DMAStatus);
-		goto error_exit;
-	}
-
-	rc = SABuilder_BuildSA(&params, (u32 *)SAHostAddress.p, NULL, NULL);
-	if (rc) {
-		CRYPTO_ERR("SA not created because of errors: %d\n", rc);
-		goto error_exit;
-	}
-
-	/* Build Token */
-	rc = TokenBuilder_GetContextSize(&params, &TCRWords);
-	if (rc) {
-		CRYPTO_ERR("TokenBuilder_GetContextSize returned errors: %d\n", rc);
-		goto error_exit;
-	}
-
-	TCRData = kmalloc(4 * TCRWords, GFP_KERNEL);
-	if (!TCRData) {
-		rc = 1;
-		CRYPTO_ERR("Allocation of TCR failed\n");
-		goto error_exit;
-	}
-
-	rc = TokenBuilder_BuildContext(&params, TCRData);
-	if (rc) {
-		CRYPTO_ERR("TokenBuilder_BuildContext failed: %d\n", rc);
-		goto error_exit;
-	}
-
-	rc = TokenBuilder_GetSize(TCRData, &TokenMaxWords);
-	if (rc) {
-		CRYPTO_ERR("TokenBuilder_GetSize failed: %d\n", rc);
-		goto error_exit;
-	}
-
-	DMAProperties.fCached = true;
-	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
-	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_TOKEN;
-	DMAProperties.Size = 4*TokenMaxWords;
-
-	DMAStatus = DMABuf_Alloc(DMAProperties, &TokenHostAddress, &TokenHandle);
-	if (DMAStatus != DMABUF_STATUS_OK) {
-		rc = 1;
-		CRYPTO_ERR("Allocation of token builder failed: %d\n", DMAStatus);
-		goto error_exit;
-	}
-
-	rc = PEC_SA_Register(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
-				DMABuf_NULLHandle);
-	if (rc != PEC_STATUS_OK) {
-		CRYPTO_ERR("PEC_SA_Register failed: %d\n", rc);
-		goto error_exit;
-	}
+	/* Get SA */
+	sa = crypto_cipher_sa_get(ctx, mtk_req->direction, 0);
+	if (!sa)
+		return -ENOMEM;
+	SAHandle.p = sa->sa;
 
 	/* Check buffer has enough size for output */
 	mtk_req->nr_src = sg_nents_for_len(src, totlen_src);
@@ -863,14 +1140,12 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 		mtk_req->nr_dst = mtk_req->nr_src;
 		if (unlikely((totlen_src || totlen_dst) && (mtk_req->nr_src <= 0))) {
 			CRYPTO_ERR("In-place buffer not large enough\n");
-			kfree(TCRData);
 			return -EINVAL;
 		}
 		dma_map_sg(crypto_dev, src, mtk_req->nr_src, DMA_BIDIRECTIONAL);
 	} else {
 		if (unlikely(totlen_src && (mtk_req->nr_src <= 0))) {
 			CRYPTO_ERR("Source buffer not large enough\n");
-			kfree(TCRData);
 			return -EINVAL;
 		}
 		dma_map_sg(crypto_dev, src, mtk_req->nr_src, DMA_TO_DEVICE);
@@ -878,12 +1153,23 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 		if (unlikely(totlen_dst && (mtk_req->nr_dst <= 0))) {
 			CRYPTO_ERR("Dest buffer not large enough\n");
 			dma_unmap_sg(crypto_dev, src, mtk_req->nr_src, DMA_TO_DEVICE);
-			kfree(TCRData);
 			return -EINVAL;
 		}
 		dma_map_sg(crypto_dev, dst, mtk_req->nr_dst, DMA_FROM_DEVICE);
 	}
 
+	DMAProperties.fCached = true;
+	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
+	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_TOKEN;
+	DMAProperties.Size = 4*sa->token_words;
+
+	DMAStatus = DMABuf_Alloc(DMAProperties, &TokenHostAddress, &TokenHandle);
+	if (DMAStatus != DMABUF_STATUS_OK) {
+		rc = 1;
+		CRYPTO_ERR("Allocation of token builder failed: %d\n", DMAStatus);
+		goto error_remove_sg;
+	}
+
 	rc = PEC_SGList_Create(MAX(mtk_req->nr_src, 1), &SrcSGListHandle);
 	if (rc != PEC_STATUS_OK) {
 		CRYPTO_ERR("PEC_SGList_Create src failed with rc = %d\n", rc);
@@ -943,21 +1229,31 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 		totlen_dst -= len;
 	}
 
-	if (params.CryptoMode == SAB_CRYPTO_MODE_CBC &&
-			mtk_req->direction == MTK_CRYPTO_DECRYPT)
-		sg_pcopy_to_buffer(src, mtk_req->nr_src, iv, ivsize, cryptlen - ivsize);
-
-	PktHostAddress.p = kmalloc(sizeof(uint8_t), GFP_KERNEL);
+	/* Only the IV and the length change from one request to the next */
 	ZEROINIT(TokenParams);
-	rc = TokenBuilder_BuildToken(TCRData, (uint8_t *)PktHostAddress.p, cryptlen,
+	if (ctx->mode == MTK_CRYPTO_MODE_CTR) {
+		memcpy(ctr_iv, &ctx->nonce, 4);
+		memcpy(ctr_iv + 4, iv, ivsize);
+		ctr_iv[15] = 1;
+		TokenParams.IV_p = ctr_iv;
+	} else if (ctx->mode != MTK_CRYPTO_MODE_ECB) {
+		TokenParams.IV_p = iv;
+	}
+
+	/* Basic protocols never look at the packet, a placeholder byte does */
+	rc = TokenBuilder_BuildToken(sa->token_context, &pkt_placeholder, cryptlen,
 					&TokenParams, (uint32_t *)TokenHostAddress.p,
 					&TokenWords, &TokenHeaderWord);
-	kfree(PktHostAddress.p);
 	if (rc != TKB_STATUS_OK) {
 		CRYPTO_ERR("Token builder failed: %d\n", rc);
 		goto error_remove_sg;
 	}
 
+	/* The token holds its own copy of the IV, save the next one now */
+	if (ctx->mode == MTK_CRYPTO_MODE_CBC &&
+			mtk_req->direction == MTK_CRYPTO_DECRYPT)
+		sg_pcopy_to_buffer(src, mtk_req->nr_src, iv, ivsize, cryptlen - ivsize);
+
 	ZEROINIT(Cmd);
 	Cmd.Token_Handle = TokenHandle;
 	Cmd.Token_WordCount = TokenWords;
@@ -980,36 +1276,22 @@ int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_ci
 		goto error_remove_sg;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID, &Cmd, 1, &count);
-	if (rc != PEC_STATUS_OK && count != 1) {
-		rc = 1;
-		CRYPTO_ERR("PEC_Packet_Put error: %d\n", rc);
-		goto error_remove_sg;
-	}
-
-	result = kmalloc(sizeof(struct mtk_crypto_result), GFP_KERNEL);
+	result = crypto_pe_result_get(mtk_req->ring);
 	if (!result) {
 		rc = 1;
-		CRYPTO_ERR("No memory for result\n");
+		CRYPTO_ERR("No free result slot on ring %u\n", mtk_req->ring);
 		goto error_remove_sg;
 	}
-	INIT_LIST_HEAD(&result->list);
-	result->eip.sa = SAHandle.p;
+	/* The SA and token context are owned by the tfm */
+	result->eip.sa = NULL;
 	result->eip.token = TokenHandle.p;
-	result->eip.token_context = TCRData;
+	result->eip.token_context = NULL;
 	result->eip.pkt_handle = SrcSGListHandle.p;
 	result->async = async;
 	result->dst = DstSGListHandle.p;
 
-	spin_lock_bh(&add_lock);
-	list_add_tail(&result->list, &result_list);
-	spin_unlock_bh(&add_lock);
-	CBFunc = mtk_crypto_interrupt_handler;
-	rc = PEC_ResultNotify_Request(PEC_INTERFACE_ID, CBFunc, 1);
-	if (rc != PEC_STATUS_OK) {
-		CRYPTO_ERR("PEC_ResultNotify_Request failed with rc = %d\n", rc);
-		goto error_remove_sg;
-	}
+	crypto_pe_batch_add(mtk_req->ring, &Cmd, result);
+
 	return 0;
 
 error_remove_sg:
@@ -1023,16 +1305,8 @@ error_remove_sg:
 	crypto_free_sglist(SrcSGListHandle.p);
 	crypto_free_sglist(DstSGListHandle.p);
 
-	PEC_SA_UnRegister(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
-				DMABuf_NULLHandle);
-
-error_exit:
-	DMABuf_Release(SAHandle);
 	DMABuf_Release(TokenHandle);
 
-	if (TCRData != NULL)
-		kfree(TCRData);
-
 	return rc;
 }
 
@@ -1064,8 +1338,104 @@ SABuilder_Auth_t lookaside_match_hash(enum mtk_crypto_alg alg)
 	}
 }
 
+/*
+ * Hash input is gathered straight from the request scatterlist. Only the
+ * linear head (the cached partial block, or the inner digest for HMAC) is
+ * bounced, through the packet buffer that also receives the digest.
+ */
+static int crypto_ahash_map_src(struct mtk_crypto_ahash_req *mtk_req,
+				DMABuf_Handle_t PktHandle, unsigned int HeadByteCount,
+				struct scatterlist *src, unsigned int SrcByteCount,
+				DMABuf_Handle_t *SGListHandle_p)
+{
+	DMABuf_Properties_t DMAProperties = {0, 0, 0, 0};
+	struct scatterlist *sg;
+	int mapped;
+	int nents;
+	int rc;
+	int i;
+
+	nents = sg_nents_for_len(src, SrcByteCount);
+	if (unlikely(nents <= 0)) {
+		CRYPTO_ERR("Source buffer not large enough\n");
+		return -EINVAL;
+	}
+
+	mapped = dma_map_sg(crypto_dev, src, nents, DMA_TO_DEVICE);
+	if (unlikely(!mapped)) {
+		CRYPTO_ERR("dma_map_sg for ahash source failed\n");
+		return -ENOMEM;
+	}
+	mtk_req->nr_src = nents;
+	mtk_req->src_head = !!HeadByteCount;
+
+	rc = PEC_SGList_Create(mtk_req->src_head + mapped, SGListHandle_p);
+	if (rc != PEC_STATUS_OK) {
+		CRYPTO_ERR("PEC_SGList_Create src failed with rc = %d\n", rc);
+		dma_unmap_sg(crypto_dev, src, nents, DMA_TO_DEVICE);
+		return -ENOMEM;
+	}
+	mtk_req->src_sglist = SGListHandle_p->p;
+
+	if (mtk_req->src_head)
+		PEC_SGList_Write(*SGListHandle_p, 0, PktHandle, HeadByteCount);
+
+	DMAProperties.fCached = true;
+	DMAProperties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
+	DMAProperties.Bank = MTK_EIP197_INLINE_BANK_PACKET;
+	for_each_sg(src, sg, mapped, i) {
+		unsigned int len = min_t(unsigned int, sg_dma_len(sg), SrcByteCount);
+		DMABuf_Handle_t sg_handle;
+		DMABuf_HostAddress_t host;
+
+		DMAProperties.Size = MAX(len, 1);
+		rc = DMABuf_Particle_Alloc(DMAProperties, sg_dma_address(sg), &host, &sg_handle);
+		if (rc != DMABUF_STATUS_OK) {
+			CRYPTO_ERR("DMABuf_Particle_Alloc failed rc = %d\n", rc);
+			crypto_ahash_unmap_src(mtk_req, src);
+			return -ENOMEM;
+		}
+		rc = PEC_SGList_Write(*SGListHandle_p, mtk_req->src_head + i, sg_handle, len);
+		if (rc != PEC_STATUS_OK)
+			pr_notice("PEC_SGList_Write failed rc = %d\n", rc);
+
+		SrcByteCount -= len;
+		if (!SrcByteCount)
+			break;
+	}
+
+	return 0;
+}
+
+void crypto_ahash_unmap_src(struct mtk_crypto_ahash_req *mtk_req, struct scatterlist *src)
+{
+	DMABuf_Handle_t SGListHandle = {0};
+	DMABuf_Handle_t ParticleHandle = {0};
+	unsigned int count;
+	unsigned int size;
+	uint8_t *Particle_p;
+	int i;
+
+	if (!mtk_req->src_sglist)
+		return;
+
+	SGListHandle.p = mtk_req->src_sglist;
+	if (PEC_SGList_GetCapacity(SGListHandle, &count) == PEC_STATUS_OK) {
+		/* The head entry is the packet buffer, it goes with the packet */
+		for (i = mtk_req->src_head; i < count; i++) {
+			PEC_SGList_Read(SGListHandle, i, &ParticleHandle, &size, &Particle_p);
+			DMABuf_Particle_Release(ParticleHandle);
+		}
+		PEC_SGList_Destroy(SGListHandle);
+	}
+
+	dma_unmap_sg(crypto_dev, src, mtk_req->nr_src, DMA_TO_DEVICE);
+	mtk_req->src_sglist = NULL;
+}
+
 int crypto_ahash_token_req(struct crypto_async_request *async, struct mtk_crypto_ahash_req *mtk_req,
-				uint8_t *Input_p, unsigned int InputByteCount, bool finish)
+				uint8_t *Input_p, unsigned int InputByteCount,
+				struct scatterlist *src, unsigned int SrcByteCount, bool finish)
 {
 	struct mtk_crypto_result *result;
 
@@ -1077,6 +1447,7 @@ int crypto_ahash_token_req(struct crypto_async_request *async, struct mtk_crypto
 	DMABuf_Handle_t TokenHandle = {0};
 	DMABuf_Handle_t PktHandle = {0};
 	DMABuf_Handle_t SAHandle = {0};
+	DMABuf_Handle_t SrcHandle = {0};
 
 	unsigned int TokenMaxWords = 0;
 	unsigned int TokenHeaderWord;
@@ -1085,9 +1456,7 @@ int crypto_ahash_token_req(struct crypto_async_request *async, struct mtk_crypto
 
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
-	PEC_NotifyFunction_t CBFunc;
 
-	unsigned int count;
 	int rc;
 
 	u32 InputToken[IOTOKEN_IN_WORD_COUNT];
@@ -1137,13 +1506,21 @@ int crypto_ahash_token_req(struct crypto_async_request *async, struct mtk_crypto
 	}
 	memcpy(PktHostAddress.p, Input_p, InputByteCount);
 
+	SrcHandle = PktHandle;
+	if (SrcByteCount) {
+		rc = crypto_ahash_map_src(mtk_req, PktHandle, InputByteCount,
+					  src, SrcByteCount, &SrcHandle);
+		if (rc)
+			goto error_exit;
+	}
+
 	ZEROINIT(TokenParams);
 	TokenParams.PacketFlags |= TKB_PACKET_FLAG_HASHAPPEND;
 	if (finish)
 		TokenParams.PacketFlags |= TKB_PACKET_FLAG_HASHFINAL;
 
 	rc = TokenBuilder_BuildToken(TCRData, (u8 *) PktHostAddress.p,
-				     InputByteCount, &TokenParams,
+				     InputByteCount + SrcByteCount, &TokenParams,
 				     (u32 *) TokenHostAddress.p,
 				     &TokenWords, &TokenHeaderWord);
 	if (rc != TKB_STATUS_OK) {
@@ -1155,8 +1532,8 @@ int crypto_ahash_token_req(struct crypto_async_request *async, struct mtk_crypto
 	ZEROINIT(Cmd);
 	Cmd.Token_Handle = TokenHandle;
 	Cmd.Token_WordCount = TokenWords;
-	Cmd.SrcPkt_Handle = PktHandle;
-	Cmd.SrcPkt_ByteCount = InputByteCount;
+	Cmd.SrcPkt_Handle = SrcHandle;
+	Cmd.SrcPkt_ByteCount = InputByteCount + SrcByteCount;
 	Cmd.DstPkt_Handle = PktHandle;
 	Cmd.SA_Handle1 = SAHandle;
 	Cmd.SA_Handle2 = DMABuf_NULLHandle;
@@ -1174,34 +1551,23 @@ int crypto_ahash_token_req(struct crypto_async_request *async, struct mtk_crypto
 		goto error_exit_unregister;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID, &Cmd, 1, &count);
-	if (rc != PEC_STATUS_OK && count != 1) {
-		rc = 1;
-		CRYPTO_ERR("PEC_Packet_Put error: %d\n", rc);
-		goto error_exit_unregister;
-	}
-
-	result = kmalloc(sizeof(struct mtk_crypto_result), GFP_KERNEL);
+	result = crypto_pe_result_get(mtk_req->ring);
 	if (!result) {
 		rc = 1;
-		CRYPTO_ERR("No memory for result\n");
+		CRYPTO_ERR("No free result slot on ring %u\n", mtk_req->ring);
 		goto error_exit_unregister;
 	}
-	INIT_LIST_HEAD(&result->list);
 	result->eip.token = TokenHandle.p;
 	result->eip.pkt_handle = PktHandle.p;
 	result->async = async;
 	result->dst = PktHostAddress.p;
 
-	spin_lock_bh(&add_lock);
-	list_add_tail(&result->list, &result_list);
-	spin_unlock_bh(&add_lock);
-	CBFunc = mtk_crypto_interrupt_handler;
-	rc = PEC_ResultNotify_Request(PEC_INTERFACE_ID, CBFunc, 1);
+	crypto_pe_batch_add(mtk_req->ring, &Cmd, result);
 
-	return rc;
+	return 0;
 
 error_exit_unregister:
+	crypto_ahash_unmap_src(mtk_req, src);
 	PEC_SA_UnRegister(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
 				DMABuf_NULLHandle);
 
@@ -1244,9 +1610,7 @@ int crypto_ahash_aes_cbc(struct crypto_async_request *async, struct mtk_crypto_a
 
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
-	PEC_NotifyFunction_t CBFunc;
 
-	unsigned int count;
 	int i;
 
 	u32 InputToken[IOTOKEN_IN_WORD_COUNT];
@@ -1400,20 +1764,12 @@ int crypto_ahash_aes_cbc(struct crypto_async_request *async, struct mtk_crypto_a
 		goto error_exit_unregister;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID, &Cmd, 1, &count);
-	if (rc != PEC_STATUS_OK && count != 1) {
-		rc = 1;
-		CRYPTO_ERR("PEC_Packet_Put error: %d\n", rc);
-		goto error_exit_unregister;
-	}
-
-	result = kmalloc(sizeof(struct mtk_crypto_result), GFP_KERNEL);
+	result = crypto_pe_result_get(mtk_req->ring);
 	if (!result) {
 		rc = 1;
-		CRYPTO_ERR("No memory for result\n");
+		CRYPTO_ERR("No free result slot on ring %u\n", mtk_req->ring);
 		goto error_exit_unregister;
 	}
-	INIT_LIST_HEAD(&result->list);
 	result->eip.sa = SAHandle.p;
 	result->eip.token = TokenHandle.p;
 	result->eip.token_context = TCRData;
@@ -1422,16 +1778,8 @@ int crypto_ahash_aes_cbc(struct crypto_async_request *async, struct mtk_crypto_a
 	result->dst = PktHostAddress.p;
 	result->size = InputByteCount;
 
-	spin_lock_bh(&add_lock);
-	list_add_tail(&result->list, &result_list);
-	spin_unlock_bh(&add_lock);
+	crypto_pe_batch_add(mtk_req->ring, &Cmd, result);
 
-	CBFunc = mtk_crypto_interrupt_handler;
-	rc = PEC_ResultNotify_Request(PEC_INTERFACE_ID, CBFunc, 1);
-	if (rc != PEC_STATUS_OK) {
-		CRYPTO_ERR("PEC_ResultNotify_Request failed with rc = %d\n", rc);
-		goto error_exit_unregister;
-	}
 	return 0;
 
 error_exit_unregister:
@@ -1451,7 +1799,8 @@ error_exit:
 
 int crypto_first_ahash_req(struct crypto_async_request *async,
 			   struct mtk_crypto_ahash_req *mtk_req, uint8_t *Input_p,
-			   unsigned int InputByteCount, bool finish)
+			   unsigned int InputByteCount, struct scatterlist *src,
+			   unsigned int SrcByteCount, bool finish)
 {
 	struct mtk_crypto_ahash_ctx *ctx = crypto_tfm_ctx(async->tfm);
 	struct mtk_crypto_result *result;
@@ -1470,6 +1819,7 @@ int crypto_first_ahash_req(struct crypto_async_request *async,
 	DMABuf_Handle_t TokenHandle = {0};
 	DMABuf_Handle_t PktHandle = {0};
 	DMABuf_Handle_t SAHandle = {0};
+	DMABuf_Handle_t SrcHandle = {0};
 
 	unsigned int TokenMaxWords = 0;
 	unsigned int TokenHeaderWord;
@@ -1479,9 +1829,7 @@ int crypto_first_ahash_req(struct crypto_async_request *async,
 
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
-	PEC_NotifyFunction_t CBFunc;
 
-	unsigned int count;
 	int i;
 
 	u32 InputToken[IOTOKEN_IN_WORD_COUNT];
@@ -1613,6 +1961,14 @@ int crypto_first_ahash_req(struct crypto_async_request *async,
 	}
 	memcpy(PktHostAddress.p, Input_p, InputByteCount);
 
+	SrcHandle = PktHandle;
+	if (SrcByteCount) {
+		rc = crypto_ahash_map_src(mtk_req, PktHandle, InputByteCount,
+					  src, SrcByteCount, &SrcHandle);
+		if (rc)
+			goto error_exit_unregister;
+	}
+
 	ZEROINIT(TokenParams);
 	TokenParams.PacketFlags |= (TKB_PACKET_FLAG_HASHFIRST
 				    | TKB_PACKET_FLAG_HASHAPPEND);
@@ -1620,7 +1976,7 @@ int crypto_first_ahash_req(struct crypto_async_request *async,
 		TokenParams.PacketFlags |= TKB_PACKET_FLAG_HASHFINAL;
 
 	rc = TokenBuilder_BuildToken(TCRData, (u8 *) PktHostAddress.p,
-				     InputByteCount, &TokenParams,
+				     InputByteCount + SrcByteCount, &TokenParams,
 				     (u32 *) TokenHostAddress.p,
 				     &TokenWords, &TokenHeaderWord);
 	if (rc != TKB_STATUS_OK) {
@@ -1631,8 +1987,8 @@ int crypto_first_ahash_req(struct crypto_async_request *async,
 	ZEROINIT(Cmd);
 	Cmd.Token_Handle = TokenHandle;
 	Cmd.Token_WordCount = TokenWords;
-	Cmd.SrcPkt_Handle = PktHandle;
-	Cmd.SrcPkt_ByteCount = InputByteCount;
+	Cmd.SrcPkt_Handle = SrcHandle;
+	Cmd.SrcPkt_ByteCount = InputByteCount + SrcByteCount;
 	Cmd.DstPkt_Handle = PktHandle;
 	Cmd.SA_Handle1 = SAHandle;
 	Cmd.SA_Handle2 = DMABuf_NULLHandle;
@@ -1652,34 +2008,23 @@ int crypto_first_ahash_req(struct crypto_async_request *async,
 		goto error_exit_unregister;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID, &Cmd, 1, &count);
-	if (rc != PEC_STATUS_OK && count != 1) {
-		rc = 1;
-		CRYPTO_ERR("PEC_Packet_Put error: %d\n", rc);
-		goto error_exit_unregister;
-	}
-
-	result = kmalloc(sizeof(struct mtk_crypto_result), GFP_KERNEL);
+	result = crypto_pe_result_get(mtk_req->ring);
 	if (!result) {
 		rc = 1;
-		CRYPTO_ERR("No memory for result\n");
+		CRYPTO_ERR("No free result slot on ring %u\n", mtk_req->ring);
 		goto error_exit_unregister;
 	}
-	INIT_LIST_HEAD(&result->list);
 	result->eip.token = TokenHandle.p;
 	result->eip.pkt_handle = PktHandle.p;
 	result->async = async;
 	result->dst = PktHostAddress.p;
 
-	spin_lock_bh(&add_lock);
-	list_add_tail(&result->list, &result_list);
-	spin_unlock_bh(&add_lock);
-	CBFunc = mtk_crypto_interrupt_handler;
-	rc = PEC_ResultNotify_Request(PEC_INTERFACE_ID, CBFunc, 1);
+	crypto_pe_batch_add(mtk_req->ring, &Cmd, result);
 
-	return rc;
+	return 0;
 
 error_exit_unregister:
+	crypto_ahash_unmap_src(mtk_req, src);
 	PEC_SA_UnRegister(PEC_INTERFACE_ID, SAHandle, DMABuf_NULLHandle,
 				DMABuf_NULLHandle);
 
@@ -1723,7 +2068,6 @@ bool crypto_basic_hash(SABuilder_Auth_t HashAlgo, uint8_t *Input_p,
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
 	PEC_ResultDescriptor_t Res;
-	unsigned int count;
 
 	u32 OutputToken[IOTOKEN_IN_WORD_COUNT];
 	u32 InputToken[IOTOKEN_IN_WORD_COUNT];
@@ -1874,16 +2218,13 @@ bool crypto_basic_hash(SABuilder_Auth_t HashAlgo, uint8_t *Input_p,
 		goto error_exit_unregister;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID, &Cmd, 1, &count);
-	if (rc != PEC_STATUS_OK && count != 1) {
-		rc = 1;
-		CRYPTO_ERR("PEC_Packet_Put error: %d\n", rc);
-		goto error_exit_unregister;
-	}
-
-	if (crypto_pe_busy_get_one(&OutTokenDscr, OutputToken, &Res) < 1) {
-		rc = 1;
-		CRYPTO_ERR("error from crypto_pe_busy_get_one\n");
+	rc = crypto_pe_sync_run(&Cmd, &OutTokenDscr, OutputToken, &Res);
+	if (rc == -ETIMEDOUT) {
+		/* Ring 0 still owns the SA, token and packet, leave them */
+		kfree(TCRData);
+		return false;
+	} else if (rc) {
+		CRYPTO_ERR("error from crypto_pe_sync_run\n");
 		goto error_exit_unregister;
 	}
 	memcpy(Output_p, PktHostAddress.p, OutputByteCount);
@@ -1982,6 +2323,42 @@ bool crypto_hmac_precompute(SABuilder_Auth_t AuthAlgo,
 	return true;
 }
 
+/*
+ * Setkey storm: run count HMAC-SHA256 key precomputes back to back and
+ * report the rate together with how the ring 0 waits behaved.
+ */
+int crypto_pe_sync_bench(u32 count)
+{
+	struct crypto_pe_sync_stats before = crypto_pe_sync_stats;
+	uint8_t key[32], inner[64], outer[64];
+	u64 ops, t0, t1;
+	u32 done;
+
+	if (!count)
+		return -EINVAL;
+
+	get_random_bytes(key, sizeof(key));
+
+	t0 = ktime_get_ns();
+	for (done = 0; done < count; done++)
+		if (!crypto_hmac_precompute(SAB_AUTH_HMAC_SHA2_256, key,
+					    sizeof(key), inner, outer))
+			break;
+	t1 = ktime_get_ns();
+
+	ops = crypto_pe_sync_stats.ops - before.ops;
+
+	CRYPTO_NOTICE("setkey bench: %u/%u hmac(sha256), %llu setkey/s, %llu ops, %llu slept, %llu timeouts, avg wait %llu ns\n",
+		      done, count,
+		      t1 > t0 ? div64_u64((u64)done * NSEC_PER_SEC, t1 - t0) : 0,
+		      ops,
+		      crypto_pe_sync_stats.sleeps - before.sleeps,
+		      crypto_pe_sync_stats.timeouts - before.timeouts,
+		      ops ? div64_u64(crypto_pe_sync_stats.wait_ns - before.wait_ns, ops) : 0);
+
+	return done == count ? 0 : -EIO;
+}
+
 static SABuilder_Crypto_t set_crypto_algo(struct xfrm_algo *ealg)
 {
 	if (strcmp(ealg->alg_name, "cbc(des)") == 0)
@@ -1995,8 +2372,10 @@ static SABuilder_Crypto_t set_crypto_algo(struct xfrm_algo *ealg)
 }
 
 static bool set_auth_algo(struct xfrm_algo_auth *aalg, SABuilder_Params_t *params,
-			  uint8_t *inner, uint8_t *outer)
+			  uint8_t **inner_p, uint8_t **outer_p)
 {
+	uint8_t *inner, *outer;
+
 	if (strcmp(aalg->alg_name, "hmac(sha1)") == 0) {
 		params->AuthAlgo = SAB_AUTH_HMAC_SHA1;
 		inner = kcalloc(SHA1_DIGEST_SIZE, sizeof(uint8_t), GFP_KERNEL);
@@ -2042,6 +2421,9 @@ static bool set_auth_algo(struct xfrm_algo_auth *aalg, SABuilder_Params_t *param
 		return false;
 	}
 
+	*inner_p = inner;
+	*outer_p = outer;
+
 	return true;
 }
 
@@ -2053,7 +2435,7 @@ u32 *mtk_ddk_tr_ipsec_build(struct mtk_xfrm_params *xfrm_params, u32 ipsec_mode)
 	SABuilder_Params_t params;
 	bool set_auth_success = false;
 	unsigned int SAWords = 0;
-	uint8_t *inner, *outer;
+	uint8_t *inner = NULL, *outer = NULL;
 
 	DMABuf_Status_t dma_status;
 	DMABuf_Properties_t dma_properties = {0, 0, 0, 0};
@@ -2065,7 +2447,8 @@ u32 *mtk_ddk_tr_ipsec_build(struct mtk_xfrm_params *xfrm_params, u32 ipsec_mode)
 				       &ipsec_params,
 				       be32_to_cpu(xs->id.spi),
 				       ipsec_mode,
-				       SAB_IPSEC_IPV4,
+				       xs->props.family == AF_INET6 ?
+				       SAB_IPSEC_IPV6 : SAB_IPSEC_IPV4,
 				       xfrm_params->dir);
 
 	if (sa_status != SAB_STATUS_OK) {
@@ -2095,7 +2478,7 @@ u32 *mtk_ddk_tr_ipsec_build(struct mtk_xfrm_params *xfrm_params, u32 ipsec_mode)
 	params.Key_p = xs->ealg->alg_key;
 
 	/* Add authentication key and parameters */
-	set_auth_success = set_auth_algo(xs->aalg, &params, inner, outer);
+	set_auth_success = set_auth_algo(xs->aalg, &params, &inner, &outer);
 	if (set_auth_success != true) {
 		CRYPTO_ERR("Set Auth Algo failed\n");
 		sa_handle.p = NULL;
@@ -2104,11 +2487,30 @@ u32 *mtk_ddk_tr_ipsec_build(struct mtk_xfrm_params *xfrm_params, u32 ipsec_mode)
 
 	ipsec_params.IPsecFlags |= (SAB_IPSEC_PROCESS_IP_HEADERS
 				    | SAB_IPSEC_EXT_PROCESSING);
-	if (ipsec_mode == SAB_IPSEC_TUNNEL) {
+
+	if ((xs->props.flags & XFRM_STATE_ESN) && xs->replay_esn) {
+		ipsec_params.IPsecFlags |= SAB_IPSEC_LONG_SEQ;
+		if (xfrm_params->dir == SAB_DIRECTION_OUTBOUND)
+			ipsec_params.SeqNumHi = xs->replay_esn->oseq_hi;
+		else
+			ipsec_params.SeqNumHi = xs->replay_esn->seq_hi;
+	}
+
+	if (ipsec_mode == SAB_IPSEC_TUNNEL && xs->props.family == AF_INET6) {
+		ipsec_params.SrcIPAddr_p = (uint8_t *) &xs->props.saddr.a6;
+		ipsec_params.DestIPAddr_p = (uint8_t *) &xs->id.daddr.a6;
+	} else if (ipsec_mode == SAB_IPSEC_TUNNEL) {
 		ipsec_params.SrcIPAddr_p = (uint8_t *) &xs->props.saddr.a4;
 		ipsec_params.DestIPAddr_p = (uint8_t *) &xs->id.daddr.a4;
 	}
 
+	/* ESP in UDP (NAT-T), ports are in host order for the SA builder */
+	if (xs->encap && xs->encap->encap_type == UDP_ENCAP_ESPINUDP) {
+		ipsec_params.IPsecFlags |= SAB_IPSEC_NATT;
+		ipsec_params.NATTSrcPort = ntohs(xs->encap->encap_sport);
+		ipsec_params.NATTDestPort = ntohs(xs->encap->encap_dport);
+	}
+
 	sa_status = SABuilder_GetSizes(&params, &SAWords, NULL, NULL);
 	if (sa_status != SAB_STATUS_OK) {
 		CRYPTO_ERR("SA not created because of size errors\n");
@@ -2136,17 +2538,70 @@ u32 *mtk_ddk_tr_ipsec_build(struct mtk_xfrm_params *xfrm_params, u32 ipsec_mode)
 		return (u32 *) sa_handle.p;
 	}
 
+	xfrm_params->seq_off = params.OffsetSeqNum;
+	xfrm_params->seq_words = params.SeqNumWord32Count;
+
+	/* the engine uses the copy in p_tr, the DMA buffer is only scratch */
+	memcpy(xfrm_params->p_tr, sa_host_addr.p,
+	       min_t(u32, SAWords, TRANSFORM_RECORD_LEN) * sizeof(u32));
+	DMABuf_Release(sa_handle);
+
 	kfree(inner);
 	kfree(outer);
-	return (u32 *) sa_host_addr.p;
+	return xfrm_params->p_tr;
 }
 
-int mtk_ddk_pec_init(void)
+static PEC_Status_t mtk_ddk_pec_ring_init(unsigned int interface_id)
 {
 	PEC_InitBlock_t pec_init_blk = {0, 0, false};
-	PEC_Capabilities_t pec_cap;
 	PEC_Status_t pec_sta;
 	u32 i = MTK_EIP197_INLINE_NOF_TRIES;
+
+	while (i) {
+		pec_sta = PEC_Init(interface_id, &pec_init_blk);
+		if (pec_sta == PEC_STATUS_OK) {
+			CRYPTO_INFO("PEC_INIT ring %u ok!\n", interface_id);
+			return PEC_STATUS_OK;
+		} else if (pec_sta != PEC_STATUS_BUSY) {
+			break;
+		}
+
+		mdelay(MTK_EIP197_INLINE_RETRY_DELAY_MS);
+		i--;
+	}
+
+	CRYPTO_ERR("PEC ring %u could not be initialized: %d\n", interface_id, pec_sta);
+	return pec_sta;
+}
+
+static bool mtk_ddk_pec_ring_deinit(unsigned int interface_id)
+{
+	unsigned int LoopCounter = MTK_EIP197_INLINE_NOF_TRIES;
+	PEC_Status_t PEC_Status;
+
+	while (LoopCounter > 0) {
+		PEC_Status = PEC_UnInit(interface_id);
+		if (PEC_Status == PEC_STATUS_OK)
+			return true;
+		else if (PEC_Status != PEC_STATUS_BUSY) {
+			CRYPTO_ERR("PEC ring %u could not be un-initialized, error=%d\n",
+				   interface_id, PEC_Status);
+			return false;
+		}
+		// Wait for MTK_EIP197_INLINE_RETRY_DELAY_MS milliseconds
+		udelay(MTK_EIP197_INLINE_RETRY_DELAY_MS * 1000);
+		LoopCounter--;
+	}
+
+	CRYPTO_ERR("PEC ring %u could not be un-initialized, timeout\n", interface_id);
+	return false;
+}
+
+int mtk_ddk_pec_init(void)
+{
+	PEC_Capabilities_t pec_cap;
+	PEC_Status_t pec_sta;
+	u32 i;
 #ifdef PEC_PCL_EIP197
 	PCL_Status_t pcl_sta;
 #endif
@@ -2164,60 +2619,45 @@ int mtk_ddk_pec_init(void)
 		return -1;
 	}
 #endif
-	while (i) {
-		pec_sta = PEC_Init(PEC_INTERFACE_ID, &pec_init_blk);
-		if (pec_sta == PEC_STATUS_OK) {
-			CRYPTO_INFO("PEC_INIT ok!\n");
-			break;
-		} else if (pec_sta != PEC_STATUS_OK && pec_sta != PEC_STATUS_BUSY) {
-			return pec_sta;
-		}
-
-		mdelay(MTK_EIP197_INLINE_RETRY_DELAY_MS);
-		i--;
-	}
-
-	if (!i) {
-		CRYPTO_ERR("PEC could not be initialized: %d\n", pec_sta);
+	pec_sta = mtk_ddk_pec_ring_init(PEC_INTERFACE_ID);
+	if (pec_sta != PEC_STATUS_OK)
 		return pec_sta;
+
+	for (i = 0; i < MTK_CRYPTO_RING_NUM; i++) {
+		pec_sta = mtk_ddk_pec_ring_init(MTK_CRYPTO_RING_BASE + i);
+		if (pec_sta != PEC_STATUS_OK)
+			goto err_ring;
 	}
 
 	pec_sta = PEC_Capabilities_Get(&pec_cap);
 	if (pec_sta != PEC_STATUS_OK) {
 		CRYPTO_ERR("PEC capability could not be obtained: %d\n", pec_sta);
-#ifdef PEC_PCL_EIP197
-		PCL_UnInit(PCL_INTERFACE_ID);
-#endif
-		return pec_sta;
+		goto err_ring;
 	}
 
 	CRYPTO_INFO("PEC Capabilities: %s\n", pec_cap.szTextDescription);
 
 	return 0;
+
+err_ring:
+	while (i--)
+		mtk_ddk_pec_ring_deinit(MTK_CRYPTO_RING_BASE + i);
+	mtk_ddk_pec_ring_deinit(PEC_INTERFACE_ID);
+#ifdef PEC_PCL_EIP197
+	PCL_UnInit(PCL_INTERFACE_ID);
+#endif
+	return pec_sta;
 }
 
 void mtk_ddk_pec_deinit(void)
 {
-	unsigned int LoopCounter = MTK_EIP197_INLINE_NOF_TRIES;
-	PEC_Status_t PEC_Status;
+	unsigned int i;
 
-	while (LoopCounter > 0) {
-		PEC_Status = PEC_UnInit(PEC_INTERFACE_ID);
-		if (PEC_Status == PEC_STATUS_OK)
-			break;
-		else if (PEC_Status != PEC_STATUS_OK && PEC_Status != PEC_STATUS_BUSY) {
-			CRYPTO_ERR("PEC could not be un-initialized, error=%d\n", PEC_Status);
-			return;
-		}
-		// Wait for MTK_EIP197_INLINE_RETRY_DELAY_MS milliseconds
-		udelay(MTK_EIP197_INLINE_RETRY_DELAY_MS * 1000);
-		LoopCounter--;
-	}
-	// Check for timeout
-	if (LoopCounter == 0) {
-		CRYPTO_ERR("PEC could not be un-initialized, timeout\n");
+	for (i = 0; i < MTK_CRYPTO_RING_NUM; i++)
+		mtk_ddk_pec_ring_deinit(MTK_CRYPTO_RING_BASE + i);
+
+	if (!mtk_ddk_pec_ring_deinit(PEC_INTERFACE_ID))
 		return;
-	}
 
 #ifdef PEC_PCL_EIP197
 	PCL_DTL_UnInit(PCL_INTERFACE_ID);
@@ -2255,7 +2695,6 @@ mtk_ddk_aes_block_encrypt(uint8_t *Key_p,
 	TokenBuilder_Params_t TokenParams;
 	PEC_CommandDescriptor_t Cmd;
 	PEC_ResultDescriptor_t Res;
-	unsigned int count;
 
 	IOToken_Input_Dscr_t InTokenDscr;
 	IOToken_Output_Dscr_t OutTokenDscr;
@@ -2414,19 +2853,13 @@ mtk_ddk_aes_block_encrypt(uint8_t *Key_p,
 		goto error_exit_unregister;
 	}
 
-	rc = PEC_Packet_Put(PEC_INTERFACE_ID,
-						&Cmd,
-						1,
-						&count);
-	if (rc != PEC_STATUS_OK && count != 1) {
-		rc = 1;
-		CRYPTO_ERR("PEC_Packet_Put error\n");
-		goto error_exit_unregister;
-	}
-
-	if (crypto_pe_busy_get_one(&OutTokenDscr, OutputToken, &Res) < 1) {
-		rc = 1;
-		CRYPTO_ERR("error from crypto_pe_busy_get_one\n");
+	rc = crypto_pe_sync_run(&Cmd, &OutTokenDscr, OutputToken, &Res);
+	if (rc == -ETIMEDOUT) {
+		/* Ring 0 still owns the SA, token and packet, leave them */
+		kfree(TCRData);
+		return false;
+	} else if (rc) {
+		CRYPTO_ERR("error from crypto_pe_sync_run\n");
 		goto error_exit_unregister;
 	}
 	memcpy(OutData_p, PktHostAddress.p, 16);
@@ -2453,10 +2886,8 @@ mtk_ddk_invalidate_rec(
 		const DMABuf_Handle_t Rec_p,
 		const bool IsTransform)
 {
-	PEC_Status_t PEC_Rc;
 	PEC_CommandDescriptor_t Cmd;
 	PEC_ResultDescriptor_t Res;
-	unsigned int count;
 	IOToken_Input_Dscr_t InTokenDscr;
 	IOToken_Output_Dscr_t OutTokenDscr;
 	uint32_t InputToken[IOTOKEN_IN_WORD_COUNT_IL];
@@ -2492,26 +2923,86 @@ mtk_ddk_invalidate_rec(
 	if (!crypto_iotoken_create(&InTokenDscr, InTokenDscrExt_p, InputToken, &Cmd))
 		return false;
 
-	// Issue command
-	PEC_Rc = PEC_Packet_Put(PEC_INTERFACE_ID,
-							&Cmd,
-							1,
-							&count);
-	if (PEC_Rc != PEC_STATUS_OK || count != 1) {
-		CRYPTO_ERR("%s: PEC_Packet_Put() error %d, count %d\n",
-				 __func__,
-				 PEC_Rc,
-				 count);
+	// Issue command and wait for the result packet
+	if (crypto_pe_sync_run(&Cmd, &OutTokenDscr, OutputToken, &Res)) {
+		CRYPTO_ERR("%s: crypto_pe_sync_run() failed\n", __func__);
 		return false;
 	}
 
-	// Receive the result packet ... do we care about contents ?
-	if (crypto_pe_busy_get_one(&OutTokenDscr, OutputToken, &Res) < 1) {
-		CRYPTO_ERR("%s: crypto_pe_busy_get_one() failed\n", __func__);
-		return false;
+	return true;
+}
+
+/*
+ * The inline path hands p_tr to the engine through the CDRT. The record is
+ * coherent memory, register it with the DDK so the record cache can be
+ * invalidated whenever the host reads or changes the sequence words.
+ */
+int mtk_ddk_tr_ipsec_register(struct mtk_xfrm_params *xfrm_params)
+{
+	DMABuf_Properties_t dma_properties = {0, 0, 0, 0};
+	DMABuf_Status_t dma_status;
+
+	dma_properties.fCached = false;
+	dma_properties.Alignment = MTK_EIP197_INLINE_DMA_ALIGNMENT_BYTE_COUNT;
+	dma_properties.Bank = MTK_EIP197_INLINE_BANK_PACKET;	/* dynamic bank */
+	dma_properties.Size = TRANSFORM_RECORD_BYTES;
+
+	/* 'C': a coherent buffer, the DDK takes the bus address as is */
+	dma_status = DMABuf_Register(dma_properties, xfrm_params->p_tr,
+				     (void *)(uintptr_t)xfrm_params->tr_dma,
+				     'C', &xfrm_params->tr_handle);
+	if (dma_status != DMABUF_STATUS_OK) {
+		CRYPTO_ERR("Register transform record failed: %d\n", dma_status);
+		return -ENOMEM;
 	}
 
-	return true;
+	return 0;
+}
+
+void mtk_ddk_tr_ipsec_unregister(struct mtk_xfrm_params *xfrm_params)
+{
+	if (!xfrm_params->tr_handle.p)
+		return;
+
+	mtk_ddk_invalidate_rec(xfrm_params->tr_handle, true);
+	DMABuf_Release(xfrm_params->tr_handle);
+	xfrm_params->tr_handle.p = NULL;
+}
+
+/* Sequence number the engine reached, sleeps on the sync ring */
+u64 mtk_ddk_tr_ipsec_seq_get(struct mtk_xfrm_params *xfrm_params)
+{
+	u32 *seq = &xfrm_params->p_tr[xfrm_params->seq_off];
+	u64 val;
+
+	/* write the engine's cached record back to memory */
+	mtk_ddk_invalidate_rec(xfrm_params->tr_handle, true);
+	rmb();
+
+	val = READ_ONCE(seq[0]);
+	if (xfrm_params->seq_words == 2)
+		val |= (u64)READ_ONCE(seq[1]) << 32;
+
+	return val;
+}
+
+/*
+ * Raise the ESN high word of an inbound record, sleeps on the sync ring.
+ * Only that word is stored, the rest of the record stays as the engine
+ * wrote it. The engine reloads the record from memory on its next packet.
+ * A packet that slips in between the invalidate and the write still uses
+ * the old high word, and the next advance_esn pushes the new one again.
+ */
+void mtk_ddk_tr_ipsec_seq_hi_set(struct mtk_xfrm_params *xfrm_params, u32 seq_hi)
+{
+	u32 *seq = &xfrm_params->p_tr[xfrm_params->seq_off];
+
+	mtk_ddk_invalidate_rec(xfrm_params->tr_handle, true);
+	rmb();
+
+	if (READ_ONCE(seq[1]) < seq_hi)
+		WRITE_ONCE(seq[1], seq_hi);
+	wmb();
 }
 
 void set_capwap_algo(SABuilder_Params_t *params, uint8_t mode)
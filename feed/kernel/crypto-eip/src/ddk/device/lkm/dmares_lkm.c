@@ -62,6 +62,8 @@
                                 // dma_free_coherent
 #include <linux/hardirq.h>      // in_atomic
 #include <linux/ioport.h>       // resource
+#include <linux/interval_tree_generic.h> // INTERVAL_TREE_DEFINE
+#include <linux/vmalloc.h>      // vzalloc, vfree
 
 #ifdef HWPAL_LOCK_SLEEPABLE
 #include <linux/mutex.h>        // mutex_*
@@ -113,6 +115,9 @@
     accessed via an index pair (chunk number and index within chunk).
   - list of free locations in Handles_p:  FreeHandles
   - list of free record index pairs     : FreeRecords
+  - host and bus address ranges of allocated resources are kept in two
+    interval trees, one node per handle and domain in AddrNodes_p, so that
+    registering a sub-buffer finds its parent without scanning all handles
  */
 
 typedef struct
@@ -127,6 +132,19 @@ typedef struct
     int CurIndex;
 } DMAResourceLib_InUseHandles_Iterator_t;
 
+typedef struct
+{
+    struct rb_node rb;
+    uintptr_t Start;
+    uintptr_t Last;
+    uintptr_t SubtreeLast;
+} DMAResourceLib_AddrNode_t;
+
+// Address index trees, AddrNodes_p holds one node per handle for each
+#define HWPAL_ADDR_INDEX_HOST   0
+#define HWPAL_ADDR_INDEX_BUS    1
+#define HWPAL_ADDR_INDEX_COUNT  2
+
 
 /* Each chunk holds as many DMA resource records as will fit into a single
    kmalloc buffer, but not more than 65536 as we use a 16-bit index  */
@@ -185,6 +203,17 @@ static HWPAL_FreeList_t FreeRecords;
 
 static void * HWPAL_Lock_p;
 
+// protected by HWPAL_Lock_p
+static DMAResourceLib_AddrNode_t * AddrNodes_p;
+static struct rb_root_cached AddrTrees[HWPAL_ADDR_INDEX_COUNT];
+
+#define ADDRNODE_START(n) ((n)->Start)
+#define ADDRNODE_LAST(n)  ((n)->Last)
+
+INTERVAL_TREE_DEFINE(DMAResourceLib_AddrNode_t, rb, uintptr_t, SubtreeLast,
+                     ADDRNODE_START, ADDRNODE_LAST,
+                     static inline, DMAResourceLib_AddrTree)
+
 
 /*----------------------------------------------------------------------------
  * DMAResourceLib_IdxPair2RecordPtr
@@ -358,6 +387,97 @@ DMAResourceLib_IsSubRangeOf(
 }
 
 
+/*----------------------------------------------------------------------------
+ * DMAResourceLib_Index_Domain
+ *
+ * Return the address index tree for `Domain', or -1 if it is not indexed.
+ */
+static inline int
+DMAResourceLib_Index_Domain(
+        const DMAResource_AddrDomain_t Domain)
+{
+    if (Domain == DMARES_DOMAIN_HOST)
+        return HWPAL_ADDR_INDEX_HOST;
+
+    if (Domain == DMARES_DOMAIN_BUS)
+        return HWPAL_ADDR_INDEX_BUS;
+
+    return -1;
+}
+
+
+/*----------------------------------------------------------------------------
+ * DMAResourceLib_Index_Add
+ *
+ * Add the host and bus address ranges of an allocated DMA resource to the
+ * address index. Registered buffers ('R' and 'N') are never a match in
+ * DMAResourceLib_Find_Matching_DMAResource and are not indexed.
+ */
+static void
+DMAResourceLib_Index_Add(
+        const DMAResource_Handle_t Handle,
+        DMAResource_Record_t * const Rec_p)
+{
+    static const DMAResource_AddrDomain_t Domains[HWPAL_ADDR_INDEX_COUNT] =
+    {
+        [HWPAL_ADDR_INDEX_HOST] = DMARES_DOMAIN_HOST,
+        [HWPAL_ADDR_INDEX_BUS] = DMARES_DOMAIN_BUS,
+    };
+    int HandleNr = (uint32_t *)Handle - Handles_p;
+    DMAResource_AddrPair_t * Pair_p;
+    DMAResourceLib_AddrNode_t * Node_p;
+    unsigned long flags;
+    int i;
+
+    if (Rec_p->AllocatorRef == 'R' || Rec_p->AllocatorRef == 'N' ||
+        Rec_p->Props.Size == 0)
+    {
+        return;
+    }
+
+    HWPAL_DMAResource_Lock_Acquire(HWPAL_Lock_p, &flags);
+
+    for (i = 0; i < HWPAL_ADDR_INDEX_COUNT; i++)
+    {
+        Pair_p = DMAResourceLib_LookupDomain(Rec_p, Domains[i]);
+        if (Pair_p == NULL)
+            continue;
+
+        Node_p = &AddrNodes_p[HandleNr * HWPAL_ADDR_INDEX_COUNT + i];
+        Node_p->Start = (uintptr_t)Pair_p->Address_p;
+        Node_p->Last = Node_p->Start + Rec_p->Props.Size - 1;
+        DMAResourceLib_AddrTree_insert(Node_p, &AddrTrees[i]);
+    }
+
+    HWPAL_DMAResource_Lock_Release(HWPAL_Lock_p, &flags);
+}
+
+
+/*----------------------------------------------------------------------------
+ * DMAResourceLib_Index_Remove
+ *
+ * Drop the address ranges of handle `HandleNr' from the address index.
+ * Must be called with HWPAL_Lock_p held.
+ */
+static inline void
+DMAResourceLib_Index_Remove(
+        const int HandleNr)
+{
+    DMAResourceLib_AddrNode_t * Node_p;
+    int i;
+
+    for (i = 0; i < HWPAL_ADDR_INDEX_COUNT; i++)
+    {
+        Node_p = &AddrNodes_p[HandleNr * HWPAL_ADDR_INDEX_COUNT + i];
+        if (RB_EMPTY_NODE(&Node_p->rb))
+            continue;
+
+        DMAResourceLib_AddrTree_remove(Node_p, &AddrTrees[i]);
+        RB_CLEAR_NODE(&Node_p->rb);
+    }
+}
+
+
 /*----------------------------------------------------------------------------
  * DMAResourceLib_Find_Matching_DMAResource
  *
@@ -366,25 +486,44 @@ DMAResourceLib_IsSubRangeOf(
  * The match can be either exact or indicate that the buffer defined by
  * `Properties and `AddrPair' is a proper sub section of the allocated or
  * attached buffer.
+ *
+ * Only the resources whose address range overlaps the requested one are
+ * visited, taken from the address index of the `AddrPair' domain.
  */
 static DMAResource_Record_t *
 DMAResourceLib_Find_Matching_DMAResource(
         const DMAResource_Properties_t * const Properties,
         const DMAResource_AddrPair_t AddrPair)
 {
-    DMAResourceLib_InUseHandles_Iterator_t it;
+    DMAResourceLib_AddrNode_t * Node_p;
     DMAResource_AddrPair_t * Pair_p;
-    DMAResource_Record_t * Rec_p;
+    DMAResource_Record_t * Rec_p = NULL;
+    uintptr_t Start, Last;
+    unsigned long flags;
     unsigned int Size;
+    int Tree;
 
-    for (Rec_p = DMAResourceLib_InUseHandles_First(&it);
-         Rec_p != NULL;
-         Rec_p = DMAResourceLib_InUseHandles_Next(&it))
+    Tree = DMAResourceLib_Index_Domain(AddrPair.Domain);
+    if (Tree < 0)
+        return NULL;
+
+    Size = Properties->Size;
+    Start = (uintptr_t)AddrPair.Address_p;
+    Last = Size ? Start + Size - 1 : Start;
+
+    HWPAL_DMAResource_Lock_Acquire(HWPAL_Lock_p, &flags);
+
+    for (Node_p = DMAResourceLib_AddrTree_iter_first(&AddrTrees[Tree],
+                                                     Start, Last);
+         Node_p != NULL;
+         Node_p = DMAResourceLib_AddrTree_iter_next(Node_p, Start, Last))
     {
-        if (Rec_p->AllocatorRef == 'R' || Rec_p->AllocatorRef == 'N')
+        Rec_p = DMAResourceLib_IdxPair2RecordPtr(
+               Handles_p[(Node_p - AddrNodes_p) / HWPAL_ADDR_INDEX_COUNT]);
+
+        if (Rec_p == NULL || Rec_p->Magic != DMARES_RECORD_MAGIC)
         {
-            // skip registered buffers when looking for a match,
-            // i.e. only consider allocated buffers.
+            Rec_p = NULL;
             continue;
         }
 
@@ -393,28 +532,24 @@ DMAResourceLib_Find_Matching_DMAResource(
             Properties->Alignment > Rec_p->Props.Alignment)
         {
             // obvious mismatch in properties
+            Rec_p = NULL;
             continue;
         }
 
-        Size = Properties->Size;
-        Pair_p = DMAResourceLib_LookupDomain(Rec_p, DMARES_DOMAIN_HOST);
+        Pair_p = DMAResourceLib_LookupDomain(Rec_p, AddrPair.Domain);
         if (Pair_p != NULL &&
             DMAResourceLib_IsSubRangeOf(&AddrPair, Size, Pair_p,
                                             Rec_p->Props.Size))
         {
-            return Rec_p;
+            break;
         }
 
-        Pair_p = DMAResourceLib_LookupDomain(Rec_p, DMARES_DOMAIN_BUS);
-        if (Pair_p != NULL &&
-            DMAResourceLib_IsSubRangeOf(&AddrPair, Size, Pair_p,
-                                            Rec_p->Props.Size))
-        {
-            return Rec_p;
-        }
+        Rec_p = NULL;
     } // for
 
-    return NULL;
+    HWPAL_DMAResource_Lock_Release(HWPAL_Lock_p, &flags);
+
+    return Rec_p;
 }
 
 
@@ -695,6 +830,8 @@ HWPAL_SG_DMAResource_Alloc(
         ++Pair_p;
         Pair_p->Address_p = UnalignedAddr_p;
         Pair_p->Domain = DMARES_DOMAIN_HOST_UNALIGNED;
+
+        DMAResourceLib_Index_Add(Handle, Rec_p);
     }
 
     *Handle_p = Handle;
@@ -1039,6 +1176,8 @@ HWPAL_DMAResource_Alloc(
                  Rec_p->Props.Alignment,Rec_p->Props.Bank,Rec_p->Props.fCached,
                  (void*)DMAAddr,UnalignedAddr_p,AlignedAddr_p);
 #endif
+
+        DMAResourceLib_Index_Add(Handle, Rec_p);
     } // Allocated DMA resource
 
     // return results
@@ -1416,20 +1555,25 @@ HWPAL_DMAResource_Init(void)
                 HWPAL_DMAResource_MemAlloc(MaxHandles * sizeof(uint32_t));
     }
 
+    AddrNodes_p = vzalloc(array_size(MaxHandles * HWPAL_ADDR_INDEX_COUNT,
+                                     sizeof(DMAResourceLib_AddrNode_t)));
+
     // if any allocation failed, free the whole lot
     if (RecordChunkPtrs_p == NULL ||
         Handles_p == NULL ||
         FreeHandles.Nrs_p == NULL ||
         FreeRecords.Nrs_p == NULL ||
+        AddrNodes_p == NULL ||
         AllocFailed)
     {
         LOG_CRIT(
             "HWPAL_DMAResource_Init: "
-            "RP=%p HP=%p FH=%p FR=%p AF=%d\n",
+            "RP=%p HP=%p FH=%p FR=%p AN=%p AF=%d\n",
             RecordChunkPtrs_p,
             Handles_p,
             FreeHandles.Nrs_p,
             FreeRecords.Nrs_p,
+            AddrNodes_p,
             AllocFailed);
 
         if (RecordChunkPtrs_p)
@@ -1467,10 +1611,13 @@ HWPAL_DMAResource_Init(void)
             if (FreeRecords.Nrs_p)
                 HWPAL_DMAResource_MemFree(FreeRecords.Nrs_p);
         }
+        vfree(AddrNodes_p);
+
         RecordChunkPtrs_p = NULL;
         Handles_p = NULL;
         FreeHandles.Nrs_p = NULL;
         FreeRecords.Nrs_p = NULL;
+        AddrNodes_p = NULL;
 
         if (HWPAL_Lock_p != NULL)
             HWPAL_DMAResource_Lock_Free(HWPAL_Lock_p);
@@ -1504,6 +1651,12 @@ HWPAL_DMAResource_Init(void)
 
         FreeRecords.ReadIndex = 0;
         FreeRecords.WriteIndex = 0;
+
+        for (i = 0; i < MaxHandles * HWPAL_ADDR_INDEX_COUNT; i++)
+            RB_CLEAR_NODE(&AddrNodes_p[i].rb);
+
+        for (i = 0; i < HWPAL_ADDR_INDEX_COUNT; i++)
+            AddrTrees[i] = RB_ROOT_CACHED;
     }
 
     HandlesCount = MaxHandles;
@@ -1612,6 +1765,8 @@ HWPAL_DMAResource_UnInit(void)
         HWPAL_DMAResource_MemFree(Handles_p);
     }
 
+    vfree(AddrNodes_p);
+
     if (HWPAL_Lock_p != NULL)
         HWPAL_DMAResource_Lock_Free(HWPAL_Lock_p);
 
@@ -1619,6 +1774,7 @@ HWPAL_DMAResource_UnInit(void)
     FreeRecords.Nrs_p = NULL;
     Handles_p = NULL;
     RecordChunkPtrs_p = NULL;
+    AddrNodes_p = NULL;
 
     HandlesCount = 0;
 }
@@ -1905,6 +2061,8 @@ HWPAL_DMAResource_CheckAndRegister(
              (void*)DMAAddr, HostAddr);
 #endif
 
+    DMAResourceLib_Index_Add(Handle, Rec_p);
+
     *Handle_p = Handle;
     return 0;
 }
@@ -2024,6 +2182,8 @@ DMAResource_DestroyRecord(
 
             HWPAL_DMAResource_Lock_Acquire(HWPAL_Lock_p, &flags);
 
+            DMAResourceLib_Index_Remove(HandleNr);
+
             // add the HandleNr and IdxPair to respective LRU lists
             DMAResourceLib_FreeList_Add(&FreeHandles, HandleNr);
             DMAResourceLib_FreeList_Add(&FreeRecords, IdxPair);
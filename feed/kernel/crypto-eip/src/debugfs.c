@@ -6,11 +6,15 @@
  */
 
 #include <linux/debugfs.h>
+#include <linux/math64.h>
 #include <linux/spinlock.h>
+#include <linux/uaccess.h>
 
 #include <pce/cdrt.h>
 
 #include "crypto-eip/crypto-eip.h"
+#include "crypto-eip/ddk-wrapper.h"
+#include "crypto-eip/debugfs.h"
 
 struct dentry *mtk_crypto_debugfs_root;
 
@@ -18,26 +22,42 @@ static int mtk_crypto_debugfs_read(struct seq_file *s, void *private)
 {
 	struct xfrm_params_list *xfrm_params_list;
 	struct mtk_xfrm_params *xfrm_params;
-	unsigned long flags;
+	struct mtk_xfrm_stats stats;
+	int bkt;
 
 	xfrm_params_list = mtk_xfrm_params_list_get();
+	if (!xfrm_params_list)
+		return 0;
 
-	spin_lock_irqsave(&xfrm_params_list->lock, flags);
+	mtk_xfrm_offload_stats_update();
 
-	list_for_each_entry(xfrm_params, &xfrm_params_list->list, node) {
-		seq_printf(s, "XFRM STATE: spi 0x%x, cdrt_idx %3d: ",
+	spin_lock_bh(&xfrm_params_list->lock);
+
+	seq_printf(s, "%u offloaded states\n", xfrm_params_list->count);
+
+	hash_for_each(xfrm_params_list->ht, bkt, xfrm_params, node) {
+		mtk_xfrm_offload_stats_sum(xfrm_params, &stats);
+		seq_printf(s, "XFRM STATE: spi 0x%x, cdrt_idx %3d, hw pkts %llu, cpu pkts %llu bytes %llu: ",
 			   htonl(xfrm_params->xs->id.spi),
-			   xfrm_params->cdrt->idx);
+			   xfrm_params->cdrt->idx,
+			   xfrm_params->hw_packets,
+			   stats.cpu_packets,
+			   stats.cpu_bytes);
 
 		if (xfrm_params->cdrt->type == CDRT_DECRYPT)
 			seq_puts(s, "DECRYPT\n");
 		else if (xfrm_params->cdrt->type == CDRT_ENCRYPT)
-			seq_puts(s, "ENCRYPT\n");
+			seq_printf(s, "ENCRYPT, udp bind %llu oversize %llu unbind %llu, l2 %s miss %llu\n",
+				   stats.udp_bind,
+				   stats.udp_oversize,
+				   stats.udp_unbind,
+				   xfrm_params->l2_ifindex ? "cached" : "unresolved",
+				   stats.l2_miss);
 		else
 			seq_puts(s, "\n");
 	}
 
-	spin_unlock_irqrestore(&xfrm_params_list->lock, flags);
+	spin_unlock_bh(&xfrm_params_list->lock);
 
 	return 0;
 }
@@ -51,6 +71,23 @@ static ssize_t mtk_crypto_debugfs_write(struct file *file,
 					const char __user *ubuf,
 					size_t count, loff_t *ppos)
 {
+	char buf[32];
+	u32 num;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+
+	buf[count] = '\0';
+
+	if (sscanf(buf, "bench %u", &num) == 1) {
+		if (mtk_xfrm_offload_bench(num) == -EOPNOTSUPP)
+			pr_info("xfrm bench needs CONFIG_CRYPTO_XFRM_OFFLOAD_BENCH\n");
+	} else
+		pr_info("usage: echo bench <num of SAs> > xfrm_params\n");
+
 	return count;
 }
 
@@ -62,12 +99,150 @@ static const struct file_operations mtk_crypto_debugfs_fops = {
 	.release = single_release,
 };
 
+static int mtk_crypto_debugfs_sync_read(struct seq_file *s, void *private)
+{
+	struct crypto_pe_sync_stats stats = crypto_pe_sync_stats;
+
+	seq_printf(s, "ring 0 sync ops %llu, slept %llu, timeouts %llu, wait total %llu ns avg %llu ns\n",
+		   stats.ops, stats.sleeps, stats.timeouts, stats.wait_ns,
+		   stats.ops ? div64_u64(stats.wait_ns, stats.ops) : 0);
+
+	return 0;
+}
+
+static int mtk_crypto_debugfs_sync_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtk_crypto_debugfs_sync_read, file->private_data);
+}
+
+static ssize_t mtk_crypto_debugfs_sync_write(struct file *file,
+					     const char __user *ubuf,
+					     size_t count, loff_t *ppos)
+{
+	char buf[32];
+	u32 num;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+
+	buf[count] = '\0';
+
+	if (sscanf(buf, "bench %u", &num) == 1)
+		crypto_pe_sync_bench(num);
+	else
+		pr_info("usage: echo bench <num of setkeys> > sync\n");
+
+	return count;
+}
+
+static const struct file_operations mtk_crypto_debugfs_sync_fops = {
+	.open = mtk_crypto_debugfs_sync_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.write = mtk_crypto_debugfs_sync_write,
+	.release = single_release,
+};
+
+static int mtk_crypto_debugfs_fallback_read(struct seq_file *s, void *private)
+{
+	mtk_crypto_fallback_show(s);
+
+	return 0;
+}
+
+static int mtk_crypto_debugfs_fallback_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtk_crypto_debugfs_fallback_read, file->private_data);
+}
+
+static const struct file_operations mtk_crypto_debugfs_fallback_fops = {
+	.open = mtk_crypto_debugfs_fallback_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int mtk_crypto_debugfs_rings_read(struct seq_file *s, void *private)
+{
+	mtk_crypto_ring_stats_show(s);
+
+	return 0;
+}
+
+static int mtk_crypto_debugfs_rings_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtk_crypto_debugfs_rings_read, file->private_data);
+}
+
+static const struct file_operations mtk_crypto_debugfs_rings_fops = {
+	.open = mtk_crypto_debugfs_rings_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int mtk_crypto_debugfs_bench_read(struct seq_file *s, void *private)
+{
+	mtk_crypto_bench_show(s);
+	mtk_crypto_ring_stats_show(s);
+
+	return 0;
+}
+
+static int mtk_crypto_debugfs_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtk_crypto_debugfs_bench_read, file->private_data);
+}
+
+static ssize_t mtk_crypto_debugfs_bench_write(struct file *file,
+					      const char __user *ubuf,
+					      size_t count, loff_t *ppos)
+{
+	char buf[192];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+
+	buf[count] = '\0';
+
+	ret = mtk_crypto_bench_cmd(buf);
+	if (ret == -EINVAL)
+		pr_info("usage: echo add <skcipher|aead|ahash> <alg> <keylen> <len> <depth> <count> > bench\n"
+			"       echo run > bench\n"
+			"       echo clear > bench\n");
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations mtk_crypto_debugfs_bench_fops = {
+	.open = mtk_crypto_debugfs_bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.write = mtk_crypto_debugfs_bench_write,
+	.release = single_release,
+};
+
 int mtk_crypto_debugfs_init(void)
 {
 	mtk_crypto_debugfs_root = debugfs_create_dir("mtk_crypto", NULL);
 
 	debugfs_create_file("xfrm_params", 0644, mtk_crypto_debugfs_root, NULL,
 			    &mtk_crypto_debugfs_fops);
+	debugfs_create_file("sync", 0644, mtk_crypto_debugfs_root, NULL,
+			    &mtk_crypto_debugfs_sync_fops);
+	debugfs_create_file("fallback", 0444, mtk_crypto_debugfs_root, NULL,
+			    &mtk_crypto_debugfs_fallback_fops);
+	debugfs_create_file("rings", 0444, mtk_crypto_debugfs_root, NULL,
+			    &mtk_crypto_debugfs_rings_fops);
+	debugfs_create_file("bench", 0644, mtk_crypto_debugfs_root, NULL,
+			    &mtk_crypto_debugfs_bench_fops);
 
 	return 0;
 }
@@ -10,8 +10,13 @@
 #define _CRYPTO_EIP_H_
 
 #include <crypto/sha.h>
+#include <linux/hashtable.h>
 #include <linux/io.h>
+#include <linux/if_ether.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
 #include <net/xfrm.h>
 
 #include "crypto-eip/crypto-eip197-inline-ddk.h"
@@ -19,9 +24,9 @@
 struct mtk_crypto;
 
 extern struct mtk_crypto mcrypto;
-extern spinlock_t add_lock;
 
 #define TRANSFORM_RECORD_LEN		64
+#define TRANSFORM_RECORD_BYTES		(TRANSFORM_RECORD_LEN * sizeof(u32))
 
 #define MAX_TUNNEL_NUM			10
 #define PACKET_INBOUND			1
@@ -29,6 +34,10 @@ extern spinlock_t add_lock;
 
 #define HASH_CACHE_SIZE			SHA512_BLOCK_SIZE
 
+#define XFRM_PARAMS_HASH_BITS		8
+#define XFRM_STATS_INTERVAL		(HZ)
+#define XFRM_STATS_BATCH		32	/* SAs synced per mutex hold */
+
 #define EIP197_FORCE_CLK_ON2		(0xfffd8)
 #define EIP197_FORCE_CLK_ON		(0xfffe8)
 #define EIP197_AUTO_LOOKUP_1		(0xfffffffc)
@@ -44,13 +53,39 @@ struct mtk_crypto {
 	u32 ppe_num;
 };
 
+/* Counters bumped on the packet path, one copy per CPU */
+struct mtk_xfrm_stats {
+	u64 cpu_packets;		/* handed to EIP197 by offload_ok */
+	u64 cpu_bytes;
+	u64 l2_miss;
+	u64 udp_bind;			/* UDP binding, outbound only */
+	u64 udp_oversize;
+	u64 udp_unbind;
+};
+
 struct mtk_xfrm_params {
 	struct xfrm_state *xs;
-	struct list_head node;
+	struct hlist_node node;		/* hashed by SPI */
 	struct cdrt_entry *cdrt;
 
 	u32 *p_tr;			/* pointer to transform record */
+	dma_addr_t tr_dma;		/* p_tr is coherent, never cached */
+	DMABuf_Handle_t tr_handle;	/* p_tr as seen by the DDK */
+	struct work_struct esn_work;	/* pushes esn_hi into the record */
+	u32 esn_hi;
 	u32 dir;			/* SABuilder_Direction_t */
+	u8 seq_off;			/* word offset of seq number in p_tr */
+	u8 seq_words;			/* 2 with ESN */
+
+	/* statistics */
+	struct mtk_xfrm_stats __percpu *stats;
+	u64 hw_packets;			/* seq number kept by EIP197 */
+
+	/* outer L2 header, outbound only, kept in sync by netevent */
+	seqcount_t l2_seq;
+	struct ethhdr l2_hdr;
+	int l2_ifindex;			/* 0 while unresolved */
+	struct hlist_node l2_node;	/* hashed by ifindex and daddr */
 };
 
 /* DTLS */
@@ -130,8 +165,13 @@ struct mtk_CDRT_DTLS_entry {
 };
 
 struct xfrm_params_list {
-	struct list_head list;
+	DECLARE_HASHTABLE(ht, XFRM_PARAMS_HASH_BITS);
+	DECLARE_HASHTABLE(l2_ht, XFRM_PARAMS_HASH_BITS);	/* resolved SAs */
 	spinlock_t lock;
+	struct mutex mutex;		/* add/free against the sleeping stats sync */
+	u32 count;
+	struct delayed_work stats_work;
+	u32 stats_bkt;			/* where the next stats batch starts */
 };
 
 #if defined(CONFIG_MTK_TOPS_CAPWAP_DTLS)
@@ -142,13 +182,36 @@ extern void (*mtk_update_cdrt_idx_from_eip_driver)(struct mtk_cdrt_idx_param *cd
 
 #if defined(CONFIG_CRYPTO_XFRM_OFFLOAD_MTK_PCE)
 struct xfrm_params_list *mtk_xfrm_params_list_get(void);
+void mtk_xfrm_offload_stats_update(void);
+void mtk_xfrm_offload_stats_sum(struct mtk_xfrm_params *xfrm_params,
+				struct mtk_xfrm_stats *sum);
 #else /* !defined(CONFIG_CRYPTO_XFRM_OFFLOAD_MTK_PCE) */
 static inline struct xfrm_params_list *mtk_xfrm_params_list_get(void)
 {
 	return NULL;
 }
+
+static inline void mtk_xfrm_offload_stats_update(void)
+{
+}
+
+static inline void mtk_xfrm_offload_stats_sum(struct mtk_xfrm_params *xfrm_params,
+					      struct mtk_xfrm_stats *sum)
+{
+	memset(sum, 0, sizeof(*sum));
+}
 #endif /* defined(CONFIG_CRYPTO_XFRM_OFFLOAD_MTK_PCE) */
 
+/* programs real CDRT/CLS entries, debug builds only */
+#if defined(CONFIG_CRYPTO_XFRM_OFFLOAD_BENCH)
+int mtk_xfrm_offload_bench(u32 count);
+#else /* !defined(CONFIG_CRYPTO_XFRM_OFFLOAD_BENCH) */
+static inline int mtk_xfrm_offload_bench(u32 count)
+{
+	return -EOPNOTSUPP;
+}
+#endif /* defined(CONFIG_CRYPTO_XFRM_OFFLOAD_BENCH) */
+
 void mtk_update_dtls_param(struct DTLS_param *DTLSParam_p, int TnlIdx);
 void mtk_remove_dtls_param(struct DTLS_param *DTLSParam_p, int TnlIdx);
 
@@ -160,7 +223,10 @@ u32 mtk_crypto_ppe_get_num(void);
 int mtk_xfrm_offload_state_add(struct xfrm_state *xs);
 void mtk_xfrm_offload_state_delete(struct xfrm_state *xs);
 void mtk_xfrm_offload_state_free(struct xfrm_state *xs);
+void mtk_xfrm_offload_state_advance_esn(struct xfrm_state *xs);
 void mtk_xfrm_offload_state_tear_down(void);
+int mtk_xfrm_offload_notifier_register(void);
+void mtk_xfrm_offload_notifier_unregister(void);
 int mtk_xfrm_offload_policy_add(struct xfrm_policy *xp);
 bool mtk_xfrm_offload_ok(struct sk_buff *skb, struct xfrm_state *xs);
 #endif /* _CRYPTO_EIP_H_ */
@@ -42,7 +42,12 @@
 
 /* Delay in milliseconds between tries to receive the packet */
 #define MTK_EIP197_INLINE_RETRY_DELAY_MS		2
-#define MTK_EIP197_PKT_GET_TIMEOUT_MS			2
+
+/* Upper bound on waiting for a synchronous (ring 0) request to complete */
+#define MTK_EIP197_SYNC_TIMEOUT_MS			100
+
+/* How much longer a timed out request is drained before ring 0 is given up */
+#define MTK_EIP197_SYNC_DRAIN_MS			1000
 
 /* Maximum number of tries to receive the packet. */
 #define MTK_EIP197_INLINE_NOF_TRIES			10
@@ -13,22 +13,52 @@
 #include "lookaside.h"
 #include "crypto-eip197-inline-ddk.h"
 
-void mtk_crypto_interrupt_handler(void);
+/* Ring 0 synchronous request accounting, updated under the sync lock */
+struct crypto_pe_sync_stats {
+	u64 ops;
+	u64 sleeps;	/* ops that had to wait for the result interrupt */
+	u64 timeouts;
+	u64 wait_ns;	/* Put to result, summed over all ops */
+};
+
+extern struct crypto_pe_sync_stats crypto_pe_sync_stats;
+
+/* Lookaside ring accounting, see crypto_pe_ring_stats_get() */
+struct crypto_pe_ring_stats {
+	unsigned int interface_id;
+	u64 submitted;
+	u64 completed;
+	u64 errors;		/* refused by the ring or failed by the engine */
+	unsigned int inflight;
+	unsigned int max_inflight;
+};
+
+int crypto_pe_sync_bench(u32 count);
+void crypto_pe_ring_init(void);
+void crypto_pe_batch_flush(unsigned int ring_id);
+void crypto_pe_ring_stats_get(unsigned int ring_id, struct crypto_pe_ring_stats *stats);
 u32 *mtk_ddk_tr_ipsec_build(struct mtk_xfrm_params *xfrm_params, u32 ipsec_mod);
+int mtk_ddk_tr_ipsec_register(struct mtk_xfrm_params *xfrm_params);
+void mtk_ddk_tr_ipsec_unregister(struct mtk_xfrm_params *xfrm_params);
+u64 mtk_ddk_tr_ipsec_seq_get(struct mtk_xfrm_params *xfrm_params);
+void mtk_ddk_tr_ipsec_seq_hi_set(struct mtk_xfrm_params *xfrm_params, u32 seq_hi);
 int crypto_basic_cipher(struct crypto_async_request *async, struct mtk_crypto_cipher_req *mtk_req,
 		struct scatterlist *src, struct scatterlist *dst, unsigned int cryptlen,
 		unsigned int assoclen, unsigned int digestsize, u8 *iv, unsigned int ivsize);
 int crypto_aead_cipher(struct crypto_async_request *async, struct mtk_crypto_cipher_req *mtk_req,
 		struct scatterlist *src, struct scatterlist *dst, unsigned int cryptlen,
 		unsigned int assoclen, unsigned int digestsize, u8 *iv, unsigned int ivsize);
+void crypto_cipher_sa_init(struct mtk_crypto_cipher_ctx *ctx);
+void crypto_cipher_sa_invalidate(struct mtk_crypto_cipher_ctx *ctx);
 int crypto_ahash_token_req(struct crypto_async_request *async,
 			   struct mtk_crypto_ahash_req *mtk_req, uint8_t *Input_p,
-			   unsigned int InputByteCount, /*uint8_t *Output_p,*/
-			   /*unsigned int OutputByteCount,*/ bool finish);
+			   unsigned int InputByteCount, struct scatterlist *src,
+			   unsigned int SrcByteCount, bool finish);
 int crypto_first_ahash_req(struct crypto_async_request *async,
 			   struct mtk_crypto_ahash_req *mtk_req, uint8_t *Input_p,
-			   unsigned int InputByteCount, /*uint8_t *Output_p,*/
-			   /*unsigned int OutputByteCount,*/ bool finish);
+			   unsigned int InputByteCount, struct scatterlist *src,
+			   unsigned int SrcByteCount, bool finish);
+void crypto_ahash_unmap_src(struct mtk_crypto_ahash_req *mtk_req, struct scatterlist *src);
 int crypto_ahash_aes_cbc(struct crypto_async_request *async,
 				struct mtk_crypto_ahash_req *mtk_req, uint8_t *Input_p,
 				unsigned int InputByteCount);
@@ -8,6 +8,13 @@
 #ifndef _CRYPTO_EIP_DEBUGFS_H_
 #define _CRYPTO_EIP_DEBUGFS_H_
 
+#include <linux/seq_file.h>
+
 int mtk_crypto_debugfs_init(void);
-void mtk_crypto_debugfs_eixt(void);
+void mtk_crypto_debugfs_exit(void);
+
+int mtk_crypto_bench_cmd(const char *cmd);
+void mtk_crypto_bench_show(struct seq_file *s);
+void mtk_crypto_bench_exit(void);
+void mtk_crypto_ring_stats_show(struct seq_file *s);
 #endif /* _CRYPTO_EIP_DEBUGFS_H_ */
@@ -14,6 +14,8 @@
 #include <crypto/md5.h>
 #include <linux/io.h>
 #include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
 #include <crypto/algapi.h>
 #include <crypto/skcipher.h>
 #include <crypto/aead.h>
@@ -22,6 +24,16 @@
 #include "crypto-eip197-inline-ddk.h"
 
 #define EIP197_DEFAULT_RING_SIZE 400
+#define MTK_CRYPTO_BATCH_SIZE 16
+/*
+ * Lookaside requests are spread over MTK_CRYPTO_RING_NUM ring pairs starting
+ * at MTK_CRYPTO_RING_BASE. PEC_INTERFACE_ID is left to the synchronous
+ * helpers that busy-poll for their result.
+ */
+#define MTK_CRYPTO_RING_NUM 4
+#define MTK_CRYPTO_RING_BASE (PEC_INTERFACE_ID + 1)
+/* Result slots per ring, above the DDK in-flight limit plus one batch */
+#define MTK_CRYPTO_RING_POOL_SIZE 128
 #define MTK_CRYPTO_PRIORITY 1500
 #define EIP197_AEAD_TYPE_IPSEC_ESP 3
 #define EIP197_AEAD_TYPE_IPSEC_ESP_GMAC 4
@@ -80,6 +92,7 @@ extern struct mtk_crypto_alg_template mtk_crypto_rfc4309_ccm;
 struct mtk_crypto_work_data {
 	struct work_struct work;
 	struct mtk_crypto_priv *priv;
+	unsigned int ring;
 };
 
 struct mtk_crypto_queue {
@@ -93,7 +106,7 @@ struct mtk_crypto_queue {
 };
 
 struct mtk_crypto_priv {
-	struct mtk_crypto_queue mtk_eip_queue;
+	struct mtk_crypto_queue mtk_eip_queue[MTK_CRYPTO_RING_NUM];
 };
 
 struct mtk_crypto_engine_data {
@@ -117,9 +130,18 @@ enum mtk_crypto_alg_type {
 	MTK_CRYPTO_ALG_TYPE_AHASH,
 };
 
+/* Per-tfm override of fallback_len, only set on the calibration tfms */
+enum mtk_crypto_fallback_force {
+	MTK_CRYPTO_FALLBACK_AUTO,
+	MTK_CRYPTO_FALLBACK_NEVER,
+	MTK_CRYPTO_FALLBACK_ALWAYS,
+};
+
 struct mtk_crypto_alg_template {
 	struct mtk_crypto_priv *priv;
 	enum mtk_crypto_alg_type type;
+	/* Requests up to this many bytes go to the software fallback, 0: never */
+	unsigned int fallback_len;
 	union {
 		struct skcipher_alg skcipher;
 		struct aead_alg aead;
@@ -170,13 +192,26 @@ enum mtk_crypto_alg {
 
 struct mtk_crypto_cipher_req {
 	enum mtk_crypto_cipher_direction direction;
+	unsigned int ring;
 	int nr_src;
 	int nr_dst;
 };
 
+/*
+ * SA and token context of a cipher tfm, built once per key and direction.
+ * The per-request IV is carried in the token, so the SA is not modified.
+ */
+struct mtk_crypto_sa_cache {
+	void *sa;
+	void *token_context;
+	unsigned int token_words;
+	unsigned int digestsize;
+};
+
 struct mtk_crypto_cipher_ctx {
 	struct mtk_crypto_context base;
 	struct mtk_crypto_priv *priv;
+	struct mtk_crypto_alg_template *tmpl;
 
 	u8 aead;
 
@@ -194,6 +229,11 @@ struct mtk_crypto_cipher_ctx {
 
 	struct crypto_cipher *hkaes;
 	struct crypto_aead *fback;
+	struct crypto_sync_skcipher *skfback;
+	enum mtk_crypto_fallback_force fback_force;
+
+	struct mutex sa_lock;
+	struct mtk_crypto_sa_cache sa_cache[2];
 };
 
 enum mtk_crypto_ahash_digest {
@@ -206,6 +246,7 @@ enum mtk_crypto_ahash_digest {
 struct mtk_crypto_ahash_ctx {
 	struct mtk_crypto_context base;
 	struct mtk_crypto_priv *priv;
+	struct mtk_crypto_alg_template *tmpl;
 
 	enum mtk_crypto_alg alg;
 	u8 key_sz;
@@ -222,6 +263,7 @@ struct mtk_crypto_ahash_ctx {
 
 	struct crypto_cipher *kaes;
 	struct crypto_ahash *fback;
+	enum mtk_crypto_fallback_force fback_force;
 	struct crypto_shash *shpre;
 	struct shash_desc *shdesc;
 };
@@ -236,6 +278,7 @@ struct mtk_crypto_ahash_req {
 	bool xcbcmac;
 
 	int nents;
+	unsigned int ring;
 
 	u32 digest;
 
@@ -252,6 +295,11 @@ struct mtk_crypto_ahash_req {
 	void *sa_pointer;
 	void *token_context;
 	u8 cache_next[HASH_CACHE_SIZE] __aligned(sizeof(u32));
+
+	/* Source gather list of the request in flight, if any */
+	void *src_sglist;
+	int nr_src;
+	bool src_head;
 };
 
 #define HASH_CACHE_SIZE		SHA512_BLOCK_SIZE
@@ -268,8 +316,29 @@ struct mtk_crypto_ahash_export_state {
 	void *token_context;
 };
 
+static inline bool mtk_crypto_use_fallback(struct mtk_crypto_alg_template *tmpl,
+					   enum mtk_crypto_fallback_force force,
+					   unsigned int len)
+{
+	unsigned int max;
+
+	if (force != MTK_CRYPTO_FALLBACK_AUTO)
+		return force == MTK_CRYPTO_FALLBACK_ALWAYS;
+
+	max = READ_ONCE(tmpl->fallback_len);
+
+	return max && len <= max;
+}
+
+void mtk_crypto_fallback_init(struct mtk_crypto_alg_template **algs,
+			      unsigned int num);
+void mtk_crypto_fallback_exit(void);
+void mtk_crypto_fallback_show(struct seq_file *s);
 void mtk_crypto_dequeue_work(struct work_struct *work);
-void mtk_crypto_dequeue(struct mtk_crypto_priv *priv);
+void mtk_crypto_dequeue(struct mtk_crypto_priv *priv, unsigned int ring);
+unsigned int mtk_crypto_select_ring(void);
+int mtk_crypto_enqueue(struct mtk_crypto_priv *priv, unsigned int ring,
+		       struct crypto_async_request *base);
 int mtk_crypto_hmac_setkey(const char *alg, const u8 *key, unsigned int keylen,
 			   void *istate, void *ostate);
 
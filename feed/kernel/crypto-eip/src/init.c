@@ -34,7 +34,6 @@
 struct mtk_crypto mcrypto;
 struct device *crypto_dev;
 struct mtk_crypto_priv *priv;
-spinlock_t add_lock;
 
 static struct mtk_crypto_alg_template *mtk_crypto_algs[] = {
 	&mtk_crypto_cbc_aes,
@@ -132,6 +131,7 @@ static const struct xfrmdev_ops mtk_xfrmdev_ops = {
 	.xdo_dev_state_add = mtk_xfrm_offload_state_add,
 	.xdo_dev_state_delete = mtk_xfrm_offload_state_delete,
 	.xdo_dev_state_free = mtk_xfrm_offload_state_free,
+	.xdo_dev_state_advance_esn = mtk_xfrm_offload_state_advance_esn,
 	.xdo_dev_offload_ok = mtk_xfrm_offload_ok,
 
 	/* Not support at v5.4*/
@@ -195,6 +195,8 @@ static void mtk_crypto_xfrm_offload_deinit(struct mtk_eth *eth)
 	mtk_crypto_offloadable = NULL;
 #endif // HNAT
 
+	mtk_xfrm_offload_notifier_unregister();
+
 	for (i = 0; i < MTK_MAC_COUNT; i++) {
 		eth->netdev[i]->xfrmdev_ops = NULL;
 		eth->netdev[i]->features &= (~NETIF_F_HW_ESP);
@@ -221,6 +223,9 @@ static void mtk_crypto_xfrm_offload_init(struct mtk_eth *eth)
 #if IS_ENABLED(CONFIG_NET_MEDIATEK_HNAT)
 	mtk_crypto_offloadable = mtk_crypto_eip_offloadable;
 #endif // HNAT
+
+	if (mtk_xfrm_offload_notifier_register())
+		CRYPTO_WARN("netevent notifier register failed\n");
 }
 
 static int __init mtk_crypto_eth_dts_init(struct platform_device *pdev)
@@ -294,6 +299,8 @@ static int __init mtk_crypto_ppe_num_dts_init(struct platform_device *pdev)
 static int __init mtk_crypto_lookaside_data_init(struct platform_device *pdev)
 {
 	struct device *dev = &pdev->dev;
+	struct mtk_crypto_queue *queue;
+	unsigned int i;
 
 	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
 	if (!priv)
@@ -301,20 +308,33 @@ static int __init mtk_crypto_lookaside_data_init(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, priv);
 
-	priv->mtk_eip_queue.work_data.priv = priv;
-	INIT_WORK(&priv->mtk_eip_queue.work_data.work, mtk_crypto_dequeue_work);
+	crypto_pe_ring_init();
 
-	priv->mtk_eip_queue.workqueue = create_singlethread_workqueue("mtk_crypto_work");
-	if (!priv->mtk_eip_queue.workqueue)
-		return -ENOMEM;
+	for (i = 0; i < MTK_CRYPTO_RING_NUM; i++) {
+		queue = &priv->mtk_eip_queue[i];
+
+		queue->work_data.priv = priv;
+		queue->work_data.ring = i;
+		INIT_WORK(&queue->work_data.work, mtk_crypto_dequeue_work);
 
-	crypto_init_queue(&priv->mtk_eip_queue.queue, EIP197_DEFAULT_RING_SIZE);
+		queue->workqueue = alloc_ordered_workqueue("mtk_crypto_work%u",
+							   WQ_MEM_RECLAIM, i);
+		if (!queue->workqueue)
+			goto err_workqueue;
 
-	spin_lock_init(&priv->mtk_eip_queue.lock);
-	spin_lock_init(&priv->mtk_eip_queue.queue_lock);
-	spin_lock_init(&add_lock);
+		crypto_init_queue(&queue->queue, EIP197_DEFAULT_RING_SIZE);
+
+		spin_lock_init(&queue->lock);
+		spin_lock_init(&queue->queue_lock);
+	}
 
 	return 0;
+
+err_workqueue:
+	while (i--)
+		destroy_workqueue(priv->mtk_eip_queue[i].workqueue);
+
+	return -ENOMEM;
 };
 
 static int __init mtk_crypto_eip_dts_init(void)
@@ -412,7 +432,8 @@ static int __init mtk_crypto_eip_init(void)
 
 	mtk_crypto_xfrm_offload_init(mcrypto.eth);
 	mtk_crypto_debugfs_init();
-	mtk_crypto_register_algorithms(priv);
+	if (!mtk_crypto_register_algorithms(priv))
+		mtk_crypto_fallback_init(mtk_crypto_algs, ARRAY_SIZE(mtk_crypto_algs));
 #if defined(CONFIG_MTK_TOPS_CAPWAP_DTLS)
 	mtk_dtls_capwap_init();
 #endif
@@ -425,9 +446,13 @@ static int __init mtk_crypto_eip_init(void)
 static void __exit mtk_crypto_eip_exit(void)
 {
 	/* TODO: deactivate all tunnel */
+	/* No debugfs handler may run into the teardown below */
+	mtk_crypto_debugfs_exit();
 #if defined(CONFIG_MTK_TOPS_CAPWAP_DTLS)
 	mtk_dtls_capwap_deinit();
 #endif
+	mtk_crypto_bench_exit();
+	mtk_crypto_fallback_exit();
 	mtk_crypto_unregister_algorithms();
 	mtk_crypto_xfrm_offload_deinit(mcrypto.eth);
 
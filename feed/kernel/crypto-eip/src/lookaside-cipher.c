@@ -93,25 +93,7 @@ static int mtk_crypto_aead_handle_result(struct mtk_crypto_result *res, int err)
 	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(async->tfm);
 	struct aead_request *req = aead_request_cast(async);
 	struct mtk_crypto_cipher_req *mtk_req = aead_request_ctx(req);
-	struct crypto_aead *aead = crypto_aead_reqtfm(req);
-	int pkt_size;
-	uint8_t *temp;
-
-	if (ctx->mode == MTK_CRYPTO_MODE_CCM && mtk_req->direction == MTK_CRYPTO_DECRYPT) {
-		pkt_size = req->cryptlen + req->assoclen - crypto_aead_authsize(aead);
-
-		temp = kmalloc(pkt_size, GFP_KERNEL);
-		if (!temp) {
-			CRYPTO_ERR("no enough memory for result\n");
-			goto free_dma;
-		}
-		memset(temp, 0, pkt_size);
-		sg_copy_to_buffer(req->dst, mtk_req->nr_dst, temp + 8, pkt_size - 8);
-		sg_copy_from_buffer(req->dst, mtk_req->nr_dst, temp, pkt_size);
-		kfree(temp);
-	}
 
-free_dma:
 	if (req->src == req->dst) {
 		dma_unmap_sg(crypto_dev, req->src, mtk_req->nr_src, DMA_BIDIRECTIONAL);
 	} else {
@@ -119,6 +101,10 @@ free_dma:
 		dma_unmap_sg(crypto_dev, req->dst, mtk_req->nr_dst, DMA_FROM_DEVICE);
 	}
 
+	/* The engine scattered CCM decrypt output past this gap, clear it */
+	if (ctx->mode == MTK_CRYPTO_MODE_CCM && mtk_req->direction == MTK_CRYPTO_DECRYPT)
+		sg_zero_buffer(req->dst, mtk_req->nr_dst, EIP197_AEAD_IPSEC_IV_SIZE, 0);
+
 	crypto_free_sglist(res->eip.pkt_handle);
 	crypto_free_sglist(res->dst);
 	crypto_free_sa(res->eip.sa);
@@ -139,6 +125,13 @@ static int mtk_crypto_skcipher_cra_init(struct crypto_tfm *tfm)
 	crypto_skcipher_set_reqsize(__crypto_skcipher_cast(tfm),
 					sizeof(struct mtk_crypto_cipher_req));
 	ctx->priv = tmpl->priv;
+	ctx->tmpl = tmpl;
+	crypto_cipher_sa_init(ctx);
+
+	/* Software tfm for short requests, the engine takes everything without it */
+	ctx->skfback = crypto_alloc_sync_skcipher(crypto_tfm_alg_name(tfm), 0, 0);
+	if (IS_ERR(ctx->skfback))
+		ctx->skfback = NULL;
 
 	ctx->base.send = mtk_crypto_skcipher_send;
 	ctx->base.handle_result = mtk_crypto_skcipher_handle_result;
@@ -167,33 +160,73 @@ static int mtk_crypto_skcipher_aes_ecb_cra_init(struct crypto_tfm *tfm)
 	return 0;
 }
 
+static int mtk_crypto_skcipher_fallback(struct skcipher_request *req,
+					enum mtk_crypto_cipher_direction dir)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_skcipher_ctx(crypto_skcipher_reqtfm(req));
+	SYNC_SKCIPHER_REQUEST_ON_STACK(subreq, ctx->skfback);
+	int ret;
+
+	skcipher_request_set_sync_tfm(subreq, ctx->skfback);
+	skcipher_request_set_callback(subreq, req->base.flags, NULL, NULL);
+	skcipher_request_set_crypt(subreq, req->src, req->dst, req->cryptlen, req->iv);
+
+	if (dir == MTK_CRYPTO_ENCRYPT)
+		ret = crypto_skcipher_encrypt(subreq);
+	else
+		ret = crypto_skcipher_decrypt(subreq);
+
+	skcipher_request_zero(subreq);
+	return ret;
+}
+
+static int mtk_crypto_skcipher_fallback_setkey(struct crypto_skcipher *ctfm,
+					       const u8 *key, unsigned int len)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_skcipher_ctx(ctfm);
+
+	if (!ctx->skfback)
+		return 0;
+
+	crypto_sync_skcipher_clear_flags(ctx->skfback, CRYPTO_TFM_REQ_MASK);
+	crypto_sync_skcipher_set_flags(ctx->skfback, crypto_skcipher_get_flags(ctfm) &
+				       CRYPTO_TFM_REQ_MASK);
+	return crypto_sync_skcipher_setkey(ctx->skfback, key, len);
+}
+
 static int mtk_crypto_queue_req(struct crypto_async_request *base,
 				struct mtk_crypto_cipher_req *mtk_req,
 				enum mtk_crypto_cipher_direction dir)
 {
 	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(base->tfm);
-	struct mtk_crypto_priv *priv = ctx->priv;
-	int ret;
 
 	mtk_req->direction = dir;
+	mtk_req->ring = mtk_crypto_select_ring();
 
-	spin_lock_bh(&priv->mtk_eip_queue.queue_lock);
-	ret = crypto_enqueue_request(&priv->mtk_eip_queue.queue, base);
-	spin_unlock_bh(&priv->mtk_eip_queue.queue_lock);
+	return mtk_crypto_enqueue(ctx->priv, mtk_req->ring, base);
+}
 
-	queue_work(priv->mtk_eip_queue.workqueue,
-			&priv->mtk_eip_queue.work_data.work);
+static bool mtk_crypto_skcipher_use_fallback(struct skcipher_request *req)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_skcipher_ctx(crypto_skcipher_reqtfm(req));
 
-	return ret;
+	return ctx->skfback && mtk_crypto_use_fallback(ctx->tmpl, ctx->fback_force,
+						       req->cryptlen);
 }
 
 static int mtk_crypto_decrypt(struct skcipher_request *req)
 {
+	if (mtk_crypto_skcipher_use_fallback(req))
+		return mtk_crypto_skcipher_fallback(req, MTK_CRYPTO_DECRYPT);
+
 	return mtk_crypto_queue_req(&req->base, skcipher_request_ctx(req), MTK_CRYPTO_DECRYPT);
 }
 
 static int mtk_crypto_encrypt(struct skcipher_request *req)
 {
+	if (mtk_crypto_skcipher_use_fallback(req))
+		return mtk_crypto_skcipher_fallback(req, MTK_CRYPTO_ENCRYPT);
+
 	return mtk_crypto_queue_req(&req->base, skcipher_request_ctx(req), MTK_CRYPTO_ENCRYPT);
 }
 
@@ -206,6 +239,8 @@ static int mtk_crypto_skcipher_aes_setkey(struct crypto_skcipher *ctfm,
 	int ret;
 	int i;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	ret = aes_expandkey(&aes, key, len);
 	if (ret)
 		return ret;
@@ -216,13 +251,16 @@ static int mtk_crypto_skcipher_aes_setkey(struct crypto_skcipher *ctfm,
 	ctx->key_len = len;
 
 	memzero_explicit(&aes, sizeof(aes));
-	return 0;
+	return mtk_crypto_skcipher_fallback_setkey(ctfm, key, len);
 }
 
 static void mtk_crypto_skcipher_cra_exit(struct crypto_tfm *tfm)
 {
 	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(tfm);
 
+	if (ctx->skfback)
+		crypto_free_sync_skcipher(ctx->skfback);
+	crypto_cipher_sa_invalidate(ctx);
 	memzero_explicit(ctx->key, sizeof(ctx->key));
 }
 
@@ -356,6 +394,8 @@ static int mtk_crypto_skcipher_aesctr_setkey(struct crypto_skcipher *ctfm,
 	int i;
 	unsigned int keylen;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	ctx->nonce = *(u32 *)(key + len - CTR_RFC3686_NONCE_SIZE);
 	keylen = len - CTR_RFC3686_NONCE_SIZE;
 	ret = aes_expandkey(&aes, key, keylen);
@@ -368,7 +408,7 @@ static int mtk_crypto_skcipher_aesctr_setkey(struct crypto_skcipher *ctfm,
 	ctx->key_len = keylen;
 
 	memzero_explicit(&aes, sizeof(aes));
-	return 0;
+	return mtk_crypto_skcipher_fallback_setkey(ctfm, key, len);
 }
 
 static int mtk_crypto_skcipher_aes_ctr_cra_init(struct crypto_tfm *tfm)
@@ -413,13 +453,15 @@ static int mtk_crypto_des_setkey(struct crypto_skcipher *ctfm, const u8 *key,
 	struct mtk_crypto_cipher_ctx *ctx = crypto_skcipher_ctx(ctfm);
 	int ret;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	ret = verify_skcipher_des_key(ctfm, key);
 	if (ret)
 		return ret;
 	memcpy(ctx->key, key, len);
 	ctx->key_len = len;
 
-	return 0;
+	return mtk_crypto_skcipher_fallback_setkey(ctfm, key, len);
 }
 
 static int mtk_crypto_skcipher_des_cbc_cra_init(struct crypto_tfm *tfm)
@@ -499,13 +541,15 @@ static int mtk_crypto_des3_ede_setkey(struct crypto_skcipher *ctfm,
 	struct mtk_crypto_cipher_ctx *ctx = crypto_skcipher_ctx(ctfm);
 	int err;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	err = verify_skcipher_des3_key(ctfm, key);
 	if (err)
 		return err;
 
 	memcpy(ctx->key, key, len);
 	ctx->key_len = len;
-	return 0;
+	return mtk_crypto_skcipher_fallback_setkey(ctfm, key, len);
 }
 
 static int mtk_crypto_skcipher_des3_cbc_cra_init(struct crypto_tfm *tfm)
@@ -579,10 +623,65 @@ struct mtk_crypto_alg_template mtk_crypto_ecb_des3_ede = {
 	},
 };
 
+static bool mtk_crypto_aead_use_fallback(struct aead_request *req)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_aead_ctx(crypto_aead_reqtfm(req));
+
+	return ctx->fback && mtk_crypto_use_fallback(ctx->tmpl, ctx->fback_force,
+						       req->cryptlen);
+}
+
+/* The fallback is synchronous, its sub-request overlays our request context */
+static int mtk_crypto_aead_fallback(struct aead_request *req,
+				    enum mtk_crypto_cipher_direction dir)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_aead_ctx(crypto_aead_reqtfm(req));
+	struct aead_request *subreq = aead_request_ctx(req);
+
+	aead_request_set_tfm(subreq, ctx->fback);
+	aead_request_set_callback(subreq, req->base.flags, req->base.complete,
+				  req->base.data);
+	aead_request_set_crypt(subreq, req->src, req->dst, req->cryptlen, req->iv);
+	aead_request_set_ad(subreq, req->assoclen);
+
+	if (dir == MTK_CRYPTO_ENCRYPT)
+		return crypto_aead_encrypt(subreq);
+
+	return crypto_aead_decrypt(subreq);
+}
+
+static int mtk_crypto_aead_fallback_setkey(struct crypto_aead *ctfm,
+					   const u8 *key, unsigned int len)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_aead_ctx(ctfm);
+
+	if (!ctx->fback)
+		return 0;
+
+	crypto_aead_clear_flags(ctx->fback, CRYPTO_TFM_REQ_MASK);
+	crypto_aead_set_flags(ctx->fback, crypto_aead_get_flags(ctfm) &
+			      CRYPTO_TFM_REQ_MASK);
+	return crypto_aead_setkey(ctx->fback, key, len);
+}
+
+static int mtk_crypto_aead_fallback_setauthsize(struct crypto_aead *ctfm,
+						unsigned int authsize)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_aead_ctx(ctfm);
+
+	if (!ctx->fback)
+		return 0;
+
+	return crypto_aead_setauthsize(ctx->fback, authsize);
+}
+
 static int mtk_crypto_aead_encrypt(struct aead_request *req)
 {
 	struct mtk_crypto_cipher_req *creq = aead_request_ctx(req);
 
+	if (mtk_crypto_aead_use_fallback(req))
+		return mtk_crypto_aead_fallback(req, MTK_CRYPTO_ENCRYPT);
+
 	return mtk_crypto_queue_req(&req->base, creq, MTK_CRYPTO_ENCRYPT);
 }
 
@@ -590,11 +689,18 @@ static int mtk_crypto_aead_decrypt(struct aead_request *req)
 {
 	struct mtk_crypto_cipher_req *creq = aead_request_ctx(req);
 
+	if (mtk_crypto_aead_use_fallback(req))
+		return mtk_crypto_aead_fallback(req, MTK_CRYPTO_DECRYPT);
+
 	return mtk_crypto_queue_req(&req->base, creq, MTK_CRYPTO_DECRYPT);
 }
 
 static void mtk_crypto_aead_cra_exit(struct crypto_tfm *tfm)
 {
+	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	if (ctx->fback)
+		crypto_free_aead(ctx->fback);
 	mtk_crypto_skcipher_cra_exit(tfm);
 }
 
@@ -603,10 +709,20 @@ static int mtk_crypto_aead_cra_init(struct crypto_tfm *tfm)
 	struct mtk_crypto_cipher_ctx *ctx = crypto_tfm_ctx(tfm);
 	struct mtk_crypto_alg_template *tmpl =
 		container_of(tfm->__crt_alg, struct mtk_crypto_alg_template, alg.aead.base);
+	unsigned int reqsize = sizeof(struct mtk_crypto_cipher_req);
+
+	ctx->fback = crypto_alloc_aead(crypto_tfm_alg_name(tfm), 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(ctx->fback))
+		ctx->fback = NULL;
+	else
+		reqsize = max_t(unsigned int, reqsize, sizeof(struct aead_request) +
+				crypto_aead_reqsize(ctx->fback));
 
-	crypto_aead_set_reqsize(__crypto_aead_cast(tfm), sizeof(struct mtk_crypto_cipher_req));
+	crypto_aead_set_reqsize(__crypto_aead_cast(tfm), reqsize);
 
 	ctx->priv = tmpl->priv;
+	ctx->tmpl = tmpl;
+	crypto_cipher_sa_init(ctx);
 
 	ctx->alg = MTK_CRYPTO_AES;
 	ctx->blocksz = AES_BLOCK_SIZE;
@@ -636,6 +752,8 @@ static int mtk_crypto_aead_setkey(struct crypto_aead *ctfm, const u8 *key, unsig
 	struct crypto_aes_ctx aes;
 	int err = -EINVAL, i;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	memset(&istate, 0, sizeof(struct mtk_crypto_ahash_export_state));
 	memset(&ostate, 0, sizeof(struct mtk_crypto_ahash_export_state));
 
@@ -723,7 +841,7 @@ static int mtk_crypto_aead_setkey(struct crypto_aead *ctfm, const u8 *key, unsig
 	kfree(ostate.token_context);
 
 	memzero_explicit(&keys, sizeof(keys));
-	return 0;
+	return mtk_crypto_aead_fallback_setkey(ctfm, key, len);
 
 badkey:
 	memzero_explicit(&keys, sizeof(keys));
@@ -734,6 +852,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha1_cbc_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = AES_BLOCK_SIZE,
@@ -768,6 +887,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha224_cbc_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = AES_BLOCK_SIZE,
@@ -802,6 +922,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha256_cbc_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = AES_BLOCK_SIZE,
@@ -836,6 +957,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha384_cbc_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = AES_BLOCK_SIZE,
@@ -870,6 +992,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha512_cbc_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = AES_BLOCK_SIZE,
@@ -904,6 +1027,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_md5_cbc_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = AES_BLOCK_SIZE,
@@ -938,6 +1062,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha1_cbc_des3_ede = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES3_EDE_BLOCK_SIZE,
@@ -972,6 +1097,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha224_cbc_des3_ede = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES3_EDE_BLOCK_SIZE,
@@ -1006,6 +1132,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha256_cbc_des3_ede = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES3_EDE_BLOCK_SIZE,
@@ -1040,6 +1167,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha384_cbc_des3_ede = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES3_EDE_BLOCK_SIZE,
@@ -1074,6 +1202,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha512_cbc_des3_ede = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES3_EDE_BLOCK_SIZE,
@@ -1108,6 +1237,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_md5_cbc_des3_ede = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES3_EDE_BLOCK_SIZE,
@@ -1142,6 +1272,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha1_cbc_des = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES_BLOCK_SIZE,
@@ -1176,6 +1307,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha224_cbc_des = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES_BLOCK_SIZE,
@@ -1210,6 +1342,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha256_cbc_des = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES_BLOCK_SIZE,
@@ -1244,6 +1377,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha384_cbc_des = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES_BLOCK_SIZE,
@@ -1278,6 +1412,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha512_cbc_des = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = DES_BLOCK_SIZE,
@@ -1311,6 +1446,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha1_ctr_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = CTR_RFC3686_IV_SIZE,
@@ -1344,6 +1480,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha256_ctr_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = CTR_RFC3686_IV_SIZE,
@@ -1377,6 +1514,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha224_ctr_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = CTR_RFC3686_IV_SIZE,
@@ -1410,6 +1548,7 @@ struct mtk_crypto_alg_template mtk_crypto_hmac_sha512_ctr_aes = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
 		.setkey = mtk_crypto_aead_setkey,
+		.setauthsize = mtk_crypto_aead_fallback_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
 		.ivsize = CTR_RFC3686_IV_SIZE,
@@ -1439,6 +1578,8 @@ static int mtk_crypto_aead_gcm_setkey(struct crypto_aead *ctfm, const u8 *key,
 	u32 hashkey[AES_BLOCK_SIZE >> 2];
 	int ret, i;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	ret = aes_expandkey(&aes, key, len);
 	if (ret) {
 		memzero_explicit(&aes, sizeof(aes));
@@ -1493,13 +1634,21 @@ static void mtk_crypto_aead_gcm_cra_exit(struct crypto_tfm *tfm)
 static int mtk_crypto_aead_gcm_setauthsize(struct crypto_aead *tfm,
 					   unsigned int authsize)
 {
-	return crypto_gcm_check_authsize(authsize);
+	return crypto_gcm_check_authsize(authsize) ?:
+		mtk_crypto_aead_fallback_setauthsize(tfm, authsize);
+}
+
+static int mtk_crypto_gcm_setkey(struct crypto_aead *ctfm, const u8 *key,
+				 unsigned int len)
+{
+	return mtk_crypto_aead_gcm_setkey(ctfm, key, len) ?:
+		mtk_crypto_aead_fallback_setkey(ctfm, key, len);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_gcm = {
 	.type = MTK_CRYPTO_ALG_TYPE_AEAD,
 	.alg.aead = {
-		.setkey = mtk_crypto_aead_gcm_setkey,
+		.setkey = mtk_crypto_gcm_setkey,
 		.setauthsize = mtk_crypto_aead_gcm_setauthsize,
 		.encrypt = mtk_crypto_aead_encrypt,
 		.decrypt = mtk_crypto_aead_decrypt,
@@ -1530,14 +1679,15 @@ static int mtk_crypto_rfc4106_gcm_setkey(struct crypto_aead *ctfm, const u8 *key
 	/* last 4 bytes of key are the nonce! */
 	ctx->nonce = *(u32 *)(key + len - CTR_RFC3686_NONCE_SIZE);
 
-	len -= CTR_RFC3686_NONCE_SIZE;
-	return mtk_crypto_aead_gcm_setkey(ctfm, key, len);
+	return mtk_crypto_aead_gcm_setkey(ctfm, key, len - CTR_RFC3686_NONCE_SIZE) ?:
+		mtk_crypto_aead_fallback_setkey(ctfm, key, len);
 }
 
 static int mtk_crypto_rfc4106_gcm_setauthsize(struct crypto_aead *tfm,
 							unsigned int authsize)
 {
-	return crypto_rfc4106_check_authsize(authsize);
+	return crypto_rfc4106_check_authsize(authsize) ?:
+		mtk_crypto_aead_fallback_setauthsize(tfm, authsize);
 }
 
 static int mtk_crypto_rfc4106_encrypt(struct aead_request *req)
@@ -1592,7 +1742,7 @@ static int mtk_crypto_rfc4543_gcm_setauthsize(struct crypto_aead *tfm,
 	if (authsize != GHASH_DIGEST_SIZE)
 		return -EINVAL;
 
-	return 0;
+	return mtk_crypto_aead_fallback_setauthsize(tfm, authsize);
 }
 
 static int mtk_crypto_rfc4543_gcm_cra_init(struct crypto_tfm *tfm)
@@ -1639,6 +1789,8 @@ static int mtk_crypto_aead_ccm_setkey(struct crypto_aead *ctfm, const u8 *key,
 	struct crypto_aes_ctx aes;
 	int ret, i;
 
+	crypto_cipher_sa_invalidate(ctx);
+
 	ret = aes_expandkey(&aes, key, len);
 	if (ret) {
 		memzero_explicit(&aes, sizeof(aes));
@@ -1670,8 +1822,8 @@ static int mtk_crypto_rfc4309_ccm_setkey(struct crypto_aead *ctfm, const u8 *key
 			EIP197_AEAD_IPSEC_CCM_NONCE_SIZE,
 			EIP197_AEAD_IPSEC_CCM_NONCE_SIZE);
 
-	len -= EIP197_AEAD_IPSEC_CCM_NONCE_SIZE;
-	return mtk_crypto_aead_ccm_setkey(ctfm, key, len);
+	return mtk_crypto_aead_ccm_setkey(ctfm, key, len - EIP197_AEAD_IPSEC_CCM_NONCE_SIZE) ?:
+		mtk_crypto_aead_fallback_setkey(ctfm, key, len);
 }
 
 static int mtk_crypto_rfc4309_ccm_setauthsize(struct crypto_aead *tfm,
@@ -1686,7 +1838,7 @@ static int mtk_crypto_rfc4309_ccm_setauthsize(struct crypto_aead *tfm,
 		return -EINVAL;
 	}
 
-	return 0;
+	return mtk_crypto_aead_fallback_setauthsize(tfm, authsize);
 }
 
 static int mtk_crypto_rfc4309_ccm_encrypt(struct aead_request *req)
@@ -1696,6 +1848,9 @@ static int mtk_crypto_rfc4309_ccm_encrypt(struct aead_request *req)
 	if (req->assoclen != 16 && req->assoclen != 20)
 		return -EINVAL;
 
+	if (mtk_crypto_aead_use_fallback(req))
+		return mtk_crypto_aead_fallback(req, MTK_CRYPTO_ENCRYPT);
+
 	return mtk_crypto_queue_req(&req->base, creq, MTK_CRYPTO_ENCRYPT);
 }
 
@@ -1706,6 +1861,9 @@ static int mtk_crypto_rfc4309_ccm_decrypt(struct aead_request *req)
 	if (req->assoclen != 16 && req->assoclen != 20)
 		return -EINVAL;
 
+	if (mtk_crypto_aead_use_fallback(req))
+		return mtk_crypto_aead_fallback(req, MTK_CRYPTO_DECRYPT);
+
 	return mtk_crypto_queue_req(&req->base, creq, MTK_CRYPTO_DECRYPT);
 }
 
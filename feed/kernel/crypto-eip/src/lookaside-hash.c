@@ -26,17 +26,11 @@ static inline u64 mtk_crypto_queued_len(struct mtk_crypto_ahash_req *req)
 static int mtk_crypto_ahash_enqueue(struct ahash_request *areq)
 {
 	struct mtk_crypto_ahash_ctx *ctx = crypto_ahash_ctx(crypto_ahash_reqtfm(areq));
-	struct mtk_crypto_priv *priv = ctx->priv;
-	int ret;
-
-	spin_lock_bh(&priv->mtk_eip_queue.queue_lock);
-	ret = crypto_enqueue_request(&priv->mtk_eip_queue.queue, &areq->base);
-	spin_unlock_bh(&priv->mtk_eip_queue.queue_lock);
+	struct mtk_crypto_ahash_req *req = ahash_request_ctx(areq);
 
-	queue_work(priv->mtk_eip_queue.workqueue,
-			&priv->mtk_eip_queue.work_data.work);
+	req->ring = mtk_crypto_select_ring();
 
-	return ret;
+	return mtk_crypto_enqueue(ctx->priv, req->ring, &areq->base);
 }
 
 static int mtk_crypto_ahash_send(struct crypto_async_request *async)
@@ -51,6 +45,9 @@ static int mtk_crypto_ahash_send(struct crypto_async_request *async)
 	u64 len;
 	bool ret = 0;
 	uint8_t *cur_req;
+	int pad_size = 0;
+	int offset;
+	int new;
 	int i;
 
 	if (req->hmac_zlen)
@@ -83,6 +80,28 @@ static int mtk_crypto_ahash_send(struct crypto_async_request *async)
 	}
 
 	len = queued;
+
+	if (likely(!req->xcbcmac)) {
+		/* Only the cached partial block is copied, the rest is gathered */
+		if (req->not_first)
+			ret = crypto_ahash_token_req(async, req, req->cache, cache_len,
+						     areq->src, len - cache_len, req->finish);
+		else
+			ret = crypto_first_ahash_req(async, req, req->cache, cache_len,
+						     areq->src, len - cache_len, req->finish);
+		if (ret) {
+			if (req->sa_pointer)
+				crypto_free_sa(req->sa_pointer);
+			CRYPTO_ERR("Fail on ahash_req process\n");
+			goto exit;
+		}
+		req->not_first = true;
+		req->processed += len - extra;
+
+		return 0;
+	}
+
+	/* XCBC pads and mixes the key into the last block, so it is bounced */
 	cur_req = kmalloc(sizeof(uint8_t) * len + AES_BLOCK_SIZE, GFP_KERNEL);
 	if (!cur_req) {
 		CRYPTO_ERR("alloc buffer for ahash request failed\n");
@@ -96,59 +115,35 @@ static int mtk_crypto_ahash_send(struct crypto_async_request *async)
 	if (queued)
 		sg_copy_to_buffer(areq->src, sg_nents(areq->src), cur_req + cache_len, queued);
 
-	if (unlikely(req->xcbcmac)) {
-		int pad_size = 0;
-		int offset;
-		int new;
-
-		if (req->finish) {
-			new = len % AES_BLOCK_SIZE;
-			pad_size = AES_BLOCK_SIZE - new;
-			offset = (len - new) / sizeof(u32);
-
-			if (pad_size != AES_BLOCK_SIZE) {
-				memset(cur_req + len, 0, pad_size);
-				cur_req[len] = 0x80;
-				for (i = 0; i < AES_BLOCK_SIZE / sizeof(u32); i++) {
-					((__be32 *) cur_req)[offset + i] ^=
-						cpu_to_be32(le32_to_cpu(
-							ctx->ipad[i + 4]));
-				}
-			} else {
-				for (i = 0; i < AES_BLOCK_SIZE / sizeof(u32); i++)
-					((__be32 *) cur_req)[offset - 4 + i] ^=
-						cpu_to_be32(le32_to_cpu(
-							ctx->ipad[i]));
-				pad_size = 0;
+	if (req->finish) {
+		new = len % AES_BLOCK_SIZE;
+		pad_size = AES_BLOCK_SIZE - new;
+		offset = (len - new) / sizeof(u32);
+
+		if (pad_size != AES_BLOCK_SIZE) {
+			memset(cur_req + len, 0, pad_size);
+			cur_req[len] = 0x80;
+			for (i = 0; i < AES_BLOCK_SIZE / sizeof(u32); i++) {
+				((__be32 *) cur_req)[offset + i] ^=
+					cpu_to_be32(le32_to_cpu(
+						ctx->ipad[i + 4]));
 			}
+		} else {
+			for (i = 0; i < AES_BLOCK_SIZE / sizeof(u32); i++)
+				((__be32 *) cur_req)[offset - 4 + i] ^=
+					cpu_to_be32(le32_to_cpu(
+						ctx->ipad[i]));
+			pad_size = 0;
 		}
-
-		ret = crypto_ahash_aes_cbc(async, req, cur_req, len + pad_size);
-		kfree(cur_req);
-		if (ret) {
-			if (req->sa_pointer)
-				crypto_free_sa(req->sa_pointer);
-			kfree(req->token_context);
-			CRYPTO_ERR("Fail on ahash_aes_cbc process\n");
-			goto exit;
-		}
-		req->not_first = true;
-		req->processed += len - extra;
-
-		return 0;
 	}
 
-	if (req->not_first)
-		ret = crypto_ahash_token_req(async, req, cur_req, len, req->finish);
-	else
-		ret = crypto_first_ahash_req(async, req, cur_req, len, req->finish);
-
+	ret = crypto_ahash_aes_cbc(async, req, cur_req, len + pad_size);
 	kfree(cur_req);
-
 	if (ret) {
 		if (req->sa_pointer)
 			crypto_free_sa(req->sa_pointer);
-		CRYPTO_ERR("Fail on ahash_req process\n");
+		kfree(req->token_context);
+		CRYPTO_ERR("Fail on ahash_aes_cbc process\n");
 		goto exit;
 	}
 	req->not_first = true;
@@ -166,7 +161,7 @@ zero_length_hmac:
 		req->sa_pointer = ctx->opad_sa;
 		req->token_context = ctx->opad_token;
 		ret = crypto_ahash_token_req(async, req, (uint8_t *) req->state,
-						req->digest_sz, true);
+						req->digest_sz, NULL, 0, true);
 	}
 
 	return 0;
@@ -184,6 +179,19 @@ static int mtk_crypto_ahash_handle_result(struct mtk_crypto_result *res, int err
 	struct crypto_ahash *ahash = crypto_ahash_reqtfm(areq);
 	int cache_len;
 
+	crypto_ahash_unmap_src(req, areq->src);
+
+	if (err) {
+		if (req->xcbcmac) {
+			crypto_free_sa(res->eip.sa);
+			kfree(res->eip.token_context);
+		}
+		crypto_free_token(res->eip.token);
+		crypto_free_pkt(res->eip.pkt_handle);
+		async->complete(async, err);
+		return 0;
+	}
+
 	if (req->xcbcmac) {
 		memcpy(req->state, res->dst + res->size - AES_BLOCK_SIZE, AES_BLOCK_SIZE);
 		crypto_free_sa(res->eip.sa);
@@ -319,6 +327,45 @@ static int mtk_crypto_ahash_finup(struct ahash_request *areq)
 	return mtk_crypto_ahash_final(areq);
 }
 
+/* The fallback is synchronous, its sub-request overlays our request context */
+static int mtk_crypto_ahash_fallback_digest(struct ahash_request *areq)
+{
+	struct mtk_crypto_ahash_ctx *ctx = crypto_ahash_ctx(crypto_ahash_reqtfm(areq));
+	struct ahash_request *subreq = ahash_request_ctx(areq);
+
+	ahash_request_set_tfm(subreq, ctx->fback);
+	ahash_request_set_callback(subreq, areq->base.flags, NULL, NULL);
+	ahash_request_set_crypt(subreq, areq->src, areq->result, areq->nbytes);
+
+	return crypto_ahash_digest(subreq);
+}
+
+/* Tail of every .digest, short one-shot requests are cheaper on the CPU */
+static int mtk_crypto_ahash_digest_finup(struct ahash_request *areq)
+{
+	struct mtk_crypto_ahash_ctx *ctx = crypto_ahash_ctx(crypto_ahash_reqtfm(areq));
+
+	if (ctx->fback && mtk_crypto_use_fallback(ctx->tmpl, ctx->fback_force,
+						     areq->nbytes))
+		return mtk_crypto_ahash_fallback_digest(areq);
+
+	return mtk_crypto_ahash_finup(areq);
+}
+
+static int mtk_crypto_ahash_fallback_setkey(struct crypto_ahash *tfm, const u8 *key,
+					    unsigned int keylen)
+{
+	struct mtk_crypto_ahash_ctx *ctx = crypto_ahash_ctx(tfm);
+
+	if (!ctx->fback)
+		return 0;
+
+	crypto_ahash_clear_flags(ctx->fback, CRYPTO_TFM_REQ_MASK);
+	crypto_ahash_set_flags(ctx->fback, crypto_ahash_get_flags(tfm) &
+			       CRYPTO_TFM_REQ_MASK);
+	return crypto_ahash_setkey(ctx->fback, key, keylen);
+}
+
 static int mtk_crypto_ahash_export(struct ahash_request *areq, void *out)
 {
 	struct mtk_crypto_ahash_req *req = ahash_request_ctx(areq);
@@ -369,11 +416,21 @@ static int mtk_crypto_ahash_cra_init(struct crypto_tfm *tfm)
 		container_of(__crypto_ahash_alg(tfm->__crt_alg),
 			     struct mtk_crypto_alg_template, alg.ahash);
 
+	unsigned int reqsize = sizeof(struct mtk_crypto_ahash_req);
+
 	ctx->priv = tmpl->priv;
+	ctx->tmpl = tmpl;
 	ctx->base.send = mtk_crypto_ahash_send;
 	ctx->base.handle_result = mtk_crypto_ahash_handle_result;
-	crypto_ahash_set_reqsize(__crypto_ahash_cast(tfm),
-				 sizeof(struct mtk_crypto_ahash_req));
+
+	ctx->fback = crypto_alloc_ahash(crypto_tfm_alg_name(tfm), 0, CRYPTO_ALG_ASYNC);
+	if (IS_ERR(ctx->fback))
+		ctx->fback = NULL;
+	else
+		reqsize = max_t(unsigned int, reqsize, sizeof(struct ahash_request) +
+				crypto_ahash_reqsize(ctx->fback));
+
+	crypto_ahash_set_reqsize(__crypto_ahash_cast(tfm), reqsize);
 
 	return 0;
 }
@@ -401,11 +458,15 @@ static int mtk_crypto_sha1_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 static void mtk_crypto_ahash_cra_exit(struct crypto_tfm *tfm)
 {
+	struct mtk_crypto_ahash_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	if (ctx->fback)
+		crypto_free_ahash(ctx->fback);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_sha1 = {
@@ -468,7 +529,7 @@ static int mtk_crypto_hmac_sha1_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_ahash_result {
@@ -695,7 +756,7 @@ static int mtk_crypto_hmac_alg_setkey(struct crypto_ahash *tfm, const u8 *key,
 	ctx->opad_sa = ostate.sa_pointer;
 	ctx->opad_token = ostate.token_context;
 
-	return 0;
+	return mtk_crypto_ahash_fallback_setkey(tfm, key, keylen);
 }
 
 static int mtk_crypto_hmac_sha1_setkey(struct crypto_ahash *tfm, const u8 *key,
@@ -758,7 +819,7 @@ static int mtk_crypto_sha256_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_sha256 = {
@@ -813,7 +874,7 @@ static int mtk_crypto_sha224_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_sha224 = {
@@ -883,7 +944,7 @@ static int mtk_crypto_hmac_sha224_digest(struct ahash_request *areq)
 
 	if (ret)
 		return ret;
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_hmac_sha224 = {
@@ -953,7 +1014,7 @@ static int mtk_crypto_hmac_sha256_digest(struct ahash_request *areq)
 
 	if (ret)
 		return ret;
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_hmac_sha256 = {
@@ -1008,7 +1069,7 @@ static int mtk_crypto_sha512_digest(struct ahash_request *areq)
 
 	if (ret)
 		return ret;
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_sha512 = {
@@ -1063,7 +1124,7 @@ static int mtk_crypto_sha384_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_sha384 = {
@@ -1133,7 +1194,7 @@ static int mtk_crypto_hmac_sha512_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_hmac_sha512 = {
@@ -1204,7 +1265,7 @@ static int mtk_crypto_hmac_sha384_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_hmac_sha384 = {
@@ -1260,7 +1321,7 @@ static int mtk_crypto_md5_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_md5 = {
@@ -1330,7 +1391,7 @@ static int mtk_crypto_hmac_md5_digest(struct ahash_request *areq)
 	if (ret)
 		return ret;
 
-	return mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_ahash_digest_finup(areq);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_hmac_md5 = {
@@ -1385,7 +1446,7 @@ static int mtk_crypto_cbcmac_init(struct ahash_request *areq)
 
 static int mtk_crypto_cbcmac_digest(struct ahash_request *areq)
 {
-	return mtk_crypto_cbcmac_init(areq) ?: mtk_crypto_ahash_finup(areq);
+	return mtk_crypto_cbcmac_init(areq) ?: mtk_crypto_ahash_digest_finup(areq);
 }
 
 static int mtk_crypto_xcbcmac_setkey(struct crypto_ahash *tfm, const u8 *key,
@@ -1432,7 +1493,7 @@ static int mtk_crypto_xcbcmac_setkey(struct crypto_ahash *tfm, const u8 *key,
 	ctx->cbcmac = false;
 
 	memzero_explicit(&aes, sizeof(aes));
-	return 0;
+	return mtk_crypto_ahash_fallback_setkey(tfm, key, len);
 }
 
 static int mtk_crypto_xcbcmac_cra_init(struct crypto_tfm *tfm)
@@ -1540,7 +1601,7 @@ static int mtk_crypto_cmac_setkey(struct crypto_ahash *tfm, const u8 *key,
 	ctx->cbcmac = false;
 
 	memzero_explicit(&aes, sizeof(aes));
-	return 0;
+	return mtk_crypto_ahash_fallback_setkey(tfm, key, len);
 }
 
 struct mtk_crypto_alg_template mtk_crypto_cmac = {
@@ -7,7 +7,15 @@
  */
 
 #include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/random.h>
+#include <linux/rtnetlink.h>
 #include <crypto/aes.h>
+#include <crypto/authenc.h>
+#include <crypto/ctr.h>
+#include <crypto/des.h>
+#include <crypto/internal/aead.h>
+#include <crypto/internal/hash.h>
 #include <crypto/internal/skcipher.h>
 
 #include "crypto-eip/crypto-eip.h"
@@ -15,18 +23,40 @@
 #include "crypto-eip/lookaside.h"
 #include "crypto-eip/internal.h"
 
-void mtk_crypto_dequeue(struct mtk_crypto_priv *priv)
+/* Steer requests by submitting CPU so concurrent users land on different rings */
+unsigned int mtk_crypto_select_ring(void)
 {
+	return raw_smp_processor_id() % MTK_CRYPTO_RING_NUM;
+}
+
+int mtk_crypto_enqueue(struct mtk_crypto_priv *priv, unsigned int ring,
+		       struct crypto_async_request *base)
+{
+	struct mtk_crypto_queue *queue = &priv->mtk_eip_queue[ring];
+	int ret;
+
+	spin_lock_bh(&queue->queue_lock);
+	ret = crypto_enqueue_request(&queue->queue, base);
+	spin_unlock_bh(&queue->queue_lock);
+
+	queue_work(queue->workqueue, &queue->work_data.work);
+
+	return ret;
+}
+
+void mtk_crypto_dequeue(struct mtk_crypto_priv *priv, unsigned int ring)
+{
+	struct mtk_crypto_queue *queue = &priv->mtk_eip_queue[ring];
 	struct crypto_async_request *req;
 	struct crypto_async_request *backlog;
 	struct mtk_crypto_context *ctx;
 	int ret;
 
 	while (true) {
-		spin_lock_bh(&priv->mtk_eip_queue.queue_lock);
-		backlog = crypto_get_backlog(&priv->mtk_eip_queue.queue);
-		req = crypto_dequeue_request(&priv->mtk_eip_queue.queue);
-		spin_unlock_bh(&priv->mtk_eip_queue.queue_lock);
+		spin_lock_bh(&queue->queue_lock);
+		backlog = crypto_get_backlog(&queue->queue);
+		req = crypto_dequeue_request(&queue->queue);
+		spin_unlock_bh(&queue->queue_lock);
 
 		if (!req)
 			goto finalize;
@@ -41,6 +71,8 @@ void mtk_crypto_dequeue(struct mtk_crypto_priv *priv)
 	}
 
 finalize:
+	/* Ring the doorbell for whatever is left in the batch */
+	crypto_pe_batch_flush(ring);
 	return;
 }
 
@@ -48,5 +80,296 @@ void mtk_crypto_dequeue_work(struct work_struct *work)
 {
 	struct mtk_crypto_work_data *data =
 			container_of(work, struct mtk_crypto_work_data, work);
-	mtk_crypto_dequeue(data->priv);
+	mtk_crypto_dequeue(data->priv, data->ring);
+}
+
+/*
+ * Software fallback calibration. For every algorithm, time single-stream
+ * requests of MTK_CRYPTO_CALIB_MIN << 0 .. MTK_CRYPTO_CALIB_STEPS - 1 bytes on
+ * the engine and on the fallback tfm, and hand the software everything up to
+ * the largest length where it still wins.
+ */
+#define MTK_CRYPTO_CALIB_MIN		16
+#define MTK_CRYPTO_CALIB_STEPS		8
+#define MTK_CRYPTO_CALIB_MAX		(MTK_CRYPTO_CALIB_MIN << (MTK_CRYPTO_CALIB_STEPS - 1))
+#define MTK_CRYPTO_CALIB_ITER		32
+#define MTK_CRYPTO_CALIB_AAD		16
+
+struct mtk_crypto_calib {
+	struct crypto_wait wait;
+	struct scatterlist sg;
+	u8 *buf;
+	u8 iv[AES_BLOCK_SIZE];
+	u8 digest[SHA512_DIGEST_SIZE];
+	u8 key[128];
+};
+
+static struct mtk_crypto_alg_template **calib_algs;
+static unsigned int calib_num;
+static bool calib_done;
+
+static struct crypto_alg *mtk_crypto_tmpl_base(struct mtk_crypto_alg_template *tmpl)
+{
+	if (tmpl->type == MTK_CRYPTO_ALG_TYPE_SKCIPHER)
+		return &tmpl->alg.skcipher.base;
+	else if (tmpl->type == MTK_CRYPTO_ALG_TYPE_AEAD)
+		return &tmpl->alg.aead.base;
+
+	return &tmpl->alg.ahash.halg.base;
+}
+
+static int mtk_crypto_calib_skcipher(void *r, struct mtk_crypto_calib *c,
+				     unsigned int len)
+{
+	struct skcipher_request *req = r;
+
+	skcipher_request_set_crypt(req, &c->sg, &c->sg, len, c->iv);
+	return crypto_wait_req(crypto_skcipher_encrypt(req), &c->wait);
+}
+
+static int mtk_crypto_calib_aead(void *r, struct mtk_crypto_calib *c,
+				 unsigned int len)
+{
+	struct aead_request *req = r;
+
+	aead_request_set_crypt(req, &c->sg, &c->sg, len, c->iv);
+	aead_request_set_ad(req, MTK_CRYPTO_CALIB_AAD);
+	return crypto_wait_req(crypto_aead_encrypt(req), &c->wait);
+}
+
+static int mtk_crypto_calib_ahash(void *r, struct mtk_crypto_calib *c,
+				  unsigned int len)
+{
+	struct ahash_request *req = r;
+
+	ahash_request_set_crypt(req, &c->sg, c->digest, len);
+	return crypto_wait_req(crypto_ahash_digest(req), &c->wait);
+}
+
+/* Key material the AEAD under test accepts, laid out as its setkey wants */
+static unsigned int mtk_crypto_calib_aead_key(struct crypto_aead *tfm, u8 *key)
+{
+	struct mtk_crypto_cipher_ctx *ctx = crypto_aead_ctx(tfm);
+	struct crypto_authenc_key_param *param;
+	struct rtattr *rta = (struct rtattr *)key;
+	unsigned int enckeylen;
+
+	switch (ctx->hash_alg) {
+	case MTK_CRYPTO_ALG_GCM:
+	case MTK_CRYPTO_ALG_GMAC:
+		if (ctx->aead == EIP197_AEAD_TYPE_IPSEC_ESP)
+			return AES_KEYSIZE_128 + CTR_RFC3686_NONCE_SIZE;
+		return AES_KEYSIZE_128;
+	case MTK_CRYPTO_ALG_XCBC:
+		return AES_KEYSIZE_128 + EIP197_AEAD_IPSEC_CCM_NONCE_SIZE;
+	default:
+		break;
+	}
+
+	if (ctx->alg == MTK_CRYPTO_DES)
+		enckeylen = DES_KEY_SIZE;
+	else if (ctx->alg == MTK_CRYPTO_3DES)
+		enckeylen = DES3_EDE_KEY_SIZE;
+	else
+		enckeylen = AES_KEYSIZE_128;
+
+	if (ctx->mode == MTK_CRYPTO_MODE_CTR)
+		enckeylen += CTR_RFC3686_NONCE_SIZE;
+
+	rta->rta_type = CRYPTO_AUTHENC_KEYA_PARAM;
+	rta->rta_len = RTA_LENGTH(sizeof(*param));
+	param = RTA_DATA(rta);
+	param->enckeylen = cpu_to_be32(enckeylen);
+
+	/* 32 bytes of HMAC key followed by the cipher key */
+	return RTA_SPACE(sizeof(*param)) + 32 + enckeylen;
+}
+
+static void mtk_crypto_calib_one(struct mtk_crypto_alg_template *tmpl,
+				 struct mtk_crypto_calib *c)
+{
+	int (*run)(void *r, struct mtk_crypto_calib *c, unsigned int len);
+	const char *name = mtk_crypto_tmpl_base(tmpl)->cra_driver_name;
+	u64 ns[MTK_CRYPTO_CALIB_STEPS][2];
+	struct mtk_crypto_cipher_ctx *cctx;
+	struct mtk_crypto_ahash_ctx *hctx;
+	struct crypto_skcipher *sk = NULL;
+	struct crypto_aead *aead = NULL;
+	struct crypto_ahash *ahash = NULL;
+	enum mtk_crypto_fallback_force *force = NULL;
+	unsigned int len = 0, step, keylen;
+	bool fallback = false;
+	void *req = NULL;
+	int ret = 0;
+	int sw, i;
+	u64 start;
+
+	get_random_bytes(c->key, sizeof(c->key));
+
+	if (tmpl->type == MTK_CRYPTO_ALG_TYPE_SKCIPHER) {
+		sk = crypto_alloc_skcipher(name, 0, 0);
+		if (IS_ERR(sk))
+			return;
+
+		cctx = crypto_skcipher_ctx(sk);
+		fallback = cctx->skfback;
+		force = &cctx->fback_force;
+		ret = crypto_skcipher_setkey(sk, c->key, tmpl->alg.skcipher.min_keysize);
+		req = skcipher_request_alloc(sk, GFP_KERNEL);
+		if (req)
+			skcipher_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+						      crypto_req_done, &c->wait);
+		run = mtk_crypto_calib_skcipher;
+	} else if (tmpl->type == MTK_CRYPTO_ALG_TYPE_AEAD) {
+		aead = crypto_alloc_aead(name, 0, 0);
+		if (IS_ERR(aead))
+			return;
+
+		cctx = crypto_aead_ctx(aead);
+		fallback = cctx->fback;
+		force = &cctx->fback_force;
+		keylen = mtk_crypto_calib_aead_key(aead, c->key);
+		ret = crypto_aead_setkey(aead, c->key, keylen);
+		req = aead_request_alloc(aead, GFP_KERNEL);
+		if (req)
+			aead_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+						  crypto_req_done, &c->wait);
+		run = mtk_crypto_calib_aead;
+	} else {
+		ahash = crypto_alloc_ahash(name, 0, 0);
+		if (IS_ERR(ahash))
+			return;
+
+		hctx = crypto_ahash_ctx(ahash);
+		fallback = hctx->fback;
+		force = &hctx->fback_force;
+		if (crypto_ahash_get_flags(ahash) & CRYPTO_TFM_NEED_KEY)
+			ret = crypto_ahash_setkey(ahash, c->key, AES_KEYSIZE_128);
+		req = ahash_request_alloc(ahash, GFP_KERNEL);
+		if (req)
+			ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_BACKLOG,
+						   crypto_req_done, &c->wait);
+		run = mtk_crypto_calib_ahash;
+	}
+
+	if (!fallback) {
+		CRYPTO_NOTICE("%s: no software fallback available\n", name);
+		goto out;
+	}
+
+	if (ret || !req) {
+		CRYPTO_NOTICE("%s: fallback calibration skipped (%d)\n", name, ret);
+		goto out;
+	}
+
+	for (step = 0; step < MTK_CRYPTO_CALIB_STEPS; step++) {
+		len = MTK_CRYPTO_CALIB_MIN << step;
+
+		for (sw = 0; sw < 2; sw++) {
+			/* only this tfm is forced, live users keep fallback_len */
+			*force = sw ? MTK_CRYPTO_FALLBACK_ALWAYS :
+				      MTK_CRYPTO_FALLBACK_NEVER;
+
+			/* The first request builds the SA, keep it out of the timing */
+			ret = run(req, c, len);
+			if (ret)
+				goto fail;
+
+			start = ktime_get_ns();
+			for (i = 0; i < MTK_CRYPTO_CALIB_ITER; i++) {
+				ret = run(req, c, len);
+				if (ret)
+					goto fail;
+			}
+			ns[step][sw] = ktime_get_ns() - start;
+		}
+	}
+
+	/*
+	 * Walk down from the largest length while the engine keeps winning,
+	 * the result is the only fallback_len live requests ever see.
+	 */
+	step = MTK_CRYPTO_CALIB_STEPS;
+	while (step && ns[step - 1][0] <= ns[step - 1][1])
+		step--;
+
+	WRITE_ONCE(tmpl->fallback_len,
+		   step ? MTK_CRYPTO_CALIB_MIN << (step - 1) : 0);
+	goto out;
+
+fail:
+	CRYPTO_NOTICE("%s: fallback calibration failed at %u bytes (%d)\n",
+		      name, len, ret);
+
+out:
+	if (sk) {
+		skcipher_request_free(req);
+		crypto_free_skcipher(sk);
+	} else if (aead) {
+		aead_request_free(req);
+		crypto_free_aead(aead);
+	} else {
+		ahash_request_free(req);
+		crypto_free_ahash(ahash);
+	}
+}
+
+static void mtk_crypto_calib_work(struct work_struct *work)
+{
+	struct mtk_crypto_calib *c;
+	unsigned int i;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return;
+
+	/* Room for the AAD, the longest payload and the largest tag */
+	c->buf = kzalloc(MTK_CRYPTO_CALIB_AAD + MTK_CRYPTO_CALIB_MAX +
+			 SHA512_DIGEST_SIZE, GFP_KERNEL);
+	if (!c->buf)
+		goto out;
+
+	crypto_init_wait(&c->wait);
+	sg_init_one(&c->sg, c->buf, MTK_CRYPTO_CALIB_AAD + MTK_CRYPTO_CALIB_MAX +
+		    SHA512_DIGEST_SIZE);
+
+	for (i = 0; i < calib_num; i++)
+		mtk_crypto_calib_one(calib_algs[i], c);
+
+	kfree(c->buf);
+out:
+	kfree(c);
+	calib_done = true;
+}
+
+static DECLARE_WORK(mtk_crypto_calib, mtk_crypto_calib_work);
+
+/* Calibration takes a while, keep it off the probe path */
+void mtk_crypto_fallback_init(struct mtk_crypto_alg_template **algs,
+			      unsigned int num)
+{
+	calib_algs = algs;
+	calib_num = num;
+	schedule_work(&mtk_crypto_calib);
+}
+
+void mtk_crypto_fallback_exit(void)
+{
+	cancel_work_sync(&mtk_crypto_calib);
+}
+
+void mtk_crypto_fallback_show(struct seq_file *s)
+{
+	struct mtk_crypto_alg_template *tmpl;
+	unsigned int i;
+
+	seq_printf(s, "software fallback up to (bytes), 0: never%s\n",
+		   calib_done ? "" : " (calibrating)");
+
+	for (i = 0; i < calib_num; i++) {
+		tmpl = calib_algs[i];
+		seq_printf(s, "%-40s %u\n",
+			   mtk_crypto_tmpl_base(tmpl)->cra_driver_name,
+			   READ_ONCE(tmpl->fallback_len));
+	}
 }
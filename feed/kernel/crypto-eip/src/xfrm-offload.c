@@ -7,7 +7,15 @@
  */
 
 #include <linux/bitops.h>
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
 #include <linux/spinlock.h>
+#include <net/arp.h>
+#include <net/ndisc.h>
+#include <net/netevent.h>
 
 #include <mtk_eth_soc.h>
 
@@ -28,9 +36,15 @@
 #include "crypto-eip/ddk-wrapper.h"
 #include "crypto-eip/internal.h"
 
+static void mtk_xfrm_offload_stats_work(struct work_struct *work);
+static void __mtk_xfrm_offload_state_free(struct mtk_xfrm_params *xfrm_params);
+static void mtk_xfrm_offload_esn_work(struct work_struct *work);
+
 static struct xfrm_params_list xfrm_params_list = {
-	.list = LIST_HEAD_INIT(xfrm_params_list.list),
 	.lock = __SPIN_LOCK_UNLOCKED(xfrm_params_list.lock),
+	.mutex = __MUTEX_INITIALIZER(xfrm_params_list.mutex),
+	.stats_work = __DELAYED_WORK_INITIALIZER(xfrm_params_list.stats_work,
+						 mtk_xfrm_offload_stats_work, 0),
 };
 
 #if IS_ENABLED(CONFIG_NET_MEDIATEK_HNAT)
@@ -43,15 +57,79 @@ static inline bool is_tops_tunnel(struct sk_buff *skb)
 		 ip_hdr(skb)->protocol == IPPROTO_GRE);
 }
 
+static inline u8 l4_proto(struct sk_buff *skb)
+{
+	if (ntohs(skb->protocol) == ETH_P_IP)
+		return ip_hdr(skb)->protocol;
+	if (ntohs(skb->protocol) == ETH_P_IPV6)
+		return ipv6_hdr(skb)->nexthdr;
+	return 0;
+}
+
 static inline bool is_tcp(struct sk_buff *skb)
 {
-	return (ntohs(skb->protocol) == ETH_P_IP) && (ip_hdr(skb)->protocol == IPPROTO_TCP);
+	return l4_proto(skb) == IPPROTO_TCP;
+}
+
+static inline bool is_udp(struct sk_buff *skb)
+{
+	return l4_proto(skb) == IPPROTO_UDP;
 }
 
 static inline bool is_hnat_rate_reach(struct sk_buff *skb)
 {
 	return is_magic_tag_valid(skb) && (skb_hnat_reason(skb) == HIT_UNBIND_RATE_REACH);
 }
+
+/*
+ * Largest inner packet that still fits the egress path once ESP is added.
+ * header_len and trailer_len already cover the outer IP header in tunnel
+ * mode, the NAT-T UDP header and the worst case padding, so this errs on
+ * the small side.
+ */
+static u32 mtk_xfrm_offload_udp_mtu(struct xfrm_state *xs,
+				    struct dst_entry *dst)
+{
+	u32 overhead = xs->props.header_len + xs->props.trailer_len;
+	u32 mtu;
+
+	mtu = min_t(u32, dst->dev->mtu, dst_mtu(xfrm_dst_path(dst)));
+
+	return mtu > overhead ? mtu - overhead : 0;
+}
+
+/*
+ * EIP197 does not support fragmentation, so a bound UDP flow must never
+ * carry a packet that would need it after encapsulation. Only bind flows
+ * whose packets fit. Once bound, a frame that outgrows the egress MTU
+ * traps to the CPU as HIT_BIND_EXCEED_MTU and HNAT unbinds the flow; a
+ * path MTU below the device MTU is only caught here, on the CPU path.
+ */
+static bool mtk_xfrm_offload_udp_bindable(struct sk_buff *skb,
+					  struct xfrm_state *xs,
+					  struct mtk_xfrm_params *xfrm_params,
+					  struct dst_entry *dst)
+{
+	u32 mtu = mtk_xfrm_offload_udp_mtu(xs, dst);
+	bool fit;
+
+	if (skb_is_gso(skb))
+		fit = skb_gso_validate_network_len(skb, mtu);
+	else
+		fit = skb->len - skb_network_offset(skb) <= mtu;
+
+	if (!fit) {
+		this_cpu_inc(xfrm_params->stats->udp_oversize);
+
+		/* the path MTU shrank under a flow bound earlier */
+		if (hnat_unbind_crypto_entry(skb))
+			this_cpu_inc(xfrm_params->stats->udp_unbind);
+
+		return false;
+	}
+
+	return is_hnat_rate_reach(skb);
+}
 #endif // HNAT
 
 struct xfrm_params_list *mtk_xfrm_params_list_get(void)
@@ -59,6 +137,120 @@ struct xfrm_params_list *mtk_xfrm_params_list_get(void)
 	return &xfrm_params_list;
 }
 
+/* caller holds xfrm_params_list.lock */
+static struct mtk_xfrm_params *mtk_xfrm_params_lookup(__be32 spi, u32 dir)
+{
+	struct mtk_xfrm_params *xfrm_params;
+
+	hash_for_each_possible(xfrm_params_list.ht, xfrm_params, node,
+			       (__force u32)spi) {
+		if (xfrm_params->xs->id.spi == spi && xfrm_params->dir == dir)
+			return xfrm_params;
+	}
+
+	return NULL;
+}
+
+/* caller holds xfrm_params_list.mutex */
+static void mtk_xfrm_offload_stats_sync(struct mtk_xfrm_params *xfrm_params)
+{
+	struct xfrm_state *xs = xfrm_params->xs;
+	u64 hw_packets;
+
+	if (!xfrm_params->seq_words)
+		return;
+
+	/*
+	 * EIP197 updates the sequence number for every packet, but in its
+	 * record cache, so flush that out before reading the host copy.
+	 */
+	hw_packets = mtk_ddk_tr_ipsec_seq_get(xfrm_params);
+
+	WRITE_ONCE(xfrm_params->hw_packets, hw_packets);
+
+	/*
+	 * Packets of bound flows never pass xfrm_output, so lift the packet
+	 * lifetime up to what the engine has seen and let xfrm raise the soft
+	 * and hard expire for the key manager.
+	 */
+	spin_lock_bh(&xs->lock);
+	if (xs->km.state == XFRM_STATE_VALID &&
+	    hw_packets > xs->curlft.packets) {
+		xs->curlft.packets = hw_packets;
+		if (!xs->curlft.use_time)
+			xs->curlft.use_time = ktime_get_real_seconds();
+		xfrm_state_check_expire(xs);
+	}
+	spin_unlock_bh(&xs->lock);
+}
+
+/*
+ * Sync the SAs of the buckets from *bkt on, stopping after the bucket that
+ * reaches budget SAs. Every SA costs a record invalidate on the sync ring,
+ * so the mutex is only held for one batch and add/free get in between.
+ * Returns true once the pass has covered the whole table.
+ */
+static bool mtk_xfrm_offload_stats_batch(u32 *bkt, u32 budget)
+{
+	struct mtk_xfrm_params *xfrm_params;
+	u32 done = 0;
+
+	mutex_lock(&xfrm_params_list.mutex);
+
+	for (; *bkt < HASH_SIZE(xfrm_params_list.ht) && done < budget; (*bkt)++) {
+		hlist_for_each_entry(xfrm_params, &xfrm_params_list.ht[*bkt],
+				     node) {
+			mtk_xfrm_offload_stats_sync(xfrm_params);
+			done++;
+		}
+	}
+
+	mutex_unlock(&xfrm_params_list.mutex);
+
+	return *bkt >= HASH_SIZE(xfrm_params_list.ht);
+}
+
+/* sleeps: the record cache is flushed through the sync command ring */
+void mtk_xfrm_offload_stats_update(void)
+{
+	u32 bkt = 0;
+
+	while (!mtk_xfrm_offload_stats_batch(&bkt, XFRM_STATS_BATCH))
+		cond_resched();
+}
+
+void mtk_xfrm_offload_stats_sum(struct mtk_xfrm_params *xfrm_params,
+				struct mtk_xfrm_stats *sum)
+{
+	struct mtk_xfrm_stats *stats;
+	int cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(xfrm_params->stats, cpu);
+		sum->cpu_packets += stats->cpu_packets;
+		sum->cpu_bytes += stats->cpu_bytes;
+		sum->l2_miss += stats->l2_miss;
+		sum->udp_bind += stats->udp_bind;
+		sum->udp_oversize += stats->udp_oversize;
+		sum->udp_unbind += stats->udp_unbind;
+	}
+}
+
+static void mtk_xfrm_offload_stats_work(struct work_struct *work)
+{
+	unsigned long delay = 1;
+
+	if (mtk_xfrm_offload_stats_batch(&xfrm_params_list.stats_bkt,
+					 XFRM_STATS_BATCH)) {
+		xfrm_params_list.stats_bkt = 0;
+		delay = XFRM_STATS_INTERVAL;
+	}
+
+	if (READ_ONCE(xfrm_params_list.count))
+		schedule_delayed_work(&xfrm_params_list.stats_work, delay);
+}
+
 static void mtk_xfrm_offload_cdrt_tear_down(struct mtk_xfrm_params *xfrm_params)
 {
 	if (!xfrm_params->cdrt)
@@ -75,7 +267,7 @@ static int mtk_xfrm_offload_cdrt_setup(struct mtk_xfrm_params *xfrm_params)
 
 	cdesc->desc1.common.type = 3;
 	cdesc->desc1.token_len = 48;
-	cdesc->desc1.p_tr[0] = __pa(xfrm_params->p_tr) | 2;
+	cdesc->desc1.p_tr[0] = xfrm_params->tr_dma | 2;
 
 	cdesc->desc2.hw_srv = 3;
 	cdesc->desc2.allow_pad = 1;
@@ -134,8 +326,11 @@ static void mtk_xfrm_offload_context_tear_down(struct mtk_xfrm_params *xfrm_para
 {
 	mtk_xfrm_offload_cdrt_tear_down(xfrm_params);
 
+	mtk_ddk_tr_ipsec_unregister(xfrm_params);
+
 	/* TODO: free context */
-	devm_kfree(crypto_dev, xfrm_params->p_tr);
+	dma_free_coherent(crypto_dev, TRANSFORM_RECORD_BYTES, xfrm_params->p_tr,
+			  xfrm_params->tr_dma);
 
 	/* TODO: transform record tear down */
 }
@@ -145,8 +340,14 @@ static int mtk_xfrm_offload_context_setup(struct mtk_xfrm_params *xfrm_params)
 	u32 *tr;
 	int ret;
 
-	xfrm_params->p_tr = devm_kcalloc(crypto_dev, sizeof(u32),
-					 TRANSFORM_RECORD_LEN, GFP_KERNEL);
+	/*
+	 * The engine writes the sequence words back while the host reads
+	 * and raises them, so keep the record out of the CPU cache.
+	 */
+	xfrm_params->p_tr = dma_alloc_coherent(crypto_dev,
+					       TRANSFORM_RECORD_BYTES,
+					       &xfrm_params->tr_dma,
+					       GFP_KERNEL);
 	if (unlikely(!xfrm_params->p_tr))
 		return -ENOMEM;
 
@@ -167,14 +368,21 @@ static int mtk_xfrm_offload_context_setup(struct mtk_xfrm_params *xfrm_params)
 		goto err_out;
 	}
 
-	memcpy(xfrm_params->p_tr, tr, sizeof(u32) * TRANSFORM_RECORD_LEN);
+	ret = mtk_ddk_tr_ipsec_register(xfrm_params);
+	if (ret)
+		goto err_out;
 
-	/* TODO: free tr */
+	ret = mtk_xfrm_offload_cdrt_setup(xfrm_params);
+	if (ret)
+		goto err_unregister;
 
-	return mtk_xfrm_offload_cdrt_setup(xfrm_params);
+	return 0;
 
+err_unregister:
+	mtk_ddk_tr_ipsec_unregister(xfrm_params);
 err_out:
-	devm_kfree(crypto_dev, xfrm_params->p_tr);
+	dma_free_coherent(crypto_dev, TRANSFORM_RECORD_BYTES, xfrm_params->p_tr,
+			  xfrm_params->tr_dma);
 
 	return ret;
 }
@@ -235,12 +443,11 @@ free_cdrt:
 int mtk_xfrm_offload_state_add(struct xfrm_state *xs)
 {
 	struct mtk_xfrm_params *xfrm_params;
-	unsigned long flags;
+	bool dup;
 	int ret = 0;
 
-	/* TODO: maybe support IPv6 in the future? */
-	if (xs->props.family != AF_INET) {
-		CRYPTO_NOTICE("Only IPv4 xfrm states may be offloaded\n");
+	if (xs->props.family != AF_INET && xs->props.family != AF_INET6) {
+		CRYPTO_NOTICE("Only IPv4/IPv6 xfrm states may be offloaded\n");
 		return -EINVAL;
 	}
 
@@ -255,14 +462,43 @@ int mtk_xfrm_offload_state_add(struct xfrm_state *xs)
 	    || xs->outer_mode.encap == XFRM_MODE_TRANSPORT))
 		return -EINVAL;
 
+	/* the inline path tags the inner packet with the SA's ethertype */
+	if (xs->outer_mode.encap == XFRM_MODE_TUNNEL &&
+	    xs->inner_mode.family != xs->props.family) {
+		CRYPTO_NOTICE("Cross-family tunnels may not be offloaded\n");
+		return -EINVAL;
+	}
+
+	/* inbound CLS rules only match on SPI, so it has to be unique */
+	if (xs->xso.flags & XFRM_OFFLOAD_INBOUND) {
+		spin_lock_bh(&xfrm_params_list.lock);
+		dup = !!mtk_xfrm_params_lookup(xs->id.spi, SAB_DIRECTION_INBOUND);
+		spin_unlock_bh(&xfrm_params_list.lock);
+
+		if (dup) {
+			CRYPTO_NOTICE("Inbound SPI 0x%x already offloaded\n",
+				      ntohl(xs->id.spi));
+			return -EEXIST;
+		}
+	}
+
 	xfrm_params = devm_kzalloc(crypto_dev,
 				   sizeof(struct mtk_xfrm_params),
 				   GFP_KERNEL);
 	if (!xfrm_params)
 		return -ENOMEM;
 
+	xfrm_params->stats = alloc_percpu(struct mtk_xfrm_stats);
+	if (!xfrm_params->stats) {
+		devm_kfree(crypto_dev, xfrm_params);
+		return -ENOMEM;
+	}
+
 	xfrm_params->xs = xs;
-	INIT_LIST_HEAD(&xfrm_params->node);
+	INIT_HLIST_NODE(&xfrm_params->node);
+	INIT_HLIST_NODE(&xfrm_params->l2_node);
+	seqcount_init(&xfrm_params->l2_seq);
+	INIT_WORK(&xfrm_params->esn_work, mtk_xfrm_offload_esn_work);
 
 	if (xs->xso.flags & XFRM_OFFLOAD_INBOUND)
 		/* rx path */
@@ -272,17 +508,36 @@ int mtk_xfrm_offload_state_add(struct xfrm_state *xs)
 		ret = mtk_xfrm_offload_state_add_outbound(xs, xfrm_params);
 
 	if (ret) {
+		free_percpu(xfrm_params->stats);
 		devm_kfree(crypto_dev, xfrm_params);
 		goto out;
 	}
 
 	xs->xso.offload_handle = (unsigned long)xfrm_params;
 
-	spin_lock_irqsave(&xfrm_params_list.lock, flags);
+	mutex_lock(&xfrm_params_list.mutex);
+	spin_lock_bh(&xfrm_params_list.lock);
 
-	list_add_tail(&xfrm_params->node, &xfrm_params_list.list);
+	/* the check above is only a fast path, a concurrent add may have won */
+	if ((xs->xso.flags & XFRM_OFFLOAD_INBOUND) &&
+	    mtk_xfrm_params_lookup(xs->id.spi, SAB_DIRECTION_INBOUND)) {
+		spin_unlock_bh(&xfrm_params_list.lock);
+		mutex_unlock(&xfrm_params_list.mutex);
 
-	spin_unlock_irqrestore(&xfrm_params_list.lock, flags);
+		CRYPTO_NOTICE("Inbound SPI 0x%x already offloaded\n",
+			      ntohl(xs->id.spi));
+		__mtk_xfrm_offload_state_free(xfrm_params);
+		return -EEXIST;
+	}
+
+	hash_add(xfrm_params_list.ht, &xfrm_params->node,
+		 (__force u32)xs->id.spi);
+	xfrm_params_list.count++;
+
+	spin_unlock_bh(&xfrm_params_list.lock);
+	mutex_unlock(&xfrm_params_list.mutex);
+
+	schedule_delayed_work(&xfrm_params_list.stats_work, XFRM_STATS_INTERVAL);
 out:
 	return ret;
 }
@@ -291,6 +546,26 @@ void mtk_xfrm_offload_state_delete(struct xfrm_state *xs)
 {
 }
 
+static void __mtk_xfrm_offload_state_free(struct mtk_xfrm_params *xfrm_params)
+{
+	struct xfrm_state *xs = xfrm_params->xs;
+
+	cancel_work_sync(&xfrm_params->esn_work);
+
+	if (xs->xso.flags & XFRM_OFFLOAD_INBOUND)
+		mtk_xfrm_offload_cls_entry_tear_down(xfrm_params);
+
+	mtk_xfrm_offload_context_tear_down(xfrm_params);
+
+	if (xfrm_params->cdrt)
+		mtk_pce_cdrt_entry_free(xfrm_params->cdrt);
+
+	xs->xso.offload_handle = 0;
+
+	free_percpu(xfrm_params->stats);
+	devm_kfree(crypto_dev, xfrm_params);
+}
+
 void mtk_xfrm_offload_state_free(struct xfrm_state *xs)
 {
 	struct mtk_xfrm_params *xfrm_params;
@@ -300,30 +575,74 @@ void mtk_xfrm_offload_state_free(struct xfrm_state *xs)
 
 	xfrm_params = (struct mtk_xfrm_params *)xs->xso.offload_handle;
 
-	list_del(&xfrm_params->node);
+	mutex_lock(&xfrm_params_list.mutex);
+	spin_lock_bh(&xfrm_params_list.lock);
 
-	if (xs->xso.flags & XFRM_OFFLOAD_INBOUND)
-		mtk_xfrm_offload_cls_entry_tear_down(xfrm_params);
+	hash_del(&xfrm_params->node);
+	hash_del(&xfrm_params->l2_node);
+	xfrm_params_list.count--;
 
-	mtk_xfrm_offload_context_tear_down(xfrm_params);
+	spin_unlock_bh(&xfrm_params_list.lock);
+	mutex_unlock(&xfrm_params_list.mutex);
 
-	if (xfrm_params->cdrt)
-		mtk_pce_cdrt_entry_free(xfrm_params->cdrt);
+	__mtk_xfrm_offload_state_free(xfrm_params);
+}
 
-	devm_kfree(crypto_dev, xfrm_params);
+static void mtk_xfrm_offload_esn_work(struct work_struct *work)
+{
+	struct mtk_xfrm_params *xfrm_params =
+		container_of(work, struct mtk_xfrm_params, esn_work);
+
+	mutex_lock(&xfrm_params_list.mutex);
+	mtk_ddk_tr_ipsec_seq_hi_set(xfrm_params, READ_ONCE(xfrm_params->esn_hi));
+	mutex_unlock(&xfrm_params_list.mutex);
+}
+
+void mtk_xfrm_offload_state_advance_esn(struct xfrm_state *xs)
+{
+	struct mtk_xfrm_params *xfrm_params;
+
+	if (!xs->xso.offload_handle || !xs->replay_esn)
+		return;
+
+	xfrm_params = (struct mtk_xfrm_params *)xs->xso.offload_handle;
+	if (xfrm_params->seq_words != 2 ||
+	    xfrm_params->dir != SAB_DIRECTION_INBOUND)
+		return;
+
+	/*
+	 * xfrm moved the replay window to a new high word on the software
+	 * path, let the engine check the ICV against the same ESN. We are
+	 * called under xs->lock and the record update sleeps, so defer it.
+	 */
+	WRITE_ONCE(xfrm_params->esn_hi, xs->replay_esn->seq_hi);
+	schedule_work(&xfrm_params->esn_work);
 }
 
 void mtk_xfrm_offload_state_tear_down(void)
 {
-	struct mtk_xfrm_params *xfrm_params, *tmp;
-	unsigned long flags;
+	struct mtk_xfrm_params *xfrm_params;
+	struct hlist_node *tmp;
+	HLIST_HEAD(free_list);
+	int bkt;
 
-	spin_lock_irqsave(&xfrm_params_list.lock, flags);
+	cancel_delayed_work_sync(&xfrm_params_list.stats_work);
 
-	list_for_each_entry_safe(xfrm_params, tmp, &xfrm_params_list.list, node)
-		mtk_xfrm_offload_state_free(xfrm_params->xs);
+	mutex_lock(&xfrm_params_list.mutex);
+	spin_lock_bh(&xfrm_params_list.lock);
+
+	hash_for_each_safe(xfrm_params_list.ht, bkt, tmp, xfrm_params, node) {
+		hash_del(&xfrm_params->node);
+		hash_del(&xfrm_params->l2_node);
+		hlist_add_head(&xfrm_params->node, &free_list);
+	}
+	xfrm_params_list.count = 0;
 
-	spin_unlock_irqrestore(&xfrm_params_list.lock, flags);
+	spin_unlock_bh(&xfrm_params_list.lock);
+	mutex_unlock(&xfrm_params_list.mutex);
+
+	hlist_for_each_entry_safe(xfrm_params, tmp, &free_list, node)
+		__mtk_xfrm_offload_state_free(xfrm_params);
 }
 
 int mtk_xfrm_offload_policy_add(struct xfrm_policy *xp)
@@ -336,6 +655,24 @@ static inline struct neighbour *mtk_crypto_find_dst_mac(struct sk_buff *skb,  st
 	struct neighbour *neigh;
 	struct dst_entry *dst = skb_dst(skb);
 
+	if (xs->props.family == AF_INET6) {
+#if IS_ENABLED(CONFIG_IPV6)
+		neigh = __ipv6_neigh_lookup_noref(dst->dev, &xs->id.daddr.in6);
+		if (unlikely(!neigh)) {
+			CRYPTO_INFO("%s: %s No neigh (daddr=%pI6)\n", __func__,
+				    dst->dev->name, &xs->id.daddr.in6);
+			neigh = __neigh_create(&nd_tbl, &xs->id.daddr.in6,
+					       dst->dev, false);
+			neigh_output(neigh, skb, false);
+			return NULL;
+		}
+
+		return neigh;
+#else
+		return NULL;
+#endif
+	}
+
 	neigh = __ipv4_neigh_lookup_noref(dst->dev, xs->id.daddr.a4);
 	if (unlikely(!neigh)) {
 		CRYPTO_INFO("%s: %s No neigh (daddr=%pI4)\n", __func__, dst->dev->name,
@@ -348,50 +685,275 @@ static inline struct neighbour *mtk_crypto_find_dst_mac(struct sk_buff *skb,  st
 	return neigh;
 }
 
-bool mtk_xfrm_offload_ok(struct sk_buff *skb,
-			 struct xfrm_state *xs)
+/* nd_tbl only exists when IPv6 is built */
+static inline bool mtk_xfrm_offload_is_nd(const struct neighbour *neigh)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	return neigh->tbl == &nd_tbl;
+#else
+	return false;
+#endif
+}
+
+static bool mtk_xfrm_offload_neigh_match(struct xfrm_state *xs,
+					 struct neighbour *neigh)
+{
+	if (neigh->tbl == &arp_tbl)
+		return xs->props.family == AF_INET &&
+		       *(__be32 *)neigh->primary_key == xs->id.daddr.a4;
+
+	return xs->props.family == AF_INET6 &&
+	       ipv6_addr_equal((struct in6_addr *)neigh->primary_key,
+			       &xs->id.daddr.in6);
+}
+
+/* l2_ht key, the same for an SA and for the neighbour entry of its peer */
+static u32 mtk_xfrm_offload_l2_key(int ifindex, int family, const void *daddr)
+{
+	if (family == AF_INET6)
+		return jhash2(daddr, 4, ifindex);
+
+	return jhash_1word(*(const u32 *)daddr, ifindex);
+}
+
+/* caller holds xfrm_params_list.lock, which serializes the writers */
+static void mtk_xfrm_offload_l2_update(struct mtk_xfrm_params *xfrm_params,
+				       struct neighbour *neigh)
+{
+	struct xfrm_state *xs = xfrm_params->xs;
+	struct ethhdr *eth = &xfrm_params->l2_hdr;
+	struct net_device *dev = neigh->dev;
+	int ifindex = 0;
+
+	write_seqcount_begin(&xfrm_params->l2_seq);
+
+	if (neigh->nud_state & NUD_VALID) {
+		neigh_ha_snapshot(eth->h_dest, neigh, dev);
+		ether_addr_copy(eth->h_source, dev->dev_addr);
+		if (xs->props.family == AF_INET6)
+			eth->h_proto = htons(ETH_P_IPV6);
+		else
+			eth->h_proto = htons(ETH_P_IP);
+		ifindex = dev->ifindex;
+	}
+
+	if (xfrm_params->l2_ifindex != ifindex) {
+		hash_del(&xfrm_params->l2_node);
+		if (ifindex)
+			hash_add(xfrm_params_list.l2_ht, &xfrm_params->l2_node,
+				 mtk_xfrm_offload_l2_key(ifindex,
+							 xs->props.family,
+							 &xs->id.daddr));
+	}
+	WRITE_ONCE(xfrm_params->l2_ifindex, ifindex);
+
+	write_seqcount_end(&xfrm_params->l2_seq);
+}
+
+static int mtk_xfrm_offload_netevent(struct notifier_block *nb,
+				     unsigned long event, void *ptr)
 {
 	struct mtk_xfrm_params *xfrm_params;
+	struct neighbour *neigh = ptr;
+	u32 key;
+
+	if (event != NETEVENT_NEIGH_UPDATE)
+		return NOTIFY_DONE;
+
+	if (neigh->tbl != &arp_tbl && !mtk_xfrm_offload_is_nd(neigh))
+		return NOTIFY_DONE;
+
+	key = mtk_xfrm_offload_l2_key(neigh->dev->ifindex,
+				      neigh->tbl == &arp_tbl ? AF_INET : AF_INET6,
+				      neigh->primary_key);
+
+	/*
+	 * Only SAs that already resolved through this device are refreshed,
+	 * the others pick the neighbour up on their next packet.
+	 */
+	spin_lock_bh(&xfrm_params_list.lock);
+
+	hash_for_each_possible(xfrm_params_list.l2_ht, xfrm_params, l2_node, key) {
+		if (xfrm_params->l2_ifindex != neigh->dev->ifindex ||
+		    !mtk_xfrm_offload_neigh_match(xfrm_params->xs, neigh))
+			continue;
+
+		mtk_xfrm_offload_l2_update(xfrm_params, neigh);
+	}
+
+	spin_unlock_bh(&xfrm_params_list.lock);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block mtk_xfrm_offload_netevent_nb = {
+	.notifier_call = mtk_xfrm_offload_netevent,
+};
+
+/*
+ * A new device address changes the source MAC of every header cached on
+ * that device, a device that goes away drops them. Both are rare, so the
+ * resolved SAs are simply walked.
+ */
+static int mtk_xfrm_offload_netdev_event(struct notifier_block *nb,
+					 unsigned long event, void *ptr)
+{
+	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
+	struct mtk_xfrm_params *xfrm_params;
+	struct hlist_node *tmp;
+	int bkt;
+
+	if (event != NETDEV_CHANGEADDR && event != NETDEV_UNREGISTER)
+		return NOTIFY_DONE;
+
+	spin_lock_bh(&xfrm_params_list.lock);
+
+	hash_for_each_safe(xfrm_params_list.l2_ht, bkt, tmp, xfrm_params,
+			   l2_node) {
+		if (xfrm_params->l2_ifindex != dev->ifindex)
+			continue;
+
+		write_seqcount_begin(&xfrm_params->l2_seq);
+		if (event == NETDEV_CHANGEADDR) {
+			ether_addr_copy(xfrm_params->l2_hdr.h_source,
+					dev->dev_addr);
+		} else {
+			hash_del(&xfrm_params->l2_node);
+			WRITE_ONCE(xfrm_params->l2_ifindex, 0);
+		}
+		write_seqcount_end(&xfrm_params->l2_seq);
+	}
+
+	spin_unlock_bh(&xfrm_params_list.lock);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block mtk_xfrm_offload_netdev_nb = {
+	.notifier_call = mtk_xfrm_offload_netdev_event,
+};
+
+int mtk_xfrm_offload_notifier_register(void)
+{
+	int ret;
+
+	ret = register_netevent_notifier(&mtk_xfrm_offload_netevent_nb);
+	if (ret)
+		return ret;
+
+	ret = register_netdevice_notifier(&mtk_xfrm_offload_netdev_nb);
+	if (ret)
+		unregister_netevent_notifier(&mtk_xfrm_offload_netevent_nb);
+
+	return ret;
+}
+
+void mtk_xfrm_offload_notifier_unregister(void)
+{
+	unregister_netdevice_notifier(&mtk_xfrm_offload_netdev_nb);
+	unregister_netevent_notifier(&mtk_xfrm_offload_netevent_nb);
+}
+
+/* fast path: a single copy of the cached header, no neighbour lookup */
+static bool mtk_xfrm_offload_l2_push(struct sk_buff *skb,
+				     struct mtk_xfrm_params *xfrm_params,
+				     struct net_device *dev)
+{
+	unsigned int seq;
+
+	if (READ_ONCE(xfrm_params->l2_ifindex) != dev->ifindex)
+		return false;
+
+	skb_push(skb, sizeof(struct ethhdr));
+	skb_reset_mac_header(skb);
+
+	do {
+		seq = read_seqcount_begin(&xfrm_params->l2_seq);
+		memcpy(eth_hdr(skb), &xfrm_params->l2_hdr, sizeof(struct ethhdr));
+	} while (read_seqcount_retry(&xfrm_params->l2_seq, seq));
+
+	return true;
+}
+
+/*
+ * slow path: look the peer up, cache the header once it is resolved.
+ * Returns false when the skb was handed to neighbour resolution.
+ */
+static bool mtk_xfrm_offload_l2_resolve(struct sk_buff *skb,
+					struct xfrm_state *xs,
+					struct mtk_xfrm_params *xfrm_params,
+					struct net_device *dev)
+{
 	struct neighbour *neigh;
-	struct dst_entry *dst = skb_dst(skb);
-	int fill_inner_info = 0;
 
 	rcu_read_lock_bh();
 
 	neigh = mtk_crypto_find_dst_mac(skb, xs);
 	if (!neigh) {
 		rcu_read_unlock_bh();
-		return true;
+		return false;
 	}
 
-	/*
-	 * For packet has pass through VTI (route-based VTI)
-	 * The 'dev_queue_xmit' function called at network layer will cause both
-	 * skb->mac_header and skb->network_header to point to the IP header
-	 */
-	if (skb->mac_header == skb->network_header)
-		fill_inner_info = 1;
+	this_cpu_inc(xfrm_params->stats->l2_miss);
+
+	if (neigh->nud_state & NUD_VALID) {
+		spin_lock_bh(&xfrm_params_list.lock);
+		mtk_xfrm_offload_l2_update(xfrm_params, neigh);
+		spin_unlock_bh(&xfrm_params_list.lock);
+	}
 
 	skb_push(skb, sizeof(struct ethhdr));
 	skb_reset_mac_header(skb);
 
-	eth_hdr(skb)->h_proto = htons(ETH_P_IP);
+	if (xs->props.family == AF_INET6)
+		eth_hdr(skb)->h_proto = htons(ETH_P_IPV6);
+	else
+		eth_hdr(skb)->h_proto = htons(ETH_P_IP);
 	memcpy(eth_hdr(skb)->h_dest, neigh->ha, ETH_ALEN);
-	memcpy(eth_hdr(skb)->h_source, dst->dev->dev_addr, ETH_ALEN);
+	memcpy(eth_hdr(skb)->h_source, dev->dev_addr, ETH_ALEN);
 
 	rcu_read_unlock_bh();
 
+	return true;
+}
+
+bool mtk_xfrm_offload_ok(struct sk_buff *skb,
+			 struct xfrm_state *xs)
+{
+	struct mtk_xfrm_params *xfrm_params;
+	struct dst_entry *dst = skb_dst(skb);
+	int fill_inner_info = 0;
+
 	xfrm_params = (struct mtk_xfrm_params *)xs->xso.offload_handle;
 
-#if IS_ENABLED(CONFIG_NET_MEDIATEK_HNAT)
-	skb_hnat_cdrt(skb) = xfrm_params->cdrt->idx;
 	/*
-	 * EIP197 does not support fragmentation. As a result, we can not bind UDP
-	 * flow since it may cause network fail due to fragmentation
+	 * For packet has pass through VTI (route-based VTI)
+	 * The 'dev_queue_xmit' function called at network layer will cause both
+	 * skb->mac_header and skb->network_header to point to the IP header
 	 */
-	if (ra_sw_nat_hook_tx &&
-	    ((is_tops_tunnel(skb) || is_tcp(skb)) && is_hnat_rate_reach(skb)))
-		hnat_bind_crypto_entry(skb, dst->dev, fill_inner_info);
+	if (skb->mac_header == skb->network_header)
+		fill_inner_info = 1;
+
+	if (!mtk_xfrm_offload_l2_push(skb, xfrm_params, dst->dev) &&
+	    !mtk_xfrm_offload_l2_resolve(skb, xs, xfrm_params, dst->dev))
+		return true;
+
+	this_cpu_inc(xfrm_params->stats->cpu_packets);
+	this_cpu_add(xfrm_params->stats->cpu_bytes,
+		     skb->len - skb_network_offset(skb));
+
+#if IS_ENABLED(CONFIG_NET_MEDIATEK_HNAT)
+	skb_hnat_cdrt(skb) = xfrm_params->cdrt->idx;
+
+	if (ra_sw_nat_hook_tx) {
+		if ((is_tops_tunnel(skb) || is_tcp(skb)) && is_hnat_rate_reach(skb)) {
+			hnat_bind_crypto_entry(skb, dst->dev, fill_inner_info);
+		} else if (is_udp(skb) &&
+			   mtk_xfrm_offload_udp_bindable(skb, xs, xfrm_params, dst)) {
+			hnat_bind_crypto_entry(skb, dst->dev, fill_inner_info);
+			this_cpu_inc(xfrm_params->stats->udp_bind);
+		}
+	}
 
 	/* Set magic tag for tport setting, reset to 0 after tport is set */
 	skb_hnat_magic_tag(skb) = HNAT_MAGIC_TAG;
@@ -419,3 +981,99 @@ bool mtk_xfrm_offload_ok(struct sk_buff *skb,
 
 	return true;
 }
+
+#if defined(CONFIG_CRYPTO_XFRM_OFFLOAD_BENCH)
+#define MTK_XFRM_BENCH_SPI		0xfe000000
+
+static struct xfrm_state *mtk_xfrm_offload_bench_state_alloc(u32 i)
+{
+	struct xfrm_state *xs;
+
+	xs = xfrm_state_alloc(&init_net);
+	if (!xs)
+		return NULL;
+
+	/* keys are left zeroed, the SAs never see traffic */
+	xs->ealg = kzalloc(sizeof(*xs->ealg) + 16, GFP_KERNEL);
+	xs->aalg = kzalloc(sizeof(*xs->aalg) + 20, GFP_KERNEL);
+	if (!xs->ealg || !xs->aalg) {
+		xs->km.state = XFRM_STATE_DEAD;
+		xfrm_state_put(xs);
+		return NULL;
+	}
+
+	strscpy(xs->ealg->alg_name, "cbc(aes)", sizeof(xs->ealg->alg_name));
+	xs->ealg->alg_key_len = 128;
+	strscpy(xs->aalg->alg_name, "hmac(sha1)", sizeof(xs->aalg->alg_name));
+	xs->aalg->alg_key_len = 160;
+	xs->aalg->alg_trunc_len = 96;
+
+	xs->id.proto = IPPROTO_ESP;
+	xs->id.spi = htonl(MTK_XFRM_BENCH_SPI + i);
+	xs->id.daddr.a4 = htonl(0xc0000201);	/* 192.0.2.1 */
+	xs->props.saddr.a4 = htonl(0xc0000202);
+	xs->props.family = AF_INET;
+	xs->inner_mode.family = AF_INET;
+	xs->outer_mode.encap = XFRM_MODE_TUNNEL;
+
+	/* half of the SAs are inbound so CLS programming is measured too */
+	if (i & 1)
+		xs->xso.flags = XFRM_OFFLOAD_INBOUND;
+
+	return xs;
+}
+
+/*
+ * Rekey storm: offload up to count SAs back to back, then free them all.
+ * Stops early once CDRT/CLS entries run out.
+ */
+int mtk_xfrm_offload_bench(u32 count)
+{
+	struct xfrm_state **states;
+	u64 t0, t1, t2;
+	u32 added = 0;
+	u32 i;
+	int ret = 0;
+
+	if (!count)
+		return -EINVAL;
+
+	states = kcalloc(count, sizeof(*states), GFP_KERNEL);
+	if (!states)
+		return -ENOMEM;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < count; i++) {
+		states[i] = mtk_xfrm_offload_bench_state_alloc(i);
+		if (!states[i]) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		ret = mtk_xfrm_offload_state_add(states[i]);
+		if (ret)
+			break;
+
+		added++;
+	}
+	t1 = ktime_get_ns();
+
+	for (i = 0; i < added; i++)
+		mtk_xfrm_offload_state_free(states[i]);
+	t2 = ktime_get_ns();
+
+	for (i = 0; i < count && states[i]; i++) {
+		states[i]->km.state = XFRM_STATE_DEAD;
+		xfrm_state_put(states[i]);
+	}
+	kfree(states);
+
+	CRYPTO_NOTICE("xfrm bench: %u/%u SAs, add %llu SA/s, free %llu SA/s (%d)\n",
+		      added, count,
+		      t1 > t0 ? div64_u64((u64)added * NSEC_PER_SEC, t1 - t0) : 0,
+		      t2 > t1 ? div64_u64((u64)added * NSEC_PER_SEC, t2 - t1) : 0,
+		      ret);
+
+	return ret;
+}
+#endif /* defined(CONFIG_CRYPTO_XFRM_OFFLOAD_BENCH) */
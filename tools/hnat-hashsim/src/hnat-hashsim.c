@@ -0,0 +1,849 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2023 MediaTek Inc. All Rights Reserved.
+ *
+ * Replay flow tuples through the PPE FOE hash and report 4-way bucket
+ * occupancy, collisions and bind failures per table size.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <arpa/inet.h>
+
+#include "hnat_hash.h"
+
+#define FOE_SIZE_MIN			1024
+#define FOE_SIZE_MAX			32768
+
+#define PCAP_MAGIC_US			0xa1b2c3d4
+#define PCAP_MAGIC_NS			0xa1b23c4d
+#define DLT_EN10MB			1
+#define DLT_RAW_BSD			12
+#define DLT_RAW				101
+#define DLT_LINUX_SLL			113
+
+#define ETH_P_IP			0x0800
+#define ETH_P_IPV6			0x86dd
+#define ETH_P_8021Q			0x8100
+#define ETH_P_8021AD			0x88a8
+#define ETH_P_PPP_SES			0x8864
+
+enum hash_mode {
+	HASH_5T = 1 << 0,	/* IPV4_HNAPT, IPV6_5T_ROUTE */
+	HASH_3T = 1 << 1,	/* IPV4_HNAT, IPV6_3T_ROUTE */
+};
+
+struct flow {
+	bool v6;
+	uint32_t sip[4];	/* host byte order, v4 only uses [0] */
+	uint32_t dip[4];
+	uint16_t sport;
+	uint16_t dport;
+};
+
+struct flow_set {
+	struct flow *flows;
+	size_t num;
+	size_t size;
+	uint32_t *slots;	/* index + 1 into flows, 0 is empty */
+	size_t slot_mask;
+	size_t num_v6;
+	uint64_t dup;
+};
+
+struct sim_result {
+	uint32_t size;
+	uint64_t placed;
+	uint64_t collided;
+	uint64_t failed;
+	uint64_t bucket_hist[HNAT_HASH_WAYS + 1];
+};
+
+static struct flow_set fset;
+static bool both_dir;
+static bool pcap_swapped;
+static uint64_t rng_state = 0x2545f4914f6cdd1dULL;
+
+static void usage(FILE *con, const char *progname)
+{
+	fprintf(con, "Usage: %s [options]\n", progname);
+	fprintf(con, "Input (at least one):\n");
+	fprintf(con, "  -r <file>     read flows from a pcap file\n");
+	fprintf(con, "  -t <file>     read flows from text, one 'sip dip sport dport' per line\n");
+	fprintf(con, "  -g <dist>     generate flows: uniform, nat or ipv6\n");
+	fprintf(con, "  -n <num>      number of generated flows (default 8192)\n");
+	fprintf(con, "  -S <seed>     generator seed\n");
+	fprintf(con, "Simulation:\n");
+	fprintf(con, "  -s <list>     table sizes, e.g. 4k,8k,16k (default 1k..32k)\n");
+	fprintf(con, "  -m <mode>     hashed tuple: 5t, 3t or all (default 5t)\n");
+	fprintf(con, "  -b            also bind the reverse direction of each flow\n");
+	fprintf(con, "  -d            dump every flow with its hash for the first size\n");
+	fprintf(con, "  -h            show this help\n");
+}
+
+static uint64_t rng_next(void)
+{
+	uint64_t x = rng_state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	rng_state = x;
+
+	return x;
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi)
+{
+	return lo + (uint32_t)(rng_next() % ((uint64_t)hi - lo + 1));
+}
+
+static uint32_t flow_key_hash(const struct flow *f)
+{
+	const uint8_t *p = (const uint8_t *)f;
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < sizeof(*f); i++)
+		h = (h ^ p[i]) * 16777619u;
+
+	return h;
+}
+
+static int flow_set_grow(void)
+{
+	size_t nslots = fset.slot_mask ? (fset.slot_mask + 1) * 2 : 4096;
+	uint32_t *slots;
+	size_t i, s;
+
+	slots = calloc(nslots, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	for (i = 0; i < fset.num; i++) {
+		s = flow_key_hash(&fset.flows[i]) & (nslots - 1);
+		while (slots[s])
+			s = (s + 1) & (nslots - 1);
+		slots[s] = i + 1;
+	}
+
+	free(fset.slots);
+	fset.slots = slots;
+	fset.slot_mask = nslots - 1;
+
+	return 0;
+}
+
+static int flow_add(const struct flow *in)
+{
+	struct flow f, *flows;
+	size_t s;
+
+	/* normalize padding so identical tuples compare equal */
+	memset(&f, 0, sizeof(f));
+	f.v6 = in->v6;
+	memcpy(f.sip, in->sip, sizeof(f.sip));
+	memcpy(f.dip, in->dip, sizeof(f.dip));
+	f.sport = in->sport;
+	f.dport = in->dport;
+
+	if ((fset.num + 1) * 2 > fset.slot_mask + 1 && flow_set_grow())
+		return -ENOMEM;
+
+	s = flow_key_hash(&f) & fset.slot_mask;
+	while (fset.slots[s]) {
+		if (!memcmp(&fset.flows[fset.slots[s] - 1], &f, sizeof(f))) {
+			fset.dup++;
+			return 0;
+		}
+		s = (s + 1) & fset.slot_mask;
+	}
+
+	if (fset.num == fset.size) {
+		fset.size = fset.size ? fset.size * 2 : 4096;
+		flows = realloc(fset.flows, fset.size * sizeof(*flows));
+		if (!flows)
+			return -ENOMEM;
+		fset.flows = flows;
+	}
+
+	fset.flows[fset.num] = f;
+	fset.slots[s] = ++fset.num;
+	if (f.v6)
+		fset.num_v6++;
+
+	return 0;
+}
+
+static int flow_add_dir(const struct flow *f)
+{
+	struct flow r;
+	int ret;
+
+	ret = flow_add(f);
+	if (ret || !both_dir)
+		return ret;
+
+	r = *f;
+	memcpy(r.sip, f->dip, sizeof(r.sip));
+	memcpy(r.dip, f->sip, sizeof(r.dip));
+	r.sport = f->dport;
+	r.dport = f->sport;
+
+	return flow_add(&r);
+}
+
+static uint16_t get_be16(const uint8_t *p)
+{
+	return (uint16_t)p[0] << 8 | p[1];
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+	       (uint32_t)p[2] << 8 | p[3];
+}
+
+static int parse_l4(struct flow *f, uint8_t proto, const uint8_t *p,
+		    size_t len)
+{
+	if ((proto != 6 && proto != 17) || len < 4)
+		return -1;
+
+	f->sport = get_be16(p);
+	f->dport = get_be16(p + 2);
+
+	return 0;
+}
+
+static int parse_ipv4(struct flow *f, const uint8_t *p, size_t len)
+{
+	size_t ihl;
+
+	if (len < 20 || (p[0] >> 4) != 4)
+		return -1;
+
+	ihl = (p[0] & 0xf) * 4;
+	if (ihl < 20 || len < ihl)
+		return -1;
+
+	/* later fragments carry no ports and are not offloaded */
+	if (get_be16(p + 6) & 0x1fff)
+		return -1;
+
+	f->v6 = false;
+	f->sip[0] = get_be32(p + 12);
+	f->dip[0] = get_be32(p + 16);
+
+	return parse_l4(f, p[9], p + ihl, len - ihl);
+}
+
+static int parse_ipv6(struct flow *f, const uint8_t *p, size_t len)
+{
+	uint8_t nexthdr;
+	size_t off = 40, hlen;
+	int i;
+
+	if (len < 40 || (p[0] >> 4) != 6)
+		return -1;
+
+	f->v6 = true;
+	for (i = 0; i < 4; i++) {
+		f->sip[i] = get_be32(p + 8 + i * 4);
+		f->dip[i] = get_be32(p + 24 + i * 4);
+	}
+
+	nexthdr = p[6];
+	for (;;) {
+		switch (nexthdr) {
+		case 0:		/* hop-by-hop */
+		case 43:	/* routing */
+		case 60:	/* destination options */
+			if (len < off + 8)
+				return -1;
+			hlen = (p[off + 1] + 1) * 8;
+			break;
+		case 44:	/* fragment */
+			if (len < off + 8 || (get_be16(p + off + 2) & 0xfff8))
+				return -1;
+			hlen = 8;
+			break;
+		default:
+			return parse_l4(f, nexthdr, p + off, len - off);
+		}
+
+		nexthdr = p[off];
+		off += hlen;
+		if (off > len)
+			return -1;
+	}
+}
+
+static int parse_l3(struct flow *f, uint16_t proto, const uint8_t *p,
+		    size_t len)
+{
+	if (proto == ETH_P_IP)
+		return parse_ipv4(f, p, len);
+	if (proto == ETH_P_IPV6)
+		return parse_ipv6(f, p, len);
+
+	return -1;
+}
+
+static int parse_frame(struct flow *f, uint32_t linktype, const uint8_t *p,
+		       size_t len)
+{
+	size_t off;
+	uint16_t proto;
+
+	switch (linktype) {
+	case DLT_RAW:
+	case DLT_RAW_BSD:
+		if (!len)
+			return -1;
+		return parse_l3(f, (p[0] >> 4) == 6 ? ETH_P_IPV6 : ETH_P_IP,
+				p, len);
+	case DLT_LINUX_SLL:
+		if (len < 16)
+			return -1;
+		return parse_l3(f, get_be16(p + 14), p + 16, len - 16);
+	case DLT_EN10MB:
+		break;
+	default:
+		return -1;
+	}
+
+	if (len < 14)
+		return -1;
+
+	off = 12;
+	proto = get_be16(p + off);
+	off += 2;
+
+	while (proto == ETH_P_8021Q || proto == ETH_P_8021AD) {
+		if (len < off + 4)
+			return -1;
+		proto = get_be16(p + off + 2);
+		off += 4;
+	}
+
+	if (proto == ETH_P_PPP_SES) {
+		if (len < off + 8)
+			return -1;
+		proto = get_be16(p + off + 6);
+		if (proto == 0x0021)
+			proto = ETH_P_IP;
+		else if (proto == 0x0057)
+			proto = ETH_P_IPV6;
+		else
+			return -1;
+		off += 8;
+	}
+
+	return parse_l3(f, proto, p + off, len - off);
+}
+
+static uint32_t pcap_u32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	if (pcap_swapped)
+		v = __builtin_bswap32(v);
+
+	return v;
+}
+
+static int load_pcap(const char *file)
+{
+	uint8_t hdr[24], rec[16], *pkt = NULL;
+	uint32_t magic, linktype, caplen;
+	uint64_t packets = 0, skipped = 0;
+	size_t pkt_size = 0;
+	struct flow f;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(file, "rb");
+	if (!fp) {
+		fprintf(stderr, "Error: failed to open '%s': %s\n", file,
+			strerror(errno));
+		return -errno;
+	}
+
+	if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+		fprintf(stderr, "Error: '%s' is not a pcap file\n", file);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	memcpy(&magic, hdr, sizeof(magic));
+	if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS) {
+		pcap_swapped = false;
+	} else if (magic == __builtin_bswap32(PCAP_MAGIC_US) ||
+		   magic == __builtin_bswap32(PCAP_MAGIC_NS)) {
+		pcap_swapped = true;
+	} else {
+		fprintf(stderr, "Error: '%s' is not a pcap file (pcapng is not supported)\n",
+			file);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	linktype = pcap_u32(hdr + 20) & 0xffff;
+
+	while (fread(rec, 1, sizeof(rec), fp) == sizeof(rec)) {
+		caplen = pcap_u32(rec + 8);
+		if (caplen > (1 << 20)) {
+			fprintf(stderr, "Error: corrupted record in '%s'\n", file);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (caplen > pkt_size) {
+			free(pkt);
+			pkt_size = caplen;
+			pkt = malloc(pkt_size);
+			if (!pkt) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+
+		if (fread(pkt, 1, caplen, fp) != caplen)
+			break;
+
+		packets++;
+		memset(&f, 0, sizeof(f));
+		if (parse_frame(&f, linktype, pkt, caplen)) {
+			skipped++;
+			continue;
+		}
+
+		ret = flow_add_dir(&f);
+		if (ret)
+			goto out;
+	}
+
+	printf("pcap: %llu packets, %llu not TCP/UDP over IP\n",
+	       (unsigned long long)packets, (unsigned long long)skipped);
+
+out:
+	free(pkt);
+	fclose(fp);
+	return ret;
+}
+
+static int parse_addr(const char *str, struct flow *f, uint32_t *addr)
+{
+	uint8_t buf[16];
+	int i;
+
+	if (inet_pton(AF_INET, str, buf) == 1) {
+		if (f->v6)
+			return -1;
+		addr[0] = get_be32(buf);
+		return 0;
+	}
+
+	if (inet_pton(AF_INET6, str, buf) == 1) {
+		f->v6 = true;
+		for (i = 0; i < 4; i++)
+			addr[i] = get_be32(buf + i * 4);
+		return 0;
+	}
+
+	return -1;
+}
+
+static int load_text(const char *file)
+{
+	char line[256], sip[64], dip[64];
+	unsigned int sport, dport;
+	uint64_t lineno = 0;
+	struct flow f;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		fprintf(stderr, "Error: failed to open '%s': %s\n", file,
+			strerror(errno));
+		return -errno;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		memset(&f, 0, sizeof(f));
+		if (sscanf(line, "%63s %63s %u %u", sip, dip, &sport, &dport) != 4 ||
+		    parse_addr(sip, &f, f.sip) || parse_addr(dip, &f, f.dip) ||
+		    !f.v6 != !strchr(sip, ':') || sport > 0xffff || dport > 0xffff) {
+			fprintf(stderr, "Warning: skip line %llu\n",
+				(unsigned long long)lineno);
+			continue;
+		}
+
+		f.sport = sport;
+		f.dport = dport;
+		ret = flow_add_dir(&f);
+		if (ret)
+			break;
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+static uint16_t gen_service_port(void)
+{
+	uint32_t r = rng_range(0, 99);
+
+	if (r < 70)
+		return 443;
+	if (r < 85)
+		return 80;
+	if (r < 95)
+		return 53;
+
+	return rng_range(1, 0xffff);
+}
+
+/* LAN hosts behind a NAT talking to a pool of servers; replies come back
+ * to the WAN address, so -b models the translated reply direction.
+ */
+static int gen_nat(uint32_t num)
+{
+	uint32_t servers[256], wan = 0x64400001, i;
+	struct flow f, r;
+	int ret;
+
+	for (i = 0; i < 256; i++)
+		servers[i] = (uint32_t)rng_next() | 0x01000000;
+
+	for (i = 0; i < num; i++) {
+		memset(&f, 0, sizeof(f));
+		f.sip[0] = 0xc0a80100 | rng_range(2, 254);
+		f.dip[0] = servers[rng_range(0, 255)];
+		f.sport = rng_range(32768, 60999);
+		f.dport = gen_service_port();
+
+		ret = flow_add(&f);
+		if (ret || !both_dir)
+			goto next;
+
+		memset(&r, 0, sizeof(r));
+		r.sip[0] = f.dip[0];
+		r.dip[0] = wan;
+		r.sport = f.dport;
+		r.dport = f.sport;
+		ret = flow_add(&r);
+next:
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int gen_flows(const char *dist, uint32_t num)
+{
+	struct flow f;
+	uint32_t i;
+	int j, ret;
+
+	if (!strcmp(dist, "nat"))
+		return gen_nat(num);
+
+	for (i = 0; i < num; i++) {
+		memset(&f, 0, sizeof(f));
+
+		if (!strcmp(dist, "uniform")) {
+			f.sip[0] = (uint32_t)rng_next();
+			f.dip[0] = (uint32_t)rng_next();
+			f.sport = rng_next();
+			f.dport = rng_next();
+		} else if (!strcmp(dist, "ipv6")) {
+			/* SLAAC hosts in one /64 to servers in one /48 */
+			f.v6 = true;
+			f.sip[0] = 0x20010db8;
+			f.sip[1] = 0x00010000;
+			f.sip[2] = rng_next();
+			f.sip[3] = rng_next();
+			f.dip[0] = 0x20010db8;
+			f.dip[1] = 0x00ff0000 | rng_range(0, 0xff);
+			for (j = 2; j < 4; j++)
+				f.dip[j] = rng_range(0, 0xff);
+			f.sport = rng_range(32768, 60999);
+			f.dport = gen_service_port();
+		} else {
+			fprintf(stderr, "Error: unknown distribution '%s'\n", dist);
+			return -EINVAL;
+		}
+
+		ret = flow_add_dir(&f);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static uint32_t flow_hash(const struct flow *f, enum hash_mode mode,
+			  uint32_t size)
+{
+	uint16_t sport = mode == HASH_3T ? 0 : f->sport;
+	uint16_t dport = mode == HASH_3T ? 0 : f->dport;
+
+	if (f->v6)
+		return hnat_ppe_hash_ipv6(f->sip, f->dip, sport, dport, size);
+
+	return hnat_ppe_hash_ipv4(f->sip[0], f->dip[0], sport, dport, size);
+}
+
+static int simulate(struct sim_result *res, enum hash_mode mode,
+		    uint32_t size)
+{
+	uint32_t nbuckets = size / HNAT_HASH_WAYS, i;
+	uint8_t *occ;
+	size_t n;
+
+	occ = calloc(nbuckets, sizeof(*occ));
+	if (!occ)
+		return -ENOMEM;
+
+	memset(res, 0, sizeof(*res));
+	res->size = size;
+
+	for (n = 0; n < fset.num; n++) {
+		i = flow_hash(&fset.flows[n], mode, size) / HNAT_HASH_WAYS;
+
+		if (occ[i] >= HNAT_HASH_WAYS) {
+			res->failed++;
+			continue;
+		}
+
+		if (occ[i]++)
+			res->collided++;
+		res->placed++;
+	}
+
+	for (i = 0; i < nbuckets; i++)
+		res->bucket_hist[occ[i]]++;
+
+	free(occ);
+	return 0;
+}
+
+/* Bind failure rate of an ideal hash: flows per bucket is Poisson with
+ * mean lambda and everything beyond the fourth way fails.
+ */
+static double ideal_fail_rate(uint64_t flows, uint32_t size)
+{
+	double lambda = (double)flows * HNAT_HASH_WAYS / size;
+	double pk, under = 0;
+	int k;
+
+	if (!flows)
+		return 0;
+
+	pk = exp(-lambda);
+	for (k = 0; k < HNAT_HASH_WAYS; k++) {
+		under += (HNAT_HASH_WAYS - k) * pk;
+		pk = pk * lambda / (k + 1);
+	}
+
+	return (lambda - HNAT_HASH_WAYS + under) / lambda;
+}
+
+static void dump_flows(enum hash_mode mode, uint32_t size)
+{
+	char sip[INET6_ADDRSTRLEN], dip[INET6_ADDRSTRLEN];
+	uint32_t addr[4];
+	size_t n;
+	int i;
+
+	for (n = 0; n < fset.num; n++) {
+		const struct flow *f = &fset.flows[n];
+
+		if (f->v6) {
+			for (i = 0; i < 4; i++)
+				addr[i] = htonl(f->sip[i]);
+			inet_ntop(AF_INET6, addr, sip, sizeof(sip));
+			for (i = 0; i < 4; i++)
+				addr[i] = htonl(f->dip[i]);
+			inet_ntop(AF_INET6, addr, dip, sizeof(dip));
+		} else {
+			addr[0] = htonl(f->sip[0]);
+			inet_ntop(AF_INET, addr, sip, sizeof(sip));
+			addr[0] = htonl(f->dip[0]);
+			inet_ntop(AF_INET, addr, dip, sizeof(dip));
+		}
+
+		printf("%s %s %u %u hash=0x%04x\n", sip, dip, f->sport,
+		       f->dport, flow_hash(f, mode, size));
+	}
+}
+
+static void report(const struct sim_result *res, enum hash_mode mode)
+{
+	uint64_t flows = res->placed + res->failed;
+	uint32_t nbuckets = res->size / HNAT_HASH_WAYS;
+	int i;
+
+	printf("%-3s %6u %6.2f %6.2f ", mode == HASH_3T ? "3t" : "5t",
+	       res->size, (double)flows / res->size * 100,
+	       (double)res->placed / res->size * 100);
+
+	for (i = 0; i <= HNAT_HASH_WAYS; i++)
+		printf("%6.2f ", (double)res->bucket_hist[i] / nbuckets * 100);
+
+	printf("%8.3f %8.3f %8.3f\n",
+	       res->placed ? (double)res->collided / res->placed * 100 : 0,
+	       flows ? (double)res->failed / flows * 100 : 0,
+	       ideal_fail_rate(flows, res->size) * 100);
+}
+
+static int parse_sizes(const char *str, uint32_t *sizes, int max)
+{
+	char *end;
+	unsigned long v;
+	int n = 0;
+
+	while (*str) {
+		v = strtoul(str, &end, 0);
+		if (*end == 'k' || *end == 'K') {
+			v *= 1024;
+			end++;
+		}
+
+		if (end == str || v < FOE_SIZE_MIN || v > FOE_SIZE_MAX ||
+		    (v & (v - 1)) || n == max)
+			return -EINVAL;
+
+		sizes[n++] = v;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -EINVAL;
+		str = end;
+	}
+
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *pcap_file = NULL, *text_file = NULL, *dist = NULL;
+	uint32_t sizes[8], num_gen = 8192;
+	int num_sizes = 0, modes = HASH_5T, c, i, m, ret;
+	bool dump = false;
+	struct sim_result res;
+
+	while ((c = getopt(argc, argv, "r:t:g:n:S:s:m:bdh")) != -1) {
+		switch (c) {
+		case 'r':
+			pcap_file = optarg;
+			break;
+		case 't':
+			text_file = optarg;
+			break;
+		case 'g':
+			dist = optarg;
+			break;
+		case 'n':
+			num_gen = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			rng_state = strtoull(optarg, NULL, 0) ? : rng_state;
+			break;
+		case 's':
+			num_sizes = parse_sizes(optarg, sizes, 8);
+			if (num_sizes <= 0) {
+				fprintf(stderr, "Error: table sizes are powers of two in %u..%u\n",
+					FOE_SIZE_MIN, FOE_SIZE_MAX);
+				return 1;
+			}
+			break;
+		case 'm':
+			if (!strcmp(optarg, "5t")) {
+				modes = HASH_5T;
+			} else if (!strcmp(optarg, "3t")) {
+				modes = HASH_3T;
+			} else if (!strcmp(optarg, "all")) {
+				modes = HASH_5T | HASH_3T;
+			} else {
+				fprintf(stderr, "Error: unknown hash mode '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		case 'b':
+			both_dir = true;
+			break;
+		case 'd':
+			dump = true;
+			break;
+		case 'h':
+			usage(stdout, argv[0]);
+			return 0;
+		default:
+			usage(stderr, argv[0]);
+			return 1;
+		}
+	}
+
+	if (!pcap_file && !text_file && !dist) {
+		usage(stderr, argv[0]);
+		return 1;
+	}
+
+	if (!num_sizes) {
+		for (i = 0; FOE_SIZE_MIN << i <= FOE_SIZE_MAX; i++)
+			sizes[num_sizes++] = FOE_SIZE_MIN << i;
+	}
+
+	if ((pcap_file && load_pcap(pcap_file)) ||
+	    (text_file && load_text(text_file)) ||
+	    (dist && gen_flows(dist, num_gen)))
+		return 1;
+
+	printf("flows: %zu unique (%zu IPv4, %zu IPv6), %llu duplicates\n",
+	       fset.num, fset.num - fset.num_v6, fset.num_v6,
+	       (unsigned long long)fset.dup);
+
+	if (dump) {
+		dump_flows(modes & HASH_5T ? HASH_5T : HASH_3T, sizes[0]);
+		return 0;
+	}
+
+	printf("\n%-3s %6s %6s %6s %6s %6s %6s %6s %6s %8s %8s %8s\n",
+	       "key", "size", "load%", "used%", "b0%", "b1%", "b2%", "b3%",
+	       "b4%", "coll%", "fail%", "ideal%");
+
+	for (m = HASH_5T; m <= HASH_3T; m <<= 1) {
+		if (!(modes & m))
+			continue;
+
+		for (i = 0; i < num_sizes; i++) {
+			ret = simulate(&res, m, sizes[i]);
+			if (ret) {
+				fprintf(stderr, "Error: %s\n", strerror(-ret));
+				return 1;
+			}
+			report(&res, m);
+		}
+	}
+
+	printf("\nload: flows per entry, used: entries bound, bN: buckets holding N flows,\n"
+	       "coll: bound flows not in the first way, fail: flows finding a full bucket,\n"
+	       "ideal: fail rate of a uniform hash at the same load\n");
+
+	return 0;
+}